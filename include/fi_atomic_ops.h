@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2017 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _FI_ATOMIC_OPS_H_
+#define _FI_ATOMIC_OPS_H_
+
+#include "config.h"
+
+#include <stddef.h>
+#include <rdma/fi_atomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Software atomic kernels for providers that execute atomics on the host.
+ * Each handler applies one (op, datatype) pair to an array of cnt elements.
+ * Unsupported combinations are left NULL.
+ *
+ * write:     dst[i] = dst[i] <op> src[i]
+ * readwrite: res[i] = dst[i]; dst[i] = dst[i] <op> src[i]
+ * swap:      res[i] = dst[i]; dst[i] = src[i] if cmp[i] <op> dst[i]
+ *
+ * For swap handlers cmp and res may point to the same buffer.
+ */
+typedef void (*ofi_atomic_write_func)(void *dst, const void *src, size_t cnt);
+typedef void (*ofi_atomic_readwrite_func)(void *dst, const void *src,
+					  void *res, size_t cnt);
+typedef void (*ofi_atomic_swap_func)(void *dst, const void *src,
+				     const void *cmp, void *res, size_t cnt);
+
+#define OFI_WRITE_OP_LAST	(FI_ATOMIC_WRITE + 1)
+#define OFI_READWRITE_OP_LAST	(FI_ATOMIC_WRITE + 1)
+#define OFI_SWAP_OP_START	FI_CSWAP
+#define OFI_SWAP_OP_LAST	(FI_MSWAP - FI_CSWAP + 1)
+
+extern ofi_atomic_write_func
+ofi_atomic_write_handlers[OFI_WRITE_OP_LAST][FI_DATATYPE_LAST];
+extern ofi_atomic_readwrite_func
+ofi_atomic_readwrite_handlers[OFI_READWRITE_OP_LAST][FI_DATATYPE_LAST];
+extern ofi_atomic_swap_func
+ofi_atomic_swap_handlers[OFI_SWAP_OP_LAST][FI_DATATYPE_LAST];
+
+static inline int ofi_atomic_isswap_op(enum fi_op op)
+{
+	return op >= FI_CSWAP && op <= FI_MSWAP;
+}
+
+static inline ofi_atomic_write_func
+ofi_atomic_write_handler(enum fi_op op, enum fi_datatype datatype)
+{
+	if (op >= OFI_WRITE_OP_LAST || datatype >= FI_DATATYPE_LAST)
+		return NULL;
+	return ofi_atomic_write_handlers[op][datatype];
+}
+
+static inline ofi_atomic_readwrite_func
+ofi_atomic_readwrite_handler(enum fi_op op, enum fi_datatype datatype)
+{
+	if (op >= OFI_READWRITE_OP_LAST || datatype >= FI_DATATYPE_LAST)
+		return NULL;
+	return ofi_atomic_readwrite_handlers[op][datatype];
+}
+
+static inline ofi_atomic_swap_func
+ofi_atomic_swap_handler(enum fi_op op, enum fi_datatype datatype)
+{
+	if (!ofi_atomic_isswap_op(op) || datatype >= FI_DATATYPE_LAST)
+		return NULL;
+	return ofi_atomic_swap_handlers[op - OFI_SWAP_OP_START][datatype];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FI_ATOMIC_OPS_H_ */
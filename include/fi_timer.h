@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2017 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _FI_TIMER_H_
+#define _FI_TIMER_H_
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <fi_list.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hierarchical timer wheel.  Level 0 holds timers due within the next
+ * OFI_TIMER_SLOTS ticks, one slot per tick; each higher level covers
+ * OFI_TIMER_SLOTS times the span of the one below, and its slots are
+ * moved down a level as the wheel turns.  Setting and canceling a timer
+ * is O(1), and a run only touches the slots that have come due.
+ *
+ * Times are in microseconds and rounded up to whole ticks, so a timer
+ * never fires early.  Deadlines past the top level are parked there and
+ * placed again when it turns.  Synchronization must be provided by the
+ * caller.
+ */
+
+#define OFI_TIMER_LEVELS	4
+#define OFI_TIMER_SLOT_BITS	6
+#define OFI_TIMER_SLOTS		(1 << OFI_TIMER_SLOT_BITS)
+#define OFI_TIMER_SLOT_MASK	(OFI_TIMER_SLOTS - 1)
+
+struct ofi_timer;
+struct ofi_timer_wheel;
+
+typedef void (*ofi_timer_cb)(struct ofi_timer_wheel *wheel,
+			     struct ofi_timer *timer);
+
+struct ofi_timer {
+	struct dlist_entry	entry;
+	uint64_t		expires;
+	ofi_timer_cb		cb;
+};
+
+struct ofi_timer_wheel {
+	uint64_t		tick_us;
+	uint64_t		now;		/* next tick to expire */
+	uint64_t		now_us;		/* time given to the last run */
+	size_t			count;
+	struct dlist_entry	slots[OFI_TIMER_LEVELS][OFI_TIMER_SLOTS];
+};
+
+void ofi_timer_wheel_init(struct ofi_timer_wheel *wheel, uint64_t tick_us,
+			  uint64_t now_us);
+/* Expire every timer due by now_us, calling its callback */
+void ofi_timer_wheel_run(struct ofi_timer_wheel *wheel, uint64_t now_us);
+/* Earliest time a timer may expire, or UINT64_MAX if none is set */
+uint64_t ofi_timer_wheel_next(struct ofi_timer_wheel *wheel);
+
+/* Set or move a timer.  A deadline already past expires at the next tick. */
+void ofi_timer_set(struct ofi_timer_wheel *wheel, struct ofi_timer *timer,
+		   uint64_t expires_us);
+void ofi_timer_cancel(struct ofi_timer_wheel *wheel, struct ofi_timer *timer);
+
+static inline void ofi_timer_init(struct ofi_timer *timer, ofi_timer_cb cb)
+{
+	dlist_init(&timer->entry);
+	timer->cb = cb;
+}
+
+static inline int ofi_timer_is_set(struct ofi_timer *timer)
+{
+	return !dlist_empty(&timer->entry);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FI_TIMER_H_ */
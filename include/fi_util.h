@@ -522,6 +522,55 @@ int ofi_mr_verify(struct ofi_mr_map *map, uintptr_t *io_addr,
 		  void **context);
 
 
+/*
+ * Registration cache
+ *
+ * Keeps registrations of the core provider alive after their last use, so
+ * that registering the same buffer again is a lookup.  A search hits when
+ * a cached region covers the whole iov.  Cached regions do not overlap;
+ * a region that overlaps one in use is registered outside of the cache.
+ * Unused regions are evicted in least recently used order once either
+ * limit is reached.
+ *
+ * The cache has no way to learn that memory was freed, so a buffer must
+ * not be unmapped while its region may still be cached.
+ *
+ * The owner sets the limits and callbacks before ofi_mr_cache_init.
+ */
+struct ofi_mr_entry {
+	struct iovec		iov;
+	void			*context;
+	unsigned int		use_cnt;
+	int			cached;
+	struct dlist_entry	lru_entry;
+};
+
+struct ofi_mr_cache {
+	const struct fi_provider *prov;
+	size_t			max_cached_cnt;
+	size_t			max_cached_size;
+	int			(*add_region)(struct ofi_mr_cache *cache,
+					      struct ofi_mr_entry *entry);
+	void			(*delete_region)(struct ofi_mr_cache *cache,
+						 struct ofi_mr_entry *entry);
+
+	fastlock_t		lock;
+	void			*rbtree;
+	struct dlist_entry	lru_list;
+	size_t			cached_cnt;
+	size_t			cached_size;
+	uint64_t		search_cnt;
+	uint64_t		hit_cnt;
+};
+
+int ofi_mr_cache_init(struct ofi_mr_cache *cache);
+void ofi_mr_cache_cleanup(struct ofi_mr_cache *cache);
+int ofi_mr_cache_search(struct ofi_mr_cache *cache, const struct iovec *iov,
+			struct ofi_mr_entry **entry);
+void ofi_mr_cache_delete(struct ofi_mr_cache *cache,
+			 struct ofi_mr_entry *entry);
+
+
 /*
  * Attributes and capabilities
  */
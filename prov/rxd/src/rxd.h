@@ -51,6 +51,7 @@
 #include <fi_enosys.h>
 #include <fi_rbuf.h>
 #include <fi_list.h>
+#include <fi_timer.h>
 #include <fi_util.h>
 
 #ifndef _RXD_H_
@@ -64,6 +65,8 @@
 #define RXD_IOV_LIMIT		(4)
 #define RXD_DEF_CQ_CNT		(8)
 #define RXD_DEF_EP_CNT 		(8)
+#define RXD_CQ_BATCH_DEF	(16)
+#define RXD_CQ_BATCH_MAX	(64)
 #define RXD_AV_DEF_COUNT	(128)
 
 #define RXD_MAX_TX_BITS 	(10)
@@ -77,9 +80,17 @@
 #define RXD_TX_POOL_CHUNK_CNT	(1024)
 #define RXD_RX_POOL_CHUNK_CNT	(1024)
 
-#define RXD_MAX_RX_WIN		(16)
+#define RXD_MAX_RX_WIN		(64)
 #define RXD_MAX_OUT_TX_MSG	(8)
-#define RXD_MAX_UNACKED		(128)
+#define RXD_ACK_INTERVAL	(8)
+
+/*
+ * Per-peer congestion window, in segments.  The cap keeps a full window
+ * within a default-sized socket receive buffer at the peer.
+ */
+#define RXD_INIT_CWND		(16)
+#define RXD_MIN_CWND		RXD_ACK_INTERVAL
+#define RXD_MAX_CWND		(48)
 
 #define RXD_EP_MAX_UNEXP_PKT	(512)
 #define RXD_EP_MAX_UNEXP_MSG	(128)
@@ -90,8 +101,12 @@
 
 
 #define RXD_RETRY_TIMEOUT	(900)
+#define RXD_MIN_RTO		(200)
+#define RXD_MAX_RTO		(100000)
 #define RXD_WAIT_TIMEOUT	(2000)
 #define RXD_MAX_PKT_RETRY	(50)
+#define RXD_MAX_BACKOFF		(16)
+#define RXD_TIMER_TICK		(16)
 
 #define RXD_PKT_LOCAL_ACK	(1)
 #define RXD_PKT_REMOTE_ACK	(1 << 1)
@@ -106,6 +121,7 @@ extern struct fi_info rxd_info;
 extern struct fi_fabric_attr rxd_fabric_attr;
 extern struct util_prov rxd_util_prov;
 extern struct fi_ops_rma rxd_ops_rma;
+extern int rxd_cq_batch;
 
 enum {
 	RXD_PKT_ORDR_OK = 0,
@@ -144,6 +160,13 @@ struct rxd_domain {
 	pthread_t progress_thread;
 	fastlock_t lock;
 
+	/* the progress thread sleeps on the core CQs through dg_wait */
+	struct fid_fabric *dg_fabric;
+	struct fid_wait *dg_wait;
+	fi_epoll_t epoll_fd;
+	struct fd_signal signal;
+	int sleeping;
+
 	struct dlist_entry ep_list;
 	struct dlist_entry cq_list;
 	struct ofi_mr_map mr_map;
@@ -182,7 +205,17 @@ struct rxd_peer {
 	uint8_t addr_published;
 	uint8_t conn_initiated;
 	uint16_t num_msg_out;
-	uint8_t pad[4];
+	uint32_t rx_unacked;
+
+	/* congestion control for segments sent to the peer */
+	uint32_t num_unacked;
+	uint32_t cwnd;
+	uint32_t ssthresh;
+	uint32_t cwnd_cnt;
+	uint64_t srtt;
+	uint64_t rttvar;
+	uint64_t rto;
+	uint64_t loss_stamp;
 };
 
 struct rxd_ep {
@@ -232,6 +265,9 @@ struct rxd_ep {
 
 	struct rxd_trecv_fs *trecv_fs;
 	struct dlist_entry trecv_list;
+
+	/* retransmit, wait probe, and delayed ack deadlines */
+	struct ofi_timer_wheel timers;
 	fastlock_t lock;
 };
 
@@ -257,10 +293,13 @@ struct rxd_rx_entry {
 	uint64_t peer;
 	uint16_t window;
 	uint32_t last_win_seg;
+	uint32_t acked_seg_no;
+	uint64_t sack;
 	fi_addr_t source;
 	struct rxd_peer *peer_info;
 	struct rxd_rx_buf *unexp_buf;
 	uint64_t nack_stamp;
+	struct ofi_timer ack_timer;
 	struct dlist_entry entry;
 
 	union {
@@ -291,9 +330,10 @@ struct rxd_tx_entry {
 	uint64_t rx_key;
 	uint32_t nxt_seg_no;
 	uint32_t win_sz;
+	uint32_t win_end;
 	int num_unacked;
 	int is_waiting;
-	uint64_t retry_stamp;
+	struct ofi_timer timer;
 
 	struct dlist_entry entry;
 	struct dlist_entry pkt_list;
@@ -367,6 +407,19 @@ struct rxd_pkt_data {
 #define RXD_DATA_PKT_SZ (sizeof(struct rxd_pkt_data))
 #define RXD_MAX_DATA_PKT_SZ(ep)	(ep->domain->max_mtu_sz - RXD_DATA_PKT_SZ)
 
+/*
+ * Trailer of ack and nack packets.  win_end is the first segment past the
+ * receive window, and bit i of sack is set when segment exp_seg_no + 1 + i
+ * is already held by the receiver.  Peers that send bare control headers
+ * fall back to the additive seg_size window and cumulative acks.
+ */
+struct rxd_ack_data {
+	uint32_t exp_seg_no;
+	uint32_t win_end;
+	uint64_t sack;
+};
+#define RXD_ACK_PKT_SZ (RXD_DATA_PKT_SZ + sizeof(struct rxd_ack_data))
+
 struct rxd_pkt_meta {
 	struct fi_context context;
 	struct dlist_entry entry;
@@ -374,14 +427,26 @@ struct rxd_pkt_meta {
 	struct rxd_ep *ep;
 	struct fid_mr *mr;
 	uint64_t us_stamp;
+	struct ofi_timer timer;
 	uint8_t ref;
 	uint8_t type;
 	uint8_t retries;
-	uint8_t pad[5];
+	uint8_t sacked;
+	uint8_t resends;
+	uint8_t pad[3];
 
 	char pkt_data[]; /* rxd_pkt, followed by data */
 };
 
+/* Arm a timer, waking the progress thread if it may be asleep */
+static inline void rxd_ep_set_timer(struct rxd_ep *ep, struct ofi_timer *timer,
+				    uint64_t expires_us)
+{
+	ofi_timer_set(&ep->timers, timer, expires_us);
+	if (ep->domain->sleeping)
+		fd_signal_set(&ep->domain->signal);
+}
+
 int rxd_info_to_core(uint32_t version, struct fi_info *rxd_info,
 		     struct fi_info *core_info);
 int rxd_info_to_rxd(uint32_t version, struct fi_info *core_info,
@@ -410,17 +475,19 @@ int rxd_av_dg_reverse_lookup(struct rxd_av *av, uint64_t start_idx,
 void rxd_ep_lock_if_required(struct rxd_ep *rxd_ep);
 void rxd_ep_unlock_if_required(struct rxd_ep *rxd_ep);
 int rxd_ep_repost_buff(struct rxd_rx_buf *rx_buf);
-void rxd_ep_progress(struct rxd_ep *ep);
+uint64_t rxd_ep_progress(struct rxd_ep *ep);
+void rxd_ep_progress_peer(struct rxd_ep *ep, fi_addr_t addr);
 int rxd_ep_reply_ack(struct rxd_ep *ep, struct ofi_ctrl_hdr *in_ctrl,
 		     uint8_t type, uint16_t seg_size, uint64_t rx_key,
 		     uint64_t source, fi_addr_t dest);
-int rxd_ep_reply_nack(struct rxd_ep *ep, struct ofi_ctrl_hdr *in_ctrl,
-		      uint32_t seg_no, uint64_t rx_key,
-		      uint64_t source, fi_addr_t dest);
+int rxd_ep_reply_rx_ack(struct rxd_ep *ep, struct rxd_rx_entry *rx_entry,
+			uint8_t type, uint16_t seg_size);
 int rxd_ep_reply_discard(struct rxd_ep *ep, struct ofi_ctrl_hdr *in_ctrl,
 			 uint32_t seg_no, uint64_t rx_key,
 			 uint64_t source, fi_addr_t dest);
 struct rxd_peer *rxd_ep_getpeer_info(struct rxd_ep *rxd_ep, fi_addr_t addr);
+void rxd_peer_rtt_sample(struct rxd_peer *peer, uint64_t rtt);
+void rxd_peer_cong_ack(struct rxd_peer *peer, int acked);
 
 void rxd_ep_check_unexp_msg_list(struct rxd_ep *ep, struct rxd_recv_entry *recv_entry);
 void rxd_ep_check_unexp_tag_list(struct rxd_ep *ep, struct rxd_trecv_entry *trecv_entry);
@@ -429,8 +496,8 @@ void rxd_ep_handle_data_msg(struct rxd_ep *ep, struct rxd_peer *peer,
 			    struct iovec *iov, size_t iov_count,
 			    struct ofi_ctrl_hdr *ctrl, void *data,
 			    struct rxd_rx_buf *rx_buf);
-void rxd_ep_free_acked_pkts(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry,
-			    uint32_t seg_no);
+int rxd_ep_free_acked_pkts(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry,
+			   uint32_t seg_no);
 int rxd_ep_retry_pkt(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry,
 		     struct rxd_pkt_meta *pkt);
 void rxd_ep_copy_msg_iov(const struct iovec *src_iov,
@@ -449,7 +516,7 @@ int rxd_mr_verify(struct rxd_domain *rxd_domain, ssize_t len,
 struct rxd_tx_entry *rxd_tx_entry_acquire(struct rxd_ep *ep, struct rxd_peer *peer);
 struct rxd_tx_entry *rxd_tx_entry_acquire_fast(struct rxd_ep *ep, struct rxd_peer *peer);
 int rxd_tx_entry_progress(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry,
-			  struct ofi_ctrl_hdr *ack);
+			  struct ofi_ctrl_hdr *ack, struct rxd_ack_data *ack_data);
 void rxd_tx_entry_discard(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry);
 void rxd_tx_entry_release(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry);
 void rxd_tx_entry_done(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry);
@@ -461,8 +528,9 @@ void rxd_rx_entry_release(struct rxd_ep *ep, struct rxd_rx_entry *rx_entry);
 
 /* CQ sub-functions */
 void rxd_cq_progress(struct util_cq *util_cq);
+int rxd_cq_progress_try(struct rxd_cq *cq);
 void rxd_cq_report_error(struct rxd_cq *cq, struct fi_cq_err_entry *err_entry);
 void rxd_cq_report_tx_comp(struct rxd_cq *cq, struct rxd_tx_entry *tx_entry);
-void rxd_cq_report_rx_comp(struct rxd_cq *cq, struct rxd_rx_entry *rx_entry);
+void rxd_cq_report_rx_comp(struct rxd_ep *ep, struct rxd_rx_entry *rx_entry);
 
 #endif
@@ -314,7 +314,8 @@ int rxd_av_create(struct fid_domain *domain_fid, struct fi_av_attr *attr,
 	av->size = av->util_av.count;
 	av_attr = *attr;
 	av_attr.type = FI_AV_TABLE;
-	av_attr.count = 0;
+	/* the datagram AV does not grow; size it like ours */
+	av_attr.count = av->size;
 	av_attr.flags = 0;
 	ret = fi_av_open(domain->dg_domain, &av_attr, &av->dg_av, context);
 	if (ret)
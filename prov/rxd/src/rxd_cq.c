@@ -165,17 +165,26 @@ static void rxd_handle_dup_datastart(struct rxd_ep *ep, struct ofi_ctrl_hdr *ctr
 	struct rxd_rx_entry *rx_entry;
 	struct rxd_peer *peer;
 
+	peer = rxd_ep_getpeer_info(ep, ctrl->conn_id);
 	item = dlist_find_first_match(&ep->rx_entry_list,
 				      rxd_rx_entry_match, ctrl);
-	if (!item)
+	if (!item) {
+		/* the message is complete, but its last ack was lost */
+		rxd_ep_reply_ack(ep, ctrl, ofi_ctrl_ack, 0, 0,
+				 peer->conn_data, ctrl->conn_id);
 		return;
+	}
 
 	FI_INFO(&rxd_prov, FI_LOG_EP_CTRL,
 		"duplicate start-data: msg_id: %" PRIu64 ", seg_no: %d\n",
 		ctrl->msg_id, ctrl->seg_no);
 
 	rx_entry = container_of(item, struct rxd_rx_entry, entry);
-	peer = rxd_ep_getpeer_info(ep, ctrl->conn_id);
+	if (rx_entry->exp_seg_no) {
+		rxd_ep_reply_rx_ack(ep, rx_entry, ofi_ctrl_ack, 0);
+		return;
+	}
+
 	rxd_ep_reply_ack(ep, ctrl, ofi_ctrl_ack, rx_entry->window, rx_entry->key,
 		       peer->conn_data, ctrl->conn_id);
 	return;
@@ -231,14 +240,43 @@ int rxd_tx_pkt_match(struct dlist_entry *item, const void *arg)
 	return (ack_ctrl->seg_no == pkt_ctrl->seg_no) ? 1 : 0;
 }
 
+static struct rxd_ack_data *rxd_get_ack_data(struct ofi_ctrl_hdr *ctrl,
+					     struct fi_cq_msg_entry *comp)
+{
+	return (comp->len >= RXD_ACK_PKT_SZ) ?
+		(struct rxd_ack_data *) ((struct rxd_pkt_data *) ctrl)->data : NULL;
+}
+
+/*
+ * An ack is cumulative, so it may have waited for an older segment to be
+ * resent.  Its delay is only a round trip if nothing it covers was resent.
+ */
+static int rxd_ack_is_clean(struct dlist_entry *pkt_list,
+			    struct dlist_entry *acked)
+{
+	struct dlist_entry *item;
+	struct rxd_pkt_meta *pkt;
+
+	for (item = pkt_list->next; ; item = item->next) {
+		pkt = container_of(item, struct rxd_pkt_meta, entry);
+		if (pkt->retries || pkt->sacked)
+			return 0;
+		if (item == acked)
+			return 1;
+	}
+}
+
 int rxd_handle_ack(struct rxd_ep *ep, struct ofi_ctrl_hdr *ctrl,
-		    struct rxd_rx_buf *rx_buf)
+		    struct fi_cq_msg_entry *comp, struct rxd_rx_buf *rx_buf)
 {
 	int ret = 0;
 	uint64_t idx;
 	struct rxd_tx_entry *tx_entry;
 	struct dlist_entry *item;
 	struct rxd_pkt_meta *pkt;
+	struct rxd_peer *peer;
+	struct rxd_ack_data *ack_data;
+	fi_addr_t addr;
 
 	rxd_ep_lock_if_required(ep);
 	FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "got ack: msg: %p - %d\n",
@@ -249,20 +287,36 @@ int rxd_handle_ack(struct rxd_ep *ep, struct ofi_ctrl_hdr *ctrl,
 	if (tx_entry->msg_id != ctrl->msg_id)
 		goto out;
 
+	addr = tx_entry->peer;
+	ack_data = rxd_get_ack_data(ctrl, comp);
 	item = dlist_find_first_match(&tx_entry->pkt_list, rxd_tx_pkt_match, ctrl);
-	if (!item)
-		goto out;
+	if (!item) {
+		/* the window may still have moved */
+		if (ack_data)
+			ret = rxd_tx_entry_progress(ep, tx_entry, ctrl, ack_data);
+		goto progress;
+	}
 
 	pkt = container_of(item, struct rxd_pkt_meta, entry);
+	peer = rxd_ep_getpeer_info(ep, tx_entry->peer);
+
+	/*
+	 * Karn's rule: only segments sent once give an RTT sample.  The start
+	 * segment is skipped, since its ack waits for a matching receive.
+	 */
+	if (ctrl->seg_no && rxd_ack_is_clean(&tx_entry->pkt_list, item))
+		rxd_peer_rtt_sample(peer, fi_gettime_us() - pkt->us_stamp);
+
 	switch (pkt->type) {
 
 	case RXD_PKT_STRT:
 	case RXD_PKT_DATA:
-		ret = rxd_tx_entry_progress(ep, tx_entry, ctrl);
+		ret = rxd_tx_entry_progress(ep, tx_entry, ctrl, ack_data);
 		break;
 
 	case RXD_PKT_LAST:
-		rxd_ep_free_acked_pkts(ep, tx_entry, ctrl->seg_no);
+		rxd_peer_cong_ack(peer, rxd_ep_free_acked_pkts(ep, tx_entry,
+							       ctrl->seg_no));
 		FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "reporting TX completion : %p\n", tx_entry);
 		if (tx_entry->op_type != RXD_TX_READ_REQ) {
 			rxd_cq_report_tx_comp(ep->tx_cq, tx_entry);
@@ -273,6 +327,8 @@ int rxd_handle_ack(struct rxd_ep *ep, struct ofi_ctrl_hdr *ctrl,
 		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "invalid pkt type\n");
 		break;
 	}
+progress:
+	rxd_ep_progress_peer(ep, addr);
 out:
 	rxd_ep_repost_buff(rx_buf);
 	rxd_ep_unlock_if_required(ep);
@@ -280,7 +336,7 @@ out:
 }
 
 int rxd_handle_nack(struct rxd_ep *ep, struct ofi_ctrl_hdr *ctrl,
-		     struct rxd_rx_buf *rx_buf)
+		     struct fi_cq_msg_entry *comp, struct rxd_rx_buf *rx_buf)
 {
 	int ret = 0;
 	uint64_t idx;
@@ -295,7 +351,9 @@ int rxd_handle_nack(struct rxd_ep *ep, struct ofi_ctrl_hdr *ctrl,
 	if (tx_entry->msg_id != ctrl->msg_id)
 		goto out;
 
-	ret = rxd_tx_entry_progress(ep, tx_entry, ctrl);
+	ret = rxd_tx_entry_progress(ep, tx_entry, ctrl,
+				    rxd_get_ack_data(ctrl, comp));
+	rxd_ep_progress_peer(ep, tx_entry->peer);
 out:
 	rxd_ep_repost_buff(rx_buf);
 	rxd_ep_unlock_if_required(ep);
@@ -306,6 +364,7 @@ void rxd_handle_discard(struct rxd_ep *ep, struct ofi_ctrl_hdr *ctrl,
 			struct rxd_rx_buf *rx_buf)
 {
 	uint64_t idx;
+	fi_addr_t addr;
 	struct rxd_tx_entry *tx_entry;
 
 	rxd_ep_lock_if_required(ep);
@@ -317,7 +376,9 @@ void rxd_handle_discard(struct rxd_ep *ep, struct ofi_ctrl_hdr *ctrl,
 	if (tx_entry->msg_id != ctrl->msg_id)
 		goto out;
 
+	addr = tx_entry->peer;
 	rxd_tx_entry_discard(ep, tx_entry);
+	rxd_ep_progress_peer(ep, addr);
 out:
 	rxd_ep_repost_buff(rx_buf);
 	rxd_ep_unlock_if_required(ep);
@@ -337,11 +398,16 @@ void rxd_tx_entry_done(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry)
 {
 	struct rxd_pkt_meta *pkt_meta;
 	struct dlist_entry *item;
+	struct rxd_peer *peer;
+
+	peer = rxd_ep_getpeer_info(ep, tx_entry->peer);
+	peer->num_unacked -= tx_entry->num_unacked;
 
 	while (!dlist_empty(&tx_entry->pkt_list)) {
 		item = tx_entry->pkt_list.next;
 		pkt_meta = container_of(item, struct rxd_pkt_meta, entry);
 		dlist_remove(&pkt_meta->entry);
+		ofi_timer_cancel(&ep->timers, &pkt_meta->timer);
 		RXD_PKT_MARK_REMOTE_ACK(pkt_meta);
 		rxd_tx_pkt_release(pkt_meta);
 	}
@@ -383,13 +449,77 @@ out:
 
 static inline uint16_t rxd_get_window_sz(struct rxd_ep *ep, uint64_t rem)
 {
-	uint16_t num_pkts, avail;
+	uint64_t num_pkts, avail;
 
 	num_pkts = (rem +  RXD_MAX_DATA_PKT_SZ(ep) - 1) / RXD_MAX_DATA_PKT_SZ(ep);
 	avail = MIN(ep->credits, num_pkts);
 	return MIN(avail, RXD_MAX_RX_WIN);
 }
 
+/*
+ * Top the window of an active message back up to RXD_MAX_RX_WIN once half
+ * of it is used, so the sender does not stall for a round trip per window.
+ */
+static uint16_t rxd_rx_entry_grant(struct rxd_ep *ep,
+				   struct rxd_rx_entry *rx_entry)
+{
+	uint64_t num_pkts;
+	uint16_t grant;
+
+	if (rx_entry->window > RXD_MAX_RX_WIN / 2)
+		return 0;
+
+	num_pkts = (rx_entry->op_hdr.size - rx_entry->done +
+		    RXD_MAX_DATA_PKT_SZ(ep) - 1) / RXD_MAX_DATA_PKT_SZ(ep);
+	num_pkts = MIN(num_pkts, RXD_MAX_RX_WIN);
+	if (num_pkts <= rx_entry->window)
+		return 0;
+
+	grant = MIN(num_pkts - rx_entry->window, ep->credits);
+	rx_entry->window += grant;
+	rx_entry->last_win_seg += grant;
+	ep->credits -= grant;
+	return grant;
+}
+
+/*
+ * Every RXD_ACK_INTERVAL segments from a peer, ack all of its messages, so
+ * that the sender's congestion window keeps opening however it is spread
+ * across messages.
+ */
+static void rxd_ep_ack_peer(struct rxd_ep *ep, struct rxd_peer *peer)
+{
+	struct dlist_entry *item;
+	struct rxd_rx_entry *rx_entry;
+
+	dlist_foreach(&ep->rx_entry_list, item) {
+		rx_entry = container_of(item, struct rxd_rx_entry, entry);
+		if (rx_entry->peer_info == peer && rx_entry->exp_seg_no &&
+		    rx_entry->acked_seg_no != rx_entry->exp_seg_no)
+			rxd_ep_reply_rx_ack(ep, rx_entry, ofi_ctrl_ack, 0);
+	}
+	peer->rx_unacked = 0;
+}
+
+/*
+ * Runs on the first progress pass after data arrives: ack whatever came in
+ * since the last ack, rather than leave the tail of a burst to the sender's
+ * retransmit timer.
+ */
+static void rxd_rx_entry_ack_timeout(struct ofi_timer_wheel *wheel,
+				     struct ofi_timer *timer)
+{
+	struct rxd_rx_entry *rx_entry;
+	struct rxd_ep *ep;
+
+	rx_entry = container_of(timer, struct rxd_rx_entry, ack_timer);
+	ep = container_of(wheel, struct rxd_ep, timers);
+	if (rx_entry->exp_seg_no &&
+	    rx_entry->acked_seg_no != rx_entry->exp_seg_no)
+		rxd_ep_reply_rx_ack(ep, rx_entry, ofi_ctrl_ack, 0);
+	rx_entry->peer_info->rx_unacked = 0;
+}
+
 struct rxd_rx_entry *rxd_get_rx_entry(struct rxd_ep *ep)
 {
 	struct rxd_rx_entry *rx_entry;
@@ -398,6 +528,7 @@ struct rxd_rx_entry *rxd_get_rx_entry(struct rxd_ep *ep)
 
 	rx_entry = freestack_pop(ep->rx_entry_fs);
 	rx_entry->key = rx_entry - &ep->rx_entry_fs->buf[0];
+	ofi_timer_init(&rx_entry->ack_timer, rxd_rx_entry_ack_timeout);
 	dlist_init(&rx_entry->entry);
 	dlist_init(&rx_entry->wait_entry);
 	dlist_insert_tail(&rx_entry->entry, &ep->rx_entry_list);
@@ -406,8 +537,6 @@ struct rxd_rx_entry *rxd_get_rx_entry(struct rxd_ep *ep)
 
 static void rxd_progress_wait_rx(struct rxd_ep *ep, struct rxd_rx_entry *rx_entry)
 {
-	struct ofi_ctrl_hdr ctrl;
-
 	rx_entry->window = rxd_get_window_sz(ep, rx_entry->op_hdr.size - rx_entry->done);
 
 	if (!rx_entry->window)
@@ -418,15 +547,9 @@ static void rxd_progress_wait_rx(struct rxd_ep *ep, struct rxd_rx_entry *rx_entr
 
 	ep->credits -= rx_entry->window;
 
-	ctrl.msg_id = rx_entry->msg_id;
-	ctrl.seg_no = rx_entry->exp_seg_no - 1;
-	ctrl.conn_id = rx_entry->peer;
-
 	FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "rx-entry wait over [%p], window: %d\n",
 		rx_entry->msg_id, rx_entry->window);
-	rxd_ep_reply_ack(ep, &ctrl, ofi_ctrl_ack, rx_entry->window,
-		       rx_entry->key, rx_entry->peer_info->conn_data,
-		       ctrl.conn_id);
+	rxd_ep_reply_rx_ack(ep, rx_entry, ofi_ctrl_ack, rx_entry->window);
 }
 
 static void rxd_check_waiting_rx(struct rxd_ep *ep)
@@ -447,6 +570,7 @@ static void rxd_check_waiting_rx(struct rxd_ep *ep)
 void rxd_rx_entry_release(struct rxd_ep *ep, struct rxd_rx_entry *rx_entry)
 {
 	rx_entry->key = -1;
+	ofi_timer_cancel(&ep->timers, &rx_entry->ack_timer);
 	dlist_remove(&rx_entry->entry);
 	freestack_push(ep->rx_entry_fs, rx_entry);
 
@@ -519,9 +643,10 @@ struct rxd_trecv_entry *rxd_get_trecv_entry(struct rxd_ep *ep,
 	return trecv_entry;
 }
 
-void rxd_report_rx_comp(struct rxd_cq *cq, struct rxd_rx_entry *rx_entry)
+void rxd_cq_report_rx_comp(struct rxd_ep *ep, struct rxd_rx_entry *rx_entry)
 {
 	struct fi_cq_tagged_entry cq_entry = {0};
+	struct rxd_cq *cq = ep->rx_cq;
 
 	/* todo: handle FI_COMPLETION */
 	if (rx_entry->op_hdr.flags & OFI_REMOTE_CQ_DATA)
@@ -569,6 +694,11 @@ void rxd_report_rx_comp(struct rxd_cq *cq, struct rxd_rx_entry *rx_entry)
 		break;
 	}
 
+	/* source is only resolved up front for directed receives */
+	if (cq->util_cq.src)
+		cq->util_cq.src[ofi_cirque_windex(cq->util_cq.cirq)] =
+			rx_entry->source != FI_ADDR_UNSPEC ? rx_entry->source :
+			rxd_av_get_fi_addr(ep->av, rx_entry->peer);
 	cq->write_fn(cq, &cq_entry);
 }
 
@@ -646,12 +776,22 @@ void rxd_ep_handle_data_msg(struct rxd_ep *ep, struct rxd_peer *peer,
 {
 
 	uint64_t done;
-
-	ep->credits++;
+	uint16_t grant;
+	int waiting;
+
+	/* a probe from a sender that was told to wait consumes no credit */
+	waiting = !rx_entry->window;
+	if (!waiting) {
+		ep->credits++;
+		rx_entry->window--;
+	}
 	done = ofi_copy_to_iov(iov, iov_count, rx_entry->done, data, ctrl->seg_size);
 	rx_entry->done += done;
-	rx_entry->window--;
 	rx_entry->exp_seg_no++;
+	rx_entry->sack >>= 1;
+	peer->rx_unacked++;
+	if (!ofi_timer_is_set(&rx_entry->ack_timer))
+		rxd_ep_set_timer(ep, &rx_entry->ack_timer, 0);
 
 	if (done != ctrl->seg_size) {
 		/* todo: generate truncation error */
@@ -659,20 +799,17 @@ void rxd_ep_handle_data_msg(struct rxd_ep *ep, struct rxd_peer *peer,
 		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "TODO: message truncated\n");
 	}
 
-	if (rx_entry->window == 0) {
-		rx_entry->window = rxd_get_window_sz(ep, rx_entry->op_hdr.size - rx_entry->done);
-
-		rx_entry->last_win_seg += rx_entry->window;
-		ep->credits -= rx_entry->window;
-		FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "replying ack [%p] - %d\n",
-			ctrl->msg_id, ctrl->seg_no);
-
-		rxd_ep_reply_ack(ep, ctrl, ofi_ctrl_ack, rx_entry->window,
-			       rx_entry->key, peer->conn_data, ctrl->conn_id);
-	}
-
 	if (rx_entry->op_hdr.size != rx_entry->done) {
-		if (rx_entry->window == 0) {
+		grant = waiting ? 0 : rxd_rx_entry_grant(ep, rx_entry);
+		if (grant || !rx_entry->window) {
+			FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "replying ack [%p] - %d\n",
+				ctrl->msg_id, ctrl->seg_no);
+			rxd_ep_reply_rx_ack(ep, rx_entry, ofi_ctrl_ack, grant);
+		}
+		if (peer->rx_unacked >= RXD_ACK_INTERVAL)
+			rxd_ep_ack_peer(ep, peer);
+
+		if (rx_entry->window == 0 && !waiting) {
 			dlist_init(&rx_entry->wait_entry);
 			dlist_insert_tail(&rx_entry->wait_entry, &ep->wait_rx_list);
 			FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "rx-entry %p - %d enqueued\n",
@@ -685,8 +822,14 @@ void rxd_ep_handle_data_msg(struct rxd_ep *ep, struct rxd_peer *peer,
 		return;
 	}
 
+	if (waiting)
+		dlist_remove(&rx_entry->wait_entry);
+	FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "replying ack [%p] - %d\n",
+		ctrl->msg_id, ctrl->seg_no);
+	rxd_ep_reply_rx_ack(ep, rx_entry, ofi_ctrl_ack, 0);
+
 	FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "reporting RX completion event\n");
-	rxd_report_rx_comp(ep->rx_cq, rx_entry);
+	rxd_cq_report_rx_comp(ep, rx_entry);
 
 	switch(rx_entry->op_hdr.op) {
 	case ofi_op_msg:
@@ -723,13 +866,14 @@ static int rxd_check_data_pkt_order(struct rxd_ep *ep,
 		RXD_PKT_ORDR_DUP : RXD_PKT_ORDR_UNEXP;
 }
 
-static inline void rxd_ep_enqueue_pkt(struct rxd_ep *ep, struct ofi_ctrl_hdr *ctrl,
-				       struct fi_cq_msg_entry *comp)
+static inline int rxd_ep_enqueue_pkt(struct rxd_ep *ep, struct ofi_ctrl_hdr *ctrl,
+				      struct fi_cq_msg_entry *comp)
 {
 	struct rxd_unexp_cq_entry *unexp;
-	if (comp->flags & RXD_UNEXP_ENTRY ||
-	    ep->num_unexp_pkt > RXD_EP_MAX_UNEXP_PKT)
-		return;
+	if (comp->flags & RXD_UNEXP_ENTRY)
+		return 0;
+	if (ep->num_unexp_pkt > RXD_EP_MAX_UNEXP_PKT)
+		return -FI_ENOMEM;
 
 	unexp = util_buf_alloc(ep->rx_cq->unexp_pool);
 	assert(unexp);
@@ -737,11 +881,27 @@ static inline void rxd_ep_enqueue_pkt(struct rxd_ep *ep, struct ofi_ctrl_hdr *ct
 	unexp->cq_entry.flags |= RXD_UNEXP_ENTRY;
 
 	dlist_init(&unexp->entry);
-	dlist_insert_tail(&ep->rx_cq->unexp_list, &unexp->entry);
+	dlist_insert_tail(&unexp->entry, &ep->rx_cq->unexp_list);
 	FI_INFO(&rxd_prov, FI_LOG_EP_CTRL,
 		"enqueuing unordered pkt: %p, seg_no: %d\n",
 		ctrl->msg_id, ctrl->seg_no);
 	ep->num_unexp_pkt++;
+	return 0;
+}
+
+static int rxd_unexp_pkt_match(struct dlist_entry *item, const void *arg)
+{
+	const struct ofi_ctrl_hdr *ctrl = arg, *queued;
+	struct rxd_unexp_cq_entry *unexp;
+	struct rxd_rx_buf *rx_buf;
+
+	unexp = container_of(item, struct rxd_unexp_cq_entry, entry);
+	rx_buf = container_of(unexp->cq_entry.op_context, struct rxd_rx_buf,
+			      context);
+	queued = (struct ofi_ctrl_hdr *) rx_buf->buf;
+	return (queued->msg_id == ctrl->msg_id &&
+		queued->conn_id == ctrl->conn_id &&
+		queued->seg_no == ctrl->seg_no);
 }
 
 static inline void rxd_release_unexp_entry(struct rxd_cq *cq,
@@ -839,7 +999,7 @@ void rxd_handle_data(struct rxd_ep *ep, struct rxd_peer *peer,
 	struct rxd_rx_entry *rx_entry;
 	struct rxd_tx_entry *tx_entry;
 	struct rxd_pkt_data *pkt_data = (struct rxd_pkt_data *) ctrl;
-	uint16_t win_sz;
+	uint32_t sack_off;
 	uint64_t curr_stamp;
 
 	rxd_ep_lock_if_required(ep);
@@ -851,28 +1011,36 @@ void rxd_handle_data(struct rxd_ep *ep, struct rxd_peer *peer,
 			"duplicate pkt: %d expected:%d, rx-key:%d, ctrl_msg_id: %p\n",
 			ctrl->seg_no, rx_entry->exp_seg_no, ctrl->rx_key, ctrl->msg_id);
 
-		win_sz = (rx_entry->msg_id == ctrl->msg_id &&
-			  rx_entry->last_win_seg == ctrl->seg_no) ? rx_entry->window : 0;
-		rxd_ep_reply_ack(ep, ctrl, ofi_ctrl_ack, win_sz,
-			       ctrl->rx_key, peer->conn_data, ctrl->conn_id);
+		if (rx_entry->msg_id == ctrl->msg_id)
+			rxd_ep_reply_rx_ack(ep, rx_entry, ofi_ctrl_ack, 0);
+		else
+			rxd_ep_reply_ack(ep, ctrl, ofi_ctrl_ack, 0,
+				       ctrl->rx_key, peer->conn_data, ctrl->conn_id);
 
 		goto repost;
 	} else if (ret == RXD_PKT_ORDR_UNEXP) {
-		if (!(comp->flags & RXD_UNEXP_ENTRY)) {
-			curr_stamp = fi_gettime_us();
-			if (rx_entry->nack_stamp == 0 ||
-			    (curr_stamp > rx_entry->nack_stamp &&
-			     curr_stamp - rx_entry->nack_stamp > RXD_RETRY_TIMEOUT)) {
-
-				FI_DBG(&rxd_prov, FI_LOG_EP_CTRL,
-				       "unexpected pkt, sending NACK: %d\n", ctrl->seg_no);
-
-				rx_entry->nack_stamp = curr_stamp;
-				rxd_ep_reply_nack(ep, ctrl, rx_entry->exp_seg_no,
-						ctrl->rx_key, peer->conn_data,
-						ctrl->conn_id);
-			}
-			rxd_ep_enqueue_pkt(ep, ctrl, comp);
+		if (comp->flags & RXD_UNEXP_ENTRY)
+			goto out;
+
+		sack_off = ctrl->seg_no - rx_entry->exp_seg_no - 1;
+		if (sack_off < 64 && (rx_entry->sack & (1ULL << sack_off)))
+			goto repost;
+
+		if (rxd_ep_enqueue_pkt(ep, ctrl, comp))
+			goto repost;
+		if (sack_off < 64)
+			rx_entry->sack |= 1ULL << sack_off;
+
+		curr_stamp = fi_gettime_us();
+		if (rx_entry->nack_stamp == 0 ||
+		    (curr_stamp > rx_entry->nack_stamp &&
+		     curr_stamp - rx_entry->nack_stamp > RXD_RETRY_TIMEOUT)) {
+
+			FI_DBG(&rxd_prov, FI_LOG_EP_CTRL,
+			       "unexpected pkt, sending NACK: %d\n", ctrl->seg_no);
+
+			rx_entry->nack_stamp = curr_stamp;
+			rxd_ep_reply_rx_ack(ep, rx_entry, ofi_ctrl_nack, 0);
 		}
 		goto out;
 	}
@@ -1086,7 +1254,13 @@ void rxd_handle_start_data(struct rxd_ep *ep, struct rxd_peer *peer,
 		goto repost;
 	} else if (ret == RXD_PKT_ORDR_UNEXP) {
 		FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "unexpected pkt: %d\n", ctrl->seg_no);
-		rxd_ep_enqueue_pkt(ep, ctrl, comp);
+		/* a start held for an earlier message is resent until acked */
+		if (!(comp->flags & RXD_UNEXP_ENTRY) &&
+		    dlist_find_first_match(&ep->rx_cq->unexp_list,
+					   rxd_unexp_pkt_match, ctrl))
+			goto repost;
+		if (rxd_ep_enqueue_pkt(ep, ctrl, comp))
+			goto repost;
 		goto out;
 	}
 
@@ -1104,6 +1278,9 @@ void rxd_handle_start_data(struct rxd_ep *ep, struct rxd_peer *peer,
 		rxd_av_get_fi_addr(ep->av, ctrl->conn_id) : FI_ADDR_UNSPEC;
 	rx_entry->window = 1;
 	rx_entry->last_win_seg = 1;
+	rx_entry->acked_seg_no = 0;
+	rx_entry->sack = 0;
+	rx_entry->nack_stamp = 0;
 
 	FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "Assign rx_entry :%d for  %p\n",
 	       rx_entry->key, rx_entry->msg_id);
@@ -1115,6 +1292,12 @@ void rxd_handle_start_data(struct rxd_ep *ep, struct rxd_peer *peer,
 	else if (ret == -FI_ENOENT) {
 		peer->exp_msg_id++;
 
+		/* the rx_entry holds the buffer now, so only drop the queue entry */
+		if (comp->flags & RXD_UNEXP_ENTRY) {
+			rxd_release_unexp_entry(ep->rx_cq, comp);
+			ep->num_unexp_pkt--;
+		}
+
 		/* reply ack, with win_sz = 0 */
 		FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "Sending wait-ACK [%p] - %d\n",
 			ctrl->msg_id, ctrl->seg_no);
@@ -1169,11 +1352,11 @@ void rxd_handle_recv_comp(struct rxd_cq *cq, struct fi_cq_msg_entry *comp,
 		break;
 
 	case ofi_ctrl_ack:
-		rxd_handle_ack(ep, ctrl, rx_buf);
+		rxd_handle_ack(ep, ctrl, comp, rx_buf);
 		break;
 
 	case ofi_ctrl_nack:
-		rxd_handle_nack(ep, ctrl, rx_buf);
+		rxd_handle_nack(ep, ctrl, comp, rx_buf);
 		break;
 
 	case ofi_ctrl_discard:
@@ -1214,34 +1397,70 @@ static inline void rxd_handle_send_comp(struct fi_cq_msg_entry *comp)
 
 	FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "Send completion for: %p\n", pkt_meta);
 	rxd_ep_lock_if_required(pkt_meta->ep);
-	RXD_PKT_MARK_LOCAL_ACK(pkt_meta);
+	if (pkt_meta->resends)
+		pkt_meta->resends--;
+	else
+		RXD_PKT_MARK_LOCAL_ACK(pkt_meta);
 	rxd_tx_pkt_release(pkt_meta);
 	rxd_ep_unlock_if_required(pkt_meta->ep);
 }
 
-void rxd_cq_progress(struct util_cq *util_cq)
+/*
+ * A failed send is handled as a lost datagram, left to the retransmit
+ * timer.  A failed receive just gives its buffer back.
+ */
+static int rxd_cq_read_error(struct rxd_cq *cq)
 {
-	ssize_t ret = 0;
-	struct rxd_cq *cq;
+	struct fi_cq_err_entry err_entry;
 	struct fi_cq_msg_entry cq_entry;
+	struct rxd_rx_buf *rx_buf;
+	ssize_t ret;
+
+	memset(&err_entry, 0, sizeof(err_entry));
+	OFI_CQ_READERR(&rxd_prov, FI_LOG_CQ, cq->dg_cq, ret, err_entry);
+	if (ret < 0) {
+		FI_WARN(&rxd_prov, FI_LOG_CQ,
+			"Unable to fi_cq_readerr on dg cq\n");
+		return (int) ret;
+	}
+
+	if (err_entry.flags & FI_SEND) {
+		cq_entry.op_context = err_entry.op_context;
+		rxd_handle_send_comp(&cq_entry);
+	} else if (err_entry.flags & FI_RECV) {
+		rx_buf = container_of(err_entry.op_context,
+				      struct rxd_rx_buf, context);
+		rxd_ep_lock_if_required(rx_buf->ep);
+		rxd_ep_repost_buff(rx_buf);
+		rxd_ep_unlock_if_required(rx_buf->ep);
+	}
+	return 0;
+}
+
+static void rxd_cq_drain(struct rxd_cq *cq)
+{
+	ssize_t ret, i;
+	struct fi_cq_msg_entry cq_entry[RXD_CQ_BATCH_MAX];
 	struct dlist_entry *item, *next;
 	struct rxd_unexp_cq_entry *unexp;
 
-	cq = container_of(util_cq, struct rxd_cq, util_cq);
-	fastlock_acquire(&cq->lock);
-
 	do {
-		ret = fi_cq_read(cq->dg_cq, &cq_entry, 1);
-		if (ret == -FI_EAGAIN)
-			break;
-
-		if (cq_entry.flags & FI_SEND) {
-			rxd_handle_send_comp(&cq_entry);
-		} else if (cq_entry.flags & FI_RECV) {
-			rxd_handle_recv_comp(cq, &cq_entry, 0);
-		} else
-			assert (0);
-	} while (ret > 0);
+		ret = fi_cq_read(cq->dg_cq, cq_entry, rxd_cq_batch);
+		if (ret == -FI_EAVAIL) {
+			if (rxd_cq_read_error(cq))
+				break;
+			continue;
+		}
+
+		for (i = 0; i < ret; i++) {
+			if (cq_entry[i].flags & FI_SEND) {
+				rxd_handle_send_comp(&cq_entry[i]);
+			} else if (cq_entry[i].flags & FI_RECV) {
+				rxd_handle_recv_comp(cq, &cq_entry[i], 0);
+			} else
+				assert (0);
+		}
+	} while (ret == rxd_cq_batch || ret == -FI_EAVAIL);
 
 	for (item = cq->unexp_list.next; item != &cq->unexp_list;) {
 		unexp = container_of(item, struct rxd_unexp_cq_entry, entry);
@@ -1249,8 +1468,37 @@ void rxd_cq_progress(struct util_cq *util_cq)
 		rxd_handle_recv_comp(cq, &unexp->cq_entry, 1);
 		item = next;
 	}
+}
+
+/* Called by the progress thread, which skips a CQ another thread holds */
+int rxd_cq_progress_try(struct rxd_cq *cq)
+{
+	if (fastlock_tryacquire(&cq->lock))
+		return -FI_EAGAIN;
 
+	rxd_cq_drain(cq);
 	fastlock_release(&cq->lock);
+	return 0;
+}
+
+void rxd_cq_progress(struct util_cq *util_cq)
+{
+	struct rxd_cq *cq;
+	struct dlist_entry *item;
+	struct fid_list_entry *fid_entry;
+
+	cq = container_of(util_cq, struct rxd_cq, util_cq);
+	fastlock_acquire(&cq->lock);
+	rxd_cq_drain(cq);
+	fastlock_release(&cq->lock);
+
+	/* run due timers, so reading the CQ alone keeps transfers moving */
+	fastlock_acquire(&util_cq->ep_list_lock);
+	dlist_foreach(&util_cq->ep_list, item) {
+		fid_entry = container_of(item, struct fid_list_entry, entry);
+		rxd_ep_progress(container_of(fid_entry->fid, struct rxd_ep, ep.fid));
+	}
+	fastlock_release(&util_cq->ep_list_lock);
 }
 
 static int rxd_cq_close(struct fid *fid)
@@ -1302,6 +1550,7 @@ int rxd_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 	int ret;
 	struct rxd_cq *cq;
 	struct rxd_domain *rxd_domain;
+	struct fi_cq_attr dg_attr;
 
 	cq = calloc(1, sizeof(*cq));
 	if (!cq)
@@ -1336,8 +1585,14 @@ int rxd_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 	}
 
 	rxd_domain = container_of(domain, struct rxd_domain, util_domain.domain_fid);
-	attr->format = FI_CQ_FORMAT_MSG;
-	ret = fi_cq_open(rxd_domain->dg_domain, attr, &cq->dg_cq, context);
+	dg_attr = *attr;
+	dg_attr.format = FI_CQ_FORMAT_MSG;
+	if (rxd_domain->dg_wait) {
+		dg_attr.wait_obj = FI_WAIT_SET;
+		dg_attr.wait_set = rxd_domain->dg_wait;
+		dg_attr.wait_cond = FI_CQ_COND_NONE;
+	}
+	ret = fi_cq_open(rxd_domain->dg_domain, &dg_attr, &cq->dg_cq, context);
 	if (ret)
 		goto err2;
 
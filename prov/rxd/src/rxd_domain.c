@@ -32,7 +32,9 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include "rxd.h"
 
@@ -49,6 +51,63 @@ static struct fi_ops_domain rxd_domain_ops = {
 	.srx_ctx = fi_no_srx_context,
 };
 
+/*
+ * The progress thread sleeps on an epoll set holding the wait set of the
+ * core CQs, plus a signal to stop it.  Without a pollable wait set it
+ * falls back to polling.
+ */
+static int rxd_domain_open_wait(struct rxd_domain *domain)
+{
+	struct fi_wait_attr wait_attr;
+	int ret, fd;
+
+	ret = fd_signal_init(&domain->signal);
+	if (ret)
+		return ret;
+
+	ret = fi_epoll_create(&domain->epoll_fd);
+	if (ret)
+		goto err1;
+
+	ret = fi_epoll_add(domain->epoll_fd, domain->signal.fd[FI_READ_FD], NULL);
+	if (ret)
+		goto err2;
+
+	memset(&wait_attr, 0, sizeof wait_attr);
+	wait_attr.wait_obj = FI_WAIT_FD;
+	ret = fi_wait_open(domain->dg_fabric, &wait_attr, &domain->dg_wait);
+	if (ret) {
+		FI_INFO(&rxd_prov, FI_LOG_DOMAIN,
+			"core provider has no wait set, polling for progress\n");
+		domain->dg_wait = NULL;
+		return 0;
+	}
+
+	ret = fi_control(&domain->dg_wait->fid, FI_GETWAIT, &fd);
+	if (!ret)
+		ret = fi_epoll_add(domain->epoll_fd, fd, NULL);
+	if (ret) {
+		FI_INFO(&rxd_prov, FI_LOG_DOMAIN,
+			"core wait set is not pollable, polling for progress\n");
+		fi_close(&domain->dg_wait->fid);
+		domain->dg_wait = NULL;
+	}
+	return 0;
+err2:
+	fi_epoll_close(domain->epoll_fd);
+err1:
+	fd_signal_free(&domain->signal);
+	return ret;
+}
+
+static void rxd_domain_close_wait(struct rxd_domain *domain)
+{
+	if (domain->dg_wait)
+		fi_close(&domain->dg_wait->fid);
+	fi_epoll_close(domain->epoll_fd);
+	fd_signal_free(&domain->signal);
+}
+
 static int rxd_domain_close(fid_t fid)
 {
 	int ret;
@@ -66,7 +125,9 @@ static int rxd_domain_close(fid_t fid)
 
 	ofi_mr_map_close(&rxd_domain->mr_map);
 	rxd_domain->do_progress = 0;
+	fd_signal_set(&rxd_domain->signal);
 	pthread_join(rxd_domain->progress_thread, NULL);
+	rxd_domain_close_wait(rxd_domain);
 	fastlock_destroy(&rxd_domain->lock);
 	fastlock_destroy(&rxd_domain->mr_lock);
 	free(rxd_domain);
@@ -81,25 +142,89 @@ static struct fi_ops rxd_domain_fi_ops = {
 	.ops_open = fi_no_ops_open,
 };
 
+/*
+ * Milliseconds the progress thread may sleep before the next timer is due,
+ * or 0 to keep polling.  Deadlines closer than the resolution of the wait
+ * are polled for.
+ */
+static int rxd_progress_timeout(struct rxd_domain *domain, uint64_t next)
+{
+	uint64_t now;
+
+	if (!domain->dg_wait)
+		return 0;
+
+	if (next == UINT64_MAX)
+		return -1;
+
+	now = fi_gettime_us();
+	return (next < now + 1000) ? 0 : (int) MIN((next - now) / 1000, INT_MAX);
+}
+
+/*
+ * Sleep until the core CQs have completions, a timer is armed, or the
+ * timeout passes.  Sends complete on the core CQs, so new posts wake the
+ * thread as well.  The thread that woke us usually still holds the
+ * endpoint lock, so give it the CPU back before taking the lock.
+ */
+static void rxd_progress_wait(struct rxd_domain *domain, int timeout)
+{
+	struct fid *fids[1];
+
+	fids[0] = &domain->dg_wait->fid;
+	if (!domain->do_progress || fi_trywait(domain->dg_fabric, fids, 1))
+		return;
+
+	fi_epoll_wait(domain->epoll_fd, timeout);
+	sched_yield();
+}
+
 void *rxd_progress(void *arg)
 {
 	struct rxd_cq *cq;
 	struct rxd_ep *ep;
 	struct dlist_entry *item;
 	struct rxd_domain *domain = arg;
+	uint64_t next;
+	int timeout, busy;
 
 	while(domain->do_progress) {
+		next = UINT64_MAX;
+		busy = 0;
 		fastlock_acquire(&domain->lock);
 		dlist_foreach(&domain->cq_list, item) {
 			cq = container_of(item, struct rxd_cq, dom_entry);
-			rxd_cq_progress(&cq->util_cq);
+			if (rxd_cq_progress_try(cq))
+				busy = 1;
 		}
 
 		dlist_foreach(&domain->ep_list, item) {
 			ep = container_of(item, struct rxd_ep, dom_entry);
-			rxd_ep_progress(ep);
+			next = MIN(next, rxd_ep_progress(ep));
 		}
 		fastlock_release(&domain->lock);
+
+		timeout = rxd_progress_timeout(domain, next);
+		if (!timeout) {
+			domain->sleeping = 0;
+			/*
+			 * The locks spin: let an application thread that
+			 * holds one run, rather than spin against it.
+			 */
+			if (busy || !next)
+				sched_yield();
+		} else if (!domain->sleeping) {
+			/*
+			 * Announce the sleep, then make one more pass, so a
+			 * timer armed meanwhile either shows up in that pass
+			 * or signals the thread.
+			 */
+			fd_signal_reset(&domain->signal);
+			domain->sleeping = 1;
+		} else {
+			rxd_progress_wait(domain, timeout);
+			domain->sleeping = 0;
+		}
 	}
 	return NULL;
 }
@@ -119,9 +244,9 @@ static int rxd_mr_close(struct fid *fid)
 	mr = container_of(fid, struct rxd_mr_entry, mr_fid.fid);
 	dom = mr->domain;
 
-	fastlock_acquire(&dom->lock);
+	fastlock_acquire(&dom->mr_lock);
 	err = ofi_mr_remove(&dom->mr_map, mr->key);
-	fastlock_release(&dom->lock);
+	fastlock_release(&dom->mr_lock);
 	if (err)
 		return err;
 
@@ -257,6 +382,7 @@ int rxd_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 	if (ret)
 		goto err2;
 
+	rxd_domain->dg_fabric = rxd_fabric->dg_fabric;
 	rxd_domain->max_mtu_sz = dg_info->ep_attr->max_msg_size;
 	rxd_domain->dg_mode = dg_info->mode;
 	rxd_domain->addrlen = (info->src_addr) ? info->src_addrlen :
@@ -277,10 +403,15 @@ int rxd_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 	if (ret)
 		goto err4;
 
+	ret = rxd_domain_open_wait(rxd_domain);
+	if (ret)
+		goto err5;
+
 	rxd_domain->do_progress = 1;
 	if (pthread_create(&rxd_domain->progress_thread, NULL,
 			   rxd_progress, rxd_domain)) {
-		goto err5;
+		ret = -FI_ENOMEM;
+		goto err6;
 	}
 
 	*domain = &rxd_domain->util_domain.domain_fid;
@@ -289,6 +420,8 @@ int rxd_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 	(*domain)->mr = &rxd_mr_ops;
 	fi_freeinfo(dg_info);
 	return 0;
+err6:
+	rxd_domain_close_wait(rxd_domain);
 err5:
 	ofi_mr_map_close(&rxd_domain->mr_map);
 err4:
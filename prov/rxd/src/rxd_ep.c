@@ -259,6 +259,108 @@ struct rxd_peer *rxd_ep_getpeer_info(struct rxd_ep *ep, fi_addr_t addr)
 	return &ep->peer_info[addr];
 }
 
+static void rxd_peer_init(struct rxd_peer *peer)
+{
+	peer->cwnd = RXD_INIT_CWND;
+	peer->ssthresh = RXD_MAX_CWND;
+	peer->rto = RXD_RETRY_TIMEOUT;
+}
+
+/* Smoothed RTT and retransmit timeout, as in RFC 6298 */
+void rxd_peer_rtt_sample(struct rxd_peer *peer, uint64_t rtt)
+{
+	uint64_t delta;
+
+	if (!peer->srtt) {
+		peer->srtt = rtt;
+		peer->rttvar = rtt / 2;
+	} else {
+		delta = (rtt > peer->srtt) ? rtt - peer->srtt : peer->srtt - rtt;
+		peer->rttvar = (3 * peer->rttvar + delta) / 4;
+		peer->srtt = (7 * peer->srtt + rtt) / 8;
+	}
+	peer->rto = MIN(MAX(peer->srtt + 4 * peer->rttvar, RXD_MIN_RTO),
+			RXD_MAX_RTO);
+}
+
+/* Slow start up to ssthresh, then grow by one segment per window */
+void rxd_peer_cong_ack(struct rxd_peer *peer, int acked)
+{
+	if (peer->cwnd < peer->ssthresh) {
+		peer->cwnd = MIN(peer->cwnd + acked, RXD_MAX_CWND);
+		return;
+	}
+
+	peer->cwnd_cnt += acked;
+	if (peer->cwnd_cnt >= peer->cwnd) {
+		peer->cwnd_cnt -= peer->cwnd;
+		if (peer->cwnd < RXD_MAX_CWND)
+			peer->cwnd++;
+	}
+}
+
+/* Halve the window, at most once per round trip */
+static void rxd_peer_cong_loss(struct rxd_peer *peer, uint64_t curr_stamp)
+{
+	if (curr_stamp - peer->loss_stamp < (peer->srtt ? peer->srtt : peer->rto))
+		return;
+
+	peer->loss_stamp = curr_stamp;
+	peer->ssthresh = MAX(peer->cwnd / 2, RXD_MIN_CWND);
+	peer->cwnd = peer->ssthresh;
+	peer->cwnd_cnt = 0;
+}
+
+/* back off exponentially with the number of retries */
+static uint64_t rxd_pkt_rto(struct rxd_peer *peer, struct rxd_pkt_meta *pkt)
+{
+	return (((uint64_t) 1) << MIN(pkt->retries + 1, RXD_MAX_BACKOFF)) *
+	       peer->rto;
+}
+
+static int rxd_pkt_timed_out(struct rxd_peer *peer, struct rxd_pkt_meta *pkt,
+			     uint64_t curr_stamp)
+{
+	return curr_stamp > pkt->us_stamp &&
+	       curr_stamp - pkt->us_stamp > rxd_pkt_rto(peer, pkt);
+}
+
+static void rxd_pkt_set_timer(struct rxd_ep *ep, struct rxd_peer *peer,
+			      struct rxd_pkt_meta *pkt)
+{
+	rxd_ep_set_timer(ep, &pkt->timer,
+			 pkt->us_stamp + rxd_pkt_rto(peer, pkt));
+}
+
+static void rxd_pkt_timeout(struct ofi_timer_wheel *wheel,
+			    struct ofi_timer *timer)
+{
+	struct rxd_pkt_meta *pkt;
+	struct rxd_tx_entry *tx_entry;
+	struct ofi_ctrl_hdr *ctrl;
+	struct rxd_peer *peer;
+
+	pkt = container_of(timer, struct rxd_pkt_meta, timer);
+	tx_entry = pkt->tx_entry;
+	peer = rxd_ep_getpeer_info(pkt->ep, tx_entry->peer);
+
+	/*
+	 * The receiver already holds sacked segments; only the oldest one
+	 * is resent, to recover a lost ack.
+	 */
+	if (pkt->sacked && &pkt->entry != tx_entry->pkt_list.next) {
+		ofi_timer_set(wheel, timer,
+			      wheel->now_us + rxd_pkt_rto(peer, pkt));
+		return;
+	}
+
+	ctrl = (struct ofi_ctrl_hdr *) pkt->pkt_data;
+	if (tx_entry->op_type != RXD_TX_CONN && ctrl->seg_no)
+		rxd_peer_cong_loss(peer, wheel->now_us);
+
+	rxd_ep_retry_pkt(pkt->ep, tx_entry, pkt);
+}
+
 void rxd_ep_lock_if_required(struct rxd_ep *ep)
 {
 	/* todo: do locking based on threading model */
@@ -327,7 +429,10 @@ struct rxd_pkt_meta *rxd_tx_pkt_acquire(struct rxd_ep *ep)
 
 	FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "Acquired tx pkt: %p\n", pkt_meta);
 	pkt_meta->ep = ep;
+	ofi_timer_init(&pkt_meta->timer, rxd_pkt_timeout);
 	pkt_meta->retries = 0;
+	pkt_meta->sacked = 0;
+	pkt_meta->resends = 0;
 	pkt_meta->mr = (struct fid_mr *) mr;
 	pkt_meta->ref = 0;
 	return pkt_meta;
@@ -377,10 +482,13 @@ static uint64_t rxd_ep_copy_data(struct rxd_tx_entry *tx_entry,
 ssize_t rxd_ep_post_data_msg(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry)
 {
 	int ret;
-	uint64_t data_sz, done;
+	uint64_t data_sz, done, flags;
 	struct rxd_pkt_meta *pkt_meta;
 	struct rxd_pkt_data *pkt;
 	struct rxd_peer *peer;
+	struct fi_msg msg;
+	struct iovec iov;
+	void *desc;
 
 	peer = rxd_ep_getpeer_info(ep, tx_entry->peer);
 	pkt_meta = rxd_tx_pkt_acquire(ep);
@@ -399,8 +507,25 @@ ssize_t rxd_ep_post_data_msg(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry)
 		RXD_PKT_LAST : RXD_PKT_DATA;
 	pkt_meta->us_stamp = fi_gettime_us();
 
-	ret = fi_send(ep->dg_ep, pkt, data_sz + RXD_DATA_PKT_SZ,
-		      rxd_mr_desc(pkt_meta->mr, ep), tx_entry->peer, &pkt_meta->context);
+	/*
+	 * Let the datagram provider hold segments back while more of the
+	 * window follows, so it can send them together.
+	 */
+	flags = (tx_entry->win_sz > 1 &&
+		 peer->num_unacked + 1 < peer->cwnd &&
+		 pkt_meta->type == RXD_PKT_DATA) ? FI_MORE : 0;
+
+	iov.iov_base = pkt;
+	iov.iov_len = data_sz + RXD_DATA_PKT_SZ;
+	desc = rxd_mr_desc(pkt_meta->mr, ep);
+	msg.msg_iov = &iov;
+	msg.desc = &desc;
+	msg.iov_count = 1;
+	msg.addr = tx_entry->peer;
+	msg.context = &pkt_meta->context;
+	msg.data = 0;
+
+	ret = fi_sendmsg(ep->dg_ep, &msg, flags);
 	if (ret) {
 		FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "send %d failed\n", pkt->ctrl.seg_no);
 		util_buf_release(ep->tx_pkt_pool, pkt_meta);
@@ -413,18 +538,22 @@ ssize_t rxd_ep_post_data_msg(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry)
 	tx_entry->win_sz--;
 	tx_entry->nxt_seg_no++;
 	tx_entry->num_unacked++;
+	peer->num_unacked++;
 
 	dlist_insert_tail(&pkt_meta->entry, &tx_entry->pkt_list);
+	rxd_pkt_set_timer(ep, peer, pkt_meta);
 	ep->num_out++;
 	return 0;
 }
 
-void rxd_ep_free_acked_pkts(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry,
-			  uint32_t seg_no)
+int rxd_ep_free_acked_pkts(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry,
+			   uint32_t seg_no)
 {
 	struct dlist_entry *next, *curr;
 	struct rxd_pkt_meta *pkt;
 	struct ofi_ctrl_hdr *ctrl;
+	struct rxd_peer *peer;
+	int acked = 0;
 
 	FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "freeing all [%p] pkts <= %d\n",
 		tx_entry->msg_id, seg_no);
@@ -436,33 +565,20 @@ void rxd_ep_free_acked_pkts(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry,
 			FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "freeing [%p] pkt:%d\n",
 				tx_entry->msg_id, ctrl->seg_no);
 			dlist_remove(curr);
+			ofi_timer_cancel(&ep->timers, &pkt->timer);
 			RXD_PKT_MARK_REMOTE_ACK(pkt);
 			rxd_tx_pkt_release(pkt);
 			tx_entry->num_unacked--;
+			acked++;
 		} else {
 			break;
 		}
 		curr = next;
 	}
-}
 
-void rxd_tx_entry_update_ts(struct rxd_tx_entry *tx_entry, uint32_t seg_no)
-{
-	struct dlist_entry *curr;
-	struct rxd_pkt_meta *pkt;
-	struct ofi_ctrl_hdr *ctrl;
-
-	for (curr = tx_entry->pkt_list.next; curr != &tx_entry->pkt_list;
-	     curr = curr->next) {
-		pkt = container_of(curr, struct rxd_pkt_meta, entry);
-		ctrl = (struct ofi_ctrl_hdr *) pkt->pkt_data;
-		if (ctrl->seg_no == seg_no) {
-			FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "updating TS of [%p] pkt:%d\n",
-				tx_entry->msg_id, seg_no);
-			pkt->us_stamp += RXD_WAIT_TIMEOUT;
-			break;
-		}
-	}
+	peer = rxd_ep_getpeer_info(ep, tx_entry->peer);
+	peer->num_unacked -= acked;
+	return acked;
 }
 
 int rxd_progress_tx(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry)
@@ -496,8 +612,10 @@ void rxd_resend_pkt(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry,
 	struct dlist_entry *pkt_item;
 	struct rxd_pkt_meta *pkt;
 	struct ofi_ctrl_hdr *ctrl;
+	struct rxd_peer *peer;
 	uint64_t curr_stamp = fi_gettime_us();
 
+	peer = rxd_ep_getpeer_info(ep, tx_entry->peer);
 	dlist_foreach(&tx_entry->pkt_list, pkt_item) {
 		pkt = container_of(pkt_item, struct rxd_pkt_meta, entry);
 		ctrl = (struct ofi_ctrl_hdr *)pkt->pkt_data;
@@ -506,49 +624,109 @@ void rxd_resend_pkt(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry,
 			ctrl->seg_no, ctrl->msg_id);
 
 		if (ctrl->seg_no == seg_no) {
-
-			if (curr_stamp < pkt->us_stamp ||
-			    (curr_stamp - pkt->us_stamp) <
-			    (((uint64_t) 1) << ((uint64_t) pkt->retries + 1)) *
-			     RXD_RETRY_TIMEOUT) {
+			if (!rxd_pkt_timed_out(peer, pkt, curr_stamp))
 				break;
-			}
 
 			FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "resending pkt %d, %p\n",
 				ctrl->seg_no, ctrl->msg_id);
 
-			pkt->us_stamp = fi_gettime_us();
 			rxd_ep_retry_pkt(ep, tx_entry, pkt);
 			break;
 		}
 	}
 }
 
+/*
+ * Mark the segments the receiver holds out of order, and resend the holes
+ * below the highest of them.  A hole is resent at once the first time, and
+ * after that at most once per RTT.
+ */
+static void rxd_tx_entry_sack(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry,
+			      struct rxd_peer *peer,
+			      struct rxd_ack_data *ack_data)
+{
+	struct dlist_entry *pkt_item;
+	struct rxd_pkt_meta *pkt;
+	struct ofi_ctrl_hdr *ctrl;
+	uint64_t curr_stamp, bit;
+	uint32_t off, top;
+
+	for (top = 0; top < 64 && (ack_data->sack >> top); top++)
+		;
+
+	curr_stamp = fi_gettime_us();
+	dlist_foreach(&tx_entry->pkt_list, pkt_item) {
+		pkt = container_of(pkt_item, struct rxd_pkt_meta, entry);
+		ctrl = (struct ofi_ctrl_hdr *) pkt->pkt_data;
+		if (ctrl->seg_no < ack_data->exp_seg_no)
+			continue;
+
+		off = ctrl->seg_no - ack_data->exp_seg_no;
+		if (off > top)
+			break;
+
+		bit = off ? ack_data->sack & (1ULL << (off - 1)) : 0;
+		if (bit) {
+			pkt->sacked = 1;
+			continue;
+		}
+
+		if (pkt->retries && (curr_stamp < pkt->us_stamp ||
+		    curr_stamp - pkt->us_stamp < MAX(peer->srtt, RXD_MIN_RTO / 2)))
+			continue;
+
+		FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "resending hole %d, %p\n",
+			ctrl->seg_no, ctrl->msg_id);
+		rxd_ep_retry_pkt(ep, tx_entry, pkt);
+	}
+}
+
 int rxd_tx_entry_progress(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry,
-			   struct ofi_ctrl_hdr *ack)
+			   struct ofi_ctrl_hdr *ack, struct rxd_ack_data *ack_data)
 {
+	struct rxd_peer *peer;
+	int acked;
+
+	peer = rxd_ep_getpeer_info(ep, tx_entry->peer);
 	if (ack) {
 		tx_entry->rx_key = ack->rx_key;
-		tx_entry->win_sz += ack->seg_size;
+		if (ack_data) {
+			/* acks may be reordered; the window never shrinks */
+			if (ack_data->win_end > tx_entry->win_end)
+				tx_entry->win_end = ack_data->win_end;
+			tx_entry->win_sz = (tx_entry->win_end > tx_entry->nxt_seg_no) ?
+				tx_entry->win_end - tx_entry->nxt_seg_no : 0;
+		} else {
+			tx_entry->win_sz += ack->seg_size;
+		}
 
 		FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "tx: %p [%p] - avail_win: %d\n",
-			tx_entry, ack->msg_id, ack->seg_size);
+			tx_entry, ack->msg_id, tx_entry->win_sz);
 
 		if (ack->type == ofi_ctrl_nack) {
 			FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "got NACK for %d, %p\n",
 				ack->seg_no, ack->msg_id);
 			if (ack->seg_no > 0)
 				rxd_ep_free_acked_pkts(ep, tx_entry, ack->seg_no - 1);
-			rxd_resend_pkt(ep, tx_entry, ack->seg_no);
+			rxd_peer_cong_loss(peer, fi_gettime_us());
+			if (ack_data)
+				rxd_tx_entry_sack(ep, tx_entry, peer, ack_data);
+			else
+				rxd_resend_pkt(ep, tx_entry, ack->seg_no);
 		} else {
 			FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "got ACK for %d, %p\n",
 			       ack->seg_no, ack->msg_id);
 
-			rxd_ep_free_acked_pkts(ep, tx_entry, ack->seg_no);
-			if (ack->seg_size == 0 &&
+			acked = rxd_ep_free_acked_pkts(ep, tx_entry, ack->seg_no);
+			rxd_peer_cong_ack(peer, acked);
+			if (ack_data && ack_data->sack)
+				rxd_tx_entry_sack(ep, tx_entry, peer, ack_data);
+
+			if ((ack_data ? !tx_entry->win_sz : !ack->seg_size) &&
 			    tx_entry->done != tx_entry->op_hdr.size) {
 				tx_entry->is_waiting = 1;
-				tx_entry->retry_stamp = fi_gettime_us();
+				rxd_ep_set_timer(ep, &tx_entry->timer,
+						 fi_gettime_us() + RXD_WAIT_TIMEOUT);
 				FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
 					"Marking [%p] as waiting\n", tx_entry->msg_id);
 			}
@@ -558,14 +736,67 @@ int rxd_tx_entry_progress(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry,
 	FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "tx: %p [%p] - num_unacked: %d\n",
 		tx_entry, tx_entry->msg_id, tx_entry->num_unacked);
 
-	while (tx_entry->win_sz && tx_entry->num_unacked < RXD_MAX_UNACKED &&
+	while (tx_entry->win_sz && peer->num_unacked < peer->cwnd &&
 	       tx_entry->done != tx_entry->op_hdr.size) {
-		if (rxd_progress_tx(ep, tx_entry))
+		if (rxd_progress_tx(ep, tx_entry)) {
+			/* try again on the next tick */
+			rxd_ep_set_timer(ep, &tx_entry->timer, 0);
 			break;
+		}
 	}
 	return 0;
 }
 
+/*
+ * A sender told to wait probes the receiver with a single segment once its
+ * outstanding segments are acked.  The timer is also used to retry sends
+ * that the datagram endpoint could not take.
+ */
+static void rxd_tx_entry_timeout(struct ofi_timer_wheel *wheel,
+				 struct ofi_timer *timer)
+{
+	struct rxd_tx_entry *tx_entry;
+	struct rxd_ep *ep;
+
+	tx_entry = container_of(timer, struct rxd_tx_entry, timer);
+	ep = container_of(wheel, struct rxd_ep, timers);
+	if (tx_entry->is_waiting && !tx_entry->win_sz) {
+		if (!dlist_empty(&tx_entry->pkt_list)) {
+			ofi_timer_set(wheel, timer, wheel->now_us + RXD_MIN_RTO);
+			return;
+		}
+
+		tx_entry->win_sz = 1;
+		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "Progressing waiting entry [%p]\n",
+			tx_entry->msg_id);
+	}
+
+	tx_entry->is_waiting = 0;
+	rxd_tx_entry_progress(ep, tx_entry, NULL, NULL);
+}
+
+/*
+ * An ack opens the congestion window for every message to that peer, so
+ * restart the ones that stopped on it rather than wait for the progress
+ * thread.
+ */
+void rxd_ep_progress_peer(struct rxd_ep *ep, fi_addr_t addr)
+{
+	struct dlist_entry *item;
+	struct rxd_tx_entry *tx_entry;
+	struct rxd_peer *peer;
+
+	peer = rxd_ep_getpeer_info(ep, addr);
+	dlist_foreach(&ep->tx_entry_list, item) {
+		if (peer->num_unacked >= peer->cwnd)
+			break;
+
+		tx_entry = container_of(item, struct rxd_tx_entry, entry);
+		if (tx_entry->peer == addr && tx_entry->win_sz)
+			rxd_tx_entry_progress(ep, tx_entry, NULL, NULL);
+	}
+}
+
 int rxd_ep_reply_ack(struct rxd_ep *ep, struct ofi_ctrl_hdr *in_ctrl,
 		   uint8_t type, uint16_t seg_size, uint64_t rx_key,
 		   uint64_t source, fi_addr_t dest)
@@ -599,30 +830,48 @@ err:
 	return ret;
 }
 
-int rxd_ep_reply_nack(struct rxd_ep *ep, struct ofi_ctrl_hdr *in_ctrl,
-		    uint32_t seg_no, uint64_t rx_key,
-		    uint64_t source, fi_addr_t dest)
+/*
+ * Ack or nack the in-order prefix of a message, with the receive window and
+ * the segments held out of order.
+ */
+int rxd_ep_reply_rx_ack(struct rxd_ep *ep, struct rxd_rx_entry *rx_entry,
+			uint8_t type, uint16_t seg_size)
 {
 	ssize_t ret;
 	struct rxd_pkt_meta *pkt_meta;
 	struct rxd_pkt_data *pkt;
+	struct rxd_ack_data *ack_data;
+	uint32_t seg_no;
 
 	pkt_meta = rxd_tx_pkt_acquire(ep);
 	if (!pkt_meta)
 		return -FI_ENOMEM;
 
 	pkt = (struct rxd_pkt_data *)pkt_meta->pkt_data;
-	rxd_init_ctrl_hdr(&pkt->ctrl, ofi_ctrl_nack, 0, seg_no,
-			   in_ctrl->msg_id, rx_key, source);
+	seg_no = (type == ofi_ctrl_nack) ? rx_entry->exp_seg_no :
+		 rx_entry->exp_seg_no - 1;
+	rxd_init_ctrl_hdr(&pkt->ctrl, type, seg_size, seg_no, rx_entry->msg_id,
+			   rx_entry->key, rx_entry->peer_info->conn_data);
+
+	ack_data = (struct rxd_ack_data *) pkt->data;
+	ack_data->exp_seg_no = rx_entry->exp_seg_no;
+	ack_data->win_end = rx_entry->last_win_seg;
+	ack_data->sack = rx_entry->sack;
+
+	FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "sending %s [%p] - %d, %d\n",
+		type == ofi_ctrl_nack ? "nack" : "ack",
+		rx_entry->msg_id, seg_no, seg_size);
 
 	RXD_PKT_MARK_REMOTE_ACK(pkt_meta);
 	pkt_meta->us_stamp = fi_gettime_us();
-	ret = fi_send(ep->dg_ep, pkt, RXD_DATA_PKT_SZ,
+	ret = fi_send(ep->dg_ep, pkt, RXD_ACK_PKT_SZ,
 		      rxd_mr_desc(pkt_meta->mr, ep),
-		      dest, &pkt_meta->context);
+		      rx_entry->peer, &pkt_meta->context);
 	if (ret)
 		goto err;
 	ep->num_out++;
+	if (type == ofi_ctrl_ack)
+		rx_entry->acked_seg_no = rx_entry->exp_seg_no;
 	return 0;
 err:
 	util_buf_release(ep->tx_pkt_pool, pkt_meta);
@@ -774,6 +1023,7 @@ ssize_t rxd_ep_post_start_msg(struct rxd_ep *ep, struct rxd_peer *peer,
 	tx_entry->nxt_seg_no = 1;
 	tx_entry->op_hdr = pkt->op;
 	tx_entry->win_sz = 0;
+	tx_entry->win_end = 0;
 
 	pkt_meta->tx_entry = tx_entry;
 	pkt_meta->type = (tx_entry->op_hdr.size == tx_entry->done) ?
@@ -789,9 +1039,11 @@ ssize_t rxd_ep_post_start_msg(struct rxd_ep *ep, struct rxd_peer *peer,
 	FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "sent start %p, %d\n",
 		pkt->ctrl.msg_id, pkt->ctrl.seg_no);
 	dlist_insert_tail(&pkt_meta->entry, &tx_entry->pkt_list);
+	rxd_pkt_set_timer(ep, peer, pkt_meta);
 	peer->nxt_msg_id++;
 	ep->num_out++;
 	tx_entry->num_unacked++;
+	peer->num_unacked++;
 	return 0;
 err:
 	util_buf_release(ep->tx_pkt_pool, pkt_meta);
@@ -871,6 +1123,7 @@ ssize_t rxd_ep_post_conn_msg(struct rxd_ep *ep, struct rxd_peer *peer,
 	rxd_init_ctrl_hdr(&pkt->ctrl, ofi_ctrl_connreq, data_sz, 0,
 			   tx_entry->msg_id, ep->conn_data, addr);
 
+	pkt_meta->tx_entry = tx_entry;
 	pkt_meta->us_stamp = fi_gettime_us();
 	ret = fi_send(ep->dg_ep, pkt, data_sz + RXD_DATA_PKT_SZ,
 		      rxd_mr_desc(pkt_meta->mr, ep),
@@ -880,6 +1133,7 @@ ssize_t rxd_ep_post_conn_msg(struct rxd_ep *ep, struct rxd_peer *peer,
 
 	FI_DBG(&rxd_prov, FI_LOG_EP_CTRL, "sent conn %p\n", pkt->ctrl.msg_id);
 	dlist_insert_tail(&pkt_meta->entry, &tx_entry->pkt_list);
+	rxd_pkt_set_timer(ep, peer, pkt_meta);
 	dlist_insert_tail(&tx_entry->entry, &ep->tx_entry_list);
 	peer->nxt_msg_id++;
 	ep->num_out++;
@@ -903,6 +1157,7 @@ struct rxd_tx_entry *rxd_tx_entry_acquire_fast(struct rxd_ep *ep, struct rxd_pee
 	tx_entry = freestack_pop(ep->tx_entry_fs);
 	tx_entry->num_unacked = 0;
 	tx_entry->is_waiting = 0;
+	ofi_timer_init(&tx_entry->timer, rxd_tx_entry_timeout);
 	dlist_init(&tx_entry->entry);
 	return tx_entry;
 }
@@ -920,6 +1175,10 @@ void rxd_tx_entry_release(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry)
 	peer = rxd_ep_getpeer_info(ep, tx_entry->peer);
 	peer->num_msg_out--;
 	dlist_remove(&tx_entry->entry);
+	ofi_timer_cancel(&ep->timers, &tx_entry->timer);
+
+	/* late acks must not match a free entry */
+	tx_entry->msg_id = UINT64_MAX;
 	freestack_push(ep->tx_entry_fs, tx_entry);
 }
 
@@ -1470,14 +1729,22 @@ static int rxd_ep_close(struct fid *fid)
 		rxd_cq_progress(&ep->tx_cq->util_cq);
 	}
 
-	ret = fi_close(&ep->dg_ep->fid);
-	if (ret)
-		return ret;
-
+	/* stop progress before the datagram endpoint goes away */
 	fastlock_acquire(&ep->domain->lock);
 	dlist_remove(&ep->dom_entry);
 	fastlock_release(&ep->domain->lock);
 
+	if (ep->tx_cq)
+		fid_list_remove(&ep->tx_cq->util_cq.ep_list,
+				&ep->tx_cq->util_cq.ep_list_lock, &ep->ep.fid);
+	if (ep->rx_cq)
+		fid_list_remove(&ep->rx_cq->util_cq.ep_list,
+				&ep->rx_cq->util_cq.ep_list_lock, &ep->ep.fid);
+
+	ret = fi_close(&ep->dg_ep->fid);
+	if (ret)
+		return ret;
+
 	while(!slist_empty(&ep->rx_pkt_list)) {
 		entry = slist_remove_head(&ep->rx_pkt_list);
 		buf = container_of(entry, struct rxd_rx_buf, entry);
@@ -1521,6 +1788,11 @@ static int rxd_ep_bind_cq(struct rxd_ep *ep, struct rxd_cq *cq, uint64_t flags)
 			return ret;
 		}
 
+		ret = fid_list_insert(&cq->util_cq.ep_list,
+				      &cq->util_cq.ep_list_lock, &ep->ep.fid);
+		if (ret)
+			return ret;
+
 		ep->tx_cq = cq;
 		ofi_atomic_inc32(&cq->util_cq.ref);
 	}
@@ -1532,6 +1804,11 @@ static int rxd_ep_bind_cq(struct rxd_ep *ep, struct rxd_cq *cq, uint64_t flags)
 				return ret;
 		}
 
+		ret = fid_list_insert(&cq->util_cq.ep_list,
+				      &cq->util_cq.ep_list_lock, &ep->ep.fid);
+		if (ret)
+			return ret;
+
 		ep->rx_cq = cq;
 		ofi_atomic_inc32(&cq->util_cq.ref);
 	}
@@ -1542,6 +1819,7 @@ static int rxd_ep_bind(struct fid *ep_fid, struct fid *bfid, uint64_t flags)
 {
 	struct rxd_ep *ep;
 	struct rxd_av *av;
+	size_t i;
 	int ret = 0;
 
 	ep = container_of(ep_fid, struct rxd_ep, ep.fid);
@@ -1563,6 +1841,8 @@ static int rxd_ep_bind(struct fid *ep_fid, struct fid *bfid, uint64_t flags)
 		if (!ep->peer_info) {
 			return -FI_ENOMEM;
 		}
+		for (i = 0; i < ep->max_peers; i++)
+			rxd_peer_init(&ep->peer_info[i]);
 
 		ep->av = av;
 		break;
@@ -1769,6 +2049,7 @@ int rxd_endpoint(struct fid_domain *domain, struct fi_info *info,
 	dlist_init(&rxd_ep->unexp_msg_list);
 	dlist_init(&rxd_ep->unexp_tag_list);
 	slist_init(&rxd_ep->rx_pkt_list);
+	ofi_timer_wheel_init(&rxd_ep->timers, RXD_TIMER_TICK, fi_gettime_us());
 	fastlock_init(&rxd_ep->lock);
 
 	dlist_init(&rxd_ep->dom_entry);
@@ -1816,57 +2097,37 @@ int rxd_ep_retry_pkt(struct rxd_ep *ep, struct rxd_tx_entry *tx_entry,
 	if (ret != -FI_EAGAIN)
 		pkt->retries++;
 
+	/* the buffer stays in use until every send of it has completed */
+	if (!ret) {
+		if (pkt->ref & RXD_PKT_LOCAL_ACK)
+			pkt->ref &= ~RXD_PKT_LOCAL_ACK;
+		else
+			pkt->resends++;
+	}
+
 	if (ret && ret != -FI_EAGAIN) {
 		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "Pkt sent failed seg: %d, ret: %d\n",
 			ctrl->seg_no, ret);
 	}
 
+	pkt->us_stamp = fi_gettime_us();
+	rxd_pkt_set_timer(ep, rxd_ep_getpeer_info(ep, tx_entry->peer), pkt);
 	return ret;
 }
 
-void rxd_ep_progress(struct rxd_ep *ep)
+/*
+ * Returns the time the endpoint next needs progress, if nothing arrives.
+ * An endpoint that another thread holds is left to that thread.
+ */
+uint64_t rxd_ep_progress(struct rxd_ep *ep)
 {
-	struct dlist_entry *tx_item, *pkt_item;
-	struct rxd_tx_entry *tx_entry;
-	struct rxd_pkt_meta *pkt;
-	uint64_t curr_stamp;
-
-	rxd_ep_lock_if_required(ep);
-	curr_stamp = fi_gettime_us();
-	dlist_foreach(&ep->tx_entry_list, tx_item) {
-
-		tx_entry = container_of(tx_item, struct rxd_tx_entry, entry);
-
-		if (tx_entry->win_sz)
-			rxd_tx_entry_progress(ep, tx_entry, NULL);
-
-		else if (tx_entry->is_waiting &&
-			 (curr_stamp - tx_entry->retry_stamp > RXD_WAIT_TIMEOUT) &&
-			 dlist_empty(&tx_entry->pkt_list)) {
-			tx_entry->win_sz = 1;
-			tx_entry->is_waiting = 0;
-
-			FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "Progressing waiting entry [%p]\n",
-				tx_entry->msg_id);
+	uint64_t next;
 
-			rxd_tx_entry_progress(ep, tx_entry, NULL);
-			tx_entry->retry_stamp = fi_gettime_us();
-		}
+	if (fastlock_tryacquire(&ep->lock))
+		return 0;
 
-		dlist_foreach(&tx_entry->pkt_list, pkt_item) {
-			pkt = container_of(pkt_item, struct rxd_pkt_meta, entry);
-			/* TODO: This if check is repeated.  Create a function
-			 * to perform this check, and figure out what the check
-			 * is actually doing with the bit-shift, multiply operation.
-			 */
-			if (curr_stamp > pkt->us_stamp &&
-			    curr_stamp - pkt->us_stamp >
-			    (((uint64_t) 1) << ((uint64_t) pkt->retries + 1)) *
-			     RXD_RETRY_TIMEOUT) {
-				pkt->us_stamp = curr_stamp;
-				rxd_ep_retry_pkt(ep, tx_entry, pkt);
-			}
-		}
-	}
+	ofi_timer_wheel_run(&ep->timers, fi_gettime_us());
+	next = ofi_timer_wheel_next(&ep->timers);
 	rxd_ep_unlock_if_required(ep);
+	return next;
 }
@@ -64,6 +64,8 @@ static int rxd_getinfo(uint32_t version, const char *node, const char *service,
 			    hints, rxd_info_to_core, rxd_info_to_rxd, info);
 }
 
+int rxd_cq_batch = RXD_CQ_BATCH_DEF;
+
 static void rxd_fini(void)
 {
 	/* yawn */
@@ -80,5 +82,11 @@ struct fi_provider rxd_prov = {
 
 RXD_INI
 {
+	fi_param_define(&rxd_prov, "cq_batch", FI_PARAM_INT,
+			"Number of completions read from the datagram provider "
+			"CQ in one call (default: 16, max: 64)");
+	fi_param_get_int(&rxd_prov, "cq_batch", &rxd_cq_batch);
+	rxd_cq_batch = MIN(MAX(rxd_cq_batch, 1), RXD_CQ_BATCH_MAX);
+
 	return &rxd_prov;
 }
@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) 2017 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Loss test of rxd over udp.  Two endpoints in this process stream tagged
+ * messages of several sizes to each other, first over a clean loopback
+ * and then with datagrams dropped on the send path.  The drop is done by
+ * defining sendmsg() and sendmmsg() here, ahead of libc, so the pattern
+ * is the same on every run.  Every message must arrive intact, and the
+ * lossy run may only send a bounded number of extra bytes per byte dropped:
+ * selective acks resend the holes, not the whole window.
+ *
+ * The payload rate of both runs is printed.  An argument replaces the
+ * default loss of one datagram in DROP_ONE_IN.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include <rdma/fabric.h>
+#include <rdma/fi_domain.h>
+#include <rdma/fi_endpoint.h>
+#include <rdma/fi_cm.h>
+#include <rdma/fi_tagged.h>
+#include <rdma/fi_errno.h>
+
+#define NMSG		96
+#define WINDOW		8
+#define DROP_ONE_IN	25
+#define MAX_EXTRA	4	/* extra bytes sent per byte dropped */
+#define TIMEOUT		60
+
+static const size_t sizes[] = { 0, 1, 1000, 8000, 65536, 300000 };
+#define NSIZES		(sizeof(sizes) / sizeof(sizes[0]))
+
+struct side {
+	struct fid_ep	*ep;
+	struct fid_av	*av;
+	struct fid_cq	*cq;
+	fi_addr_t	peer;
+	char		*buf[NMSG];
+};
+
+static struct fi_info *info;
+static struct fid_fabric *fabric;
+static struct fid_domain *domain;
+static struct side tx, rx;
+static int errors;
+
+/* datagram accounting, shared with the send interposers below */
+static int drop_on, drop_one_in = DROP_ONE_IN;
+static uint64_t sent, dropped, lcg = 1;	/* in bytes */
+
+#define CHECK_RET(call)						\
+	do {							\
+		int _ret = (call);				\
+		if (_ret) {					\
+			fprintf(stderr, "%s: %s\n", #call,	\
+				fi_strerror(-_ret));		\
+			exit(EXIT_FAILURE);			\
+		}						\
+	} while (0)
+
+static size_t msg_len(const struct msghdr *msg)
+{
+	size_t i, len = 0;
+
+	for (i = 0; i < msg->msg_iovlen; i++)
+		len += msg->msg_iov[i].iov_len;
+	return len;
+}
+
+static int drop(int sock, const struct msghdr *msg)
+{
+	int type;
+	socklen_t len = sizeof(type);
+
+	if (getsockopt(sock, SOL_SOCKET, SO_TYPE, &type, &len) ||
+	    type != SOCK_DGRAM)
+		return 0;
+
+	sent += msg_len(msg);
+	if (!drop_on)
+		return 0;
+
+	lcg = lcg * 6364136223846793005ULL + 1442695040888963407ULL;
+	if ((lcg >> 33) % drop_one_in)
+		return 0;
+	dropped += msg_len(msg);
+	return 1;
+}
+
+__attribute__((visibility ("default")))
+ssize_t sendmsg(int sock, const struct msghdr *msg, int flags)
+{
+	if (drop(sock, msg))
+		return msg_len(msg);
+	return syscall(SYS_sendmsg, sock, msg, flags);
+}
+
+#if HAVE_SENDMMSG
+/* one datagram per call, so each is dropped on its own; callers loop */
+__attribute__((visibility ("default")))
+int sendmmsg(int sock, struct mmsghdr *msg, unsigned int cnt, int flags)
+{
+	if (!cnt)
+		return 0;
+	if (drop(sock, &msg[0].msg_hdr)) {
+		msg[0].msg_len = msg_len(&msg[0].msg_hdr);
+		return 1;
+	}
+	return syscall(SYS_sendmmsg, sock, msg, 1, flags);
+}
+#endif
+
+static void open_side(struct side *s)
+{
+	struct fi_av_attr av_attr = { .type = FI_AV_MAP };
+	struct fi_cq_attr cq_attr = { .format = FI_CQ_FORMAT_TAGGED };
+	int i;
+
+	CHECK_RET(fi_av_open(domain, &av_attr, &s->av, NULL));
+	CHECK_RET(fi_cq_open(domain, &cq_attr, &s->cq, NULL));
+	CHECK_RET(fi_endpoint(domain, info, &s->ep, NULL));
+	CHECK_RET(fi_ep_bind(s->ep, &s->av->fid, 0));
+	CHECK_RET(fi_ep_bind(s->ep, &s->cq->fid, FI_TRANSMIT | FI_RECV));
+	CHECK_RET(fi_enable(s->ep));
+
+	for (i = 0; i < NMSG; i++) {
+		s->buf[i] = malloc(sizes[NSIZES - 1]);
+		if (!s->buf[i]) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+static void close_side(struct side *s)
+{
+	int i;
+
+	fi_close(&s->ep->fid);
+	fi_close(&s->cq->fid);
+	fi_close(&s->av->fid);
+	for (i = 0; i < NMSG; i++)
+		free(s->buf[i]);
+}
+
+static void insert_peer(struct side *s, struct side *peer)
+{
+	char name[64];
+	size_t len = sizeof(name);
+
+	CHECK_RET(fi_getname(&peer->ep->fid, name, &len));
+	if (fi_av_insert(s->av, name, 1, &s->peer, 0, NULL) != 1) {
+		fprintf(stderr, "fi_av_insert failed\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void setup(void)
+{
+	struct fi_info *hints;
+
+	hints = fi_allocinfo();
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_TAGGED;
+	hints->fabric_attr->prov_name = strdup("UDP;ofi-rxd");
+	CHECK_RET(fi_getinfo(FI_VERSION(1, 5), "127.0.0.1", NULL, 0, hints,
+			     &info));
+	fi_freeinfo(hints);
+
+	CHECK_RET(fi_fabric(info->fabric_attr, &fabric, NULL));
+	CHECK_RET(fi_domain(fabric, info, &domain, NULL));
+	open_side(&tx);
+	open_side(&rx);
+	insert_peer(&tx, &rx);
+	insert_peer(&rx, &tx);
+}
+
+static void teardown(void)
+{
+	close_side(&tx);
+	close_side(&rx);
+	fi_close(&domain->fid);
+	fi_close(&fabric->fid);
+	fi_freeinfo(info);
+}
+
+static size_t size_of(int msg)
+{
+	return sizes[msg % NSIZES];
+}
+
+static void fill(char *buf, int msg, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (char) (msg * 31 + i * 7 + (i >> 12));
+}
+
+static void verify(const char *buf, int msg, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (buf[i] != (char) (msg * 31 + i * 7 + (i >> 12))) {
+			fprintf(stderr, "message %d: bad data at %zu of %zu\n",
+				msg, i, len);
+			errors++;
+			return;
+		}
+	}
+}
+
+static void post_send(int msg)
+{
+	char *buf = tx.buf[msg];
+	ssize_t ret;
+
+	fill(buf, msg, size_of(msg));
+	do {
+		ret = fi_tsend(tx.ep, buf, size_of(msg), NULL, tx.peer, msg,
+			       (void *) (uintptr_t) msg);
+		if (ret == -FI_EAGAIN)
+			fi_cq_read(tx.cq, NULL, 0);
+	} while (ret == -FI_EAGAIN);
+	CHECK_RET((int) ret);
+}
+
+static void post_recv(int msg)
+{
+	ssize_t ret;
+
+	do {
+		ret = fi_trecv(rx.ep, rx.buf[msg], size_of(msg), NULL,
+			       rx.peer, msg, 0, (void *) (uintptr_t) msg);
+		if (ret == -FI_EAGAIN)
+			fi_cq_read(rx.cq, NULL, 0);
+	} while (ret == -FI_EAGAIN);
+	CHECK_RET((int) ret);
+}
+
+/* returns the message index of a completion, or -1 if none is ready */
+static int poll_cq(struct fid_cq *cq)
+{
+	struct fi_cq_tagged_entry comp;
+	struct fi_cq_err_entry err;
+	ssize_t ret;
+
+	ret = fi_cq_read(cq, &comp, 1);
+	if (ret == 1)
+		return (int) (uintptr_t) comp.op_context;
+	if (ret == -FI_EAVAIL) {
+		fi_cq_readerr(cq, &err, 0);
+		fprintf(stderr, "completion error: %s\n", fi_strerror(err.err));
+		exit(EXIT_FAILURE);
+	}
+	if (ret != -FI_EAGAIN)
+		CHECK_RET((int) ret);
+	return -1;
+}
+
+/*
+ * Keep WINDOW messages in flight.  Messages to a peer are interleaved,
+ * so a short one may complete ahead of a long one posted before it.
+ */
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Returns the payload rate in MB/s */
+static double stream(void)
+{
+	int sends = 0, recvs = 0, send_done = 0, recv_done = 0, msg;
+	uint64_t bytes = 0, start;
+
+	for (msg = 0; msg < NMSG; msg++)
+		memset(rx.buf[msg], 0, size_of(msg));
+
+	start = now_ns();
+	while (sends < WINDOW && sends < NMSG) {
+		post_recv(recvs++);
+		post_send(sends++);
+	}
+
+	while (send_done < NMSG || recv_done < NMSG) {
+		msg = poll_cq(rx.cq);
+		if (msg >= 0) {
+			verify(rx.buf[msg], msg, size_of(msg));
+			bytes += size_of(msg);
+			recv_done++;
+			if (recvs < NMSG)
+				post_recv(recvs++);
+		}
+
+		msg = poll_cq(tx.cq);
+		if (msg >= 0) {
+			send_done++;
+			if (sends < NMSG)
+				post_send(sends++);
+		}
+	}
+	return bytes * 1e3 / (now_ns() - start);
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t clean, extra;
+	double clean_mbps, lossy_mbps;
+
+	if (argc > 1) {
+		drop_one_in = atoi(argv[1]);
+		if (drop_one_in < 2) {
+			fprintf(stderr, "usage: %s [drop one datagram in N, "
+				"N >= 2]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	alarm(TIMEOUT);
+	setup();
+
+	/* untimed, so both timed runs start with peers and buffers set up */
+	stream();
+	sent = 0;
+
+	clean_mbps = stream();
+	clean = sent;
+
+	sent = 0;
+	drop_on = 1;
+	lossy_mbps = stream();
+	drop_on = 0;
+	extra = sent > clean ? sent - clean : 0;
+
+	printf("clean %" PRIu64 " bytes, %.1f MB/s\n", clean, clean_mbps);
+	printf("lossy %" PRIu64 " bytes with %" PRIu64 " dropped (1 in %d), "
+	       "%.1f MB/s\n", sent, dropped, drop_one_in, lossy_mbps);
+	if (!dropped || extra > MAX_EXTRA * dropped) {
+		fprintf(stderr, "%" PRIu64 " extra bytes for %" PRIu64
+			" dropped\n", extra, dropped);
+		errors++;
+	}
+
+	teardown();
+	printf("%s\n", errors ? "FAIL" : "PASS");
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -61,6 +61,8 @@
 #define RXM_MINOR_VERSION 0
 
 #define RXM_IOV_LIMIT 4
+#define RXM_CQ_BATCH_DEF 16
+#define RXM_CQ_BATCH_MAX 64
 
 /*
  * Macros to generate enums and associated string values
@@ -98,6 +100,18 @@
 
 extern struct fi_provider rxm_prov;
 extern struct util_prov rxm_util_prov;
+extern int rxm_cq_batch;
+
+#define RXM_MR_CACHE_MAX_MB_DEF	1024
+#define RXM_SAR_LIMIT_DEF	(256 * 1024)
+#define RXM_CONN_RX_SIZE_DEF	16
+#define RXM_CONN_RX_MIN		4
+extern int rxm_sar_limit;
+extern int rxm_lmt_write;
+extern int rxm_mr_cache_size;
+extern int rxm_mr_cache_max_mb;
+extern int rxm_rx_size;
+extern int rxm_conn_rx_size;
 
 struct rxm_fabric {
 	struct util_fabric util_fabric;
@@ -109,11 +123,16 @@ struct rxm_fabric {
 struct rxm_conn {
 	struct fid_ep *msg_ep;
 	struct util_cmap_handle handle;
+	struct rxm_ep *ep;
+	/* receive buffers posted to msg_ep without a shared context */
+	ofi_atomic32_t rx_posted;
 };
 
 struct rxm_domain {
 	struct util_domain util_domain;
 	struct fid_domain *msg_domain;
+	/* used for large message buffers when max_cached_cnt is set */
+	struct ofi_mr_cache mr_cache;
 };
 
 struct rxm_mr {
@@ -140,7 +159,10 @@ struct rxm_rma_iov {
 	FUNC(RXM_LMT_ACK_WAIT),	\
 	FUNC(RXM_LMT_READ),	\
 	FUNC(RXM_LMT_ACK_SENT), \
-	FUNC(RXM_LMT_FINISH),
+	FUNC(RXM_LMT_FINISH),	\
+	FUNC(RXM_SAR_TX),	\
+	FUNC(RXM_LMT_WRITE),	\
+	FUNC(RXM_LMT_CTS_SENT),
 
 enum rxm_proto_state {
 	RXM_PROTO_STATES(ENUM)
@@ -148,6 +170,16 @@ enum rxm_proto_state {
 
 extern char *rxm_proto_state_str[];
 
+/* ofi_op_hdr::op_data of large message packets. In write mode the
+ * receiver answers the request with an ofi_ctrl_ack carrying its buffer
+ * and the sender writes the data with the rx_key as remote CQ data. The
+ * rx_key holds the receiving connection's cmap index in its upper half,
+ * so a write is only matched to a receive on the same connection. */
+enum {
+	RXM_LMT_OP_READ,
+	RXM_LMT_OP_WRITE,
+};
+
 struct rxm_pkt {
 	struct ofi_ctrl_hdr ctrl_hdr;
 	struct ofi_op_hdr hdr;
@@ -197,6 +229,24 @@ struct rxm_rx_buf {
 	struct rxm_rma_iov *rma_iov;
 	size_t index;
 	struct fid_mr *mr[RXM_IOV_LIMIT];
+	struct ofi_mr_entry *mr_entry[RXM_IOV_LIMIT];
+
+	/* Used for segmented messages. The first segment is kept on the
+	 * EP's sar_rx_list until the message is complete; later segments
+	 * that arrive before it is matched are queued on its seg_list. */
+	struct dlist_entry sar_entry;
+	struct dlist_entry sar_seg_list;
+	size_t sar_recvd;
+
+	/* Used for write-based large messages */
+	struct dlist_entry lmt_entry;
+	struct rxm_tx_buf *cts_buf;
+	uint64_t rx_key;
+	int lmt_pending;
+
+	/* Set when no replacement could be posted on arrival, so the
+	 * buffer goes back to its msg EP instead of to the pool */
+	int repost;
 
 	struct rxm_pkt pkt;
 };
@@ -205,6 +255,9 @@ struct rxm_tx_buf {
 	/* Must stay at top */
 	struct rxm_buf hdr;
 
+	/* Owner of a segment of a SAR message */
+	struct rxm_tx_entry *tx_entry;
+
 	struct rxm_pkt pkt;
 };
 
@@ -225,6 +278,14 @@ struct rxm_tx_entry {
 	/* Used for large messages */
 	uint64_t msg_id;
 	struct fid_mr *mr[RXM_IOV_LIMIT];
+	struct ofi_mr_entry *mr_entry[RXM_IOV_LIMIT];
+
+	/* Used for segmented messages and write-based large messages */
+	struct iovec iov[RXM_IOV_LIMIT];
+	void *desc[RXM_IOV_LIMIT];
+	struct dlist_entry sar_entry;
+	size_t sar_offset;
+	size_t sar_pending;
 };
 DECLARE_FREESTACK(struct rxm_tx_entry, rxm_txe_fs);
 
@@ -258,6 +319,9 @@ struct rxm_buf_pool {
 	struct util_buf_pool *pool;
 	struct dlist_entry buf_list;
 	uint8_t local_mr;
+	/* Receive buffers are posted from the CM thread when the msg
+	 * provider has no shared receive context */
+	fastlock_t lock;
 };
 
 struct rxm_ep {
@@ -266,14 +330,28 @@ struct rxm_ep {
 	struct fi_info *msg_info;
 	struct fid_pep *msg_pep;
 	struct fid_cq *msg_cq;
+	/* NULL if the msg provider has no shared receive context, in which
+	 * case receive buffers are posted to each msg EP */
 	struct fid_ep *srx_ctx;
 
 	struct rxm_buf_pool tx_pool;
 	struct rxm_buf_pool rx_pool;
+	/* Without a shared receive context: buffers posted to msg EPs beyond
+	 * their floor, drawn from a budget shared by all of them */
+	ofi_atomic32_t rx_extra;
+	size_t rx_budget;
 
 	struct rxm_send_queue send_queue;
 	struct rxm_recv_queue recv_queue;
 	struct rxm_recv_queue trecv_queue;
+
+	/* SAR sends with segments left to post */
+	struct dlist_entry sar_tx_list;
+	/* SAR receives still waiting for segments */
+	struct dlist_entry sar_rx_list;
+	/* Large receives waiting for the sender's RMA write */
+	struct dlist_entry lmt_write_list;
+	uint64_t lmt_rx_key;
 };
 
 extern struct fi_provider rxm_prov;
@@ -305,7 +383,7 @@ int rxm_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 			     struct fid_domain **dom, void *context);
 int rxm_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 			 struct fid_cq **cq_fid, void *context);
-void rxm_cq_progress(struct fid_cq *msg_cq);
+void rxm_cq_progress(struct rxm_ep *rxm_ep);
 int rxm_cq_comp(struct util_cq *util_cq, void *context, uint64_t flags, size_t len,
 		void *buf, uint64_t data, uint64_t tag);
 int rxm_cq_handle_data(struct rxm_rx_buf *rx_buf);
@@ -321,13 +399,21 @@ int rxm_msg_process_connreq(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
 void rxm_conn_close(void *arg);
 int rxm_get_conn(struct rxm_ep *rxm_ep, fi_addr_t fi_addr, struct rxm_conn **rxm_conn);
 
-int rxm_ep_repost_buf(struct rxm_rx_buf *buf);
+int rxm_ep_post_buf(struct rxm_ep *rxm_ep, struct fid_ep *msg_ep);
+int rxm_conn_rx_floor(void);
+int rxm_rx_buf_release(struct rxm_rx_buf *rx_buf);
+int rxm_ep_sar_tx_continue(struct rxm_tx_entry *tx_entry);
+ssize_t rxm_rma_iov_init(struct rxm_ep *rxm_ep, void *buf,
+			 const struct iovec *iov, size_t count,
+			 struct fid_mr **mr, struct ofi_mr_entry **mr_entry);
 int ofi_match_addr(fi_addr_t addr, fi_addr_t match_addr);
 int ofi_match_tag(uint64_t tag, uint64_t ignore, uint64_t match_tag);
 void rxm_pkt_init(struct rxm_pkt *pkt);
 int rxm_ep_msg_mr_regv(struct rxm_ep *rxm_ep, const struct iovec *iov,
-		       size_t count, uint64_t access, struct fid_mr **mr);
-void rxm_ep_msg_mr_closev(struct fid_mr **mr, size_t count);
+		       size_t count, uint64_t access, struct fid_mr **mr,
+		       struct ofi_mr_entry **mr_entry);
+void rxm_ep_msg_mr_closev(struct rxm_ep *rxm_ep, struct fid_mr **mr,
+			  struct ofi_mr_entry **mr_entry, size_t count);
 struct rxm_buf *rxm_buf_get(struct rxm_buf_pool *pool);
 void rxm_buf_release(struct rxm_buf_pool *pool, struct rxm_buf *buf);
 void *rxm_buf_get_desc(struct rxm_buf_pool *pool, void *buf);
@@ -42,12 +42,15 @@ int rxm_msg_ep_open(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
 	struct rxm_domain *rxm_domain;
 	struct rxm_fabric *rxm_fabric;
 	struct fid_ep *msg_ep;
-	int ret;
+	int i, ret;
 
 	rxm_domain = container_of(rxm_ep->util_ep.domain, struct rxm_domain,
 			util_domain);
 	rxm_fabric = container_of(rxm_domain->util_domain.fabric, struct rxm_fabric,
 			util_fabric);
+	if (rxm_ep->srx_ctx)
+		msg_info->ep_attr->rx_ctx_cnt = FI_SHARED_CONTEXT;
+
 	ret = fi_endpoint(rxm_domain->msg_domain, msg_info, &msg_ep, rxm_conn);
 	if (ret) {
 		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL, "Unable to create msg_ep\n");
@@ -60,10 +63,13 @@ int rxm_msg_ep_open(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
 		goto err;
 	}
 
-	ret = fi_ep_bind(msg_ep, &rxm_ep->srx_ctx->fid, 0);
-	if (ret) {
-		FI_WARN(&rxm_prov, FI_LOG_FABRIC, "Unable to bind msg EP to shared RX ctx\n");
-		goto err;
+	if (rxm_ep->srx_ctx) {
+		ret = fi_ep_bind(msg_ep, &rxm_ep->srx_ctx->fid, 0);
+		if (ret) {
+			FI_WARN(&rxm_prov, FI_LOG_FABRIC,
+				"Unable to bind msg EP to shared RX ctx\n");
+			goto err;
+		}
 	}
 
 	// TODO add other completion flags
@@ -80,6 +86,21 @@ int rxm_msg_ep_open(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
 		goto err;
 	}
 
+	/* Without a shared receive context each msg EP starts with a small
+	 * floor of buffers, see rxm_rx_buf_replace(). */
+	rxm_conn->ep = rxm_ep;
+	ofi_atomic_initialize32(&rxm_conn->rx_posted, 0);
+	if (!rxm_ep->srx_ctx) {
+		for (i = 0; i < rxm_conn_rx_floor(); i++) {
+			ret = rxm_ep_post_buf(rxm_ep, msg_ep);
+			if (ret) {
+				FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+					"Unable to post recv bufs to msg_ep\n");
+				goto err;
+			}
+		}
+	}
+
 	rxm_conn->msg_ep = msg_ep;
 	return 0;
 err:
@@ -96,6 +117,13 @@ void rxm_conn_close(void *arg)
 	if ((rxm_conn->handle.state == CMAP_UNSPEC) || !rxm_conn->msg_ep)
 		goto out;
 
+	/* hand the buffers it took beyond its floor back to the budget */
+	if (!rxm_conn->ep->srx_ctx &&
+	    ofi_atomic_get32(&rxm_conn->rx_posted) > rxm_conn_rx_floor())
+		ofi_atomic_sub32(&rxm_conn->ep->rx_extra,
+				 ofi_atomic_get32(&rxm_conn->rx_posted) -
+				 rxm_conn_rx_floor());
+
 	if (rxm_conn->handle.state == CMAP_CONNECTED) {
 		ret = fi_shutdown(rxm_conn->msg_ep, 0);
 		if (ret)
@@ -138,7 +138,7 @@ int rxm_finish_recv(struct rxm_rx_buf *rx_buf)
 	}
 
 	freestack_push(rx_buf->recv_fs, rx_buf->recv_entry);
-	return rxm_ep_repost_buf(rx_buf);
+	return rxm_rx_buf_release(rx_buf);
 }
 
 int rxm_finish_send(struct rxm_tx_entry *tx_entry)
@@ -227,8 +227,9 @@ static int rxm_lmt_rma_read(struct rxm_rx_buf *rx_buf)
 	int ret;
 
 	ret = fi_readv(rx_buf->conn->msg_ep, match_iov->iov, match_iov->desc,
-		       match_iov->count, 0, rx_buf->rma_iov->iov[0].addr,
-		       rx_buf->rma_iov->iov[0].key, rx_buf);
+		       match_iov->count, 0,
+		       rx_buf->rma_iov->iov[rx_buf->index].addr,
+		       rx_buf->rma_iov->iov[rx_buf->index].key, rx_buf);
 	if (ret)
 		return ret;
 	rx_buf->index++;
@@ -254,13 +255,337 @@ static int rxm_lmt_handle_ack(struct rxm_rx_buf *rx_buf)
 	tx_entry->state = RXM_LMT_FINISH;
 
 	if (!RXM_MR_LOCAL(rx_buf->ep->rxm_info))
-		rxm_ep_msg_mr_closev(tx_entry->mr, tx_entry->count);
+		rxm_ep_msg_mr_closev(tx_entry->ep, tx_entry->mr,
+				     tx_entry->mr_entry, tx_entry->count);
 
 	ret = rxm_finish_send(tx_entry);
 	if (ret)
 		return ret;
 
-	return rxm_ep_repost_buf(rx_buf);
+	return rxm_rx_buf_release(rx_buf);
+}
+
+/* Segments after the first are sent as ofi_ctrl_data with a non-zero
+ * seg_no; eager messages always carry seg_no 0. */
+static int rxm_sar_is_seg(struct rxm_pkt *pkt)
+{
+	return pkt->ctrl_hdr.type == ofi_ctrl_data && pkt->ctrl_hdr.seg_no;
+}
+
+static int rxm_sar_match_seg(struct dlist_entry *item, const void *arg)
+{
+	const struct rxm_pkt *pkt = arg;
+	struct rxm_rx_buf *rx_buf;
+
+	rx_buf = container_of(item, struct rxm_rx_buf, sar_entry);
+	return (rx_buf->pkt.ctrl_hdr.conn_id == pkt->ctrl_hdr.conn_id) &&
+	       (rx_buf->pkt.ctrl_hdr.msg_id == pkt->ctrl_hdr.msg_id);
+}
+
+static void rxm_sar_copy_seg(struct rxm_rx_buf *rx_buf,
+			     struct rxm_rx_buf *seg)
+{
+	ofi_copy_to_iov(rx_buf->recv_entry->iov, rx_buf->recv_entry->count,
+			(uint64_t)seg->pkt.ctrl_hdr.seg_no *
+			rx_buf->pkt.ctrl_hdr.seg_size,
+			seg->pkt.data, seg->pkt.ctrl_hdr.seg_size);
+}
+
+static int rxm_sar_check_done(struct rxm_rx_buf *rx_buf)
+{
+	if (rx_buf->sar_recvd < rx_buf->pkt.hdr.size)
+		return 0;
+
+	dlist_remove(&rx_buf->sar_entry);
+	return rxm_finish_recv(rx_buf);
+}
+
+/* Copy the first segment and any segments that arrived before the
+ * receive was matched */
+static int rxm_sar_handle_data(struct rxm_rx_buf *rx_buf)
+{
+	struct rxm_rx_buf *seg;
+	int ret;
+
+	ofi_copy_to_iov(rx_buf->recv_entry->iov, rx_buf->recv_entry->count, 0,
+			rx_buf->pkt.data, rx_buf->pkt.ctrl_hdr.seg_size);
+
+	while (!dlist_empty(&rx_buf->sar_seg_list)) {
+		dlist_pop_front_container(&rx_buf->sar_seg_list, seg, sar_entry);
+		rxm_sar_copy_seg(rx_buf, seg);
+		ret = rxm_rx_buf_release(seg);
+		if (ret)
+			return ret;
+	}
+	return rxm_sar_check_done(rx_buf);
+}
+
+static int rxm_sar_handle_seg(struct rxm_rx_buf *seg)
+{
+	struct rxm_rx_buf *rx_buf;
+	struct dlist_entry *entry;
+	int ret;
+
+	entry = dlist_find_first_match(&seg->ep->sar_rx_list,
+				       rxm_sar_match_seg, &seg->pkt);
+	if (!entry) {
+		FI_WARN(&rxm_prov, FI_LOG_CQ,
+			"Dropping SAR segment of unknown msg_id: 0x%" PRIx64 "\n",
+			seg->pkt.ctrl_hdr.msg_id);
+		return rxm_rx_buf_release(seg);
+	}
+
+	rx_buf = container_of(entry, struct rxm_rx_buf, sar_entry);
+	rx_buf->sar_recvd += seg->pkt.ctrl_hdr.seg_size;
+
+	if (!rx_buf->recv_entry) {
+		dlist_insert_tail(&seg->sar_entry, &rx_buf->sar_seg_list);
+		return 0;
+	}
+
+	rxm_sar_copy_seg(rx_buf, seg);
+	ret = rxm_rx_buf_release(seg);
+	if (ret)
+		return ret;
+	return rxm_sar_check_done(rx_buf);
+}
+
+static int rxm_sar_handle_send_comp(struct rxm_tx_buf *tx_buf)
+{
+	struct rxm_tx_entry *tx_entry = tx_buf->tx_entry;
+
+	/* The first buffer holds the header template until the end */
+	if (tx_buf != tx_entry->tx_buf)
+		rxm_buf_release(&tx_entry->ep->tx_pool, (struct rxm_buf *)tx_buf);
+
+	if (--tx_entry->sar_pending ||
+	    tx_entry->sar_offset < tx_entry->tx_buf->pkt.hdr.size)
+		return 0;
+	return rxm_finish_send(tx_entry);
+}
+
+/* The CQ data of a large message write names the receiving connection
+ * by its cmap index in the upper half and the receive in the lower. */
+static uint64_t rxm_lmt_conn_idx(struct rxm_conn *rxm_conn)
+{
+	return ofi_key2idx(&rxm_conn->handle.cmap->key_idx,
+			   rxm_conn->handle.key);
+}
+
+static uint64_t rxm_lmt_rx_key(struct rxm_ep *rxm_ep,
+			       struct rxm_conn *rxm_conn)
+{
+	return (rxm_lmt_conn_idx(rxm_conn) << 32) |
+		(uint32_t) rxm_ep->lmt_rx_key++;
+}
+
+struct rxm_lmt_write_match {
+	uint64_t rx_key;
+	/* msg EP the write consumed a buffer of, if buffers are per EP */
+	struct fid_ep *msg_ep;
+};
+
+static int rxm_lmt_match_write(struct dlist_entry *item, const void *arg)
+{
+	const struct rxm_lmt_write_match *match = arg;
+	struct rxm_rx_buf *rx_buf;
+
+	rx_buf = container_of(item, struct rxm_rx_buf, lmt_entry);
+	return rx_buf->rx_key == match->rx_key &&
+	       rxm_lmt_conn_idx(rx_buf->conn) == (match->rx_key >> 32) &&
+	       (!match->msg_ep || rx_buf->conn->msg_ep == match->msg_ep);
+}
+
+/* Completes a write-based receive once both the CTS send and the
+ * sender's write have completed, in whichever order they are seen. */
+static int rxm_lmt_rx_finish(struct rxm_rx_buf *rx_buf)
+{
+	if (--rx_buf->lmt_pending)
+		return 0;
+
+	RXM_LOG_STATE(FI_LOG_CQ, RXM_LMT_CTS_SENT, RXM_LMT_FINISH);
+	rx_buf->hdr.state = RXM_LMT_FINISH;
+	if (!RXM_MR_LOCAL(rx_buf->ep->rxm_info))
+		rxm_ep_msg_mr_closev(rx_buf->ep, rx_buf->mr,
+				     rx_buf->mr_entry, RXM_IOV_LIMIT);
+	return rxm_finish_recv(rx_buf);
+}
+
+static int rxm_lmt_handle_write(struct rxm_ep *rxm_ep,
+				struct fi_cq_data_entry *comp)
+{
+	struct rxm_lmt_write_match match;
+	struct rxm_rx_buf *rx_buf;
+	struct dlist_entry *entry;
+	int ret;
+
+	match.rx_key = comp->data;
+	match.msg_ep = NULL;
+
+	/* Providers that need FI_RX_CQ_DATA consume a posted buffer, which
+	 * also tells which connection the write came in on when buffers
+	 * are not shared between connections */
+	if (comp->op_context) {
+		rx_buf = comp->op_context;
+		if (!rxm_ep->srx_ctx)
+			match.msg_ep = rx_buf->hdr.msg_ep;
+		ret = rxm_rx_buf_release(rx_buf);
+		if (ret)
+			return ret;
+	}
+
+	entry = dlist_remove_first_match(&rxm_ep->lmt_write_list,
+					 rxm_lmt_match_write, &match);
+	if (!entry) {
+		FI_WARN(&rxm_prov, FI_LOG_CQ,
+			"Unknown rx_key in RMA write: 0x%" PRIx64 "\n",
+			comp->data);
+		return -FI_EOTHER;
+	}
+
+	rx_buf = container_of(entry, struct rxm_rx_buf, lmt_entry);
+	return rxm_lmt_rx_finish(rx_buf);
+}
+
+static int rxm_lmt_send_cts(struct rxm_rx_buf *rx_buf)
+{
+	struct rxm_ep *rxm_ep = rx_buf->ep;
+	struct rxm_recv_entry *recv_entry = rx_buf->recv_entry;
+	struct rxm_iov mr_match_iov;
+	struct rxm_tx_buf *tx_buf;
+	struct rxm_pkt *pkt;
+	struct fid_mr **mr;
+	ssize_t size;
+	int ret;
+
+	if (rx_buf->pkt.hdr.size > ofi_total_iov_len(recv_entry->iov,
+						      recv_entry->count)) {
+		FI_WARN(&rxm_prov, FI_LOG_CQ,
+			"Posted receive buffer size is not enough!\n");
+		return -FI_ETRUNC;
+	}
+
+	ret = rxm_match_iov(recv_entry->iov, recv_entry->desc,
+			    recv_entry->count, 0, rx_buf->pkt.hdr.size,
+			    &mr_match_iov);
+	if (ret)
+		return ret;
+
+	if (!RXM_MR_LOCAL(rxm_ep->rxm_info)) {
+		ret = rxm_ep_msg_mr_regv(rxm_ep, mr_match_iov.iov,
+					 mr_match_iov.count, FI_REMOTE_WRITE,
+					 rx_buf->mr, rx_buf->mr_entry);
+		if (ret)
+			return ret;
+		mr = rx_buf->mr;
+	} else {
+		/* desc is msg fid_mr * array */
+		mr = (struct fid_mr **)mr_match_iov.desc;
+	}
+
+	tx_buf = (struct rxm_tx_buf *)rxm_buf_get(&rxm_ep->tx_pool);
+	if (!tx_buf) {
+		ret = -FI_EAGAIN;
+		goto err1;
+	}
+	tx_buf->hdr.msg_ep = rx_buf->conn->msg_ep;
+
+	pkt = &tx_buf->pkt;
+	rxm_pkt_init(pkt);
+	pkt->ctrl_hdr.type = ofi_ctrl_ack;
+	pkt->ctrl_hdr.conn_id = rx_buf->conn->handle.remote_key;
+	pkt->ctrl_hdr.msg_id = rx_buf->pkt.ctrl_hdr.msg_id;
+	pkt->ctrl_hdr.rx_key = rxm_lmt_rx_key(rxm_ep, rx_buf->conn);
+	pkt->hdr.op = rx_buf->pkt.hdr.op;
+	pkt->hdr.op_data = RXM_LMT_OP_WRITE;
+
+	size = rxm_rma_iov_init(rxm_ep, pkt->data, mr_match_iov.iov,
+				mr_match_iov.count, mr,
+				RXM_MR_LOCAL(rxm_ep->rxm_info) ?
+				NULL : rx_buf->mr_entry);
+
+	rx_buf->cts_buf = tx_buf;
+	rx_buf->rx_key = pkt->ctrl_hdr.rx_key;
+	rx_buf->lmt_pending = 2;
+	RXM_LOG_STATE(FI_LOG_CQ, RXM_RX, RXM_LMT_CTS_SENT);
+	rx_buf->hdr.state = RXM_LMT_CTS_SENT;
+	dlist_insert_tail(&rx_buf->lmt_entry, &rxm_ep->lmt_write_list);
+
+	ret = fi_send(tx_buf->hdr.msg_ep, pkt, sizeof(*pkt) + size,
+		      rxm_buf_get_desc(&rxm_ep->tx_pool, tx_buf), 0, rx_buf);
+	if (ret) {
+		FI_WARN(&rxm_prov, FI_LOG_CQ, "Unable to send CTS\n");
+		dlist_remove(&rx_buf->lmt_entry);
+		rx_buf->hdr.state = RXM_RX;
+		goto err2;
+	}
+	return 0;
+err2:
+	rxm_buf_release(&rxm_ep->tx_pool, (struct rxm_buf *)tx_buf);
+err1:
+	if (!RXM_MR_LOCAL(rxm_ep->rxm_info))
+		rxm_ep_msg_mr_closev(rxm_ep, rx_buf->mr, rx_buf->mr_entry,
+				     mr_match_iov.count);
+	return ret;
+}
+
+static int rxm_lmt_handle_cts(struct rxm_rx_buf *rx_buf)
+{
+	struct fi_rma_iov rma_iov[RXM_IOV_LIMIT];
+	struct rxm_rma_iov *cts_iov;
+	struct rxm_tx_entry *tx_entry;
+	struct fi_msg_rma msg;
+	int ret, index;
+	size_t i;
+
+	index = ofi_key2idx(&rx_buf->ep->send_queue.tx_key_idx,
+			    rx_buf->pkt.ctrl_hdr.msg_id);
+	tx_entry = &rx_buf->ep->send_queue.fs->buf[index];
+
+	assert(tx_entry->msg_id == rx_buf->pkt.ctrl_hdr.msg_id);
+	assert(tx_entry->state == RXM_LMT_ACK_WAIT);
+
+	cts_iov = (struct rxm_rma_iov *)rx_buf->pkt.data;
+	if (cts_iov->count > RXM_IOV_LIMIT) {
+		FI_WARN(&rxm_prov, FI_LOG_CQ, "Invalid CTS iov count\n");
+		return -FI_EINVAL;
+	}
+
+	for (i = 0; i < cts_iov->count; i++) {
+		rma_iov[i].addr = cts_iov->iov[i].addr;
+		rma_iov[i].len = cts_iov->iov[i].len;
+		rma_iov[i].key = cts_iov->iov[i].key;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = tx_entry->iov;
+	msg.desc = tx_entry->desc;
+	msg.iov_count = tx_entry->count;
+	msg.rma_iov = rma_iov;
+	msg.rma_iov_count = cts_iov->count;
+	msg.context = tx_entry;
+	msg.data = rx_buf->pkt.ctrl_hdr.rx_key;
+
+	RXM_LOG_STATE(FI_LOG_CQ, RXM_LMT_ACK_WAIT, RXM_LMT_WRITE);
+	tx_entry->state = RXM_LMT_WRITE;
+
+	ret = fi_writemsg(tx_entry->tx_buf->hdr.msg_ep, &msg, FI_REMOTE_CQ_DATA);
+	if (ret) {
+		FI_WARN(&rxm_prov, FI_LOG_CQ, "Unable to write large msg\n");
+		tx_entry->state = RXM_LMT_ACK_WAIT;
+		return ret;
+	}
+	return rxm_rx_buf_release(rx_buf);
+}
+
+static int rxm_lmt_handle_write_comp(struct rxm_tx_entry *tx_entry)
+{
+	RXM_LOG_STATE(FI_LOG_CQ, RXM_LMT_WRITE, RXM_LMT_FINISH);
+	tx_entry->state = RXM_LMT_FINISH;
+	if (!RXM_MR_LOCAL(tx_entry->ep->rxm_info))
+		rxm_ep_msg_mr_closev(tx_entry->ep, tx_entry->mr,
+				     tx_entry->mr_entry, tx_entry->count);
+	return rxm_finish_send(tx_entry);
 }
 
 int rxm_cq_handle_data(struct rxm_rx_buf *rx_buf)
@@ -276,11 +601,14 @@ int rxm_cq_handle_data(struct rxm_rx_buf *rx_buf)
 				return -FI_EOTHER;
 		}
 
+		if (rx_buf->pkt.hdr.op_data == RXM_LMT_OP_WRITE)
+			return rxm_lmt_send_cts(rx_buf);
+
 		rx_buf->rma_iov = (struct rxm_rma_iov *)rx_buf->pkt.data;
 		rx_buf->index = 0;
 
 		for (i = 0; i < rx_buf->rma_iov->count; i++)
-			rma_total_len += rx_buf->rma_iov->iov->len;
+			rma_total_len += rx_buf->rma_iov->iov[i].len;
 
 		if (rma_total_len > ofi_total_iov_len(rx_buf->recv_entry->iov,
 				      rx_buf->recv_entry->count)) {
@@ -299,7 +627,7 @@ int rxm_cq_handle_data(struct rxm_rx_buf *rx_buf)
 
 			ret = rxm_ep_msg_mr_regv(rx_buf->ep, mr_match_iov.iov,
 						 mr_match_iov.count, FI_WRITE,
-						 rx_buf->mr);
+						 rx_buf->mr, rx_buf->mr_entry);
 			if (ret)
 				return ret;
 
@@ -322,6 +650,8 @@ int rxm_cq_handle_data(struct rxm_rx_buf *rx_buf)
 		RXM_LOG_STATE(FI_LOG_CQ, RXM_LMT_ACK_SENT, RXM_LMT_FINISH);
 		rx_buf->hdr.state = RXM_LMT_READ;
 		return rxm_lmt_rma_read(rx_buf);
+	} else if (rx_buf->pkt.ctrl_hdr.type == ofi_ctrl_start_data) {
+		return rxm_sar_handle_data(rx_buf);
 	} else {
 		ofi_copy_to_iov(rx_buf->recv_entry->iov, rx_buf->recv_entry->count, 0,
 				rx_buf->pkt.data, rx_buf->pkt.hdr.size);
@@ -375,6 +705,12 @@ int rxm_handle_recv_comp(struct rxm_rx_buf *rx_buf)
 
 	rx_buf->recv_fs = recv_queue->fs;
 
+	if (rx_buf->pkt.ctrl_hdr.type == ofi_ctrl_start_data) {
+		dlist_init(&rx_buf->sar_seg_list);
+		rx_buf->sar_recvd = rx_buf->pkt.ctrl_hdr.seg_size;
+		dlist_insert_tail(&rx_buf->sar_entry, &rx_buf->ep->sar_rx_list);
+	}
+
 	entry = dlist_remove_first_match(&recv_queue->recv_list,
 					 recv_queue->match_recv, &match_attr);
 	if (!entry) {
@@ -426,19 +762,80 @@ static int rxm_lmt_send_ack(struct rxm_rx_buf *rx_buf)
 	return 0;
 }
 
-static int rxm_cq_handle_comp(struct fi_cq_msg_entry *comp) {
+/*
+ * Keeps the number of buffers posted to the shared context constant while
+ * RxM holds on to the completed one.  Without a shared context, a msg EP
+ * keeps at least its floor; one that receives takes an extra buffer from
+ * the endpoint's budget, up to FI_OFI_RXM_CONN_RX_SIZE, and gives extra
+ * buffers back once the budget is used up.  The posted memory thus follows
+ * the peers that are active rather than the number of connections.
+ */
+static void rxm_rx_buf_replace(struct rxm_rx_buf *rx_buf)
+{
+	struct rxm_ep *rxm_ep = rx_buf->ep;
+	struct rxm_conn *rxm_conn;
+	int posted;
+
+	if (!rxm_ep->srx_ctx) {
+		rxm_conn = rx_buf->hdr.msg_ep->fid.context;
+		posted = ofi_atomic_dec32(&rxm_conn->rx_posted);
+		if (posted >= rxm_conn_rx_floor()) {
+			ofi_atomic_dec32(&rxm_ep->rx_extra);
+			if ((size_t)ofi_atomic_get32(&rxm_ep->rx_extra) >=
+			    rxm_ep->rx_budget)
+				return;
+		}
+		if (posted + 1 < rxm_conn_rx_size &&
+		    (size_t)ofi_atomic_get32(&rxm_ep->rx_extra) <
+		    rxm_ep->rx_budget)
+			(void) rxm_ep_post_buf(rxm_ep, rx_buf->hdr.msg_ep);
+	}
+
+	if (rxm_ep_post_buf(rxm_ep, rx_buf->hdr.msg_ep)) {
+		FI_WARN(&rxm_prov, FI_LOG_CQ,
+			"Unable to post replacement rx buf\n");
+		rx_buf->repost = 1;
+	}
+}
+
+static int rxm_cq_handle_comp(struct rxm_ep *rxm_ep,
+			      struct fi_cq_data_entry *comp)
+{
 	enum rxm_proto_state *state = comp->op_context;
 	struct rxm_rx_buf *rx_buf = comp->op_context;
 	int ret;
 
+	if (state && *state == RXM_RX)
+		rxm_rx_buf_replace(rx_buf);
+
+	/* rxm only sends remote CQ data with large message writes. Some
+	 * providers also flag the local write completion, which carries
+	 * the tx_entry as context. */
+	if ((comp->flags & FI_REMOTE_CQ_DATA) && (!state || *state == RXM_RX))
+		return rxm_lmt_handle_write(rxm_ep, comp);
+
 	switch (*state) {
 	case RXM_TX:
 		return rxm_finish_send(comp->op_context);
 	case RXM_RX:
-		if (rx_buf->pkt.ctrl_hdr.type == ofi_ctrl_ack)
+		if (rx_buf->pkt.ctrl_hdr.type == ofi_ctrl_ack &&
+		    rx_buf->pkt.hdr.op_data == RXM_LMT_OP_WRITE)
+			return rxm_lmt_handle_cts(rx_buf);
+		else if (rx_buf->pkt.ctrl_hdr.type == ofi_ctrl_ack)
 			return rxm_lmt_handle_ack(rx_buf);
+		else if (rxm_sar_is_seg(&rx_buf->pkt))
+			return rxm_sar_handle_seg(rx_buf);
 		else
 			return rxm_handle_recv_comp(comp->op_context);
+	case RXM_SAR_TX:
+		return rxm_sar_handle_send_comp(comp->op_context);
+	case RXM_LMT_WRITE:
+		return rxm_lmt_handle_write_comp(comp->op_context);
+	case RXM_LMT_CTS_SENT:
+		rxm_buf_release(&rx_buf->ep->tx_pool,
+				(struct rxm_buf *)rx_buf->cts_buf);
+		rx_buf->cts_buf = NULL;
+		return rxm_lmt_rx_finish(rx_buf);
 	case RXM_LMT_TX:
 		RXM_LOG_STATE(FI_LOG_CQ, RXM_LMT_TX, RXM_LMT_ACK_WAIT);
 		*state = RXM_LMT_ACK_WAIT;
@@ -452,7 +849,8 @@ static int rxm_cq_handle_comp(struct fi_cq_msg_entry *comp) {
 		RXM_LOG_STATE(FI_LOG_CQ, RXM_LMT_ACK_SENT, RXM_LMT_FINISH);
 		*state = RXM_LMT_FINISH;
 		if (!RXM_MR_LOCAL(rx_buf->ep->rxm_info))
-			rxm_ep_msg_mr_closev(rx_buf->mr, RXM_IOV_LIMIT);
+			rxm_ep_msg_mr_closev(rx_buf->ep, rx_buf->mr,
+					     rx_buf->mr_entry, RXM_IOV_LIMIT);
 		return rxm_finish_recv(rx_buf);
 	default:
 		FI_WARN(&rxm_prov, FI_LOG_CQ, "Invalid state!\n");
@@ -462,42 +860,51 @@ static int rxm_cq_handle_comp(struct fi_cq_msg_entry *comp) {
 	return ret;
 }
 
-static ssize_t rxm_cq_read(struct fid_cq *msg_cq, struct fi_cq_msg_entry *comp)
+static ssize_t rxm_cq_read_error(struct fid_cq *msg_cq, ssize_t ret)
 {
 	struct rxm_tx_entry *tx_entry;
 	struct rxm_rx_buf *rx_buf;
 	struct fi_cq_err_entry err_entry;
 	struct util_cq *util_cq;
 	void *op_context;
-	ssize_t ret;
 
-	ret = fi_cq_read(msg_cq, comp, 1);
-	if (ret >= 0 || ret == -FI_EAGAIN)
+	if (ret != -FI_EAVAIL)
 		return ret;
 
-	op_context = comp->op_context;
 	memset(&err_entry, 0, sizeof(err_entry));
-
-	if (ret == -FI_EAVAIL) {
-		OFI_CQ_READERR(&rxm_prov, FI_LOG_CQ, msg_cq,
-				ret, err_entry);
-		if (ret < 0)
-			FI_WARN(&rxm_prov, FI_LOG_CQ,
-					"Unable to fi_cq_readerr on msg cq\n");
-		op_context = err_entry.op_context;
+	OFI_CQ_READERR(&rxm_prov, FI_LOG_CQ, msg_cq, ret, err_entry);
+	if (ret < 0) {
+		FI_WARN(&rxm_prov, FI_LOG_CQ,
+				"Unable to fi_cq_readerr on msg cq\n");
+		return ret;
+	}
+	op_context = err_entry.op_context;
+	if (!op_context) {
+		/* failed remote write notification; it has no rxm context */
+		FI_WARN(&rxm_prov, FI_LOG_CQ, "msg cq readerr: %s\n",
+			fi_cq_strerror(msg_cq, err_entry.prov_errno,
+				       err_entry.err_data, NULL, 0));
+		return -err_entry.err;
 	}
+
 	switch (*(enum rxm_proto_state *)op_context) {
 	case RXM_TX:
 	case RXM_LMT_TX:
+	case RXM_LMT_WRITE:
 		tx_entry = (struct rxm_tx_entry *)op_context;
 		util_cq = tx_entry->ep->util_ep.tx_cq;
 		break;
+	case RXM_SAR_TX:
+		tx_entry = ((struct rxm_tx_buf *)op_context)->tx_entry;
+		util_cq = tx_entry->ep->util_ep.tx_cq;
+		break;
 	case RXM_LMT_ACK_SENT:
 		tx_entry = (struct rxm_tx_entry *)op_context;
 		util_cq = tx_entry->ep->util_ep.rx_cq;
 		break;
 	case RXM_RX:
 	case RXM_LMT_READ:
+	case RXM_LMT_CTS_SENT:
 		rx_buf = (struct rxm_rx_buf *)op_context;
 		util_cq = rx_buf->ep->util_ep.rx_cq;
 		break;
@@ -512,20 +919,24 @@ static ssize_t rxm_cq_read(struct fid_cq *msg_cq, struct fi_cq_msg_entry *comp)
 	return rxm_cq_report_error(util_cq, &err_entry);
 }
 
-void rxm_cq_progress(struct fid_cq *msg_cq)
+void rxm_cq_progress(struct rxm_ep *rxm_ep)
 {
-	struct fi_cq_msg_entry comp;
-	ssize_t ret = 0;
+	struct fi_cq_data_entry comp[RXM_CQ_BATCH_MAX];
+	ssize_t ret, i, count;
 
-	do {
-		ret = rxm_cq_read(msg_cq, &comp);
-		if (ret < 0)
+	count = fi_cq_read(rxm_ep->msg_cq, comp, rxm_cq_batch);
+	if (count < 0) {
+		ret = rxm_cq_read_error(rxm_ep->msg_cq, count);
+		if (ret)
 			goto err;
+		return;
+	}
 
-		ret = rxm_cq_handle_comp(&comp);
+	for (i = 0; i < count; i++) {
+		ret = rxm_cq_handle_comp(rxm_ep, &comp[i]);
 		if (ret)
 			goto err;
-	} while (ret > 0);
+	}
 	return;
 err:
 	// TODO report error on RXM EP/domain since EP/CQ is broken.
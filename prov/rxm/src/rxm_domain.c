@@ -56,6 +56,9 @@ static int rxm_domain_close(fid_t fid)
 
 	rxm_domain = container_of(fid, struct rxm_domain, util_domain.domain_fid.fid);
 
+	if (rxm_domain->mr_cache.max_cached_cnt)
+		ofi_mr_cache_cleanup(&rxm_domain->mr_cache);
+
 	ret = fi_close(&rxm_domain->msg_domain->fid);
 	if (ret)
 		return ret;
@@ -68,6 +71,41 @@ static int rxm_domain_close(fid_t fid)
 	return 0;
 }
 
+static int rxm_mr_cache_add(struct ofi_mr_cache *cache,
+			    struct ofi_mr_entry *entry)
+{
+	struct rxm_domain *rxm_domain;
+
+	rxm_domain = container_of(cache, struct rxm_domain, mr_cache);
+
+	/* The region may be reused for either side of a transfer */
+	return fi_mr_reg(rxm_domain->msg_domain, entry->iov.iov_base,
+			 entry->iov.iov_len, FI_READ | FI_WRITE |
+			 FI_REMOTE_READ | FI_REMOTE_WRITE, 0, 0, 0,
+			 (struct fid_mr **)&entry->context, NULL);
+}
+
+static void rxm_mr_cache_delete(struct ofi_mr_cache *cache,
+				struct ofi_mr_entry *entry)
+{
+	struct fid_mr *mr = entry->context;
+
+	if (fi_close(&mr->fid))
+		FI_WARN(&rxm_prov, FI_LOG_DOMAIN, "Unable to close MSG MR\n");
+}
+
+static int rxm_domain_mr_cache_init(struct rxm_domain *rxm_domain)
+{
+	struct ofi_mr_cache *cache = &rxm_domain->mr_cache;
+
+	cache->prov = &rxm_prov;
+	cache->max_cached_cnt = rxm_mr_cache_size;
+	cache->max_cached_size = (size_t)rxm_mr_cache_max_mb * 1024 * 1024;
+	cache->add_region = rxm_mr_cache_add;
+	cache->delete_region = rxm_mr_cache_delete;
+	return ofi_mr_cache_init(cache);
+}
+
 static struct fi_ops rxm_domain_fi_ops = {
 	.size = sizeof(struct fi_ops),
 	.close = rxm_domain_close,
@@ -113,6 +151,8 @@ static int rxm_mr_reg(struct fid *domain_fid, const void *buf, size_t len,
 
 	/* Additional flags to use RMA read for large message transfers */
 	access |= FI_READ | FI_REMOTE_READ;
+	if (rxm_lmt_write)
+		access |= FI_WRITE | FI_REMOTE_WRITE;
 
 	ret = fi_mr_reg(rxm_domain->msg_domain, buf, len, access, offset, requested_key,
 			flags, &rxm_mr->msg_mr, context);
@@ -163,8 +203,10 @@ int rxm_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 	if (ret)
 		goto err1;
 
-	/* Force core provider to supply MR key */
-	if (FI_VERSION_LT(fabric->api_version, FI_VERSION(1, 5)))
+	/* Force core provider to supply MR key.  FI_MR_BASIC already does,
+	 * and is only recognized on its own. */
+	if (FI_VERSION_LT(fabric->api_version, FI_VERSION(1, 5)) ||
+	    msg_info->domain_attr->mr_mode == FI_MR_BASIC)
 		msg_info->domain_attr->mr_mode = FI_MR_BASIC;
 	else
 		msg_info->domain_attr->mr_mode |= FI_MR_PROV_KEY;
@@ -179,6 +221,12 @@ int rxm_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 		goto err3;
 	}
 
+	if (rxm_mr_cache_size) {
+		ret = rxm_domain_mr_cache_init(rxm_domain);
+		if (ret)
+			goto err4;
+	}
+
 	*domain = &rxm_domain->util_domain.domain_fid;
 	(*domain)->fid.ops = &rxm_domain_fi_ops;
 	/* Replace MR ops set by ofi_domain_init() */
@@ -187,6 +235,8 @@ int rxm_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 
 	fi_freeinfo(msg_info);
 	return 0;
+err4:
+	ofi_domain_close(&rxm_domain->util_domain);
 err3:
 	fi_close(&rxm_domain->msg_domain->fid);
 err2:
@@ -72,7 +72,7 @@ static int rxm_match_unexp_msg_tagged(struct dlist_entry *item, const void *arg)
 	struct rxm_unexp_msg *unexp_msg;
 
 	unexp_msg = container_of(item, struct rxm_unexp_msg, entry);
-	return rxm_match_addr(attr->tag, unexp_msg->addr) &&
+	return rxm_match_addr(attr->addr, unexp_msg->addr) &&
 		rxm_match_tag(attr->tag, attr->ignore, unexp_msg->tag);
 }
 
@@ -107,21 +107,30 @@ void *rxm_buf_get_desc(struct rxm_buf_pool *pool, void *buf)
 
 void rxm_buf_release(struct rxm_buf_pool *pool, struct rxm_buf *buf)
 {
+	fastlock_acquire(&pool->lock);
 	dlist_remove(&buf->entry);
 	util_buf_release(pool->pool, buf);
+	fastlock_release(&pool->lock);
 }
 
 struct rxm_buf *rxm_buf_get(struct rxm_buf_pool *pool)
 {
 	struct rxm_buf *buf;
+
+	fastlock_acquire(&pool->lock);
 	buf = util_buf_get(pool->pool);
-	if (!buf)
+	if (!buf) {
+		fastlock_release(&pool->lock);
 		return NULL;
+	}
 	memset(buf, 0, sizeof(*buf));
 	dlist_insert_tail(&buf->entry, &pool->buf_list);
+	fastlock_release(&pool->lock);
 	return buf;
 }
 
+/* The msg EPs and the shared receive context are closed before the pools,
+ * so buffers still posted to them are no longer referenced. */
 static void rxm_buf_pool_destroy(struct rxm_buf_pool *pool)
 {
 	struct dlist_entry *entry;
@@ -130,12 +139,11 @@ static void rxm_buf_pool_destroy(struct rxm_buf_pool *pool)
 	while(!dlist_empty(&pool->buf_list)) {
 		entry = pool->buf_list.next;
 		buf = container_of(entry, struct rxm_buf, entry);
-		/* Cancel pre-posted context and release it */
-		(void)fi_cancel(&buf->msg_ep->fid, buf);
 		rxm_buf_release(pool, buf);
 	}
 
 	util_buf_pool_destroy(pool->pool);
+	fastlock_destroy(&pool->lock);
 }
 
 static int rxm_buf_pool_create(int local_mr, size_t count, size_t size,
@@ -143,13 +151,14 @@ static int rxm_buf_pool_create(int local_mr, size_t count, size_t size,
 {
 	pool->pool = local_mr ? util_buf_pool_create_ex(RXM_BUF_SIZE + size, 16, 0, count,
 				rxm_mr_buf_reg, rxm_mr_buf_close, pool_ctx) :
-		util_buf_pool_create(RXM_BUF_SIZE, 16, 0, count);
+		util_buf_pool_create(RXM_BUF_SIZE + size, 16, 0, count);
 	if (!pool->pool) {
 		FI_WARN(&rxm_prov, FI_LOG_EP_DATA, "Unable to create buf pool\n");
 		return -FI_ENOMEM;
 	}
 	dlist_init(&pool->buf_list);
 	pool->local_mr = local_mr;
+	fastlock_init(&pool->lock);
 	return 0;
 }
 
@@ -198,6 +207,10 @@ static int rxm_ep_txrx_res_open(struct rxm_ep *rxm_ep)
 
 	rxm_domain = container_of(rxm_ep->util_ep.domain, struct rxm_domain, util_domain);
 
+	dlist_init(&rxm_ep->sar_tx_list);
+	dlist_init(&rxm_ep->sar_rx_list);
+	dlist_init(&rxm_ep->lmt_write_list);
+
 	FI_DBG(&rxm_prov, FI_LOG_EP_CTRL, "MSG provider mr_mode & FI_MR_LOCAL: %d\n",
 			RXM_MR_LOCAL(rxm_ep->msg_info));
 
@@ -253,44 +266,93 @@ static void rxm_ep_txrx_res_close(struct rxm_ep *rxm_ep)
 	rxm_buf_pool_destroy(&rxm_ep->tx_pool);
 }
 
-int rxm_ep_repost_buf(struct rxm_rx_buf *rx_buf)
+static int rxm_rx_buf_post(struct rxm_rx_buf *rx_buf)
+{
+	void *desc;
+
+	desc = rxm_buf_get_desc(&rx_buf->ep->rx_pool, rx_buf);
+	return (int)fi_recv(rx_buf->hdr.msg_ep, &rx_buf->pkt, RXM_BUF_SIZE,
+			    desc, FI_ADDR_UNSPEC, rx_buf);
+}
+
+int rxm_conn_rx_floor(void)
+{
+	return MIN(rxm_conn_rx_size, RXM_CONN_RX_MIN);
+}
+
+/* Counts a buffer posted to a msg EP that has no shared receive context */
+static void rxm_rx_buf_posted(struct rxm_ep *rxm_ep, struct fid_ep *msg_ep)
+{
+	struct rxm_conn *rxm_conn = msg_ep->fid.context;
+
+	if (ofi_atomic_inc32(&rxm_conn->rx_posted) > rxm_conn_rx_floor())
+		ofi_atomic_inc32(&rxm_ep->rx_extra);
+}
+
+/* Posts a new receive buffer from the pool, which grows as needed, to the
+ * shared receive context or to a msg EP. */
+int rxm_ep_post_buf(struct rxm_ep *rxm_ep, struct fid_ep *msg_ep)
+{
+	struct rxm_rx_buf *rx_buf;
+	struct rxm_buf hdr;
+	int ret;
+
+	rx_buf = (struct rxm_rx_buf *)rxm_buf_get(&rxm_ep->rx_pool);
+	if (!rx_buf)
+		return -FI_ENOMEM;
+
+	hdr = rx_buf->hdr;
+	memset(rx_buf, 0, sizeof(*rx_buf));
+	rx_buf->hdr = hdr;
+	rx_buf->hdr.state = RXM_RX;
+	rx_buf->hdr.msg_ep = msg_ep;
+	rx_buf->ep = rxm_ep;
+
+	ret = rxm_rx_buf_post(rx_buf);
+	if (ret)
+		rxm_buf_release(&rxm_ep->rx_pool, (struct rxm_buf *)rx_buf);
+	else if (!rxm_ep->srx_ctx)
+		rxm_rx_buf_posted(rxm_ep, msg_ep);
+	return ret;
+}
+
+/* Called once RxM no longer needs the data in a receive buffer. A
+ * replacement was normally posted when the buffer completed, so the
+ * buffer goes back to the pool; otherwise it is posted again. */
+int rxm_rx_buf_release(struct rxm_rx_buf *rx_buf)
 {
 	struct rxm_buf hdr = rx_buf->hdr;
 	struct rxm_ep *rxm_ep = rx_buf->ep;
-	void *desc = NULL;
 	int ret;
 
+	if (!rx_buf->repost) {
+		rxm_buf_release(&rxm_ep->rx_pool, (struct rxm_buf *)rx_buf);
+		return 0;
+	}
+
 	memset(rx_buf, 0, sizeof(*rx_buf));
 	rx_buf->hdr = hdr;
 	rx_buf->hdr.state = RXM_RX;
 	rx_buf->ep = rxm_ep;
 
-	desc = rxm_buf_get_desc(&rx_buf->ep->rx_pool, rx_buf);
-
 	FI_DBG(&rxm_prov, FI_LOG_EP_CTRL, "Re-posting rx buf\n");
-	ret = fi_recv(rx_buf->ep->srx_ctx, &rx_buf->pkt, RXM_BUF_SIZE, desc,
-			FI_ADDR_UNSPEC,	rx_buf);
+	ret = rxm_rx_buf_post(rx_buf);
 	if (ret)
 		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL, "Unable to repost buf\n");
+	else if (!rxm_ep->srx_ctx)
+		rxm_rx_buf_posted(rxm_ep, rx_buf->hdr.msg_ep);
 	return ret;
 }
 
-int rxm_ep_prepost_buf(struct rxm_ep *rxm_ep)
+static int rxm_ep_prepost_buf(struct rxm_ep *rxm_ep)
 {
-	struct rxm_rx_buf *rx_buf;
-	int ret;
 	size_t i;
+	int ret;
 
-	for (i = 0; i < rxm_ep->msg_info->rx_attr->size; i++) {
-		rx_buf = (struct rxm_rx_buf *)rxm_buf_get(&rxm_ep->rx_pool);
-		rx_buf->hdr.state = RXM_RX,
-		rx_buf->hdr.msg_ep = rxm_ep->srx_ctx;
-		rx_buf->ep = rxm_ep;
-		ret = rxm_ep_repost_buf(rx_buf);
-		if (ret) {
-			rxm_buf_release(&rxm_ep->rx_pool, (struct rxm_buf *)rx_buf);
+	for (i = 0; i < rxm_ep->rx_budget; i++) {
+		ret = rxm_ep_post_buf(rxm_ep, rxm_ep->srx_ctx);
+		if (ret)
 			return ret;
-		}
 	}
 	return 0;
 }
@@ -357,6 +419,7 @@ static inline uint64_t rxm_ep_rx_flags(struct fid_ep *ep_fid) {
 	return rxm_ep->rxm_info->rx_attr->op_flags;
 }
 
+/* Returns 1 if recv_entry was consumed by an unexpected message */
 static int rxm_check_unexp_msg_list(struct util_cq *util_cq, struct rxm_recv_queue *recv_queue,
 		struct rxm_recv_entry *recv_entry, dlist_func_t *match)
 {
@@ -367,10 +430,10 @@ static int rxm_check_unexp_msg_list(struct util_cq *util_cq, struct rxm_recv_que
 	int ret = 0;
 
 	fastlock_acquire(&util_cq->cq_lock);
-	if (ofi_cirque_isfull(util_cq->cirq)) {
-		ret = -FI_EAGAIN;
-		goto out;
-	}
+	ret = ofi_cirque_isfull(util_cq->cirq) ? -FI_EAGAIN : 0;
+	fastlock_release(&util_cq->cq_lock);
+	if (ret)
+		return ret;
 
 	match_attr.addr = recv_entry->addr;
 	match_attr.tag = recv_entry->tag;
@@ -378,17 +441,16 @@ static int rxm_check_unexp_msg_list(struct util_cq *util_cq, struct rxm_recv_que
 
 	entry = dlist_remove_first_match(&recv_queue->unexp_msg_list, match, &match_attr);
 	if (!entry)
-		goto out;
+		return 0;
 	FI_DBG(&rxm_prov, FI_LOG_EP_DATA, "Match for posted recv found in unexp msg list\n");
 
 	unexp_msg = container_of(entry, struct rxm_unexp_msg, entry);
 	rx_buf = container_of(unexp_msg, struct rxm_rx_buf, unexp_msg);
 	rx_buf->recv_entry = recv_entry;
 
+	/* rxm_cq_comp takes cq_lock to write the completion */
 	ret = rxm_cq_handle_data(rx_buf);
-out:
-	fastlock_release(&util_cq->cq_lock);
-	return ret;
+	return ret ? ret : 1;
 }
 
 static int rxm_ep_recv_common(struct rxm_ep *rxm_ep, const struct iovec *iov,
@@ -417,6 +479,7 @@ static int rxm_ep_recv_common(struct rxm_ep *rxm_ep, const struct iovec *iov,
 	recv_entry->count = count;
 	recv_entry->addr = (rxm_ep->rxm_info->caps & FI_DIRECTED_RECV) ?
 		src_addr : FI_ADDR_UNSPEC;
+	recv_entry->context = context;
 	recv_entry->flags = flags;
 	recv_entry->tag = tag;
 	recv_entry->ignore = ignore;
@@ -424,11 +487,15 @@ static int rxm_ep_recv_common(struct rxm_ep *rxm_ep, const struct iovec *iov,
 	if (!dlist_empty(&recv_queue->unexp_msg_list)) {
 		ret = rxm_check_unexp_msg_list(rxm_ep->util_ep.rx_cq, recv_queue,
 				recv_entry, recv_queue->match_unexp);
-		if (ret) {
+		if (ret < 0) {
 			FI_WARN(&rxm_prov, FI_LOG_EP_DATA,
 					"Unable to check unexp msg list\n");
+			freestack_push(recv_queue->fs, recv_entry);
 			return ret;
 		}
+		/* The entry now belongs to the unexpected message */
+		if (ret)
+			return 0;
 	}
 
 	dlist_insert_tail(&recv_entry->entry, &recv_queue->recv_list);
@@ -494,23 +561,32 @@ void rxm_pkt_init(struct rxm_pkt *pkt)
 	pkt->hdr.version = OFI_OP_VERSION;
 }
 
-void rxm_ep_msg_mr_closev(struct fid_mr **mr, size_t count)
+void rxm_ep_msg_mr_closev(struct rxm_ep *rxm_ep, struct fid_mr **mr,
+			  struct ofi_mr_entry **mr_entry, size_t count)
 {
+	struct rxm_domain *rxm_domain;
 	int ret;
 	size_t i;
 
+	rxm_domain = container_of(rxm_ep->util_ep.domain, struct rxm_domain, util_domain);
+
 	for (i = 0; i < count; i++) {
-		if (mr[i]) {
+		if (mr_entry[i]) {
+			ofi_mr_cache_delete(&rxm_domain->mr_cache, mr_entry[i]);
+		} else if (mr[i]) {
 			ret = fi_close(&mr[i]->fid);
 			if (ret)
 				FI_WARN(&rxm_prov, FI_LOG_EP_DATA,
 					"Unable to close msg mr: %d\n", i);
 		}
+		mr_entry[i] = NULL;
+		mr[i] = NULL;
 	}
 }
 
 int rxm_ep_msg_mr_regv(struct rxm_ep *rxm_ep, const struct iovec *iov,
-		       size_t count, uint64_t access, struct fid_mr **mr)
+		       size_t count, uint64_t access, struct fid_mr **mr,
+		       struct ofi_mr_entry **mr_entry)
 {
 	struct rxm_domain *rxm_domain;
 	int ret;
@@ -520,34 +596,129 @@ int rxm_ep_msg_mr_regv(struct rxm_ep *rxm_ep, const struct iovec *iov,
 
 	// TODO do fi_mr_regv if provider supports it
 	for (i = 0; i < count; i++) {
-		ret = fi_mr_reg(rxm_domain->msg_domain, iov->iov_base,
-				iov->iov_len, access, 0, 0, 0, &mr[i], NULL);
+		if (rxm_domain->mr_cache.max_cached_cnt) {
+			ret = ofi_mr_cache_search(&rxm_domain->mr_cache,
+						  &iov[i], &mr_entry[i]);
+			if (!ret)
+				mr[i] = mr_entry[i]->context;
+		} else {
+			mr_entry[i] = NULL;
+			ret = fi_mr_reg(rxm_domain->msg_domain, iov[i].iov_base,
+					iov[i].iov_len, access, 0, 0, 0, &mr[i], NULL);
+		}
 		if (ret)
 			goto err;
 	}
 	return 0;
 err:
-	rxm_ep_msg_mr_closev(mr, count);
+	rxm_ep_msg_mr_closev(rxm_ep, mr, mr_entry, i);
 	return ret;
 }
 
-static ssize_t rxm_rma_iov_init(struct rxm_ep *rxm_ep, void *buf,
-				const struct iovec *iov, size_t count,
-				struct fid_mr **mr)
+ssize_t rxm_rma_iov_init(struct rxm_ep *rxm_ep, void *buf,
+			 const struct iovec *iov, size_t count,
+			 struct fid_mr **mr, struct ofi_mr_entry **mr_entry)
 {
 	struct rxm_rma_iov *rma_iov = (struct rxm_rma_iov *)buf;
 	size_t i;
 
 	for (i = 0; i < count; i++) {
-		rma_iov->iov[i].addr = RXM_MR_VIRT_ADDR(rxm_ep->msg_info) ?
-			(uintptr_t)iov->iov_base : 0;
-		rma_iov->iov[i].len = (uint64_t)iov->iov_len;
+		if (RXM_MR_VIRT_ADDR(rxm_ep->msg_info))
+			rma_iov->iov[i].addr = (uintptr_t)iov[i].iov_base;
+		else if (mr_entry && mr_entry[i])
+			/* a cached region may start before the buffer */
+			rma_iov->iov[i].addr = (uintptr_t)iov[i].iov_base -
+				(uintptr_t)mr_entry[i]->iov.iov_base;
+		else
+			rma_iov->iov[i].addr = 0;
+		rma_iov->iov[i].len = (uint64_t)iov[i].iov_len;
 		rma_iov->iov[i].key = fi_mr_key(mr[i]);
 	}
 	rma_iov->count = count;
 	return sizeof(*rma_iov) + sizeof(*rma_iov->iov) * count;
 }
 
+/* Post the remaining segments of a SAR message until the MSG EP or the
+ * buffer pool runs out of room. */
+int rxm_ep_sar_tx_continue(struct rxm_tx_entry *tx_entry)
+{
+	struct rxm_tx_buf *first = tx_entry->tx_buf, *tx_buf;
+	size_t seg_size;
+	int ret;
+
+	while (tx_entry->sar_offset < first->pkt.hdr.size) {
+		tx_buf = (struct rxm_tx_buf *)rxm_buf_get(&tx_entry->ep->tx_pool);
+		if (!tx_buf)
+			return -FI_EAGAIN;
+
+		tx_buf->hdr.state = RXM_SAR_TX;
+		tx_buf->hdr.msg_ep = first->hdr.msg_ep;
+		tx_buf->tx_entry = tx_entry;
+
+		seg_size = MIN(RXM_TX_DATA_SIZE,
+			       first->pkt.hdr.size - tx_entry->sar_offset);
+		tx_buf->pkt = first->pkt;
+		tx_buf->pkt.ctrl_hdr.type = ofi_ctrl_data;
+		tx_buf->pkt.ctrl_hdr.seg_size = seg_size;
+		tx_buf->pkt.ctrl_hdr.seg_no = tx_entry->sar_offset /
+					      first->pkt.ctrl_hdr.seg_size;
+		ofi_copy_from_iov(tx_buf->pkt.data, seg_size, tx_entry->iov,
+				  tx_entry->count, tx_entry->sar_offset);
+
+		ret = fi_send(tx_buf->hdr.msg_ep, &tx_buf->pkt,
+			      sizeof(tx_buf->pkt) + seg_size,
+			      rxm_buf_get_desc(&tx_entry->ep->tx_pool, tx_buf),
+			      0, tx_buf);
+		if (ret) {
+			rxm_buf_release(&tx_entry->ep->tx_pool,
+					(struct rxm_buf *)tx_buf);
+			return ret;
+		}
+		tx_entry->sar_offset += seg_size;
+		tx_entry->sar_pending++;
+	}
+	return 0;
+}
+
+/* The first segment carries the message header and goes out before the
+ * call returns, so message matching order is kept. The rest follow as
+ * MSG EP send credits allow. */
+static ssize_t rxm_ep_sar_tx_start(struct rxm_ep *rxm_ep,
+				   struct rxm_tx_entry *tx_entry,
+				   const struct iovec *iov, void *desc)
+{
+	struct rxm_tx_buf *tx_buf = tx_entry->tx_buf;
+	struct rxm_pkt *pkt = &tx_buf->pkt;
+	ssize_t ret;
+
+	memcpy(tx_entry->iov, iov, sizeof(*iov) * tx_entry->count);
+
+	pkt->ctrl_hdr.type = ofi_ctrl_start_data;
+	pkt->ctrl_hdr.seg_size = RXM_TX_DATA_SIZE;
+	pkt->ctrl_hdr.seg_no = 0;
+	ofi_copy_from_iov(pkt->data, RXM_TX_DATA_SIZE, iov, tx_entry->count, 0);
+
+	tx_entry->state = RXM_SAR_TX;
+	tx_buf->hdr.state = RXM_SAR_TX;
+	tx_buf->tx_entry = tx_entry;
+
+	ret = fi_send(tx_buf->hdr.msg_ep, pkt, sizeof(*pkt) + RXM_TX_DATA_SIZE,
+		      desc, 0, tx_buf);
+	if (ret)
+		return ret;
+
+	tx_entry->sar_offset = RXM_TX_DATA_SIZE;
+	tx_entry->sar_pending = 1;
+
+	ret = rxm_ep_sar_tx_continue(tx_entry);
+	if (ret && ret != -FI_EAGAIN)
+		FI_WARN(&rxm_prov, FI_LOG_EP_DATA,
+			"Unable to send SAR segment: %zd\n", ret);
+	if (tx_entry->sar_offset < pkt->hdr.size)
+		dlist_insert_tail(&tx_entry->sar_entry, &rxm_ep->sar_tx_list);
+	return 0;
+}
+
 // TODO handle all flags
 static ssize_t rxm_ep_send_common(struct fid_ep *ep_fid, const struct iovec *iov,
 		void **desc, size_t count, fi_addr_t dest_addr, void *context,
@@ -559,9 +730,11 @@ static ssize_t rxm_ep_send_common(struct fid_ep *ep_fid, const struct iovec *iov
 	struct rxm_tx_buf *tx_buf;
 	struct rxm_pkt *pkt;
 	struct fid_mr **mr_iov;
+	struct ofi_mr_entry **mr_entry = NULL;
 	void *desc_tx_buf = NULL;
 	size_t pkt_size = 0;
 	ssize_t size;
+	size_t i;
 	int ret;
 
 	rxm_ep = container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
@@ -619,23 +792,50 @@ static ssize_t rxm_ep_send_common(struct fid_ep *ep_fid, const struct iovec *iov
 					       rxm_txe_fs_index(rxm_ep->send_queue.fs,
 								tx_entry));
 		pkt->ctrl_hdr.msg_id = tx_entry->msg_id;
+
+		if (pkt->hdr.size <= (size_t)rxm_sar_limit) {
+			FI_DBG(&rxm_prov, FI_LOG_EP_DATA,
+			       "Sending SAR msg. msg_id: 0x%" PRIx64 "\n",
+			       tx_entry->msg_id);
+			ret = rxm_ep_sar_tx_start(rxm_ep, tx_entry, iov,
+						  desc_tx_buf);
+			if (ret)
+				goto done;
+			return 0;
+		}
+
 		pkt->ctrl_hdr.type = ofi_ctrl_large_data;
+		pkt->hdr.op_data = rxm_lmt_write ? RXM_LMT_OP_WRITE :
+						   RXM_LMT_OP_READ;
 
 		if (!RXM_MR_LOCAL(rxm_ep->rxm_info)) {
 			ret = rxm_ep_msg_mr_regv(rxm_ep, iov, tx_entry->count,
-						 FI_REMOTE_READ, tx_entry->mr);
+						 rxm_lmt_write ? FI_WRITE :
+						 FI_REMOTE_READ, tx_entry->mr,
+						 tx_entry->mr_entry);
 			if (ret)
 				goto done;
 			mr_iov = tx_entry->mr;
+			mr_entry = tx_entry->mr_entry;
 		} else {
 			/* desc is msg fid_mr * array */
 			mr_iov = (struct fid_mr **)desc;
 		}
-		size = rxm_rma_iov_init(rxm_ep, &tx_entry->tx_buf->pkt.data, iov,
-					count, mr_iov);
-		if (size < 0) {
-			ret = size;
-			goto done;
+
+		if (rxm_lmt_write) {
+			/* The receiver replies with the buffer to write to */
+			for (i = 0; i < count; i++) {
+				tx_entry->iov[i] = iov[i];
+				tx_entry->desc[i] = fi_mr_desc(mr_iov[i]);
+			}
+			size = 0;
+		} else {
+			size = rxm_rma_iov_init(rxm_ep, &tx_entry->tx_buf->pkt.data,
+						iov, count, mr_iov, mr_entry);
+			if (size < 0) {
+				ret = size;
+				goto done;
+			}
 		}
 
 		pkt_size = sizeof(*pkt) + size;
@@ -883,10 +1083,13 @@ static int rxm_ep_msg_res_close(struct rxm_ep *rxm_ep)
 		retv = ret;
 	}
 
-	ret = fi_close(&rxm_ep->srx_ctx->fid);
-	if (ret) {
-		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL, "Unable to close msg shared ctx\n");
-		retv = ret;
+	if (rxm_ep->srx_ctx) {
+		ret = fi_close(&rxm_ep->srx_ctx->fid);
+		if (ret) {
+			FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+				"Unable to close msg shared ctx\n");
+			retv = ret;
+		}
 	}
 
 	ret = fi_close(&rxm_ep->msg_pep->fid);
@@ -909,8 +1112,8 @@ static int rxm_ep_close(struct fid *fid)
 	if (rxm_ep->util_ep.cmap)
 		ofi_cmap_free(rxm_ep->util_ep.cmap);
 
-	rxm_ep_txrx_res_close(rxm_ep);
 	ret = rxm_ep_msg_res_close(rxm_ep);
+	rxm_ep_txrx_res_close(rxm_ep);
 
 	if (rxm_ep->util_ep.tx_cq) {
 		fid_list_remove(&rxm_ep->util_ep.tx_cq->ep_list,
@@ -1021,11 +1224,15 @@ static int rxm_ep_ctrl(struct fid *fid, int command, void *arg)
 		if (!rxm_ep->util_ep.av)
 			return -FI_EOPBADSTATE;
 
-		ret = rxm_ep_prepost_buf(rxm_ep);
-		if (ret) {
-			FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+		rxm_ep->rx_budget = rxm_rx_size ? (size_t)rxm_rx_size :
+				    rxm_ep->msg_info->rx_attr->size;
+		if (rxm_ep->srx_ctx) {
+			ret = rxm_ep_prepost_buf(rxm_ep);
+			if (ret) {
+				FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
 					"Unable to prepost recv bufs\n");
-			return ret;
+				return ret;
+			}
 		}
 		ret = fi_pep_bind(rxm_ep->msg_pep, &rxm_fabric->msg_eq->fid, 0);
 		if (ret) {
@@ -1079,7 +1286,7 @@ static int rxm_ep_msg_res_open(struct fi_info *rxm_fi_info,
 
 	memset(&cq_attr, 0, sizeof(cq_attr));
 	cq_attr.size = rxm_fi_info->tx_attr->size + rxm_fi_info->rx_attr->size;
-	cq_attr.format = FI_CQ_FORMAT_MSG;
+	cq_attr.format = FI_CQ_FORMAT_DATA;
 
 	ret = fi_cq_open(rxm_domain->msg_domain, &cq_attr, &rxm_ep->msg_cq, NULL);
 	if (ret) {
@@ -1089,7 +1296,11 @@ static int rxm_ep_msg_res_open(struct fi_info *rxm_fi_info,
 
 	ret = fi_srx_context(rxm_domain->msg_domain, rxm_ep->msg_info->rx_attr,
 			&rxm_ep->srx_ctx, NULL);
-	if (ret) {
+	if (ret == -FI_ENOSYS || ret == -FI_EOPNOTSUPP) {
+		FI_INFO(&rxm_prov, FI_LOG_FABRIC, "msg provider has no shared "
+			"receive context, posting receive buffers per msg EP\n");
+		rxm_ep->srx_ctx = NULL;
+	} else if (ret) {
 		FI_WARN(&rxm_prov, FI_LOG_FABRIC, "Unable to open shared receive context\n");
 		goto err2;
 	}
@@ -1121,9 +1332,24 @@ err1:
 void rxm_ep_progress(struct util_ep *util_ep)
 {
 	struct rxm_ep *rxm_ep;
+	struct rxm_tx_entry *tx_entry;
+	struct dlist_entry *item, *next;
+	int ret;
 
 	rxm_ep = container_of(util_ep, struct rxm_ep, util_ep);
-	rxm_cq_progress(rxm_ep->msg_cq);
+	rxm_cq_progress(rxm_ep);
+
+	for (item = rxm_ep->sar_tx_list.next; item != &rxm_ep->sar_tx_list;
+	     item = next) {
+		next = item->next;
+		tx_entry = container_of(item, struct rxm_tx_entry, sar_entry);
+		ret = rxm_ep_sar_tx_continue(tx_entry);
+		if (!ret)
+			dlist_remove(&tx_entry->sar_entry);
+		else if (ret != -FI_EAGAIN)
+			FI_WARN(&rxm_prov, FI_LOG_EP_DATA,
+				"Unable to send SAR segment: %d\n", ret);
+	}
 }
 
 int rxm_endpoint(struct fid_domain *domain, struct fi_info *info,
@@ -1136,6 +1362,7 @@ int rxm_endpoint(struct fid_domain *domain, struct fi_info *info,
 	rxm_ep = calloc(1, sizeof(*rxm_ep));
 	if (!rxm_ep)
 		return -FI_ENOMEM;
+	ofi_atomic_initialize32(&rxm_ep->rx_extra, 0);
 
 	if (!(rxm_ep->rxm_info = fi_dupinfo(info))) {
 		ret = -FI_ENOMEM;
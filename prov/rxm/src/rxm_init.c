@@ -39,6 +39,8 @@ int rxm_info_to_core(uint32_t version, struct fi_info *hints,
 		     struct fi_info *core_info)
 {
 	core_info->caps = FI_MSG;
+	if (rxm_lmt_write)
+		core_info->caps |= FI_RMA | FI_WRITE | FI_REMOTE_WRITE;
 	if (hints) {
 		core_info->mode = hints->mode;
 
@@ -60,8 +62,13 @@ int rxm_info_to_core(uint32_t version, struct fi_info *hints,
 				core_info->domain_attr->mode = hints->domain_attr->mode;
 		}
 	}
-	core_info->ep_attr->rx_ctx_cnt = FI_SHARED_CONTEXT;
+	/* Remote CQ data is only used to signal a large message write;
+	 * a receive buffer it consumes is released. */
+	if (rxm_lmt_write)
+		core_info->mode |= FI_RX_CQ_DATA;
 	core_info->ep_attr->type = FI_EP_MSG;
+	/* rxm reads the core CQs in its own progress; no core thread needed */
+	core_info->domain_attr->data_progress = FI_PROGRESS_MANUAL;
 
 	return 0;
 }
@@ -137,6 +144,14 @@ static int rxm_getinfo(uint32_t version, const char *node, const char *service,
 }
 
 
+int rxm_cq_batch = RXM_CQ_BATCH_DEF;
+int rxm_sar_limit = RXM_SAR_LIMIT_DEF;
+int rxm_lmt_write = 0;
+int rxm_mr_cache_size = 0;
+int rxm_mr_cache_max_mb = RXM_MR_CACHE_MAX_MB_DEF;
+int rxm_rx_size = 0;
+int rxm_conn_rx_size = RXM_CONN_RX_SIZE_DEF;
+
 static void rxm_fini(void)
 {
 	/* yawn */
@@ -153,5 +168,52 @@ struct fi_provider rxm_prov = {
 
 RXM_INI
 {
+	fi_param_define(&rxm_prov, "cq_batch", FI_PARAM_INT,
+			"Number of completions read from the msg provider CQ "
+			"in one call (default: 16, max: 64)");
+	fi_param_get_int(&rxm_prov, "cq_batch", &rxm_cq_batch);
+	rxm_cq_batch = MIN(MAX(rxm_cq_batch, 1), RXM_CQ_BATCH_MAX);
+
+	fi_param_define(&rxm_prov, "sar_limit", FI_PARAM_INT,
+			"Largest message sent as a series of eager segments; "
+			"larger messages use the rendezvous protocol. Values "
+			"below the eager buffer size disable segmentation "
+			"(default: 262144)");
+	fi_param_get_int(&rxm_prov, "sar_limit", &rxm_sar_limit);
+	rxm_sar_limit = MAX(rxm_sar_limit, 0);
+
+	fi_param_define(&rxm_prov, "lmt_write", FI_PARAM_BOOL,
+			"Send large messages with an RMA write by the sender "
+			"instead of an RMA read by the receiver (default: no)");
+	fi_param_get_bool(&rxm_prov, "lmt_write", &rxm_lmt_write);
+
+	fi_param_define(&rxm_prov, "mr_cache_size", FI_PARAM_INT,
+			"Number of large message buffer registrations kept "
+			"after a transfer completes (default: 0, disabled). "
+			"Buffers must not be freed while they are cached.");
+	fi_param_get_int(&rxm_prov, "mr_cache_size", &rxm_mr_cache_size);
+	rxm_mr_cache_size = MAX(rxm_mr_cache_size, 0);
+
+	fi_param_define(&rxm_prov, "mr_cache_max_mb", FI_PARAM_INT,
+			"Total size in MB of the cached registrations "
+			"(default: 1024)");
+	fi_param_get_int(&rxm_prov, "mr_cache_max_mb", &rxm_mr_cache_max_mb);
+	rxm_mr_cache_max_mb = MAX(rxm_mr_cache_max_mb, 1);
+
+	fi_param_define(&rxm_prov, "rx_size", FI_PARAM_INT,
+			"Number of receive buffers kept posted to the msg "
+			"provider's shared receive context, or without one, "
+			"the number that msg EPs may take beyond their floor "
+			"of 4 (default: msg provider rx size)");
+	fi_param_get_int(&rxm_prov, "rx_size", &rxm_rx_size);
+	rxm_rx_size = MAX(rxm_rx_size, 0);
+
+	fi_param_define(&rxm_prov, "conn_rx_size", FI_PARAM_INT,
+			"Maximum number of receive buffers posted to one msg "
+			"EP when the msg provider has no shared receive "
+			"context (default: 16)");
+	fi_param_get_int(&rxm_prov, "conn_rx_size", &rxm_conn_rx_size);
+	rxm_conn_rx_size = MAX(rxm_conn_rx_size, 1);
+
 	return &rxm_prov;
 }
@@ -53,6 +53,7 @@
 #include <fi_indexer.h>
 #include <fi_rbuf.h>
 #include <fi_list.h>
+#include <rbtree.h>
 #include <fi_file.h>
 #include <fi_osd.h>
 #include "fi_util.h"
@@ -78,11 +79,15 @@
 #define SOCK_EP_MIN_MULTI_RECV (64)
 #define SOCK_EP_MAX_ATOMIC_SZ (4096)
 #define SOCK_EP_MAX_CTX_BITS (16)
+#define SOCK_EP_RX_HASH_SZ (256)
 #define SOCK_EP_MSG_PREFIX_SZ (0)
 
 #define SOCK_PE_POLL_TIMEOUT (100000)
 #define SOCK_PE_MAX_ENTRIES (128)
 #define SOCK_PE_WAITTIME (10)
+#define SOCK_PE_DEF_COUNT (1)
+/* responses name the waiting entry by engine and slot in 16 bits */
+#define SOCK_PE_MAX_COUNT (UINT16_MAX / SOCK_PE_MAX_ENTRIES + 1)
 
 #define SOCK_EQ_DEF_SZ (1<<8)
 #define SOCK_CQ_DEF_SZ (1<<8)
@@ -91,6 +96,7 @@
 
 #define SOCK_CQ_DATA_SIZE (sizeof(uint64_t))
 #define SOCK_TAG_SIZE (sizeof(uint64_t))
+#define SOCK_RNDV_LEN_SIZE (sizeof(uint64_t))
 #define SOCK_MAX_NETWORK_ADDR_SZ (35)
 
 #define SOCK_PEP_LISTENER_TIMEOUT (10000)
@@ -100,6 +106,8 @@
 #define SOCK_CM_DEF_BACKLOG (128)
 #define SOCK_CM_DEF_RETRY (5)
 #define SOCK_CM_CONN_IN_PROGRESS ((struct sock_conn *)(0x1L))
+#define SOCK_CONN_TIMEOUT (15000)
+#define SOCK_CONN_RETRY_DELAY (10000)
 
 #define SOCK_EP_RDM_PRI_CAP (FI_MSG | FI_RMA | FI_TAGGED | FI_ATOMICS |	\
 			 FI_NAMED_RX_CTX | \
@@ -148,8 +156,11 @@
 #define SOCK_NO_COMPLETION (1ULL << 60)
 #define SOCK_USE_OP_FLAGS (1ULL << 61)
 #define SOCK_TRIGGERED_OP (1ULL << 62)
+#define SOCK_RNDV (1ULL << 63)
 #define SOCK_PE_COMM_BUFF_SZ (1024)
 #define SOCK_PE_OVERFLOW_COMM_BUFF_SZ (128)
+#define SOCK_PE_TX_BATCH_MAX (16)
+#define SOCK_PE_RX_BATCH_MAX (16)
 
 /* it must be adjusted if error data size in CQ/EQ 
  * will be larger than SOCK_EP_MAX_CM_DATA_SZ */
@@ -164,6 +175,8 @@ enum {
 #define SOCK_MINOR_VERSION 0
 
 #define SOCK_WIRE_PROTO_VERSION (1)
+/* rendezvous messages, so that older peers reject rather than misread them */
+#define SOCK_WIRE_PROTO_RNDV_VERSION (2)
 
 struct sock_service_entry {
 	int service;
@@ -196,21 +209,56 @@ struct sock_fabric {
 	fastlock_t lock;
 };
 
+/* connection establishment state, driven by the progress engine */
+enum {
+	SOCK_CONN_DONE = 0,
+	SOCK_CONN_CONNECTING,
+	SOCK_CONN_RETRY_WAIT,
+	/* gave up; the next send to the address reconnects through the same
+	 * entry, which is reclaimed for other peers once unreferenced */
+	SOCK_CONN_FAILED,
+};
+
 struct sock_conn {
 	int sock_fd;
 	int connected;
 	int address_published;
+	int connect_state;
+	int connect_retry;
+	int connect_ready;
+	uint64_t connect_time;
 	struct sockaddr_in addr;
 	struct sock_pe_entry *rx_pe_entry;
 	struct sock_pe_entry *tx_pe_entry;
 	struct sock_ep_attr *ep_attr;
 	fi_addr_t av_index;
 	struct dlist_entry ep_entry;
+	int zerocopy;
+	uint32_t zc_next;
+	uint32_t zc_done;
+
+	/* small sends staged in their comm buffers, in wire order */
+	struct sock_pe_entry *tx_batch[SOCK_PE_TX_BATCH_MAX];
+	int tx_batch_cnt;
+
+	/* bytes read past the end of the last message */
+	char *rx_stash;
+	size_t rx_stash_off;
+	size_t rx_stash_len;
+
+	/* operations queued on a TX ring or held by a TX pe_entry; the
+	 * entry is not handed out again while any remain */
+	ofi_atomic32_t ref;
+
+	/* taken by an engine working on the connection when the endpoint's
+	 * contexts are spread over several engines */
+	fastlock_t lock;
 };
 
 struct sock_conn_map {
-	struct sock_conn *table;
+	struct sock_conn **table;
 	struct sock_epoll_set epoll_set;
+	struct sock_epoll_set connect_set;
 	int used;
 	int size;
 	fastlock_t lock;
@@ -228,7 +276,9 @@ struct sock_domain {
 
 	enum fi_progress	progress_mode;
 	struct ofi_mr_map	mr_map;
-	struct sock_pe		*pe;
+	struct sock_pe		**pe;
+	int			pe_count;
+	int			pe_next;
 	struct dlist_entry	dom_list_entry;
 	struct fi_domain_attr	attr;
 };
@@ -259,7 +309,7 @@ struct sock_triggered_context {
 struct sock_trigger {
 	enum fi_op_type op_type;
 	size_t threshold;
-	struct dlist_entry entry;
+	uint64_t seq;
 
 	struct sock_triggered_context *context;
 	struct fid_ep *ep;
@@ -310,7 +360,8 @@ struct sock_cntr {
 	fastlock_t		list_lock;
 
 	fastlock_t		trigger_lock;
-	struct dlist_entry	trigger_list;
+	RbtHandle		trigger_tree;
+	uint64_t		trigger_seq;
 
 	struct fid_wait		*waitset;
 	int			signal;
@@ -336,6 +387,7 @@ struct sock_av_addr {
 struct sock_av_table_hdr {
 	uint64_t size;
 	uint64_t stored;
+	uint64_t gen;	/* bumped by every insert and remove */
 };
 
 struct sock_av {
@@ -354,6 +406,13 @@ struct sock_av {
 	int    shared;
 	struct dlist_entry ep_list;
 	fastlock_t list_lock;
+
+	/* process-local reverse map from sockaddr to table index */
+	fastlock_t table_lock;
+	int *addr_hash;
+	int *addr_next;
+	uint64_t addr_hash_mask;
+	uint64_t addr_hash_gen;	/* table_hdr->gen when built */
 };
 
 struct sock_fid_list {
@@ -401,6 +460,9 @@ enum {
 
 	SOCK_OP_CONN_MSG = 12,
 
+	SOCK_OP_RNDV_PULL = 13,
+	SOCK_OP_RNDV_DATA = 14,
+
 	/* internal */
 	SOCK_OP_RECV,
 	SOCK_OP_TRECV,
@@ -534,6 +596,8 @@ struct sock_ep_attr {
 	struct sock_eq *eq;
 	struct sock_av *av;
 	struct sock_domain *domain;
+	struct sock_pe *pe;
+	int pe_cnt;	/* engines from pe on that host the contexts */
 
 	struct sock_rx_ctx *rx_ctx;
 	struct sock_tx_ctx *tx_ctx;
@@ -586,6 +650,16 @@ struct sock_pep {
 	int name_set;
 };
 
+/*
+ * Rendezvous receives waiting for their payload.  The slot index and its
+ * generation travel in the pull request and come back with the data.
+ */
+struct sock_rndv_slot {
+	struct sock_rx_entry *rx_entry;
+	uint32_t gen;
+	uint32_t next_free;
+};
+
 struct sock_rx_entry {
 	struct sock_op rx_op;
 	uint8_t is_buffered;
@@ -594,7 +668,8 @@ struct sock_rx_entry {
 	uint8_t is_complete;
 	uint8_t is_tagged;
 	uint8_t is_pool_entry;
-	uint8_t reserved[2];
+	uint8_t is_rndv;
+	uint8_t rndv_ack;
 
 	uint64_t used;
 	uint64_t total_len;
@@ -607,10 +682,22 @@ struct sock_rx_entry {
 	uint64_t ignore;
 	struct sock_comp *comp;
 
+	/* rendezvous sends: the sender, its waiting PE entry and the rx_id
+	 * it addressed */
+	struct sock_conn *conn;
+	uint16_t rndv_id;
+	uint8_t rndv_rx_id;
+
 	union sock_iov iov[SOCK_EP_MAX_IOV_LIMIT];
 	struct dlist_entry entry;
 	struct slist_entry pool_entry;
 	struct sock_rx_ctx *rx_ctx;
+
+	/* matching queue links, see sock_rx_entry.c */
+	uint64_t seq;
+	int src_bucket;
+	struct dlist_entry match_entry;
+	struct dlist_entry src_entry;
 };
 
 struct sock_rx_ctx {
@@ -622,6 +709,7 @@ struct sock_rx_ctx {
 	int is_ctrl_ctx;
 	int recv_cq_event;
 	int use_shared;
+	int pe_assigned;
 
 	size_t num_left;
 	size_t buffered_len;
@@ -634,6 +722,7 @@ struct sock_rx_ctx {
 	struct sock_av *av;
 	struct sock_eq *eq;
  	struct sock_domain *domain;
+	struct sock_pe *pe;
 
 	struct dlist_entry pe_entry;
 	struct dlist_entry cq_entry;
@@ -641,9 +730,33 @@ struct sock_rx_ctx {
 	struct dlist_entry pe_entry_list;
 	struct dlist_entry rx_entry_list;
 	struct dlist_entry rx_buffered_list;
+	struct dlist_entry rx_rndv_list;
+	struct sock_rndv_slot *rndv_slots;
+	uint32_t rndv_slots_size;
+	uint32_t rndv_free;
 	struct dlist_entry ep_list;
 	fastlock_t lock;
 
+	/* posted receive matching queues */
+	struct dlist_entry *rx_tag_hash;
+	struct dlist_entry *rx_src_hash;
+	struct dlist_entry rx_directed_list;
+	struct dlist_entry rx_wild_list;
+	struct dlist_entry rx_msg_list;
+
+	/* unexpected message matching queues */
+	struct dlist_entry *rx_buffered_tag_hash;
+	struct dlist_entry *rx_buffered_src_hash;
+	struct dlist_entry *rx_buffered_unspec_hash;
+	struct dlist_entry rx_buffered_unspec_list;
+	struct dlist_entry rx_buffered_msg_list;
+	struct dlist_entry rx_claimed_list;
+
+	uint64_t match_seq;
+	size_t num_directed;
+	size_t num_buffered_unspec;
+	int buffered_pending;
+
 	struct fi_rx_attr attr;
 	struct sock_rx_entry *rx_entry_pool;
 	struct slist pool_list;
@@ -659,12 +772,14 @@ struct sock_tx_ctx {
 	struct ofi_ringbuf rb;
 	fastlock_t wlock;
 	fastlock_t rlock;
+	struct sock_conn *write_conn;
 
 	uint16_t tx_id;
 	uint8_t enabled;
 	uint8_t progress;
 
 	int use_shared;
+	int pe_assigned;
 	uint64_t addr;
 	struct sock_comp comp;
 	struct sock_rx_ctx *rx_ctrl_ctx;
@@ -674,6 +789,7 @@ struct sock_tx_ctx {
 	struct sock_av *av;
 	struct sock_eq *eq;
  	struct sock_domain *domain;
+	struct sock_pe *pe;
 
 	struct dlist_entry pe_entry;
 	struct dlist_entry cq_entry;
@@ -765,7 +881,11 @@ struct sock_tx_pe_entry {
 	struct sock_comp *comp;
 	uint8_t header_sent;
 	uint8_t send_done;
-	uint8_t reserved[6];
+	uint8_t zc_pending;
+	uint8_t zc_deferred;
+	uint8_t zc_acked;
+	uint8_t batched;
+	uint32_t zc_id;
 
 	struct sock_tx_ctx *tx_ctx;
 	struct sock_tx_iov tx_iov[SOCK_EP_MAX_IOV_LIMIT];
@@ -831,6 +951,7 @@ struct sock_pe_entry {
 
 struct sock_pe {
 	struct sock_domain *domain;
+	int index;
 	int num_free_entries;
 	struct sock_pe_entry pe_table[SOCK_PE_MAX_ENTRIES];
 	fastlock_t lock;
@@ -853,6 +974,7 @@ struct sock_pe {
 	volatile int do_progress;
 	struct sock_pe_entry *pe_atomic;
 	struct sock_epoll_set epoll_set;
+	ofi_atomic32_t rx_stashed;
 };
 
 typedef int (*sock_cq_report_fn) (struct sock_cq *cq, fi_addr_t addr,
@@ -1002,6 +1124,7 @@ void sock_dom_add_to_list(struct sock_domain *domain);
 int sock_dom_check_list(struct sock_domain *domain);
 void sock_dom_remove_from_list(struct sock_domain *domain);
 struct sock_domain *sock_dom_list_head(void);
+struct sock_pe *sock_dom_get_pe(struct sock_domain *domain);
 int sock_dom_check_manual_progress(struct sock_fabric *fabric);
 int sock_query_atomic(struct fid_domain *domain,
 		      enum fi_datatype datatype, enum fi_op op,
@@ -1119,7 +1242,13 @@ struct sock_conn *sock_ep_lookup_conn(struct sock_ep_attr *attr, fi_addr_t index
 int sock_ep_get_conn(struct sock_ep_attr *ep_attr, struct sock_tx_ctx *tx_ctx,
 		     fi_addr_t index, struct sock_conn **pconn);
 void sock_ep_remove_conn(struct sock_ep_attr *ep_attr, struct sock_conn *conn);
+struct sock_pe *sock_ep_get_pe(struct sock_ep_attr *attr, int index);
+void sock_ep_poll_add(struct sock_ep_attr *attr, int fd);
+void sock_ep_poll_del(struct sock_ep_attr *attr, int fd);
+void sock_ep_signal(struct sock_ep_attr *attr);
 struct sock_conn *sock_ep_connect(struct sock_ep_attr *attr, fi_addr_t index);
+int sock_conn_progress_connect(struct sock_ep_attr *ep_attr,
+			       struct sock_conn *conn);
 ssize_t sock_conn_send_src_addr(struct sock_ep_attr *ep_attr, struct sock_tx_ctx *tx_ctx,
 				struct sock_conn *conn);
 int sock_conn_listen(struct sock_ep_attr *ep_attr);
@@ -1131,7 +1260,7 @@ void sock_set_sockopt_reuseaddr(int sock);
 int sock_conn_map_init(struct sock_ep *ep, int init_size);
 void sock_set_sockopts_conn(int sock);
 
-struct sock_pe *sock_pe_init(struct sock_domain *domain);
+struct sock_pe *sock_pe_init(struct sock_domain *domain, int index);
 void sock_pe_add_tx_ctx(struct sock_pe *pe, struct sock_tx_ctx *ctx);
 void sock_pe_add_rx_ctx(struct sock_pe *pe, struct sock_rx_ctx *ctx);
 void sock_pe_signal(struct sock_pe *pe);
@@ -1139,6 +1268,12 @@ void sock_pe_poll_add(struct sock_pe *pe, int fd);
 void sock_pe_poll_del(struct sock_pe *pe, int fd);
 int sock_pe_progress_rx_ctx(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx);
 int sock_pe_progress_tx_ctx(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx);
+ssize_t sock_pe_send_direct(struct sock_tx_ctx *tx_ctx,
+			    struct sock_ep_attr *ep_attr, struct sock_conn *conn,
+			    struct sock_op *tx_op, uint64_t flags,
+			    const struct iovec *iov, size_t iov_count,
+			    uint64_t context, uint64_t addr, uint64_t data,
+			    uint64_t tag);
 void sock_pe_remove_tx_ctx(struct sock_tx_ctx *tx_ctx);
 void sock_pe_remove_rx_ctx(struct sock_rx_ctx *rx_ctx);
 void sock_pe_finalize(struct sock_pe *pe);
@@ -1147,9 +1282,18 @@ void sock_pe_finalize(struct sock_pe *pe);
 struct sock_rx_entry *sock_rx_new_entry(struct sock_rx_ctx *rx_ctx);
 struct sock_rx_entry *sock_rx_new_buffered_entry(struct sock_rx_ctx *rx_ctx,
 						 size_t len);
+void sock_rx_init_queues(struct sock_rx_ctx *rx_ctx);
+void sock_rx_enqueue_posted(struct sock_rx_ctx *rx_ctx,
+			    struct sock_rx_entry *rx_entry);
+void sock_rx_enqueue_buffered(struct sock_rx_ctx *rx_ctx,
+			      struct sock_rx_entry *rx_entry);
+void sock_rx_claim_entry(struct sock_rx_ctx *rx_ctx,
+			 struct sock_rx_entry *rx_entry);
+void sock_rx_dequeue_entry(struct sock_rx_entry *rx_entry);
+int sock_rx_src_bucket(struct sock_rx_ctx *rx_ctx, uint64_t addr);
 struct sock_rx_entry *sock_rx_get_entry(struct sock_rx_ctx *rx_ctx,
-					uint64_t addr, uint64_t tag,
-					uint8_t is_tagged);
+					uint64_t addr, int src_bucket,
+					uint64_t tag, uint8_t is_tagged);
 struct sock_rx_entry *sock_rx_get_buffered_entry(struct sock_rx_ctx *rx_ctx,
 						 uint64_t addr, uint64_t tag,
 						 uint64_t ignore, uint8_t is_tagged);
@@ -1161,13 +1305,31 @@ ssize_t sock_rx_claim_recv(struct sock_rx_ctx *rx_ctx, void *context,
 			   uint8_t is_tagged, const struct iovec *msg_iov,
 			   size_t iov_count);
 void sock_rx_release_entry(struct sock_rx_entry *rx_entry);
+uint64_t sock_rx_rndv_insert(struct sock_rx_ctx *rx_ctx,
+			     struct sock_rx_entry *rx_entry);
+struct sock_rx_entry *sock_rx_rndv_lookup(struct sock_rx_ctx *rx_ctx,
+					  uint64_t cookie);
+void sock_rx_rndv_remove(struct sock_rx_ctx *rx_ctx, uint64_t cookie);
+void sock_rx_fail_rndv(struct sock_ep_attr *ep_attr, struct sock_conn *conn);
 
 ssize_t sock_comm_send(struct sock_pe_entry *pe_entry, const void *buf, size_t len);
+ssize_t sock_comm_sendv(struct sock_pe_entry *pe_entry,
+			const struct iovec *iov, size_t iov_cnt);
 ssize_t sock_comm_recv(struct sock_pe_entry *pe_entry, void *buf, size_t len);
+ssize_t sock_comm_recvv(struct sock_pe_entry *pe_entry,
+			struct iovec *iov, size_t iov_cnt);
 ssize_t sock_comm_peek(struct sock_conn *conn, void *buf, size_t len);
 ssize_t sock_comm_discard(struct sock_pe_entry *pe_entry, size_t len);
 int sock_comm_tx_done(struct sock_pe_entry *pe_entry);
+int sock_comm_zc_enable(struct sock_conn *conn);
+ssize_t sock_comm_sendv_zc(struct sock_pe_entry *pe_entry,
+			   const struct iovec *iov, size_t iov_cnt);
+int sock_comm_zc_done(struct sock_pe_entry *pe_entry);
+void sock_comm_zc_poll(struct sock_conn *conn);
 ssize_t sock_comm_flush(struct sock_pe_entry *pe_entry);
+ssize_t sock_comm_flush_batch(struct sock_conn *conn);
+void sock_comm_stash(struct sock_pe_entry *pe_entry);
+void sock_comm_stash_free(struct sock_conn *conn);
 int sock_comm_is_disconnected(struct sock_pe_entry *pe_entry);
 
 ssize_t sock_ep_recvmsg(struct fid_ep *ep, const struct fi_msg *msg,
@@ -1200,13 +1362,16 @@ ssize_t sock_queue_tmsg_op(struct fid_ep *ep, const struct fi_msg_tagged *msg,
 ssize_t sock_queue_msg_op(struct fid_ep *ep, const struct fi_msg *msg,
 			  uint64_t flags, enum fi_op_type op_type);
 ssize_t sock_queue_cntr_op(struct fi_deferred_work *work, uint64_t flags);
+int sock_cntr_add_trigger(struct sock_cntr *cntr, struct sock_trigger *trigger);
 void sock_cntr_check_trigger_list(struct sock_cntr *cntr);
 
 int sock_epoll_create(struct sock_epoll_set *set, int size);
 int sock_epoll_add(struct sock_epoll_set *set, int fd);
+int sock_epoll_add_out(struct sock_epoll_set *set, int fd);
 int sock_epoll_del(struct sock_epoll_set *set, int fd);
 int sock_epoll_wait(struct sock_epoll_set *set, int timeout);
 int sock_epoll_get_fd_at_index(struct sock_epoll_set *set, int index);
+int sock_epoll_err_at_index(struct sock_epoll_set *set, int index);
 void sock_epoll_close(struct sock_epoll_set *set);
 
 static inline size_t sock_rx_avail_len(struct sock_rx_entry *rx_entry)
@@ -52,6 +52,7 @@
 
 #include "fi_osd.h"
 #include "fi_util.h"
+#include "fasthash.h"
 
 #define SOCK_LOG_DBG(...) _SOCK_LOG_DBG(FI_LOG_AV, __VA_ARGS__)
 #define SOCK_LOG_ERROR(...) _SOCK_LOG_ERROR(FI_LOG_AV, __VA_ARGS__)
@@ -61,21 +62,117 @@
 				count * sizeof(struct sock_av_addr))
 #define SOCK_IS_SHARED_AV(av_name) ((av_name) ? 1 : 0)
 
-int sock_av_get_addr_index(struct sock_av *av, struct sockaddr_in *addr)
+static inline int sock_av_hash_bucket(struct sock_av *av,
+				      struct sockaddr_in *addr)
 {
-	int i;
-	struct sock_av_addr *av_addr;
+	uint64_t key;
 
-	for (i = 0; i < (int)av->table_hdr->size; i++) {
-		av_addr = &av->table[i];
-		if (!av_addr->valid)
-			continue;
+	key = ((uint64_t)addr->sin_addr.s_addr << 16) | addr->sin_port;
+	return (int)(fasthash64(&key, sizeof(key), 0) & av->addr_hash_mask);
+}
 
-		 if (ofi_equals_sockaddr(addr, (struct sockaddr_in *)&av_addr->addr))
-			return i;
+/*
+ * Must hold table_lock
+ */
+static void sock_av_hash_insert(struct sock_av *av, int index)
+{
+	int bucket;
+
+	bucket = sock_av_hash_bucket(av,
+			(struct sockaddr_in *)&av->table[index].addr);
+	av->addr_next[index] = av->addr_hash[bucket];
+	av->addr_hash[bucket] = index;
+}
+
+/*
+ * Must hold table_lock
+ */
+static void sock_av_hash_remove(struct sock_av *av, int index)
+{
+	int *link;
+
+	link = &av->addr_hash[sock_av_hash_bucket(av,
+			(struct sockaddr_in *)&av->table[index].addr)];
+	while (*link != -1) {
+		if (*link == index) {
+			*link = av->addr_next[index];
+			return;
+		}
+		link = &av->addr_next[*link];
 	}
-	SOCK_LOG_DBG("failed to get index in AV\n");
-	return -1;
+}
+
+/*
+ * (Re)build the hash for a table of count entries from the valid entries
+ * currently stored.  Must hold table_lock.
+ */
+static int sock_av_hash_init(struct sock_av *av, size_t count)
+{
+	uint64_t i, buckets;
+	int *hash, *next;
+
+	buckets = roundup_power_of_two(count);
+	hash = malloc(buckets * sizeof(*hash));
+	next = malloc(count * sizeof(*next));
+	if (!hash || !next) {
+		free(hash);
+		free(next);
+		return -FI_ENOMEM;
+	}
+
+	free(av->addr_hash);
+	free(av->addr_next);
+	av->addr_hash = hash;
+	av->addr_next = next;
+	av->addr_hash_mask = buckets - 1;
+	memset(hash, 0xff, buckets * sizeof(*hash));
+
+	for (i = 0; i < av->table_hdr->size; i++) {
+		if (av->table[i].valid)
+			sock_av_hash_insert(av, i);
+	}
+	av->addr_hash_gen = av->table_hdr->gen;
+	return 0;
+}
+
+static int sock_av_hash_lookup(struct sock_av *av, struct sockaddr_in *addr)
+{
+	int i, index = -1;
+
+	/* keep returning the lowest matching index, as a table scan would */
+	for (i = av->addr_hash[sock_av_hash_bucket(av, addr)]; i != -1;
+	     i = av->addr_next[i]) {
+		if (av->table[i].valid && (index == -1 || i < index) &&
+		    ofi_equals_sockaddr(addr, (struct sockaddr_in *)&av->table[i].addr))
+			index = i;
+	}
+	return index;
+}
+
+/*
+ * A read-only shared table is updated by another process, which bumps the
+ * generation on every insert and remove.  Rebuild the hash only when it
+ * has moved since the last build.  Must hold table_lock.
+ */
+static int sock_av_find_index(struct sock_av *av, struct sockaddr_in *addr)
+{
+	if (av->shared && (av->attr.flags & FI_READ) &&
+	    av->table_hdr->gen != av->addr_hash_gen)
+		sock_av_hash_init(av, av->table_hdr->size);
+	return sock_av_hash_lookup(av, addr);
+}
+
+int sock_av_get_addr_index(struct sock_av *av, struct sockaddr_in *addr)
+{
+	int index;
+
+	fastlock_acquire(&av->table_lock);
+	index = sock_av_find_index(av, addr);
+	fastlock_release(&av->table_lock);
+
+	if (index < 0)
+		SOCK_LOG_DBG("failed to get index in AV\n");
+	return index;
 }
 
 int sock_av_compare_addr(struct sock_av *av,
@@ -147,6 +244,9 @@ static int sock_resize_av_table(struct sock_av *av)
 	table_sz = SOCK_AV_TABLE_SZ(new_count, av->attr.name);
 	old_sz = SOCK_AV_TABLE_SZ(av->table_hdr->size, av->attr.name);
 
+	if (sock_av_hash_init(av, new_count))
+		return -1;
+
 	if (av->attr.name) {
 		new_addr = sock_mremap(av->table_hdr, old_sz, table_sz);
 		if (new_addr == MAP_FAILED)
@@ -183,7 +283,6 @@ static int sock_check_table_in(struct sock_av *_av, struct sockaddr_in *addr,
 			       void *context)
 {
 	int i, ret = 0;
-	uint64_t j;
 	char sa_ip[INET_ADDRSTRLEN];
 	struct sock_av_addr *av_addr;
 	int index;
@@ -192,31 +291,28 @@ static int sock_check_table_in(struct sock_av *_av, struct sockaddr_in *addr,
 		return -FI_ENOEQ;
 
 	if (_av->attr.flags & FI_READ) {
+		fastlock_acquire(&_av->table_lock);
 		for (i = 0; i < count; i++) {
-			for (j = 0; j < _av->table_hdr->size; j++) {
-				if (_av->table[j].valid &&
-				     !sock_av_is_valid_address(&addr[i])) {
-					if (fi_addr)
-						fi_addr[i] = FI_ADDR_NOTAVAIL;
-					sock_av_report_error(_av, context, i,
-								FI_EINVAL);
-					continue;
-				}
-
-				av_addr = &_av->table[j];
-				if (memcmp(&av_addr->addr, &addr[i],
-					   sizeof(struct sockaddr_in)) == 0) {
-					SOCK_LOG_DBG("Found addr in shared av\n");
-					if (fi_addr)
-						fi_addr[i] = (fi_addr_t)j;
-					ret++;
-				}
+			index = sock_av_is_valid_address(&addr[i]) ?
+				sock_av_find_index(_av, &addr[i]) : -1;
+			if (index < 0) {
+				if (fi_addr)
+					fi_addr[i] = FI_ADDR_NOTAVAIL;
+				sock_av_report_error(_av, context, i, FI_EINVAL);
+				continue;
 			}
+
+			SOCK_LOG_DBG("Found addr in shared av\n");
+			if (fi_addr)
+				fi_addr[i] = (fi_addr_t)index;
+			ret++;
 		}
+		fastlock_release(&_av->table_lock);
 		sock_av_report_success(_av, context, ret, flags);
 		return (_av->attr.flags & FI_EVENT) ? 0 : ret;
 	}
 
+	fastlock_acquire(&_av->table_lock);
 	for (i = 0, ret = 0; i < count; i++) {
 		if (!sock_av_is_valid_address(&addr[i])) {
 			if (fi_addr)
@@ -250,8 +346,11 @@ static int sock_check_table_in(struct sock_av *_av, struct sockaddr_in *addr,
 			fi_addr[i] = (fi_addr_t)index;
 
 		av_addr->valid = 1;
+		sock_av_hash_insert(_av, index);
 		ret++;
 	}
+	_av->table_hdr->gen++;
+	fastlock_release(&_av->table_lock);
 	sock_av_report_success(_av, context, ret, flags);
 	return (_av->attr.flags & FI_EVENT) ? 0 : ret;
 }
@@ -403,16 +502,22 @@ static int sock_av_remove(struct fid_av *av, fi_addr_t *fi_addr, size_t count,
 			if (conn && conn->sock_fd != -1) {
 				sock_ep_remove_conn(sock_ep->attr, conn);
 				ofi_idm_clear(&sock_ep->attr->av_idm, idx);
+				sock_rx_fail_rndv(sock_ep->attr, conn);
 			}
 		}
 		fastlock_release(&sock_ep->attr->cmap.lock);
 	}
 	fastlock_release(&_av->list_lock);
 
+	fastlock_acquire(&_av->table_lock);
 	for (i = 0; i < count; i++) {
 		av_addr = &_av->table[fi_addr[i]];
+		if (av_addr->valid)
+			sock_av_hash_remove(_av, fi_addr[i]);
 		av_addr->valid = 0;
 	}
+	_av->table_hdr->gen++;
+	fastlock_release(&_av->table_lock);
 
 	return 0;
 }
@@ -466,6 +571,9 @@ static int sock_av_close(struct fid *fid)
 
 	ofi_atomic_dec32(&av->domain->ref);
 	fastlock_destroy(&av->list_lock);
+	fastlock_destroy(&av->table_lock);
+	free(av->addr_hash);
+	free(av->addr_next);
 	free(av);
 	return 0;
 }
@@ -569,6 +677,7 @@ int sock_av_open(struct fid_domain *domain, struct fi_av_attr *attr,
 		} else {
 			_av->table_hdr->size = _av->attr.count;
 			_av->table_hdr->stored = 0;
+			_av->table_hdr->gen = 0;
 		}
 		_av->shared = 1;
 	} else {
@@ -581,6 +690,10 @@ int sock_av_open(struct fid_domain *domain, struct fi_av_attr *attr,
 	}
 	sock_update_av_table(_av, _av->attr.count);
 
+	ret = sock_av_hash_init(_av, _av->attr.count);
+	if (ret)
+		goto err2;
+
 	_av->av_fid.fid.fclass = FI_CLASS_AV;
 	_av->av_fid.fid.context = context;
 	_av->av_fid.fid.ops = &sock_av_fi_ops;
@@ -611,6 +724,7 @@ int sock_av_open(struct fid_domain *domain, struct fi_av_attr *attr,
 	}
 	dlist_init(&_av->ep_list);
 	fastlock_init(&_av->list_lock);
+	fastlock_init(&_av->table_lock);
 	_av->rx_ctx_bits = attr->rx_ctx_bits;
 	_av->mask = attr->rx_ctx_bits ?
 		((uint64_t)1 << (64 - attr->rx_ctx_bits)) - 1 : ~0;
@@ -624,6 +738,8 @@ err2:
 		if(_av->table_hdr != MAP_FAILED)
 			free(_av->table_hdr);
 	}
+	free(_av->addr_hash);
+	free(_av->addr_next);
 err:
 	free(_av);
 	return ret;
@@ -106,9 +106,9 @@ int sock_cntr_progress(struct sock_cntr *cntr)
 		fid_entry = container_of(entry, struct fid_list_entry, entry);
 		tx_ctx = container_of(fid_entry->fid, struct sock_tx_ctx, fid.ctx.fid);
 		if (tx_ctx->use_shared)
-			sock_pe_progress_tx_ctx(cntr->domain->pe, tx_ctx->stx_ctx);
+			sock_pe_progress_tx_ctx(tx_ctx->stx_ctx->pe, tx_ctx->stx_ctx);
 		else
-			sock_pe_progress_tx_ctx(cntr->domain->pe, tx_ctx);
+			sock_pe_progress_tx_ctx(tx_ctx->pe, tx_ctx);
 	}
 
 	for (entry = cntr->rx_list.next; entry != &cntr->rx_list;
@@ -116,31 +116,55 @@ int sock_cntr_progress(struct sock_cntr *cntr)
 		fid_entry = container_of(entry, struct fid_list_entry, entry);
 		rx_ctx = container_of(fid_entry->fid, struct sock_rx_ctx, ctx.fid);
 		if (rx_ctx->use_shared)
-			sock_pe_progress_rx_ctx(cntr->domain->pe, rx_ctx->srx_ctx);
+			sock_pe_progress_rx_ctx(rx_ctx->srx_ctx->pe, rx_ctx->srx_ctx);
 		else
-			sock_pe_progress_rx_ctx(cntr->domain->pe, rx_ctx);
+			sock_pe_progress_rx_ctx(rx_ctx->pe, rx_ctx);
 	}
 
 	fastlock_release(&cntr->list_lock);
 	return 0;
 }
 
+/*
+ * Pending triggers are ordered by threshold, with triggers of equal
+ * threshold in submission order, so they fire in that order and the check
+ * stops at the first one not yet reached.  A tree keeps posting O(log n)
+ * whatever order the thresholds come in.
+ */
+static int sock_cntr_trigger_compare(void *a, void *b)
+{
+	struct sock_trigger *ta = a, *tb = b;
+
+	if (ta->threshold != tb->threshold)
+		return ta->threshold < tb->threshold ? -1 : 1;
+	return ta->seq < tb->seq ? -1 : ta->seq > tb->seq;
+}
+
+int sock_cntr_add_trigger(struct sock_cntr *cntr, struct sock_trigger *trigger)
+{
+	RbtStatus status;
+
+	fastlock_acquire(&cntr->trigger_lock);
+	trigger->seq = cntr->trigger_seq++;
+	status = rbtInsert(cntr->trigger_tree, trigger, trigger);
+	fastlock_release(&cntr->trigger_lock);
+	return status == RBT_STATUS_OK ? 0 : -FI_ENOMEM;
+}
+
 void sock_cntr_check_trigger_list(struct sock_cntr *cntr)
 {
 	struct fi_deferred_work *work;
 	struct sock_trigger *trigger;
-	struct dlist_entry *entry;
+	RbtIterator it;
+	void *key;
 	int ret = 0;
 
 	fastlock_acquire(&cntr->trigger_lock);
-	for (entry = cntr->trigger_list.next;
-	     entry != &cntr->trigger_list;) {
-
-		trigger = container_of(entry, struct sock_trigger, entry);
-		entry = entry->next;
+	while ((it = rbtBegin(cntr->trigger_tree))) {
+		rbtKeyValue(cntr->trigger_tree, it, &key, (void **) &trigger);
 
 		if (ofi_atomic_get32(&cntr->value) < (int) trigger->threshold)
-			continue;
+			break;
 
 		switch (trigger->op_type) {
 		case FI_OP_SEND:
@@ -201,7 +225,7 @@ void sock_cntr_check_trigger_list(struct sock_cntr *cntr)
 		}
 
 		if (ret != -FI_EAGAIN) {
-			dlist_remove(&trigger->entry);
+			rbtErase(cntr->trigger_tree, it);
 			free(trigger);
 		} else {
 			break;
@@ -428,6 +452,7 @@ static int sock_cntr_close(struct fid *fid)
 	pthread_mutex_destroy(&cntr->mut);
 	fastlock_destroy(&cntr->list_lock);
 	fastlock_destroy(&cntr->trigger_lock);
+	rbtDelete(cntr->trigger_tree);
 
 	pthread_cond_destroy(&cntr->cond);
 	ofi_atomic_dec32(&cntr->domain->ref);
@@ -572,7 +597,11 @@ int sock_cntr_open(struct fid_domain *domain, struct fi_cntr_attr *attr,
 	dlist_init(&_cntr->tx_list);
 	dlist_init(&_cntr->rx_list);
 
-	dlist_init(&_cntr->trigger_list);
+	_cntr->trigger_tree = rbtNew(sock_cntr_trigger_compare);
+	if (!_cntr->trigger_tree) {
+		ret = FI_ENOMEM;
+		goto err;
+	}
 	fastlock_init(&_cntr->trigger_lock);
 
 	_cntr->cntr_fid.fid.fclass = FI_CLASS_CNTR;
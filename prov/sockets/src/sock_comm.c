@@ -36,11 +36,19 @@
 #include <stdlib.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 
 #include "sock.h"
 #include "sock_util.h"
 
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#include <linux/errqueue.h>
+#define SOCK_HAVE_ZEROCOPY 1
+#else
+#define SOCK_HAVE_ZEROCOPY 0
+#endif
+
 #define SOCK_LOG_DBG(...) _SOCK_LOG_DBG(FI_LOG_EP_DATA, __VA_ARGS__)
 #define SOCK_LOG_ERROR(...) _SOCK_LOG_ERROR(FI_LOG_EP_DATA, __VA_ARGS__)
 
@@ -65,6 +73,33 @@ static ssize_t sock_comm_send_socket(struct sock_conn *conn,
 	return ret;
 }
 
+static ssize_t sock_comm_sendmsg_socket(struct sock_conn *conn,
+					struct iovec *iov, size_t iov_cnt,
+					int flags)
+{
+	struct msghdr msg;
+	ssize_t ret;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iov_cnt;
+
+	ret = sendmsg(conn->sock_fd, &msg, flags | MSG_NOSIGNAL);
+	if (ret < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			ret = 0;
+		else if (errno == EPIPE) {
+			conn->connected = 0;
+			SOCK_LOG_DBG("Disconnected: %s:%d\n", inet_ntoa(conn->addr.sin_addr),
+				     ntohs(conn->addr.sin_port));
+		} else
+			SOCK_LOG_DBG("write error: %s\n", strerror(errno));
+	}
+	if (ret > 0)
+		SOCK_LOG_DBG("wrote to network: %lu\n", ret);
+	return ret;
+}
+
 ssize_t sock_comm_flush(struct sock_pe_entry *pe_entry)
 {
 	ssize_t ret1, ret2 = 0;
@@ -94,6 +129,49 @@ ssize_t sock_comm_flush(struct sock_pe_entry *pe_entry)
 	return (ret1 > 0) ? ret1 + ret2 : 0;
 }
 
+/*
+ * Write the staged bytes of every send batched on the connection with a
+ * single sendmsg().  Bytes are taken from the batch in wire order.
+ */
+ssize_t sock_comm_flush_batch(struct sock_conn *conn)
+{
+	struct iovec vec[SOCK_PE_TX_BATCH_MAX * 2];
+	struct ofi_ringbuf *rb;
+	size_t used, endlen, xfer_len, len;
+	ssize_t ret;
+	int i, cnt = 0;
+
+	for (i = 0; i < conn->tx_batch_cnt; i++) {
+		rb = &conn->tx_batch[i]->comm_buf;
+		used = ofi_rbused(rb);
+		if (!used)
+			continue;
+
+		endlen = rb->size - (rb->rcnt & rb->size_mask);
+		vec[cnt].iov_base = (char *) rb->buf + (rb->rcnt & rb->size_mask);
+		vec[cnt++].iov_len = MIN(used, endlen);
+		if (used > endlen) {
+			vec[cnt].iov_base = rb->buf;
+			vec[cnt++].iov_len = used - endlen;
+		}
+	}
+
+	if (!cnt)
+		return 0;
+
+	ret = sock_comm_sendmsg_socket(conn, vec, cnt, 0);
+	if (ret <= 0)
+		return 0;
+
+	for (i = 0, len = ret; i < conn->tx_batch_cnt && len; i++) {
+		rb = &conn->tx_batch[i]->comm_buf;
+		xfer_len = MIN(ofi_rbused(rb), len);
+		rb->rcnt += xfer_len;
+		len -= xfer_len;
+	}
+	return ret;
+}
+
 ssize_t sock_comm_send(struct sock_pe_entry *pe_entry,
 		       const void *buf, size_t len)
 {
@@ -121,11 +199,176 @@ ssize_t sock_comm_send(struct sock_pe_entry *pe_entry,
 	return ret;
 }
 
+/*
+ * Gather whatever is staged in the comm buffer (typically the protocol
+ * header) together with the caller's iovecs into a single sendmsg().
+ * Staged bytes are drained first; the return value only counts bytes
+ * taken from the caller's iovecs.
+ */
+ssize_t sock_comm_sendv(struct sock_pe_entry *pe_entry,
+			const struct iovec *iov, size_t iov_cnt)
+{
+	struct iovec vec[SOCK_EP_MAX_IOV_LIMIT + 2];
+	size_t used, endlen, cnt = 0, i;
+	ssize_t ret;
+
+	assert(iov_cnt <= SOCK_EP_MAX_IOV_LIMIT);
+	used = ofi_rbused(&pe_entry->comm_buf);
+	if (used) {
+		endlen = pe_entry->comm_buf.size -
+			(pe_entry->comm_buf.rcnt & pe_entry->comm_buf.size_mask);
+		vec[cnt].iov_base = (char *) pe_entry->comm_buf.buf +
+			(pe_entry->comm_buf.rcnt & pe_entry->comm_buf.size_mask);
+		vec[cnt++].iov_len = MIN(used, endlen);
+		if (used > endlen) {
+			vec[cnt].iov_base = pe_entry->comm_buf.buf;
+			vec[cnt++].iov_len = used - endlen;
+		}
+	}
+
+	for (i = 0; i < iov_cnt; i++)
+		vec[cnt++] = iov[i];
+
+	ret = sock_comm_sendmsg_socket(pe_entry->conn, vec, cnt, 0);
+	if (ret <= 0)
+		return ret;
+
+	if (used) {
+		used = MIN(used, (size_t) ret);
+		pe_entry->comm_buf.rcnt += used;
+		ret -= used;
+	}
+	return ret;
+}
+
 int sock_comm_tx_done(struct sock_pe_entry *pe_entry)
 {
 	return ofi_rbempty(&pe_entry->comm_buf);
 }
 
+#if SOCK_HAVE_ZEROCOPY
+int sock_comm_zc_enable(struct sock_conn *conn)
+{
+	int optval = 1;
+
+	if (setsockopt(conn->sock_fd, SOL_SOCKET, SO_ZEROCOPY,
+		       &optval, sizeof(optval))) {
+		SOCK_LOG_DBG("setsockopt zerocopy failed: %s\n", strerror(errno));
+		return -ofi_sockerr();
+	}
+	conn->zerocopy = 1;
+	return 0;
+}
+
+/*
+ * Every successful MSG_ZEROCOPY send is numbered by the kernel, starting
+ * at zero.  Completions come back on the error queue as inclusive ranges
+ * of those numbers; TCP reports them in order, so tracking the first
+ * number not yet released is enough.  Pending notifications raise
+ * EPOLLERR on the socket, so this must also run whenever that is seen.
+ */
+void sock_comm_zc_poll(struct sock_conn *conn)
+{
+	char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+	struct sock_extended_err *serr;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	uint32_t next;
+
+	while (1) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(conn->sock_fd, &msg, MSG_ERRQUEUE) < 0)
+			break;
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+		     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (!((cmsg->cmsg_level == SOL_IP &&
+			       cmsg->cmsg_type == IP_RECVERR) ||
+			      (cmsg->cmsg_level == SOL_IPV6 &&
+			       cmsg->cmsg_type == IPV6_RECVERR)))
+				continue;
+
+			serr = (struct sock_extended_err *) CMSG_DATA(cmsg);
+			if (serr->ee_errno != 0 ||
+			    serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+
+			next = serr->ee_data + 1;
+			if ((int32_t) (next - conn->zc_done) > 0)
+				conn->zc_done = next;
+
+			/* The kernel fell back to copying (e.g. loopback). */
+			if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				conn->zerocopy = 0;
+		}
+	}
+}
+
+ssize_t sock_comm_sendv_zc(struct sock_pe_entry *pe_entry,
+			   const struct iovec *iov, size_t iov_cnt)
+{
+	struct iovec vec[SOCK_EP_MAX_IOV_LIMIT];
+	struct sock_conn *conn = pe_entry->conn;
+	ssize_t ret;
+
+	/*
+	 * The kernel keeps referencing the pages after sendmsg() returns, so
+	 * the comm buffer must be drained first: it is reused for the next
+	 * header and cannot be handed out by reference.
+	 */
+	sock_comm_flush(pe_entry);
+	if (!sock_comm_tx_done(pe_entry))
+		return 0;
+
+	assert(iov_cnt <= SOCK_EP_MAX_IOV_LIMIT);
+	memcpy(vec, iov, sizeof(*iov) * iov_cnt);
+	ret = sock_comm_sendmsg_socket(conn, vec, iov_cnt, MSG_ZEROCOPY);
+	if (ret < 0 && errno == ENOBUFS)
+		return sock_comm_sendmsg_socket(conn, vec, iov_cnt, 0);
+
+	if (ret > 0) {
+		pe_entry->pe.tx.zc_id = conn->zc_next++;
+		pe_entry->pe.tx.zc_pending = 1;
+	}
+	return ret;
+}
+
+int sock_comm_zc_done(struct sock_pe_entry *pe_entry)
+{
+	if (!pe_entry->pe.tx.zc_pending)
+		return 1;
+
+	sock_comm_zc_poll(pe_entry->conn);
+	if ((int32_t) (pe_entry->conn->zc_done - pe_entry->pe.tx.zc_id) <= 0)
+		return 0;
+
+	pe_entry->pe.tx.zc_pending = 0;
+	return 1;
+}
+#else
+int sock_comm_zc_enable(struct sock_conn *conn)
+{
+	return -FI_ENOSYS;
+}
+
+ssize_t sock_comm_sendv_zc(struct sock_pe_entry *pe_entry,
+			   const struct iovec *iov, size_t iov_cnt)
+{
+	return sock_comm_sendv(pe_entry, iov, iov_cnt);
+}
+
+int sock_comm_zc_done(struct sock_pe_entry *pe_entry)
+{
+	return 1;
+}
+
+void sock_comm_zc_poll(struct sock_conn *conn)
+{
+}
+#endif
+
 static ssize_t sock_comm_recv_socket(struct sock_conn *conn,
 			      void *buf, size_t len)
 {
@@ -148,10 +391,68 @@ static ssize_t sock_comm_recv_socket(struct sock_conn *conn,
 	return ret;
 }
 
+/* any engine hosting the endpoint's contexts may take the stash over */
+static void sock_comm_count_stash(struct sock_conn *conn, int n)
+{
+	int i;
+
+	for (i = 0; i < conn->ep_attr->pe_cnt; i++)
+		ofi_atomic_add32(&sock_ep_get_pe(conn->ep_attr, i)->rx_stashed, n);
+}
+
+/*
+ * Reads into the comm buffer are not bounded by the current message, so
+ * a burst of small messages can be drained with one recv().  Whatever is
+ * left when the reader gives up the connection is parked in the
+ * connection's stash and handed to the next reader ahead of the socket.
+ */
+static size_t sock_comm_recv_stash(struct sock_conn *conn,
+				   void *buf, size_t len)
+{
+	len = MIN(len, conn->rx_stash_len);
+	memcpy(buf, conn->rx_stash + conn->rx_stash_off, len);
+	conn->rx_stash_off += len;
+	conn->rx_stash_len -= len;
+	if (!conn->rx_stash_len)
+		sock_comm_count_stash(conn, -1);
+
+	SOCK_LOG_DBG("read from stash: %lu\n", len);
+	return len;
+}
+
+void sock_comm_stash(struct sock_pe_entry *pe_entry)
+{
+	struct sock_conn *conn = pe_entry->conn;
+	size_t len;
+
+	len = ofi_rbused(&pe_entry->comm_buf);
+	if (!len)
+		return;
+
+	/* the reader only fills its comm buffer once the stash is empty */
+	assert(!conn->rx_stash_len && conn->rx_stash);
+	ofi_rbread(&pe_entry->comm_buf, conn->rx_stash, len);
+	conn->rx_stash_off = 0;
+	conn->rx_stash_len = len;
+	sock_comm_count_stash(conn, 1);
+	SOCK_LOG_DBG("stashed %lu\n", len);
+}
+
+void sock_comm_stash_free(struct sock_conn *conn)
+{
+	if (conn->rx_stash_len)
+		sock_comm_count_stash(conn, -1);
+
+	free(conn->rx_stash);
+	conn->rx_stash = NULL;
+	conn->rx_stash_off = conn->rx_stash_len = 0;
+}
+
 static void sock_comm_recv_buffer(struct sock_pe_entry *pe_entry)
 {
 	int ret;
 	size_t max_read, avail;
+	struct sock_conn *conn = pe_entry->conn;
 
 	avail = ofi_rbavail(&pe_entry->comm_buf);
 	assert(avail == pe_entry->comm_buf.size);
@@ -159,9 +460,15 @@ static void sock_comm_recv_buffer(struct sock_pe_entry *pe_entry)
 		pe_entry->comm_buf.wcnt =
 		pe_entry->comm_buf.wpos = 0;
 
-	max_read = pe_entry->rem ? pe_entry->rem :
-		pe_entry->total_len - pe_entry->done_len;
-	ret = sock_comm_recv_socket(pe_entry->conn, (char *) pe_entry->comm_buf.buf,
+	if (!conn->rx_stash)
+		conn->rx_stash = malloc(SOCK_PE_COMM_BUFF_SZ);
+
+	if (conn->rx_stash)
+		max_read = avail;
+	else
+		max_read = pe_entry->rem ? pe_entry->rem :
+			pe_entry->total_len - pe_entry->done_len;
+	ret = sock_comm_recv_socket(conn, (char *) pe_entry->comm_buf.buf,
 				    MIN(max_read, avail));
 	pe_entry->comm_buf.wpos += ret;
 	ofi_rbcommit(&pe_entry->comm_buf);
@@ -170,40 +477,156 @@ static void sock_comm_recv_buffer(struct sock_pe_entry *pe_entry)
 ssize_t sock_comm_recv(struct sock_pe_entry *pe_entry, void *buf, size_t len)
 {
 	ssize_t read_len;
+	size_t stash_len = 0;
+
+	if (pe_entry->conn->rx_stash_len) {
+		stash_len = sock_comm_recv_stash(pe_entry->conn, buf, len);
+		if (stash_len == len)
+			return stash_len;
+		buf = (char *) buf + stash_len;
+		len -= stash_len;
+	}
+
 	if (ofi_rbempty(&pe_entry->comm_buf)) {
 		if (len <= pe_entry->cache_sz) {
 			sock_comm_recv_buffer(pe_entry);
 		} else {
-			return sock_comm_recv_socket(pe_entry->conn, buf, len);
+			return stash_len +
+				sock_comm_recv_socket(pe_entry->conn, buf, len);
 		}
 	}
 
 	read_len = MIN(len, ofi_rbused(&pe_entry->comm_buf));
 	ofi_rbread(&pe_entry->comm_buf, buf, read_len);
 	SOCK_LOG_DBG("read from buffer: %lu\n", read_len);
-	return read_len;
+	return stash_len + read_len;
 }
 
-ssize_t sock_comm_peek(struct sock_conn *conn, void *buf, size_t len)
+static ssize_t sock_comm_readv_socket(struct sock_conn *conn,
+				      const struct iovec *iov, size_t iov_cnt)
 {
 	ssize_t ret;
-	ret = recv(conn->sock_fd, buf, len, MSG_PEEK);
+	ret = readv(conn->sock_fd, iov, iov_cnt);
 	if (ret == 0) {
 		conn->connected = 0;
-		SOCK_LOG_DBG("Disconnected\n");
+		SOCK_LOG_DBG("Disconnected: %s:%d\n", inet_ntoa(conn->addr.sin_addr),
+			     ntohs(conn->addr.sin_port));
 		return ret;
 	}
 
 	if (ret < 0) {
-		SOCK_LOG_DBG("peek %s\n", strerror(errno));
+		SOCK_LOG_DBG("readv %s\n", strerror(errno));
 		ret = 0;
 	}
 
 	if (ret > 0)
-		SOCK_LOG_DBG("peek from network: %lu\n", ret);
+		SOCK_LOG_DBG("readv from network: %lu\n", ret);
 	return ret;
 }
 
+/* copy out data already read ahead of the socket, without touching it */
+static size_t sock_comm_recv_ahead(struct sock_pe_entry *pe_entry,
+				   void *buf, size_t len)
+{
+	size_t stash_len = 0, read_len;
+
+	if (pe_entry->conn->rx_stash_len)
+		stash_len = sock_comm_recv_stash(pe_entry->conn, buf, len);
+
+	read_len = MIN(len - stash_len, ofi_rbused(&pe_entry->comm_buf));
+	ofi_rbread(&pe_entry->comm_buf, (char *) buf + stash_len, read_len);
+	return stash_len + read_len;
+}
+
+/*
+ * Payloads larger than the comm buffer are read with readv() straight
+ * into the destination iov once the read-ahead data has been handed out.
+ * Smaller ones still go through the comm buffer so that the headers of
+ * the messages behind them come in with the same recv().  The iov array
+ * is used as scratch space.
+ */
+ssize_t sock_comm_recvv(struct sock_pe_entry *pe_entry,
+			struct iovec *iov, size_t iov_cnt)
+{
+	size_t i, len, total = 0;
+	ssize_t ret, done = 0;
+
+	for (i = 0; i < iov_cnt; i++)
+		total += iov[i].iov_len;
+
+	if (total <= pe_entry->cache_sz) {
+		for (i = 0; i < iov_cnt; i++) {
+			ret = sock_comm_recv(pe_entry, iov[i].iov_base,
+					     iov[i].iov_len);
+			done += ret;
+			if (ret != iov[i].iov_len)
+				break;
+		}
+		return done;
+	}
+
+	for (i = 0; i < iov_cnt; i++) {
+		len = sock_comm_recv_ahead(pe_entry, iov[i].iov_base,
+					   iov[i].iov_len);
+		done += len;
+		if (len != iov[i].iov_len) {
+			iov[i].iov_base = (char *) iov[i].iov_base + len;
+			iov[i].iov_len -= len;
+			break;
+		}
+	}
+
+	if (i == iov_cnt)
+		return done;
+	return done + sock_comm_readv_socket(pe_entry->conn, &iov[i],
+					     iov_cnt - i);
+}
+
+/*
+ * A header is taken off the socket into the stash even while it is still
+ * incomplete.  Peeking would leave its first bytes queued in a segment the
+ * kernel cannot free, and over loopback that segment can hold enough of the
+ * receive buffer to keep the window shut on the rest of the header.
+ */
+ssize_t sock_comm_peek(struct sock_conn *conn, void *buf, size_t len)
+{
+	ssize_t ret;
+
+	if (conn->rx_stash_len < len) {
+		if (!conn->rx_stash)
+			conn->rx_stash = malloc(SOCK_PE_COMM_BUFF_SZ);
+		if (!conn->rx_stash)
+			return 0;
+
+		if (conn->rx_stash_off) {
+			memmove(conn->rx_stash, conn->rx_stash + conn->rx_stash_off,
+				conn->rx_stash_len);
+			conn->rx_stash_off = 0;
+		}
+
+		ret = sock_comm_recv_socket(conn, conn->rx_stash + conn->rx_stash_len,
+					    len - conn->rx_stash_len);
+		if (ret == 0 && !conn->connected) {
+			/* a partial message can no longer be completed */
+			if (conn->rx_stash_len) {
+				sock_comm_count_stash(conn, -1);
+				conn->rx_stash_len = 0;
+			}
+			return 0;
+		}
+
+		if (ret > 0) {
+			if (!conn->rx_stash_len)
+				sock_comm_count_stash(conn, 1);
+			conn->rx_stash_len += ret;
+		}
+	}
+
+	len = MIN(len, conn->rx_stash_len);
+	memcpy(buf, conn->rx_stash + conn->rx_stash_off, len);
+	return len;
+}
+
 ssize_t sock_comm_discard(struct sock_pe_entry *pe_entry, size_t len)
 {
 	void *buf;
@@ -220,5 +643,6 @@ ssize_t sock_comm_discard(struct sock_pe_entry *pe_entry, size_t len)
 
 int sock_comm_is_disconnected(struct sock_pe_entry *pe_entry)
 {
-	return (ofi_rbempty(&pe_entry->comm_buf) && !pe_entry->conn->connected);
+	return (ofi_rbempty(&pe_entry->comm_buf) &&
+		!pe_entry->conn->rx_stash_len && !pe_entry->conn->connected);
 }
@@ -103,12 +103,24 @@ int sock_conn_map_init(struct sock_ep *ep, int init_size)
                 return -FI_ENOMEM;
         }
 
+	if (sock_epoll_create(&map->connect_set, init_size) < 0) {
+		SOCK_LOG_ERROR("failed to create epoll set\n");
+		sock_epoll_close(&map->epoll_set);
+		free(map->table);
+		return -FI_ENOMEM;
+	}
+
 	fastlock_init(&map->lock);
 	map->used = 0;
 	map->size = init_size;
 	return 0;
 }
 
+/*
+ * Only the array of pointers moves when the map grows; the entries are
+ * allocated one by one so that pointers held by pe_entries, TX contexts
+ * and the av_idm stay valid.
+ */
 static int sock_conn_map_increase(struct sock_conn_map *map, int new_size)
 {
 	void *_table;
@@ -120,6 +132,8 @@ static int sock_conn_map_increase(struct sock_conn_map *map, int new_size)
 		return -FI_ENOMEM;
 	}
 
+	memset((struct sock_conn **) _table + map->size, 0,
+	       (new_size - map->size) * sizeof(*map->table));
 	map->size = new_size;
 	map->table = _table;
 	return 0;
@@ -130,44 +144,64 @@ void sock_conn_map_destroy(struct sock_ep_attr *ep_attr)
 	int i;
 	struct sock_conn_map *cmap = &ep_attr->cmap;
 	for (i = 0; i < cmap->used; i++) {
-		if (cmap->table[i].sock_fd != -1) {
-			sock_pe_poll_del(ep_attr->domain->pe, cmap->table[i].sock_fd);
-			sock_conn_release_entry(cmap, &cmap->table[i]);
+		if (cmap->table[i]->sock_fd != -1) {
+			sock_ep_poll_del(ep_attr, cmap->table[i]->sock_fd);
+			sock_conn_release_entry(cmap, cmap->table[i]);
 		}
 	}
+	for (i = 0; i < cmap->size; i++) {
+		if (!cmap->table[i])
+			continue;
+		fastlock_destroy(&cmap->table[i]->lock);
+		free(cmap->table[i]);
+	}
 	free(cmap->table);
 	cmap->table = NULL;
 	cmap->used = cmap->size = 0;
 	sock_epoll_close(&cmap->epoll_set);
+	sock_epoll_close(&cmap->connect_set);
 	fastlock_destroy(&cmap->lock);
 }
 
 void sock_conn_release_entry(struct sock_conn_map *map, struct sock_conn *conn)
 {
 	sock_epoll_del(&map->epoll_set, conn->sock_fd);
+	/* collect zerocopy releases that are queued but not yet read */
+	if (conn->zc_next != conn->zc_done)
+		sock_comm_zc_poll(conn);
 	ofi_close_socket(conn->sock_fd);
+	sock_comm_stash_free(conn);
 
 	conn->address_published = 0;
         conn->connected = 0;
         conn->sock_fd = -1;
+	if (conn->connect_state != SOCK_CONN_FAILED)
+		conn->connect_state = SOCK_CONN_DONE;
 }
 
 static int sock_conn_get_next_index(struct sock_conn_map *map)
 {
 	int i;
 	for (i = 0; i < map->size; i++) {
-		if (map->table[i].sock_fd == -1)
+		if (map->table[i]->sock_fd == -1 &&
+		    !ofi_atomic_get32(&map->table[i]->ref))
 			return i;
 	}
 	return -1;
 }
 
-static struct sock_conn *sock_conn_map_insert(struct sock_ep_attr *ep_attr,
-				struct sockaddr_in *addr, int conn_fd,
-				int addr_published)
+static void sock_conn_init_entry(struct sock_conn *conn)
+{
+	/* the lock, last in the struct, lives as long as the entry */
+	memset(conn, 0, offsetof(struct sock_conn, lock));
+	conn->sock_fd = -1;
+	conn->av_index = FI_ADDR_NOTAVAIL;
+	ofi_atomic_initialize32(&conn->ref, 0);
+}
+
+static struct sock_conn *sock_conn_map_new_entry(struct sock_conn_map *map)
 {
 	int index;
-	struct sock_conn_map *map = &ep_attr->cmap;
 
 	if (map->size == map->used) {
 		index = sock_conn_get_next_index(map);
@@ -182,23 +216,65 @@ static struct sock_conn *sock_conn_map_insert(struct sock_ep_attr *ep_attr,
 		map->used++;
 	}
 
-	map->table[index].av_index = FI_ADDR_NOTAVAIL;
-	map->table[index].connected = 1;
-	map->table[index].addr = *addr;
-	map->table[index].sock_fd = conn_fd;
-	map->table[index].ep_attr = ep_attr;
-	sock_set_sockopts(conn_fd);
+	if (!map->table[index]) {
+		map->table[index] = calloc(1, sizeof(**map->table));
+		if (!map->table[index]) {
+			if (index == map->used - 1)
+				map->used--;
+			return NULL;
+		}
+		fastlock_init(&map->table[index]->lock);
+	}
+
+	sock_conn_init_entry(map->table[index]);
+	return map->table[index];
+}
+
+static void sock_conn_map_free_entry(struct sock_conn_map *map,
+				     struct sock_conn *conn)
+{
+	if (conn == map->table[map->used - 1])
+		map->used--;
+}
+
+static void sock_conn_map_activate(struct sock_ep_attr *ep_attr,
+				   struct sock_conn *conn)
+{
+	struct sock_conn_map *map = &ep_attr->cmap;
 
+	conn->connected = 1;
+	conn->connect_state = SOCK_CONN_DONE;
+	sock_set_sockopts(conn->sock_fd);
+	if (sock_zerocopy_threshold > 0)
+		sock_comm_zc_enable(conn);
 
-	if (ofi_idm_set(&ep_attr->conn_idm, conn_fd, &map->table[index]) < 0)
+	/* a connect in progress has already registered the fd */
+	if (ofi_idm_lookup(&ep_attr->conn_idm, conn->sock_fd) != conn &&
+	    ofi_idm_set(&ep_attr->conn_idm, conn->sock_fd, conn) < 0)
 		SOCK_LOG_ERROR("ofi_idm_set failed\n");
 
-	if (sock_epoll_add(&map->epoll_set, conn_fd))
-		SOCK_LOG_ERROR("failed to add to epoll set: %d\n", conn_fd);
+	if (sock_epoll_add(&map->epoll_set, conn->sock_fd))
+		SOCK_LOG_ERROR("failed to add to epoll set: %d\n", conn->sock_fd);
+
+	sock_ep_poll_add(ep_attr, conn->sock_fd);
+}
+
+static struct sock_conn *sock_conn_map_insert(struct sock_ep_attr *ep_attr,
+				struct sockaddr_in *addr, int conn_fd,
+				int addr_published)
+{
+	struct sock_conn *conn;
 
-	map->table[index].address_published = addr_published;
-	sock_pe_poll_add(ep_attr->domain->pe, conn_fd);
-	return &map->table[index];
+	conn = sock_conn_map_new_entry(&ep_attr->cmap);
+	if (!conn)
+		return NULL;
+
+	conn->addr = *addr;
+	conn->sock_fd = conn_fd;
+	conn->ep_attr = ep_attr;
+	conn->address_published = addr_published;
+	sock_conn_map_activate(ep_attr, conn);
+	return conn;
 }
 
 int fd_set_nonblock(int fd)
@@ -288,7 +364,7 @@ static void *_sock_conn_listen(void *arg)
 		fastlock_acquire(&map->lock);
 		sock_conn_map_insert(ep_attr, &remote, conn_fd, 1);
 		fastlock_release(&map->lock);
-		sock_pe_signal(ep_attr->domain->pe);
+		sock_ep_signal(ep_attr);
 	}
 
 err:
@@ -403,131 +479,254 @@ err:
 	return -FI_EINVAL;
 }
 
-struct sock_conn *sock_ep_connect(struct sock_ep_attr *ep_attr, fi_addr_t index)
+static int sock_conn_start_connect(struct sock_ep_attr *ep_attr,
+				   struct sock_conn *conn)
 {
-	int conn_fd = -1, ret;
-	int do_retry = sock_conn_retry;
-	struct sock_conn *conn, *new_conn;
-	struct sockaddr_in addr;
-	socklen_t lon;
-	int valopt = 0;
-	struct pollfd poll_fd;
-
-	if (ep_attr->ep_type == FI_EP_MSG) {
-		/* Need to check that destination address has been
-		   passed to endpoint */
-		assert(ep_attr->dest_addr);
-		addr = *ep_attr->dest_addr;
-		addr.sin_port = htons(ep_attr->msg_dest_port);
-	} else {
-		addr = *((struct sockaddr_in *)&ep_attr->av->table[index].addr);
-	}
-
-do_connect:
-	fastlock_acquire(&ep_attr->cmap.lock);
-	conn = sock_ep_lookup_conn(ep_attr, index, &addr);
-	fastlock_release(&ep_attr->cmap.lock);
-
-	if (conn != SOCK_CM_CONN_IN_PROGRESS)
-		return conn;
+	int conn_fd, ret;
 
 	conn_fd = socket(AF_INET, SOCK_STREAM, 0);
 	if (conn_fd == -1) {
 		SOCK_LOG_ERROR("failed to create conn_fd, errno: %d\n", errno);
-		errno = FI_EOTHER;
-		return NULL;
+		return -FI_EOTHER;
 	}
 
 	ret = fd_set_nonblock(conn_fd);
 	if (ret) {
 		SOCK_LOG_ERROR("failed to set conn_fd nonblocking, errno: %d\n", errno);
-		errno = FI_EOTHER;
 		ofi_close_socket(conn_fd);
-		return NULL;
+		return -FI_EOTHER;
 	}
 
-	SOCK_LOG_DBG("Connecting to: %s:%d\n", inet_ntoa(addr.sin_addr),
-			ntohs(addr.sin_port));
+	SOCK_LOG_DBG("Connecting to: %s:%d\n", inet_ntoa(conn->addr.sin_addr),
+			ntohs(conn->addr.sin_port));
 	SOCK_LOG_DBG("Connecting using address:%s\n",
 			inet_ntoa(ep_attr->src_addr->sin_addr));
 
-	ret = connect(conn_fd, (struct sockaddr *) &addr, sizeof addr);
-	if (ret < 0) {
-		if (ofi_sockerr() == EINPROGRESS) {
-			poll_fd.fd = conn_fd;
-			poll_fd.events = POLLOUT;
+	conn->sock_fd = conn_fd;
+	conn->connect_state = SOCK_CONN_CONNECTING;
+	conn->connect_ready = 0;
+	conn->connect_time = fi_gettime_ms();
+
+	ret = connect(conn_fd, (struct sockaddr *) &conn->addr, sizeof(conn->addr));
+	if (!ret)
+		return 0;
+
+	ret = ofi_sockerr();
+	if (ret != EINPROGRESS)
+		return -ret;
+
+	/*
+	 * The fd becomes writable once the connect completes or fails.  It
+	 * sits in a set of its own, so that a single wait on that set
+	 * covers every connect the endpoint has pending.
+	 */
+	if (ofi_idm_set(&ep_attr->conn_idm, conn_fd, conn) < 0)
+		SOCK_LOG_ERROR("ofi_idm_set failed\n");
+	if (sock_epoll_add_out(&ep_attr->cmap.connect_set, conn_fd)) {
+		SOCK_LOG_ERROR("failed to add to epoll set: %d\n", conn_fd);
+		conn->connect_ready = 1;
+	}
+	return -FI_EAGAIN;
+}
 
-			ret = poll(&poll_fd, 1, 15 * 1000);
-			if (ret < 0) {
-				SOCK_LOG_DBG("poll failed\n");
-				goto retry;
-			}
+/* Closes the socket of a connect attempt that did not complete */
+static void sock_conn_abort_connect(struct sock_ep_attr *ep_attr,
+				    struct sock_conn *conn)
+{
+	if (conn->sock_fd == -1)
+		return;
 
-			lon = sizeof(int);
-			ret = getsockopt(conn_fd, SOL_SOCKET, SO_ERROR, (void*)(&valopt), &lon);
-			if (ret < 0) {
-				SOCK_LOG_DBG("getsockopt failed: %d, %d\n", ret, conn_fd);
-				goto retry;
-			}
+	sock_epoll_del(&ep_attr->cmap.connect_set, conn->sock_fd);
+	if (ofi_idm_lookup(&ep_attr->conn_idm, conn->sock_fd) == conn)
+		ofi_idm_clear(&ep_attr->conn_idm, conn->sock_fd);
+	ofi_close_socket(conn->sock_fd);
+	conn->sock_fd = -1;
+}
 
-			if (valopt) {
-				SOCK_LOG_DBG("Error in connection() %d - %s - %d\n", valopt, strerror(valopt), conn_fd);
-				SOCK_LOG_DBG("Connecting to: %s:%d\n", inet_ntoa(addr.sin_addr),
-						ntohs(addr.sin_port));
-				SOCK_LOG_DBG("Connecting using address:%s\n",
-				inet_ntoa(ep_attr->src_addr->sin_addr));
-				goto retry;
-			}
+/* Marks the pending connects whose sockets have become writable */
+static void sock_conn_poll_connects(struct sock_ep_attr *ep_attr)
+{
+	struct sock_conn *conn;
+	int i, fd, num_fds;
+
+	num_fds = sock_epoll_wait(&ep_attr->cmap.connect_set, 0);
+	for (i = 0; i < num_fds; i++) {
+		fd = sock_epoll_get_fd_at_index(&ep_attr->cmap.connect_set, i);
+		conn = ofi_idm_lookup(&ep_attr->conn_idm, fd);
+		if (conn && conn->connect_state == SOCK_CONN_CONNECTING)
+			conn->connect_ready = 1;
+	}
+}
+
+/*
+ * Drives a pending connection one step forward without blocking.  Returns 0
+ * once the connection is established, -FI_EAGAIN while it is in progress or
+ * waiting to be retried, and a negative error code after the last retry.
+ */
+int sock_conn_progress_connect(struct sock_ep_attr *ep_attr,
+			       struct sock_conn *conn)
+{
+	struct pollfd poll_fd;
+	socklen_t lon;
+	int ret, retry, valopt = 0;
+	uint64_t idx;
+
+	fastlock_acquire(&ep_attr->cmap.lock);
+	switch (conn->connect_state) {
+	case SOCK_CONN_DONE:
+		ret = conn->connected ? 0 : -FI_ENOTCONN;
+		goto out;
+	case SOCK_CONN_FAILED:
+		ret = -FI_ENOTCONN;
+		goto out;
+	case SOCK_CONN_RETRY_WAIT:
+		if (fi_gettime_ms() - conn->connect_time < SOCK_CONN_RETRY_DELAY) {
+			ret = -FI_EAGAIN;
 			goto out;
-		} else {
-			SOCK_LOG_DBG("Timeout or error() - %s: %d\n", strerror(errno), conn_fd);
-			SOCK_LOG_DBG("Connecting to: %s:%d\n", inet_ntoa(addr.sin_addr),
-					ntohs(addr.sin_port));
-			SOCK_LOG_DBG("Connecting using address:%s\n",
-					inet_ntoa(ep_attr->src_addr->sin_addr));
-			goto retry;
 		}
-	} else {
+
+		SOCK_LOG_DBG("Retrying connect to: %s:%d\n",
+			     inet_ntoa(conn->addr.sin_addr),
+			     ntohs(conn->addr.sin_port));
+		ret = sock_conn_start_connect(ep_attr, conn);
+		break;
+	default:
+		if (!conn->connect_ready)
+			sock_conn_poll_connects(ep_attr);
+		if (!conn->connect_ready) {
+			ret = (fi_gettime_ms() - conn->connect_time > SOCK_CONN_TIMEOUT) ?
+				-FI_ETIMEDOUT : -FI_EAGAIN;
+			break;
+		}
+
+		poll_fd.fd = conn->sock_fd;
+		poll_fd.events = POLLOUT;
+		ret = poll(&poll_fd, 1, 0);
+		if (ret < 0) {
+			ret = -ofi_sockerr();
+			break;
+		}
+
+		if (ret == 0) {
+			ret = (fi_gettime_ms() - conn->connect_time > SOCK_CONN_TIMEOUT) ?
+				-FI_ETIMEDOUT : -FI_EAGAIN;
+			break;
+		}
+
+		lon = sizeof(int);
+		ret = getsockopt(conn->sock_fd, SOL_SOCKET, SO_ERROR,
+				 (void *) &valopt, &lon);
+		ret = ret ? -ofi_sockerr() : -valopt;
+		break;
+	}
+
+	if (!ret) {
+		SOCK_LOG_DBG("Connected to: %s:%d - %d\n",
+			     inet_ntoa(conn->addr.sin_addr),
+			     ntohs(conn->addr.sin_port), conn->sock_fd);
+		sock_epoll_del(&ep_attr->cmap.connect_set, conn->sock_fd);
+		sock_conn_map_activate(ep_attr, conn);
 		goto out;
 	}
 
-retry:
-	do_retry--;
-	sleep(10);
-	if (!do_retry)
-		goto err;
+	if (ret == -FI_EAGAIN)
+		goto out;
 
-	if (conn_fd != -1) {
-		ofi_close_socket(conn_fd);
-		conn_fd = -1;
+	/* no socket means socket() itself failed; retrying will not help */
+	retry = conn->sock_fd != -1;
+	sock_conn_abort_connect(ep_attr, conn);
+	if (retry && --conn->connect_retry > 0) {
+		SOCK_LOG_ERROR("Connect error, retrying - %s - %d left\n",
+			       fi_strerror(-ret), conn->connect_retry);
+		conn->connect_state = SOCK_CONN_RETRY_WAIT;
+		conn->connect_time = fi_gettime_ms();
+		ret = -FI_EAGAIN;
+		goto out;
 	}
 
-	SOCK_LOG_ERROR("Connect error, retrying - %s - %d\n", strerror(errno), conn_fd);
-	SOCK_LOG_DBG("Connecting to: %s:%d\n", inet_ntoa(addr.sin_addr),
-			ntohs(addr.sin_port));
-	SOCK_LOG_DBG("Connecting using address:%s\n",
-			inet_ntoa(ep_attr->src_addr->sin_addr));
-        goto do_connect;
+	SOCK_LOG_ERROR("Failed to connect to: %s:%d - %s\n",
+		       inet_ntoa(conn->addr.sin_addr),
+		       ntohs(conn->addr.sin_port), fi_strerror(-ret));
+
+	idx = (ep_attr->ep_type == FI_EP_MSG) ? 0 : conn->av_index;
+	if (ofi_idm_lookup(&ep_attr->av_idm, idx) == conn)
+		ofi_idm_clear(&ep_attr->av_idm, idx);
 
+	conn->connect_state = SOCK_CONN_FAILED;
+	conn->connected = 0;
+	conn->address_published = 0;
 out:
+	fastlock_release(&ep_attr->cmap.lock);
+	return ret;
+}
+
+struct sock_conn *sock_ep_connect(struct sock_ep_attr *ep_attr, fi_addr_t index)
+{
+	int ret;
+	struct sock_conn *conn, *new_conn;
+	struct sockaddr_in addr;
+
+	if (ep_attr->ep_type == FI_EP_MSG) {
+		/* Need to check that destination address has been
+		   passed to endpoint */
+		assert(ep_attr->dest_addr);
+		addr = *ep_attr->dest_addr;
+		addr.sin_port = htons(ep_attr->msg_dest_port);
+	} else {
+		addr = *((struct sockaddr_in *)&ep_attr->av->table[index].addr);
+	}
+
 	fastlock_acquire(&ep_attr->cmap.lock);
-	new_conn = sock_conn_map_insert(ep_attr, &addr, conn_fd, 0);
+	conn = sock_ep_lookup_conn(ep_attr, index, &addr);
+	if (conn != SOCK_CM_CONN_IN_PROGRESS)
+		goto out;
+
+	/*
+	 * A failed entry to the same peer is left alone: operations still
+	 * queued against it fail, and it is reclaimed once they are gone.
+	 */
+	new_conn = sock_conn_map_new_entry(&ep_attr->cmap);
 	if (!new_conn) {
-		fastlock_release(&ep_attr->cmap.lock);
-		goto err;
+		errno = FI_ENOMEM;
+		conn = NULL;
+		goto out;
 	}
+
+	new_conn->addr = addr;
+	new_conn->ep_attr = ep_attr;
 	new_conn->av_index = (ep_attr->ep_type == FI_EP_MSG) ? FI_ADDR_NOTAVAIL : index;
-	conn = ofi_idm_lookup(&ep_attr->av_idm, index);
-	if (conn == SOCK_CM_CONN_IN_PROGRESS) {
-		if (ofi_idm_set(&ep_attr->av_idm, index, new_conn) < 0)
-			SOCK_LOG_ERROR("ofi_idm_set failed\n");
-		conn = new_conn;
+	new_conn->connect_retry = sock_conn_retry;
+
+	/*
+	 * The connect is only started here; sock_conn_progress_connect()
+	 * completes it from the progress engine, and operations queued to
+	 * this connection stay pending until then.
+	 */
+	ret = sock_conn_start_connect(ep_attr, new_conn);
+	if (ret == -FI_EOTHER) {
+		sock_conn_map_free_entry(&ep_attr->cmap, new_conn);
+		if (ofi_idm_lookup(&ep_attr->av_idm, index) ==
+		    SOCK_CM_CONN_IN_PROGRESS)
+			ofi_idm_clear(&ep_attr->av_idm, index);
+		errno = FI_EOTHER;
+		conn = NULL;
+		goto out;
 	}
+
+	if (!ret) {
+		sock_conn_map_activate(ep_attr, new_conn);
+	} else if (ret != -FI_EAGAIN) {
+		SOCK_LOG_DBG("Connect error() - %s: %d\n",
+			     fi_strerror(-ret), new_conn->sock_fd);
+		sock_conn_abort_connect(ep_attr, new_conn);
+		new_conn->connect_state = SOCK_CONN_RETRY_WAIT;
+		new_conn->connect_retry--;
+	}
+
+	if (ofi_idm_set(&ep_attr->av_idm, index, new_conn) < 0)
+		SOCK_LOG_ERROR("ofi_idm_set failed\n");
+	conn = new_conn;
+out:
 	fastlock_release(&ep_attr->cmap.lock);
 	return conn;
-
-err:
-	ofi_close_socket(conn_fd);
-	return NULL;
 }
-
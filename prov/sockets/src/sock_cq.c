@@ -115,18 +115,18 @@ int sock_cq_progress(struct sock_cq *cq)
 	     entry = entry->next) {
 		tx_ctx = container_of(entry, struct sock_tx_ctx, cq_entry);
 		if (tx_ctx->use_shared)
-			sock_pe_progress_tx_ctx(cq->domain->pe, tx_ctx->stx_ctx);
+			sock_pe_progress_tx_ctx(tx_ctx->stx_ctx->pe, tx_ctx->stx_ctx);
 		else
-			sock_pe_progress_tx_ctx(cq->domain->pe, tx_ctx);
+			sock_pe_progress_tx_ctx(tx_ctx->pe, tx_ctx);
 	}
 
 	for (entry = cq->rx_list.next; entry != &cq->rx_list;
 	     entry = entry->next) {
 		rx_ctx = container_of(entry, struct sock_rx_ctx, cq_entry);
 		if (rx_ctx->use_shared)
-			sock_pe_progress_rx_ctx(cq->domain->pe, rx_ctx->srx_ctx);
+			sock_pe_progress_rx_ctx(rx_ctx->srx_ctx->pe, rx_ctx->srx_ctx);
 		else
-			sock_pe_progress_rx_ctx(cq->domain->pe, rx_ctx);
+			sock_pe_progress_rx_ctx(rx_ctx->pe, rx_ctx);
 	}
 	fastlock_release(&cq->list_lock);
 
@@ -55,8 +55,11 @@ struct sock_rx_ctx *sock_rx_ctx_alloc(const struct fi_rx_attr *attr,
 	dlist_init(&rx_ctx->pe_entry_list);
 	dlist_init(&rx_ctx->rx_entry_list);
 	dlist_init(&rx_ctx->rx_buffered_list);
+	dlist_init(&rx_ctx->rx_rndv_list);
 	dlist_init(&rx_ctx->ep_list);
 
+	sock_rx_init_queues(rx_ctx);
+
 	fastlock_init(&rx_ctx->lock);
 
 	rx_ctx->ctx.fid.fclass = FI_CLASS_RX_CTX;
@@ -71,6 +74,8 @@ void sock_rx_ctx_free(struct sock_rx_ctx *rx_ctx)
 {
 	fastlock_destroy(&rx_ctx->lock);
 	free(rx_ctx->rx_entry_pool);
+	free(rx_ctx->rx_tag_hash);
+	free(rx_ctx->rndv_slots);
 	free(rx_ctx);
 }
 
@@ -169,14 +174,20 @@ void sock_tx_ctx_write(struct sock_tx_ctx *tx_ctx, const void *buf, size_t len)
 
 void sock_tx_ctx_commit(struct sock_tx_ctx *tx_ctx)
 {
+	/* the queued operation keeps its connection from being reclaimed */
+	if (tx_ctx->write_conn) {
+		ofi_atomic_inc32(&tx_ctx->write_conn->ref);
+		tx_ctx->write_conn = NULL;
+	}
 	ofi_rbcommit(&tx_ctx->rb);
-	sock_pe_signal(tx_ctx->domain->pe);
+	sock_pe_signal(tx_ctx->pe);
 	fastlock_release(&tx_ctx->wlock);
 }
 
 void sock_tx_ctx_abort(struct sock_tx_ctx *tx_ctx)
 {
 	ofi_rbabort(&tx_ctx->rb);
+	tx_ctx->write_conn = NULL;
 	fastlock_release(&tx_ctx->wlock);
 }
 
@@ -192,6 +203,7 @@ void sock_tx_ctx_write_op_send(struct sock_tx_ctx *tx_ctx,
 	sock_tx_ctx_write(tx_ctx, &buf, sizeof(buf));
 	sock_tx_ctx_write(tx_ctx, &ep_attr, sizeof(ep_attr));
 	sock_tx_ctx_write(tx_ctx, &conn, sizeof(conn));
+	tx_ctx->write_conn = conn;
 }
 
 void sock_tx_ctx_write_op_tsend(struct sock_tx_ctx *tx_ctx,
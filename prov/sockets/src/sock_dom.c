@@ -165,6 +165,50 @@ int sock_verify_domain_attr(uint32_t version, struct fi_domain_attr *attr)
 	return 0;
 }
 
+static int sock_dom_init_pe(struct sock_domain *dom)
+{
+	int i;
+
+	dom->pe_count = MIN(MAX(sock_pe_count, 1), SOCK_PE_MAX_COUNT);
+	dom->pe = calloc(dom->pe_count, sizeof(*dom->pe));
+	if (!dom->pe)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < dom->pe_count; i++) {
+		dom->pe[i] = sock_pe_init(dom, i);
+		if (!dom->pe[i])
+			goto err;
+	}
+	return 0;
+
+err:
+	while (i--)
+		sock_pe_finalize(dom->pe[i]);
+	free(dom->pe);
+	return -FI_ENOMEM;
+}
+
+static void sock_dom_finalize_pe(struct sock_domain *dom)
+{
+	int i;
+
+	for (i = 0; i < dom->pe_count; i++)
+		sock_pe_finalize(dom->pe[i]);
+	free(dom->pe);
+}
+
+/* endpoints are spread round-robin across the domain's progress engines */
+struct sock_pe *sock_dom_get_pe(struct sock_domain *dom)
+{
+	struct sock_pe *pe;
+
+	fastlock_acquire(&dom->lock);
+	pe = dom->pe[dom->pe_next];
+	dom->pe_next = (dom->pe_next + 1) % dom->pe_count;
+	fastlock_release(&dom->lock);
+	return pe;
+}
+
 static int sock_dom_close(struct fid *fid)
 {
 	struct sock_domain *dom;
@@ -172,7 +216,7 @@ static int sock_dom_close(struct fid *fid)
 	if (ofi_atomic_get32(&dom->ref))
 		return -FI_EBUSY;
 
-	sock_pe_finalize(dom->pe);
+	sock_dom_finalize_pe(dom);
 	fastlock_destroy(&dom->lock);
 	ofi_mr_map_close(&dom->mr_map);
 	sock_dom_remove_from_list(dom);
@@ -478,8 +522,7 @@ int sock_domain(struct fid_fabric *fabric, struct fi_info *info,
 	else
 		sock_domain->progress_mode = info->domain_attr->data_progress;
 
-	sock_domain->pe = sock_pe_init(sock_domain);
-	if (!sock_domain->pe) {
+	if (sock_dom_init_pe(sock_domain)) {
 		SOCK_LOG_ERROR("Failed to init PE\n");
 		goto err1;
 	}
@@ -501,7 +544,7 @@ int sock_domain(struct fid_fabric *fabric, struct fi_info *info,
 	return 0;
 
 err2:
-	sock_pe_finalize(sock_domain->pe);
+	sock_dom_finalize_pe(sock_domain);
 err1:
 	fastlock_destroy(&sock_domain->lock);
 	free(sock_domain);
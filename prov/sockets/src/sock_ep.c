@@ -288,7 +288,7 @@ static int sock_ctx_enable(struct fid_ep *ep)
 	case FI_CLASS_RX_CTX:
 		rx_ctx = container_of(ep, struct sock_rx_ctx, ctx.fid);
 		rx_ctx->enabled = 1;
-		sock_pe_add_rx_ctx(rx_ctx->domain->pe, rx_ctx);
+		sock_pe_add_rx_ctx(rx_ctx->pe, rx_ctx);
 
 		if (!rx_ctx->ep_attr->listener.listener_thread &&
 		    sock_conn_listen(rx_ctx->ep_attr)) {
@@ -299,7 +299,7 @@ static int sock_ctx_enable(struct fid_ep *ep)
 	case FI_CLASS_TX_CTX:
 		tx_ctx = container_of(ep, struct sock_tx_ctx, fid.ctx.fid);
 		tx_ctx->enabled = 1;
-		sock_pe_add_tx_ctx(tx_ctx->domain->pe, tx_ctx);
+		sock_pe_add_tx_ctx(tx_ctx->pe, tx_ctx);
 
 		if (!tx_ctx->ep_attr->listener.listener_thread &&
 		    sock_conn_listen(tx_ctx->ep_attr)) {
@@ -504,7 +504,7 @@ static ssize_t sock_rx_ctx_cancel(struct sock_rx_ctx *rx_ctx, void *context)
 			if (rx_ctx->comp.recv_cntr)
 				fi_cntr_adderr(&rx_ctx->comp.recv_cntr->cntr_fid, 1);
 
-			dlist_remove(&rx_entry->entry);
+			sock_rx_dequeue_entry(rx_entry);
 			sock_rx_release_entry(rx_entry);
 			ret = 0;
 			break;
@@ -660,7 +660,7 @@ static int sock_ep_close(struct fid *fid)
 		fastlock_release(&sock_ep->attr->av->list_lock);
 	}
 
-	pthread_mutex_lock(&sock_ep->attr->domain->pe->list_lock);
+	pthread_mutex_lock(&sock_ep->attr->pe->list_lock);
 	if (sock_ep->attr->tx_shared) {
 		fastlock_acquire(&sock_ep->attr->tx_ctx->lock);
 		dlist_remove(&sock_ep->attr->tx_ctx_entry);
@@ -672,7 +672,7 @@ static int sock_ep_close(struct fid *fid)
 		dlist_remove(&sock_ep->attr->rx_ctx_entry);
 		fastlock_release(&sock_ep->attr->rx_ctx->lock);
 	}
-	pthread_mutex_unlock(&sock_ep->attr->domain->pe->list_lock);
+	pthread_mutex_unlock(&sock_ep->attr->pe->list_lock);
 
 	if (sock_ep->attr->listener.do_listen) {
 		sock_ep->attr->listener.do_listen = 0;
@@ -714,11 +714,11 @@ static int sock_ep_close(struct fid *fid)
 	if (sock_ep->attr->dest_addr)
 		free(sock_ep->attr->dest_addr);
 
-	fastlock_acquire(&sock_ep->attr->domain->pe->lock);
+	fastlock_acquire(&sock_ep->attr->pe->lock);
 	ofi_idm_reset(&sock_ep->attr->conn_idm);
 	ofi_idm_reset(&sock_ep->attr->av_idm);
 	sock_conn_map_destroy(sock_ep->attr);
-	fastlock_release(&sock_ep->attr->domain->pe->lock);
+	fastlock_release(&sock_ep->attr->pe->lock);
 
 	ofi_atomic_dec32(&sock_ep->attr->domain->ref);
 	fastlock_destroy(&sock_ep->attr->lock);
@@ -727,6 +727,46 @@ static int sock_ep_close(struct fid *fid)
 	return 0;
 }
 
+/*
+ * An endpoint bound to a shared context moves to the shared context's
+ * engine, together with all of its own contexts.
+ */
+static void sock_ep_set_pe(struct sock_ep_attr *attr, struct sock_pe *pe)
+{
+	size_t i;
+
+	attr->pe = pe;
+	attr->pe_cnt = 1;
+	for (i = 0; i < attr->ep_attr.tx_ctx_cnt; i++) {
+		if (attr->tx_array[i])
+			attr->tx_array[i]->pe = pe;
+	}
+	for (i = 0; i < attr->ep_attr.rx_ctx_cnt; i++) {
+		if (attr->rx_array[i])
+			attr->rx_array[i]->pe = pe;
+	}
+}
+
+/*
+ * A shared context is placed on an engine when first bound: the one serving
+ * the endpoint's other shared context, if any, or else the endpoint's own.
+ * Endpoints later bound to it move to that engine.
+ */
+static int sock_ep_share_pe(struct sock_ep_attr *attr, struct sock_pe **pe,
+			    int *pe_assigned, struct sock_pe *other_pe)
+{
+	if (!*pe_assigned) {
+		*pe = other_pe ? other_pe : attr->pe;
+		*pe_assigned = 1;
+	} else if (other_pe && other_pe != *pe) {
+		SOCK_LOG_ERROR("shared contexts are on different progress engines\n");
+		return -FI_EINVAL;
+	}
+
+	sock_ep_set_pe(attr, *pe);
+	return 0;
+}
+
 static int sock_ep_bind(struct fid *fid, struct fid *bfid, uint64_t flags)
 {
 	int ret;
@@ -869,6 +909,13 @@ static int sock_ep_bind(struct fid *fid, struct fid *bfid, uint64_t flags)
 	case FI_CLASS_STX_CTX:
 		tx_ctx = container_of(bfid, struct sock_tx_ctx, fid.stx.fid);
 		fastlock_acquire(&tx_ctx->lock);
+		ret = sock_ep_share_pe(ep->attr, &tx_ctx->pe, &tx_ctx->pe_assigned,
+				       ep->attr->rx_ctx->srx_ctx ?
+				       ep->attr->rx_ctx->srx_ctx->pe : NULL);
+		if (ret) {
+			fastlock_release(&tx_ctx->lock);
+			return ret;
+		}
 		dlist_insert_tail(&ep->attr->tx_ctx_entry, &tx_ctx->ep_list);
 		fastlock_release(&tx_ctx->lock);
 
@@ -879,6 +926,13 @@ static int sock_ep_bind(struct fid *fid, struct fid *bfid, uint64_t flags)
 	case FI_CLASS_SRX_CTX:
 		rx_ctx = container_of(bfid, struct sock_rx_ctx, ctx);
 		fastlock_acquire(&rx_ctx->lock);
+		ret = sock_ep_share_pe(ep->attr, &rx_ctx->pe, &rx_ctx->pe_assigned,
+				       ep->attr->tx_ctx->stx_ctx ?
+				       ep->attr->tx_ctx->stx_ctx->pe : NULL);
+		if (ret) {
+			fastlock_release(&rx_ctx->lock);
+			return ret;
+		}
 		dlist_insert_tail(&ep->attr->rx_ctx_entry, &rx_ctx->ep_list);
 		fastlock_release(&rx_ctx->lock);
 
@@ -978,11 +1032,11 @@ int sock_ep_enable(struct fid_ep *ep)
 			tx_ctx->enabled = 1;
 			if (tx_ctx->use_shared) {
 				if (tx_ctx->stx_ctx) {
-					sock_pe_add_tx_ctx(tx_ctx->domain->pe, tx_ctx->stx_ctx);
+					sock_pe_add_tx_ctx(tx_ctx->stx_ctx->pe, tx_ctx->stx_ctx);
 					tx_ctx->stx_ctx->enabled = 1;
 				}
 			} else {
-				sock_pe_add_tx_ctx(tx_ctx->domain->pe, tx_ctx);
+				sock_pe_add_tx_ctx(tx_ctx->pe, tx_ctx);
 			}
 		}
 	}
@@ -993,11 +1047,11 @@ int sock_ep_enable(struct fid_ep *ep)
 			rx_ctx->enabled = 1;
 			if (rx_ctx->use_shared) {
 				if (rx_ctx->srx_ctx) {
-					sock_pe_add_rx_ctx(rx_ctx->domain->pe, rx_ctx->srx_ctx);
+					sock_pe_add_rx_ctx(rx_ctx->srx_ctx->pe, rx_ctx->srx_ctx);
 					rx_ctx->srx_ctx->enabled = 1;
 				}
 			} else {
-				sock_pe_add_rx_ctx(rx_ctx->domain->pe, rx_ctx);
+				sock_pe_add_rx_ctx(rx_ctx->pe, rx_ctx);
 			}
 		}
 	}
@@ -1121,6 +1175,7 @@ static int sock_ep_tx_ctx(struct fid_ep *ep, int index, struct fi_tx_attr *attr,
 	tx_ctx->tx_id = index;
 	tx_ctx->ep_attr = sock_ep->attr;
 	tx_ctx->domain = sock_ep->attr->domain;
+	tx_ctx->pe = sock_ep_get_pe(sock_ep->attr, index);
 	tx_ctx->av = sock_ep->attr->av;
 	dlist_insert_tail(&sock_ep->attr->tx_ctx_entry, &tx_ctx->ep_list);
 
@@ -1162,6 +1217,7 @@ static int sock_ep_rx_ctx(struct fid_ep *ep, int index, struct fi_rx_attr *attr,
 	rx_ctx->rx_id = index;
 	rx_ctx->ep_attr = sock_ep->attr;
 	rx_ctx->domain = sock_ep->attr->domain;
+	rx_ctx->pe = sock_ep_get_pe(sock_ep->attr, index);
 	rx_ctx->av = sock_ep->attr->av;
 	dlist_insert_tail(&sock_ep->attr->rx_ctx_entry, &rx_ctx->ep_list);
 
@@ -1225,6 +1281,7 @@ int sock_stx_ctx(struct fid_domain *domain,
 		return -FI_ENOMEM;
 
 	tx_ctx->domain = dom;
+	tx_ctx->pe = dom->pe[0];	/* placed when first bound */
 	tx_ctx->fid.stx.fid.ops = &sock_ctx_ops;
 	tx_ctx->fid.stx.ops = &sock_ep_ops;
 	ofi_atomic_inc32(&dom->ref);
@@ -1271,6 +1328,7 @@ int sock_srx_ctx(struct fid_domain *domain,
 		return -FI_ENOMEM;
 
 	rx_ctx->domain = dom;
+	rx_ctx->pe = dom->pe[0];	/* placed when first bound */
 	rx_ctx->ctx.fid.fclass = FI_CLASS_SRX_CTX;
 
 	rx_ctx->ctx.fid.ops = &sock_ctx_ops;
@@ -1561,6 +1619,7 @@ int sock_alloc_endpoint(struct fid_domain *domain, struct fi_info *info,
 		  struct sock_ep **ep, void *context, size_t fclass)
 {
 	int ret;
+	size_t cnt;
 	struct sock_ep *sock_ep;
 	struct sock_tx_ctx *tx_ctx;
 	struct sock_rx_ctx *rx_ctx;
@@ -1694,6 +1753,17 @@ int sock_alloc_endpoint(struct fid_domain *domain, struct fi_info *info,
 		goto err2;
 	}
 
+	/*
+	 * Context i of a scalable endpoint runs on the i-th engine from the
+	 * endpoint's own, so that each context pair gets an engine of its own.
+	 */
+	sock_ep->attr->pe = sock_dom_get_pe(sock_dom);
+	sock_ep->attr->pe_cnt = 1;
+	if (sock_ep->attr->fclass == FI_CLASS_SEP) {
+		cnt = MAX(sock_ep->attr->ep_attr.tx_ctx_cnt,
+			  sock_ep->attr->ep_attr.rx_ctx_cnt);
+		sock_ep->attr->pe_cnt = MAX(MIN(cnt, sock_dom->pe_count), 1);
+	}
 	if (sock_ep->attr->fclass != FI_CLASS_SEP) {
 		/* default tx ctx */
 		tx_ctx = sock_tx_ctx_alloc(&sock_ep->tx_attr, context,
@@ -1704,6 +1774,7 @@ int sock_alloc_endpoint(struct fid_domain *domain, struct fi_info *info,
 		}
 		tx_ctx->ep_attr = sock_ep->attr;
 		tx_ctx->domain = sock_dom;
+		tx_ctx->pe = sock_ep->attr->pe;
 		tx_ctx->tx_id = 0;
 		dlist_insert_tail(&sock_ep->attr->tx_ctx_entry, &tx_ctx->ep_list);
 		sock_ep->attr->tx_array[0] = tx_ctx;
@@ -1718,6 +1789,7 @@ int sock_alloc_endpoint(struct fid_domain *domain, struct fi_info *info,
 		}
 		rx_ctx->ep_attr = sock_ep->attr;
 		rx_ctx->domain = sock_dom;
+		rx_ctx->pe = sock_ep->attr->pe;
 		rx_ctx->rx_id = 0;
 		dlist_insert_tail(&sock_ep->attr->rx_ctx_entry, &rx_ctx->ep_list);
 		sock_ep->attr->rx_array[0] = rx_ctx;
@@ -1764,9 +1836,41 @@ err1:
 	return ret;
 }
 
+struct sock_pe *sock_ep_get_pe(struct sock_ep_attr *attr, int index)
+{
+	struct sock_domain *dom = attr->domain;
+
+	return dom->pe[(attr->pe->index + index % attr->pe_cnt) % dom->pe_count];
+}
+
+/* any engine hosting one of the endpoint's contexts may read a connection */
+void sock_ep_poll_add(struct sock_ep_attr *attr, int fd)
+{
+	int i;
+
+	for (i = 0; i < attr->pe_cnt; i++)
+		sock_pe_poll_add(sock_ep_get_pe(attr, i), fd);
+}
+
+void sock_ep_poll_del(struct sock_ep_attr *attr, int fd)
+{
+	int i;
+
+	for (i = 0; i < attr->pe_cnt; i++)
+		sock_pe_poll_del(sock_ep_get_pe(attr, i), fd);
+}
+
+void sock_ep_signal(struct sock_ep_attr *attr)
+{
+	int i;
+
+	for (i = 0; i < attr->pe_cnt; i++)
+		sock_pe_signal(sock_ep_get_pe(attr, i));
+}
+
 void sock_ep_remove_conn(struct sock_ep_attr *attr, struct sock_conn *conn)
 {
-	sock_pe_poll_del(attr->domain->pe, conn->sock_fd);
+	sock_ep_poll_del(attr, conn->sock_fd);
 	ofi_idm_clear(&attr->conn_idm, conn->sock_fd);
 	sock_conn_release_entry(&attr->cmap, conn);
 }
@@ -1785,11 +1889,11 @@ struct sock_conn *sock_ep_lookup_conn(struct sock_ep_attr *attr, fi_addr_t index
 		return conn;
 
 	for (i = 0; i < attr->cmap.used; i++) {
-		if (!attr->cmap.table[i].connected)
+		if (!attr->cmap.table[i]->connected)
 			continue;
 
-		if (ofi_equals_sockaddr(&attr->cmap.table[i].addr, addr))
-			return &attr->cmap.table[i];
+		if (ofi_equals_sockaddr(&attr->cmap.table[i]->addr, addr))
+			return attr->cmap.table[i];
 	}
 	return conn;
 }
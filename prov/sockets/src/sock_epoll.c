@@ -74,17 +74,15 @@ int sock_epoll_create(struct sock_epoll_set *set, int size)
 	return ret;
 }
 
-int sock_epoll_add(struct sock_epoll_set *set, int fd)
+static int sock_epoll_add_events(struct sock_epoll_set *set, int fd,
+				 uint32_t events)
 {
 	int ret;
 	struct epoll_event event;
 
 	memset(&event, 0, sizeof(event));
 	event.data.fd = fd;
-	event.events = EPOLLIN;
-
-	if (set->used == set->size)
-		return -1;
+	event.events = events;
 
 	ret = epoll_ctl(set->fd, EPOLL_CTL_ADD, fd, &event);
 	if (!ret)
@@ -93,6 +91,16 @@ int sock_epoll_add(struct sock_epoll_set *set, int fd)
 	return ret;
 }
 
+int sock_epoll_add(struct sock_epoll_set *set, int fd)
+{
+	return sock_epoll_add_events(set, fd, EPOLLIN);
+}
+
+int sock_epoll_add_out(struct sock_epoll_set *set, int fd)
+{
+	return sock_epoll_add_events(set, fd, EPOLLOUT);
+}
+
 int sock_epoll_del(struct sock_epoll_set *set, int fd)
 {
 	int ret;
@@ -107,11 +115,17 @@ int sock_epoll_del(struct sock_epoll_set *set, int fd)
 	return ret;
 }
 
+/*
+ * The kernel set is not bounded by size, which only limits how many events
+ * one call returns; the rest stay level-triggered for the next call.  The
+ * events buffer is never reallocated, as a waiter may be blocked on it.
+ */
 int sock_epoll_wait(struct sock_epoll_set *set, int timeout)
 {
 	if (!set->used)
 		return 0;
-	return epoll_wait(set->fd, set->events, set->used, timeout);
+	return epoll_wait(set->fd, set->events, MIN(set->used, set->size),
+			  timeout);
 }
 
 int sock_epoll_get_fd_at_index(struct sock_epoll_set *set, int index)
@@ -119,6 +133,11 @@ int sock_epoll_get_fd_at_index(struct sock_epoll_set *set, int index)
 	return set->events[index].data.fd;
 }
 
+int sock_epoll_err_at_index(struct sock_epoll_set *set, int index)
+{
+	return !!(set->events[index].events & EPOLLERR);
+}
+
 void sock_epoll_close(struct sock_epoll_set *set)
 {
 	free(set->events);
@@ -136,18 +155,29 @@ int sock_epoll_create(struct sock_epoll_set *set, int size)
 	return set->pollfds ? 0 : -1;
 }
 
-int sock_epoll_add(struct sock_epoll_set *set, int fd)
+static int sock_epoll_add_events(struct sock_epoll_set *set, int fd,
+				 short events)
 {
 	if (set->used == set->size)
 		return -1;
 
 	set->pollfds[set->used].fd = fd;
-	set->pollfds[set->used].events = POLLIN;
+	set->pollfds[set->used].events = events;
 
 	set->used++;
 	return 0;
 }
 
+int sock_epoll_add(struct sock_epoll_set *set, int fd)
+{
+	return sock_epoll_add_events(set, fd, POLLIN);
+}
+
+int sock_epoll_add_out(struct sock_epoll_set *set, int fd)
+{
+	return sock_epoll_add_events(set, fd, POLLOUT);
+}
+
 int sock_epoll_del(struct sock_epoll_set *set, int fd)
 {
 	int i;
@@ -160,7 +190,7 @@ int sock_epoll_del(struct sock_epoll_set *set, int fd)
 	if (i == set->used)
     		return -1;
 
-	set->pollfds[i].fd = set->pollfds[set->used - 1].fd;
+	set->pollfds[i] = set->pollfds[set->used - 1];
 	set->used--;
 	return 0;
 }
@@ -173,21 +203,37 @@ int sock_epoll_wait(struct sock_epoll_set *set, int timeout)
 	return poll(set->pollfds, set->used, timeout);
 }
 
-int sock_epoll_get_fd_at_index(struct sock_epoll_set *set, int index)
+static struct pollfd *sock_epoll_get_at_index(struct sock_epoll_set *set,
+					      int index)
 {
 	int i;
 
 	for (i = 0; i < set->used; i++) {
-		if ((set->pollfds[i].revents & POLLIN)) {
+		if (set->pollfds[i].revents &
+		    (set->pollfds[i].events | POLLERR | POLLHUP)) {
 			if (index) {
 				index--;
 				continue;
       			} else {
-				return set->pollfds[i].fd;
+				return &set->pollfds[i];
       			}
     		}
   	}
-	return -1;
+	return NULL;
+}
+
+int sock_epoll_get_fd_at_index(struct sock_epoll_set *set, int index)
+{
+	struct pollfd *pfd = sock_epoll_get_at_index(set, index);
+
+	return pfd ? pfd->fd : -1;
+}
+
+int sock_epoll_err_at_index(struct sock_epoll_set *set, int index)
+{
+	struct pollfd *pfd = sock_epoll_get_at_index(set, index);
+
+	return pfd ? !!(pfd->revents & POLLERR) : 0;
 }
 
 void sock_epoll_close(struct sock_epoll_set *set)
@@ -65,6 +65,9 @@ int sock_av_def_sz = SOCK_AV_DEF_SZ;
 int sock_cq_def_sz = SOCK_CQ_DEF_SZ;
 int sock_eq_def_sz = SOCK_EQ_DEF_SZ;
 char *sock_pe_affinity_str = NULL;
+int sock_pe_count = SOCK_PE_DEF_COUNT;
+int sock_zerocopy_threshold = 0;
+int sock_rndv_threshold = 0;
 #if ENABLE_DEBUG
 int sock_dgram_drop_rate = 0;
 #endif
@@ -342,6 +345,11 @@ static void sock_read_default_params()
 		fi_param_get_int(&sock_prov, "def_eq_sz", &sock_eq_def_sz);
 		if (fi_param_get_str(&sock_prov, "pe_affinity", &sock_pe_affinity_str) != FI_SUCCESS)
 			sock_pe_affinity_str = NULL;
+		fi_param_get_int(&sock_prov, "pe_count", &sock_pe_count);
+		fi_param_get_int(&sock_prov, "zerocopy_threshold",
+				 &sock_zerocopy_threshold);
+		fi_param_get_int(&sock_prov, "rndv_threshold",
+				 &sock_rndv_threshold);
 #if ENABLE_DEBUG
 		fi_param_get_int(&sock_prov, "dgram_drop_rate", &sock_dgram_drop_rate);
 #endif
@@ -768,6 +776,17 @@ SOCKETS_INI
 			"If specified, bind the progress thread to the indicated range(s) of Linux virtual processor ID(s). "
 			"This option is currently not supported on OS X. Usage: id_start[-id_end[:stride]][,]");
 
+	fi_param_define(&sock_prov, "pe_count", FI_PARAM_INT,
+			"Number of progress engines per domain (default: 1)");
+
+	fi_param_define(&sock_prov, "zerocopy_threshold", FI_PARAM_INT,
+			"Send and RMA write payloads of at least this many bytes "
+			"are transmitted with MSG_ZEROCOPY (default: 0, disabled)");
+
+	fi_param_define(&sock_prov, "rndv_threshold", FI_PARAM_INT,
+			"Send payloads of at least this many bytes are pulled "
+			"by the receiver once matched (default: 0, disabled)");
+
 	fastlock_init(&sock_list_lock);
 	dlist_init(&sock_fab_list);
 	dlist_init(&sock_dom_list);
@@ -134,7 +134,7 @@ ssize_t sock_ep_recvmsg(struct fid_ep *ep, const struct fi_msg *msg,
 
 	SOCK_LOG_DBG("New rx_entry: %p (ctx: %p)\n", rx_entry, rx_ctx);
 	fastlock_acquire(&rx_ctx->lock);
-	dlist_insert_tail(&rx_entry->entry, &rx_ctx->rx_entry_list);
+	sock_rx_enqueue_posted(rx_ctx, rx_entry);
 	fastlock_release(&rx_ctx->lock);
 	return 0;
 }
@@ -255,6 +255,15 @@ ssize_t sock_ep_sendmsg(struct fid_ep *ep, const struct fi_msg *msg,
 		total_len += sizeof(uint64_t);
 
 	sock_tx_ctx_start(tx_ctx);
+	if (!sock_pe_send_direct(tx_ctx, ep_attr, conn, &tx_op, flags,
+				 msg->msg_iov, msg->iov_count,
+				 (uintptr_t) msg->context, msg->addr,
+				 msg->data, 0)) {
+		/* nothing was queued; just drop the ring's write lock */
+		sock_tx_ctx_abort(tx_ctx);
+		return 0;
+	}
+
 	if (ofi_rbavail(&tx_ctx->rb) < total_len) {
 		ret = -FI_EAGAIN;
 		goto err;
@@ -468,7 +477,7 @@ ssize_t sock_ep_trecvmsg(struct fid_ep *ep,
 
 	fastlock_acquire(&rx_ctx->lock);
 	SOCK_LOG_DBG("New rx_entry: %p (ctx: %p)\n", rx_entry, rx_ctx);
-	dlist_insert_tail(&rx_entry->entry, &rx_ctx->rx_entry_list);
+	sock_rx_enqueue_posted(rx_ctx, rx_entry);
 	fastlock_release(&rx_ctx->lock);
 	return 0;
 }
@@ -592,6 +601,15 @@ ssize_t sock_ep_tsendmsg(struct fid_ep *ep,
 		total_len += sizeof(uint64_t);
 
 	sock_tx_ctx_start(tx_ctx);
+	if (!sock_pe_send_direct(tx_ctx, ep_attr, conn, &tx_op, flags,
+				 msg->msg_iov, msg->iov_count,
+				 (uintptr_t) msg->context, msg->addr,
+				 msg->data, msg->tag)) {
+		/* nothing was queued; just drop the ring's write lock */
+		sock_tx_ctx_abort(tx_ctx);
+		return 0;
+	}
+
 	if (ofi_rbavail(&tx_ctx->rb) < total_len) {
 		ret = -FI_EAGAIN;
 		goto err;
@@ -57,6 +57,7 @@
 #include <net/if.h>
 
 #include <fi_mem.h>
+#include <fi_atomic_ops.h>
 #include "sock.h"
 #include "sock_util.h"
 
@@ -64,6 +65,11 @@
 #define SOCK_LOG_ERROR(...) _SOCK_LOG_ERROR(FI_LOG_EP_DATA, __VA_ARGS__)
 
 #define PE_INDEX(_pe, _e) (_e - &_pe->pe_table[0])
+/* a TX entry is named on the wire by its engine and its slot there */
+#define PE_ENTRY_ID(_pe, _e) ((_pe)->index * SOCK_PE_MAX_ENTRIES + \
+			      PE_INDEX(_pe, _e))
+#define PE_ENTRY_PE(_id) ((_id) / SOCK_PE_MAX_ENTRIES)
+#define PE_ENTRY_SLOT(_id) ((_id) % SOCK_PE_MAX_ENTRIES)
 #define SOCK_GET_RX_ID(_addr, _bits) (((_bits) == 0) ? 0 : \
 		(((uint64_t)_addr) >> (64 - _bits)))
 
@@ -79,12 +85,66 @@ static inline int sock_pe_is_data_msg(int msg_id)
 	case SOCK_OP_WRITE:
 	case SOCK_OP_READ:
 	case SOCK_OP_ATOMIC:
+	case SOCK_OP_RNDV_DATA:
 		return 1;
 	default:
 		return 0;
 	}
 }
 
+/*
+ * The contexts of a scalable endpoint may run on several engines that
+ * share the endpoint's connections.  An engine then holds the connection
+ * lock while it works on a connection: its TX and RX owner entries, send
+ * batch, stash and zerocopy counters.  Engines never wait for each other;
+ * one that finds the connection busy retries on its next pass.
+ */
+static inline int sock_pe_lock_conn(struct sock_ep_attr *ep_attr,
+				    struct sock_conn *conn)
+{
+	return ep_attr->pe_cnt > 1 ? fastlock_tryacquire(&conn->lock) : 0;
+}
+
+static inline void sock_pe_unlock_conn(struct sock_ep_attr *ep_attr,
+				       struct sock_conn *conn)
+{
+	if (ep_attr->pe_cnt > 1)
+		fastlock_release(&conn->lock);
+}
+
+/* a send batch only holds entries of the engine that started it */
+static inline int sock_pe_batch_busy(struct sock_pe *pe,
+				     struct sock_conn *conn)
+{
+	return conn->tx_batch_cnt &&
+	       conn->tx_batch[0]->pe.tx.tx_ctx->pe != pe;
+}
+
+/*
+ * Whether the owner of a shared connection changes between two entries of
+ * a pass depends on other engines, so a send may only take the connection
+ * once no earlier send of its context to the same peer is left waiting.
+ */
+static int sock_pe_tx_in_order(struct sock_ep_attr *ep_attr,
+			       struct sock_tx_ctx *tx_ctx,
+			       struct sock_pe_entry *pe_entry)
+{
+	struct dlist_entry *entry;
+	struct sock_pe_entry *prev;
+
+	if (ep_attr->pe_cnt <= 1)
+		return 1;
+
+	for (entry = tx_ctx->pe_entry_list.next; entry != &pe_entry->ctx_entry;
+	     entry = entry->next) {
+		prev = container_of(entry, struct sock_pe_entry, ctx_entry);
+		if (prev->conn == pe_entry->conn && !prev->is_complete &&
+		    !prev->pe.tx.send_done && !prev->pe.tx.batched)
+			return 0;
+	}
+	return 1;
+}
+
 static inline ssize_t sock_pe_send_field(struct sock_pe_entry *pe_entry,
 					 void *field, size_t field_len,
 					 size_t start_offset)
@@ -106,6 +166,66 @@ static inline ssize_t sock_pe_send_field(struct sock_pe_entry *pe_entry,
 	return (ret == data_len) ? 0 : -1;
 }
 
+/*
+ * Send the source iovs of a non-inject transfer.  Payloads larger than the
+ * comm buffer are handed to the socket straight from the user buffers,
+ * gathered with any staged header bytes in one syscall.  Payloads above
+ * the zerocopy threshold are sent with MSG_ZEROCOPY when the connection
+ * supports it.
+ */
+static inline ssize_t sock_pe_send_src_iov(struct sock_pe_entry *pe_entry,
+					   size_t start_offset)
+{
+	struct iovec iov[SOCK_EP_MAX_IOV_LIMIT];
+	size_t i, cnt, offset, len;
+	ssize_t ret;
+	int zerocopy;
+
+	pe_entry->data_len = 0;
+	for (i = 0; i < pe_entry->pe.tx.tx_op.src_iov_len; i++)
+		pe_entry->data_len += pe_entry->pe.tx.tx_iov[i].src.iov.len;
+
+	zerocopy = pe_entry->conn->zerocopy && sock_zerocopy_threshold > 0 &&
+		   pe_entry->data_len >= (size_t) sock_zerocopy_threshold;
+
+	if (!zerocopy && pe_entry->data_len <= pe_entry->cache_sz) {
+		for (i = 0; i < pe_entry->pe.tx.tx_op.src_iov_len; i++) {
+			len = pe_entry->pe.tx.tx_iov[i].src.iov.len;
+			if (sock_pe_send_field(pe_entry,
+				    (void *) (uintptr_t) pe_entry->pe.tx.tx_iov[i].src.iov.addr,
+				    len, start_offset))
+				return -1;
+			start_offset += len;
+		}
+		return 0;
+	}
+
+	if (pe_entry->done_len >= start_offset + pe_entry->data_len)
+		return 0;
+
+	offset = pe_entry->done_len - start_offset;
+	for (i = 0, cnt = 0; i < pe_entry->pe.tx.tx_op.src_iov_len; i++) {
+		len = pe_entry->pe.tx.tx_iov[i].src.iov.len;
+		if (offset >= len) {
+			offset -= len;
+			continue;
+		}
+		iov[cnt].iov_base = (char *) (uintptr_t)
+			pe_entry->pe.tx.tx_iov[i].src.iov.addr + offset;
+		iov[cnt++].iov_len = len - offset;
+		offset = 0;
+	}
+
+	ret = zerocopy ? sock_comm_sendv_zc(pe_entry, iov, cnt) :
+		sock_comm_sendv(pe_entry, iov, cnt);
+	if (ret <= 0)
+		return -1;
+
+	pe_entry->done_len += ret;
+	return (pe_entry->done_len ==
+		start_offset + pe_entry->data_len) ? 0 : -1;
+}
+
 static inline ssize_t sock_pe_recv_field(struct sock_pe_entry *pe_entry,
 					 void *field, size_t field_len,
 					 size_t start_offset)
@@ -126,6 +246,16 @@ static inline ssize_t sock_pe_recv_field(struct sock_pe_entry *pe_entry,
 	return (ret == data_len) ? 0 : -1;
 }
 
+/* give up the receive side of the connection, parking any read-ahead */
+static inline void sock_pe_release_rx_conn(struct sock_pe_entry *pe_entry)
+{
+	if (pe_entry->conn->rx_pe_entry != pe_entry)
+		return;
+
+	sock_comm_stash(pe_entry);
+	pe_entry->conn->rx_pe_entry = NULL;
+}
+
 static inline void sock_pe_discard_field(struct sock_pe_entry *pe_entry)
 {
 	size_t ret;
@@ -138,7 +268,7 @@ static inline void sock_pe_discard_field(struct sock_pe_entry *pe_entry)
 
 	pe_entry->rem -= ret;
 	if (pe_entry->rem == 0)
-		pe_entry->conn->rx_pe_entry = NULL;
+		sock_pe_release_rx_conn(pe_entry);
 
  out:
 	if (pe_entry->done_len == pe_entry->total_len && !pe_entry->rem) {
@@ -154,8 +284,9 @@ static void sock_pe_release_entry(struct sock_pe *pe,
 
 	if (pe_entry->conn->tx_pe_entry == pe_entry)
 		pe_entry->conn->tx_pe_entry = NULL;
-	if (pe_entry->conn->rx_pe_entry == pe_entry)
-		pe_entry->conn->rx_pe_entry = NULL;
+	if (pe_entry->type == SOCK_PE_TX)
+		ofi_atomic_dec32(&pe_entry->conn->ref);
+	sock_pe_release_rx_conn(pe_entry);
 
 	if (pe_entry->type == SOCK_PE_RX && pe_entry->pe.rx.atomic_cmp) {
 		util_buf_release(pe->atomic_rx_pool, pe_entry->pe.rx.atomic_cmp);
@@ -350,6 +481,30 @@ static void sock_pe_report_write_completion(struct sock_pe_entry *pe_entry)
 	}
 }
 
+/*
+ * With MSG_ZEROCOPY the kernel may still reference the source buffer after
+ * the peer has acknowledged the data; hold the completion back until the
+ * error queue releases it.
+ */
+static int sock_pe_defer_tx_completion(struct sock_pe_entry *pe_entry)
+{
+	if (sock_comm_zc_done(pe_entry))
+		return 0;
+
+	SOCK_LOG_DBG("Deferring completion of %p for zerocopy\n", pe_entry);
+	pe_entry->pe.tx.zc_deferred = 1;
+	return 1;
+}
+
+static void sock_pe_report_deferred_completion(struct sock_pe_entry *pe_entry)
+{
+	if (pe_entry->msg_hdr.op_type == SOCK_OP_WRITE)
+		sock_pe_report_write_completion(pe_entry);
+	else
+		sock_pe_report_send_completion(pe_entry);
+	pe_entry->is_complete = 1;
+}
+
 static void sock_pe_report_remote_read(struct sock_rx_ctx *rx_ctx,
 				struct sock_pe_entry *pe_entry)
 {
@@ -418,6 +573,112 @@ static void sock_pe_report_tx_rma_write_err(struct sock_pe_entry *pe_entry,
 			 	     err, -err, NULL, 0);
 }
 
+static void sock_pe_tx_send_done(struct sock_pe_entry *pe_entry)
+{
+	pe_entry->pe.tx.send_done = 1;
+	SOCK_LOG_DBG("Send complete\n");
+
+	/* rendezvous sends complete once the payload was pulled */
+	if ((pe_entry->flags & FI_INJECT_COMPLETE) &&
+	    !(pe_entry->flags & SOCK_RNDV) &&
+	    !sock_pe_defer_tx_completion(pe_entry)) {
+		sock_pe_report_send_completion(pe_entry);
+		pe_entry->is_complete = 1;
+	}
+}
+
+/*
+ * Small sends are staged whole in their comm buffers and batched on the
+ * connection instead of being flushed one by one; the batch goes out
+ * with a single sendmsg() at the end of the progress pass, or as soon
+ * as anything else needs to write to the connection.
+ */
+static int sock_pe_tx_batchable(struct sock_pe_entry *pe_entry)
+{
+	if (pe_entry->msg_hdr.op_type != SOCK_OP_SEND &&
+	    pe_entry->msg_hdr.op_type != SOCK_OP_TSEND)
+		return 0;
+
+	if ((pe_entry->flags & SOCK_RNDV) ||
+	    pe_entry->total_len > pe_entry->cache_sz)
+		return 0;
+
+	return (pe_entry->flags & FI_INJECT) || !pe_entry->conn->zerocopy ||
+		sock_zerocopy_threshold <= 0 ||
+		pe_entry->data_len < (size_t) sock_zerocopy_threshold;
+}
+
+static void sock_pe_flush_tx_batch(struct sock_conn *conn)
+{
+	struct sock_pe_entry *pe_entry;
+	int i;
+
+	if (!conn->tx_batch_cnt)
+		return;
+
+	if (!conn->connected) {
+		for (i = 0; i < conn->tx_batch_cnt; i++) {
+			pe_entry = conn->tx_batch[i];
+			pe_entry->pe.tx.batched = 0;
+			sock_pe_report_tx_error(pe_entry, 0, FI_EIO);
+			pe_entry->is_complete = 1;
+		}
+		conn->tx_batch_cnt = 0;
+		return;
+	}
+
+	sock_comm_flush_batch(conn);
+	for (i = 0; i < conn->tx_batch_cnt; i++) {
+		pe_entry = conn->tx_batch[i];
+		if (!sock_comm_tx_done(pe_entry))
+			break;
+		pe_entry->pe.tx.batched = 0;
+		sock_pe_tx_send_done(pe_entry);
+	}
+
+	conn->tx_batch_cnt -= i;
+	memmove(&conn->tx_batch[0], &conn->tx_batch[i],
+		conn->tx_batch_cnt * sizeof(conn->tx_batch[0]));
+}
+
+static int sock_pe_tx_batch_add(struct sock_pe_entry *pe_entry)
+{
+	struct sock_conn *conn = pe_entry->conn;
+
+	if (!sock_pe_tx_batchable(pe_entry))
+		return 0;
+
+	if (conn->tx_batch_cnt == SOCK_PE_TX_BATCH_MAX) {
+		sock_pe_flush_tx_batch(conn);
+		if (conn->tx_batch_cnt == SOCK_PE_TX_BATCH_MAX)
+			return -FI_EAGAIN;
+	}
+
+	conn->tx_batch[conn->tx_batch_cnt++] = pe_entry;
+	pe_entry->pe.tx.batched = 1;
+	conn->tx_pe_entry = NULL;
+	return 1;
+}
+
+/*
+ * The payload of a rendezvous send has been handed to the socket.  Sends
+ * asking for FI_INJECT_COMPLETE complete now, others wait for the
+ * receiver's ack.
+ */
+static void sock_pe_rndv_data_sent(struct sock_pe *pe,
+				   struct sock_pe_entry *pe_entry)
+{
+	struct sock_pe_entry *waiting_entry;
+
+	waiting_entry = &pe->pe_table[PE_ENTRY_SLOT(pe_entry->msg_hdr.pe_entry_id)];
+	assert(waiting_entry->type == SOCK_PE_TX);
+	if (!(waiting_entry->flags & FI_INJECT_COMPLETE))
+		return;
+
+	sock_pe_report_send_completion(waiting_entry);
+	waiting_entry->is_complete = 1;
+}
+
 static void sock_pe_progress_pending_ack(struct sock_pe *pe,
 					 struct sock_pe_entry *pe_entry)
 {
@@ -434,6 +695,11 @@ static void sock_pe_progress_pending_ack(struct sock_pe *pe,
 	}
 
 	if (conn->tx_pe_entry == NULL) {
+		if (sock_pe_batch_busy(pe, conn))
+			return;
+		sock_pe_flush_tx_batch(conn);
+		if (conn->tx_batch_cnt)
+			return;
 		SOCK_LOG_DBG("Connection %p grabbed by %p\n", conn, pe_entry);
 		conn->tx_pe_entry = pe_entry;
 	}
@@ -444,6 +710,19 @@ static void sock_pe_progress_pending_ack(struct sock_pe *pe,
 	len = sizeof(struct sock_msg_response);
 
 	switch (pe_entry->response.msg_hdr.op_type) {
+	case SOCK_OP_RNDV_PULL:
+		if (sock_pe_send_field(pe_entry, &pe_entry->data,
+				       sizeof(pe_entry->data), len))
+			return;
+		len += sizeof(pe_entry->data);
+		break;
+
+	case SOCK_OP_RNDV_DATA:
+		if (sock_pe_send_field(pe_entry, &pe_entry->data,
+				       sizeof(pe_entry->data), len))
+			return;
+		len += sizeof(pe_entry->data);
+		/* fall through */
 	case SOCK_OP_READ_COMPLETE:
 		for (i = 0; i < pe_entry->msg_hdr.dest_iov_len; i++) {
 			if (sock_pe_send_field(
@@ -477,6 +756,9 @@ static void sock_pe_progress_pending_ack(struct sock_pe *pe,
 		pe_entry->is_complete = 1;
 		pe_entry->pe.rx.pending_send = 0;
 		pe_entry->conn->tx_pe_entry = NULL;
+
+		if (pe_entry->response.msg_hdr.op_type == SOCK_OP_RNDV_DATA)
+			sock_pe_rndv_data_sent(pe, pe_entry);
 	}
 }
 
@@ -489,11 +771,15 @@ static void sock_pe_send_response(struct sock_pe *pe,
 	memset(response, 0, sizeof(struct sock_msg_response));
 
 	response->pe_entry_id = htons(pe_entry->msg_hdr.pe_entry_id);
+	/* lets the reader route the response before reading all of it */
+	response->msg_hdr.pe_entry_id = response->pe_entry_id;
 	response->err = htonl(err);
 	response->msg_hdr.dest_iov_len = 0;
 	response->msg_hdr.flags = 0;
 	response->msg_hdr.msg_len = sizeof(*response) + data_len;
-	response->msg_hdr.version = SOCK_WIRE_PROTO_VERSION;
+	response->msg_hdr.version = (op_type == SOCK_OP_RNDV_PULL ||
+				     op_type == SOCK_OP_RNDV_DATA) ?
+		SOCK_WIRE_PROTO_RNDV_VERSION : SOCK_WIRE_PROTO_VERSION;
 	response->msg_hdr.op_type = op_type;
 	response->msg_hdr.msg_len = htonll(response->msg_hdr.msg_len);
 	response->msg_hdr.rx_id = pe_entry->msg_hdr.rx_id;
@@ -502,7 +788,7 @@ static void sock_pe_send_response(struct sock_pe *pe,
 	pe_entry->done_len = 0;
 	pe_entry->pe.rx.pending_send = 1;
 	if (pe_entry->rem == 0)
-		pe_entry->conn->rx_pe_entry = NULL;
+		sock_pe_release_rx_conn(pe_entry);
 	pe_entry->total_len = sizeof(*response) + data_len;
 
 	sock_pe_progress_pending_ack(pe, pe_entry);
@@ -536,15 +822,19 @@ static int sock_pe_handle_ack(struct sock_pe *pe,
 		return 0;
 
 	response = &pe_entry->response;
-	assert(response->pe_entry_id <= SOCK_PE_MAX_ENTRIES);
-	waiting_entry = &pe->pe_table[response->pe_entry_id];
+	assert(PE_ENTRY_PE(response->pe_entry_id) == pe->index);
+	waiting_entry = &pe->pe_table[PE_ENTRY_SLOT(response->pe_entry_id)];
 	SOCK_LOG_DBG("Received ack for PE entry %p (index: %d)\n",
 		      waiting_entry, response->pe_entry_id);
 
 	assert(waiting_entry->type == SOCK_PE_TX);
+	pe_entry->is_complete = 1;
+	waiting_entry->pe.tx.zc_acked = 1;
+	if (sock_pe_defer_tx_completion(waiting_entry))
+		return 0;
+
 	sock_pe_report_send_completion(waiting_entry);
 	waiting_entry->is_complete = 1;
-	pe_entry->is_complete = 1;
 	return 0;
 }
 
@@ -558,8 +848,8 @@ static int sock_pe_handle_error(struct sock_pe *pe,
 		return 0;
 
 	response = &pe_entry->response;
-	assert(response->pe_entry_id <= SOCK_PE_MAX_ENTRIES);
-	waiting_entry = &pe->pe_table[response->pe_entry_id];
+	assert(PE_ENTRY_PE(response->pe_entry_id) == pe->index);
+	waiting_entry = &pe->pe_table[PE_ENTRY_SLOT(response->pe_entry_id)];
 	SOCK_LOG_ERROR("Received error for PE entry %p (index: %d)\n",
 		      waiting_entry, response->pe_entry_id);
 
@@ -594,12 +884,12 @@ static int sock_pe_handle_read_complete(struct sock_pe *pe,
 		return 0;
 
 	response = &pe_entry->response;
-	assert(response->pe_entry_id <= SOCK_PE_MAX_ENTRIES);
-	waiting_entry = &pe->pe_table[response->pe_entry_id];
+	assert(PE_ENTRY_PE(response->pe_entry_id) == pe->index);
+	waiting_entry = &pe->pe_table[PE_ENTRY_SLOT(response->pe_entry_id)];
 	SOCK_LOG_DBG("Received read complete for PE entry %p (index: %d)\n",
 		      waiting_entry, response->pe_entry_id);
 
-	waiting_entry = &pe->pe_table[response->pe_entry_id];
+	waiting_entry = &pe->pe_table[PE_ENTRY_SLOT(response->pe_entry_id)];
 	assert(waiting_entry->type == SOCK_PE_TX);
 
 	len = sizeof(struct sock_msg_response);
@@ -628,15 +918,19 @@ static int sock_pe_handle_write_complete(struct sock_pe *pe,
 		return 0;
 
 	response = &pe_entry->response;
-	assert(response->pe_entry_id <= SOCK_PE_MAX_ENTRIES);
-	waiting_entry = &pe->pe_table[response->pe_entry_id];
+	assert(PE_ENTRY_PE(response->pe_entry_id) == pe->index);
+	waiting_entry = &pe->pe_table[PE_ENTRY_SLOT(response->pe_entry_id)];
 	SOCK_LOG_DBG("Received ack for PE entry %p (index: %d)\n",
 		      waiting_entry, response->pe_entry_id);
 
 	assert(waiting_entry->type == SOCK_PE_TX);
+	pe_entry->is_complete = 1;
+	waiting_entry->pe.tx.zc_acked = 1;
+	if (sock_pe_defer_tx_completion(waiting_entry))
+		return 0;
+
 	sock_pe_report_write_completion(waiting_entry);
 	waiting_entry->is_complete = 1;
-	pe_entry->is_complete = 1;
 	return 0;
 }
 
@@ -652,12 +946,12 @@ static int sock_pe_handle_atomic_complete(struct sock_pe *pe,
 		return 0;
 
 	response = &pe_entry->response;
-	assert(response->pe_entry_id <= SOCK_PE_MAX_ENTRIES);
-	waiting_entry = &pe->pe_table[response->pe_entry_id];
+	assert(PE_ENTRY_PE(response->pe_entry_id) == pe->index);
+	waiting_entry = &pe->pe_table[PE_ENTRY_SLOT(response->pe_entry_id)];
 	SOCK_LOG_DBG("Received atomic complete for PE entry %p (index: %d)\n",
 		      waiting_entry, response->pe_entry_id);
 
-	waiting_entry = &pe->pe_table[response->pe_entry_id];
+	waiting_entry = &pe->pe_table[PE_ENTRY_SLOT(response->pe_entry_id)];
 	assert(waiting_entry->type == SOCK_PE_TX);
 
 	len = sizeof(struct sock_msg_response);
@@ -682,6 +976,152 @@ static int sock_pe_handle_atomic_complete(struct sock_pe *pe,
 	return 0;
 }
 
+/*
+ * The receiver matched one of our rendezvous sends and asks for its
+ * payload.  Answer with the receiver's cookie followed by the source iovs.
+ */
+static int sock_pe_handle_rndv_pull(struct sock_pe *pe,
+				    struct sock_rx_ctx *rx_ctx,
+				    struct sock_pe_entry *pe_entry)
+{
+	struct sock_pe_entry *waiting_entry;
+	struct sock_msg_response *response;
+	uint64_t len, data_len;
+	int i;
+
+	if (sock_pe_read_response(pe_entry))
+		return 0;
+
+	len = sizeof(struct sock_msg_response);
+	if (sock_pe_recv_field(pe_entry, &pe_entry->data,
+			       sizeof(pe_entry->data), len))
+		return 0;
+
+	response = &pe_entry->response;
+	if (PE_ENTRY_PE(response->pe_entry_id) != pe->index) {
+		SOCK_LOG_ERROR("Dropping rendezvous pull for invalid PE entry "
+			       "%d\n", response->pe_entry_id);
+		goto drop;
+	}
+
+	waiting_entry = &pe->pe_table[PE_ENTRY_SLOT(response->pe_entry_id)];
+	SOCK_LOG_DBG("Received rendezvous pull for PE entry %p (index: %d)\n",
+		      waiting_entry, response->pe_entry_id);
+
+	/* the entry may have completed, been reused, or belong to another peer */
+	if (waiting_entry->type != SOCK_PE_TX ||
+	    !(waiting_entry->flags & SOCK_RNDV) ||
+	    waiting_entry->is_complete ||
+	    waiting_entry->conn != pe_entry->conn) {
+		SOCK_LOG_ERROR("Dropping stale rendezvous pull for PE entry "
+			       "%d\n", response->pe_entry_id);
+		goto drop;
+	}
+
+	data_len = 0;
+	for (i = 0; i < waiting_entry->pe.tx.tx_op.src_iov_len; i++) {
+		pe_entry->pe.rx.rx_iov[i].iov.addr =
+			waiting_entry->pe.tx.tx_iov[i].src.iov.addr;
+		pe_entry->pe.rx.rx_iov[i].iov.len =
+			waiting_entry->pe.tx.tx_iov[i].src.iov.len;
+		data_len += waiting_entry->pe.tx.tx_iov[i].src.iov.len;
+	}
+	pe_entry->msg_hdr.dest_iov_len = waiting_entry->pe.tx.tx_op.src_iov_len;
+	pe_entry->msg_hdr.pe_entry_id = response->pe_entry_id;
+
+	sock_pe_send_response(pe, rx_ctx, pe_entry,
+			      sizeof(pe_entry->data) + data_len,
+			      SOCK_OP_RNDV_DATA, 0);
+	return 0;
+
+drop:
+	pe_entry->is_error = 1;
+	pe_entry->rem = pe_entry->total_len - pe_entry->done_len;
+	return 0;
+}
+
+/*
+ * Payload of a rendezvous send we pulled.  The cookie echoed in front of it
+ * names the slot of the matched rx_entry, which holds the destination iovs
+ * and everything needed to report the receive.  Data for a cookie that is
+ * stale or did not come from the peer we pulled from is dropped.
+ */
+static int sock_pe_handle_rndv_data(struct sock_pe *pe,
+				    struct sock_rx_ctx *rx_ctx,
+				    struct sock_pe_entry *pe_entry)
+{
+	struct sock_rx_entry *rx_entry;
+	uint64_t len, rem, cookie;
+	int i;
+
+	if (sock_pe_read_response(pe_entry))
+		return 0;
+
+	len = sizeof(struct sock_msg_response);
+	if (sock_pe_recv_field(pe_entry, &pe_entry->data,
+			       sizeof(pe_entry->data), len))
+		return 0;
+	len += sizeof(pe_entry->data);
+	cookie = pe_entry->data;
+
+	fastlock_acquire(&rx_ctx->lock);
+	rx_entry = sock_rx_rndv_lookup(rx_ctx, cookie);
+	fastlock_release(&rx_ctx->lock);
+	if (!rx_entry || rx_entry->conn != pe_entry->conn) {
+		SOCK_LOG_ERROR("Dropping rendezvous data for unknown cookie "
+			       "0x%" PRIx64 "\n", cookie);
+		pe_entry->is_error = 1;
+		pe_entry->rem = pe_entry->total_len - pe_entry->done_len;
+		return 0;
+	}
+
+	rem = rx_entry->total_len;
+	for (i = 0; i < rx_entry->rx_op.dest_iov_len; i++) {
+		if (sock_pe_recv_field(pe_entry,
+				(char *) (uintptr_t) rx_entry->iov[i].iov.addr,
+				rx_entry->iov[i].iov.len, len))
+			return 0;
+		len += rx_entry->iov[i].iov.len;
+		rem -= rx_entry->iov[i].iov.len;
+	}
+
+	pe_entry->is_complete = 1;
+	pe_entry->data_len = rx_entry->total_len - rem;
+	pe_entry->buf = rx_entry->iov[0].iov.addr;
+	pe_entry->data = rx_entry->data;
+	pe_entry->tag = rx_entry->tag;
+	pe_entry->context = rx_entry->context;
+	pe_entry->flags = rx_entry->flags;
+	pe_entry->addr = rx_entry->addr;
+	pe_entry->comp = rx_entry->comp;
+
+	if (!(rx_entry->flags & FI_DISCARD)) {
+		if (rem) {
+			SOCK_LOG_ERROR("Not enough space in posted recv buffer\n");
+			sock_pe_report_rx_error(pe_entry, rem, FI_ETRUNC);
+		} else {
+			sock_pe_report_recv_completion(pe_entry);
+		}
+	}
+
+	if (rem) {
+		pe_entry->is_error = 1;
+		pe_entry->rem = pe_entry->total_len - pe_entry->done_len;
+	}
+
+	if (rx_entry->rndv_ack) {
+		pe_entry->msg_hdr.pe_entry_id = pe_entry->response.pe_entry_id;
+		sock_pe_send_response(pe, rx_ctx, pe_entry, 0,
+				      SOCK_OP_SEND_COMPLETE, 0);
+	}
+
+	fastlock_acquire(&rx_ctx->lock);
+	sock_rx_rndv_remove(rx_ctx, cookie);
+	sock_rx_release_entry(rx_entry);
+	fastlock_release(&rx_ctx->lock);
+	return 0;
+}
+
 static int sock_pe_process_rx_read(struct sock_pe *pe,
 					struct sock_rx_ctx *rx_ctx,
 					struct sock_pe_entry *pe_entry)
@@ -801,416 +1241,65 @@ out:
 	return ret;
 }
 
-#define SOCK_ATOMIC_UPDATE_INT(_cmp, _src, _dst, _tmp) do {		\
-	switch (op) {							\
-	case FI_MIN:							\
-		*_cmp = *_dst;						\
-		if (*_src < *_dst)					\
-			*_dst = *_src;					\
-		break;							\
-									\
-	case FI_MAX:							\
-		*_cmp = *_dst;						\
-		if (*_src > *_dst)					\
-			*_dst = *_src;					\
-		break;							\
-									\
-	case FI_SUM:							\
-		*_cmp = *_dst;						\
-		*_dst = *_dst + *_src;					\
-		break;							\
-									\
-	case FI_PROD:							\
-		*_cmp = *_dst;						\
-		*_dst = *_dst * *_src;					\
-		break;							\
-									\
-	case FI_LOR:							\
-		*_cmp = *_dst;						\
-		*_dst = *_dst || *_src;					\
-		break;							\
-									\
-	case FI_LAND:							\
-		*_cmp = *_dst;						\
-		*_dst = *_dst && *_src;					\
-		break;							\
-									\
-	case FI_BOR:							\
-		*_cmp = *_dst;						\
-		*_dst = *_dst | *_src;					\
-		break;							\
-									\
-	case FI_BAND:							\
-		*_cmp = *_dst;						\
-		*_dst = *_dst & *_src;					\
-		break;							\
-									\
-	case FI_LXOR:							\
-		*_cmp = *_dst;						\
-									\
-		*_dst = ((*_dst && !*_src) || (!*_dst && *_src));	\
-		break;							\
-									\
-	case FI_BXOR:							\
-		*_cmp = *_dst;						\
-		*_dst = *_dst ^ *_src;					\
-		break;							\
-									\
-	case FI_ATOMIC_READ:						\
-		*_cmp = *_dst;						\
-		break;							\
-									\
-	case FI_ATOMIC_WRITE:						\
-		*_cmp = *_dst;						\
-		*_dst = *_src;						\
-		break;							\
-									\
-	case FI_CSWAP:							\
-		if (*_cmp == *_dst)					\
-			*_dst = *_src;					\
-		else							\
-			*_cmp = *_dst;					\
-		break;							\
-									\
-	case FI_CSWAP_NE:						\
-		_tmp = *_dst;						\
-		if (*_cmp != *_dst)					\
-			*_dst = *_src;					\
-		*_cmp = _tmp;						\
-		break;							\
-									\
-	case FI_CSWAP_LE:						\
-		_tmp = *_dst;						\
-		if (*_cmp <= *_dst)					\
-			*_dst = *_src;					\
-		*_cmp = _tmp;						\
-		break;							\
-									\
-	case FI_CSWAP_LT:						\
-		_tmp = *_dst;						\
-		if (*_cmp < *_dst)					\
-			*_dst = *_src;					\
-		*_cmp = _tmp;						\
-		break;							\
-									\
-	case FI_CSWAP_GE:						\
-		_tmp = *_dst;						\
-		if (*_cmp >= *_dst)					\
-			*_dst = *_src;					\
-		*_cmp = _tmp;						\
-		break;							\
-									\
-	case FI_CSWAP_GT:						\
-		_tmp = *_dst;						\
-		if (*_cmp > *_dst)					\
-			*_dst = *_src;					\
-		*_cmp = _tmp;						\
-		break;							\
-									\
-	case FI_MSWAP:							\
-		_tmp = *_dst;						\
-		*_dst = (*_src & *_cmp) | (*_dst & ~(*_cmp));		\
-		*_cmp = _tmp;						\
-		break;							\
-									\
-	default:							\
-		SOCK_LOG_ERROR("Atomic operation type not supported\n"); \
-		break;							\
-	}								\
-} while (0)
-
-#define SOCK_ATOMIC_UPDATE_FLOAT(_cmp, _src, _dst) do {			\
-	switch (op) {							\
-	case FI_MIN:							\
-		*_cmp = *_dst;						\
-		if (*_src < *_dst)					\
-			*_dst = *_src;					\
-		break;							\
-									\
-	case FI_MAX:							\
-		*_cmp = *_dst;						\
-		if (*_src > *_dst)					\
-			*_dst = *_src;					\
-		break;							\
-									\
-	case FI_SUM:							\
-		*_cmp = *_dst;						\
-		*_dst = *_dst + *_src;					\
-		break;							\
-									\
-	case FI_PROD:							\
-		*_cmp = *_dst;						\
-		*_dst = *_dst * *_src;					\
-		break;							\
-									\
-	case FI_LOR:							\
-		*_cmp = *_dst;						\
-		*_dst = *_dst || *_src;					\
-		break;							\
-									\
-	case FI_LAND:							\
-		*_cmp = *_dst;						\
-		*_dst = *_dst && *_src;					\
-		break;							\
-									\
-	case FI_ATOMIC_READ:						\
-		*_cmp = *_dst;						\
-		break;							\
-									\
-	case FI_ATOMIC_WRITE:						\
-		*_cmp = *_dst;						\
-		*_dst = *_src;						\
-		break;							\
-									\
-	case FI_CSWAP:							\
-		if (*_cmp == *_dst)					\
-			*_dst = *_src;					\
-		else							\
-			*_cmp = *_dst;					\
-		break;							\
-									\
-	case FI_CSWAP_NE:						\
-		_tmp = *_dst;						\
-		if (*_cmp != *_dst)					\
-			*_dst = *_src;					\
-		*_cmp = _tmp;						\
-		break;							\
-									\
-	case FI_CSWAP_LE:						\
-		_tmp = *_dst;						\
-		if (*_cmp <= *_dst)					\
-			*_dst = *_src;					\
-		*_cmp = _tmp;						\
-		break;							\
-									\
-	case FI_CSWAP_LT:						\
-		_tmp = *_dst;						\
-		if (*_cmp < *_dst)					\
-			*_dst = *_src;					\
-		*_cmp = _tmp;						\
-		break;							\
-									\
-	case FI_CSWAP_GE:						\
-		_tmp = *_dst;						\
-		if (*_cmp >= *_dst)					\
-			*_dst = *_src;					\
-		*_cmp = _tmp;						\
-		break;							\
-									\
-	case FI_CSWAP_GT:						\
-		_tmp = *_dst;						\
-		if (*_cmp > *_dst)					\
-			*_dst = *_src;					\
-		*_cmp = _tmp;						\
-		break;							\
-									\
-	default:							\
-		SOCK_LOG_ERROR("Atomic operation type not supported\n"); \
-		break;							\
-	}								\
-} while (0)
-
-#define SOCK_ATOMIC_UPDATE_COMPLEX(_cmp, _src, _dst, _name) do {	\
-	switch (op) {							\
-	case FI_SUM:							\
-		*_cmp = *_dst;						\
-		*_dst = OFI_COMPLEX_OP(_name, sum)(*_dst, *_src);		\
-		break;							\
-									\
-	case FI_PROD:							\
-		*_cmp = *_dst;						\
-		*_dst = OFI_COMPLEX_OP(_name, mul)(*_dst, *_src);		\
-		break;							\
-									\
-	case FI_LOR:							\
-		*_cmp = *_dst;						\
-		*_dst = OFI_COMPLEX_OP(_name, lor)(*_dst, *_src);		\
-		break;							\
-									\
-	case FI_LAND:							\
-		*_cmp = *_dst;						\
-		*_dst = OFI_COMPLEX_OP(_name, land)(*_dst, *_src);		\
-		break;							\
-									\
-	case FI_ATOMIC_READ:						\
-		*_cmp = *_dst;						\
-		break;							\
-									\
-	case FI_ATOMIC_WRITE:						\
-		*_cmp = *_dst;						\
-		*_dst = *_src;						\
-		break;							\
-									\
-	case FI_CSWAP:							\
-		if (OFI_COMPLEX_OP(_name, equ)(*_dst, *_src))		\
-			*_dst = *_src;					\
-		else							\
-			*_cmp = *_dst;					\
-		break;							\
-									\
-	case FI_CSWAP_NE:						\
-		_tmp = *_dst;						\
-		if (!OFI_COMPLEX_OP(_name, equ)(*_dst, *_src))		\
-			*_dst = *_src;					\
-		*_cmp = _tmp;						\
-		break;							\
-									\
-	default:							\
-		SOCK_LOG_ERROR("Atomic operation type not supported\n");\
-		break;							\
-	}								\
-} while (0)
-
-
-static int sock_pe_update_atomic(void *cmp, void *dst, void *src,
+/*
+ * Apply an atomic to cnt elements at dst.  When cmp is given it supplies
+ * the compare operands and receives the prior contents of dst.
+ */
+static int sock_pe_update_atomic(void *cmp, void *dst, void *src, size_t cnt,
 				 enum fi_datatype datatype, enum fi_op op)
 {
-	switch (datatype) {
-	case FI_INT8:
-	{
-		int8_t *_cmp, *_dst, *_src, _tmp;
-		_cmp = cmp, _src = src, _dst = dst;
-		SOCK_ATOMIC_UPDATE_INT(_cmp, _src, _dst, _tmp);
-		break;
-	}
-
-	case FI_UINT8:
-	{
-		uint8_t *_cmp, *_dst, *_src, _tmp;
-		_cmp = cmp, _src = src, _dst = dst;
-		SOCK_ATOMIC_UPDATE_INT(_cmp, _src, _dst, _tmp);
-		break;
+	ofi_atomic_swap_func swap;
+	ofi_atomic_readwrite_func readwrite;
+	ofi_atomic_write_func write;
+
+	if (ofi_atomic_isswap_op(op)) {
+		swap = ofi_atomic_swap_handler(op, datatype);
+		if (!swap || !cmp)
+			goto err;
+		swap(dst, src, cmp, cmp, cnt);
+	} else if (cmp) {
+		readwrite = ofi_atomic_readwrite_handler(op, datatype);
+		if (!readwrite)
+			goto err;
+		readwrite(dst, src, cmp, cnt);
+	} else if (op != FI_ATOMIC_READ) {
+		write = ofi_atomic_write_handler(op, datatype);
+		if (!write)
+			goto err;
+		write(dst, src, cnt);
 	}
+	return 0;
+err:
+	SOCK_LOG_ERROR("Atomic operation %d on datatype %d not supported\n",
+		       op, datatype);
+	return -FI_EOPNOTSUPP;
+}
 
-	case FI_INT16:
-	{
-		int16_t *_cmp, *_dst, *_src, _tmp;
-		_cmp = cmp, _src = src, _dst = dst;
-		SOCK_ATOMIC_UPDATE_INT(_cmp, _src, _dst, _tmp);
-		break;
-	}
+static int sock_pe_recv_atomic_hdrs(struct sock_pe *pe,
+				    struct sock_pe_entry *pe_entry,
+				    size_t *datatype_sz, uint64_t *entry_len)
+{
+	uint64_t len;
+	int i;
 
-	case FI_UINT16:
-	{
-		uint16_t *_cmp, *_dst, *_src, _tmp;
-		_cmp = cmp, _src = src, _dst = dst;
-		SOCK_ATOMIC_UPDATE_INT(_cmp, _src, _dst, _tmp);
-		break;
+	if (!pe_entry->pe.rx.atomic_cmp) {
+		pe_entry->pe.rx.atomic_cmp = util_buf_alloc(pe->atomic_rx_pool);
+		pe_entry->pe.rx.atomic_src = util_buf_alloc(pe->atomic_rx_pool);
+		if (!pe_entry->pe.rx.atomic_cmp || !pe_entry->pe.rx.atomic_src)
+			return -FI_ENOMEM;
 	}
 
-	case FI_INT32:
-	{
-		int32_t *_cmp, *_dst, *_src, _tmp;
-		_cmp = cmp, _src = src, _dst = dst;
-		SOCK_ATOMIC_UPDATE_INT(_cmp, _src, _dst, _tmp);
-		break;
-	}
+	len = sizeof(struct sock_msg_hdr);
+	if (sock_pe_recv_field(pe_entry, &pe_entry->pe.rx.rx_op,
+			       sizeof(struct sock_op), len))
+		return -FI_EAGAIN;
+	len += sizeof(struct sock_op);
 
-	case FI_UINT32:
-	{
-		uint32_t *_cmp, *_dst, *_src, _tmp;
-		_cmp = cmp, _src = src, _dst = dst;
-		SOCK_ATOMIC_UPDATE_INT(_cmp, _src, _dst, _tmp);
-		break;
-	}
-
-	case FI_INT64:
-	{
-		int64_t *_cmp, *_dst, *_src, _tmp;
-		_cmp = cmp, _src = src, _dst = dst;
-		SOCK_ATOMIC_UPDATE_INT(_cmp, _src, _dst, _tmp);
-		break;
-	}
-
-	case FI_UINT64:
-	{
-		uint64_t *_cmp, *_dst, *_src, _tmp;
-		_cmp = cmp, _src = src, _dst = dst;
-		SOCK_ATOMIC_UPDATE_INT(_cmp, _src, _dst, _tmp);
-		break;
-	}
-
-	case FI_FLOAT:
-	{
-		float *_cmp, *_dst, *_src, _tmp;
-		_cmp = cmp, _src = src, _dst = dst;
-		SOCK_ATOMIC_UPDATE_FLOAT(_cmp, _src, _dst);
-		break;
-	}
-
-	case FI_DOUBLE:
-	{
-		double *_cmp, *_dst, *_src, _tmp;
-		_cmp = cmp, _src = src, _dst = dst;
-		SOCK_ATOMIC_UPDATE_FLOAT(_cmp, _src, _dst);
-		break;
-	}
-
-	case FI_LONG_DOUBLE:
-	{
-		long double *_cmp, *_dst, *_src, _tmp;
-		_cmp = cmp, _src = src, _dst = dst;
-		SOCK_ATOMIC_UPDATE_FLOAT(_cmp, _src, _dst);
-		break;
-	}
-
-	case FI_DOUBLE_COMPLEX:
-	{
-		OFI_COMPLEX(double) *_cmp, *_dst, *_src, _tmp;
-		_cmp = cmp, _src = src, _dst = dst;
-		SOCK_ATOMIC_UPDATE_COMPLEX(_cmp, _src, _dst, double);
-		break;
-	}
-
-	case FI_FLOAT_COMPLEX:
-	{
-		OFI_COMPLEX(float) *_cmp, *_dst, *_src, _tmp;
-		_cmp = cmp, _src = src, _dst = dst;
-		SOCK_ATOMIC_UPDATE_COMPLEX(_cmp, _src, _dst, float);
-		break;
-	}
-
-	case FI_LONG_DOUBLE_COMPLEX:
-	{
-		OFI_COMPLEX(long_double) *_cmp, *_dst, *_src, _tmp;
-		_cmp = cmp, _src = src, _dst = dst;
-		SOCK_ATOMIC_UPDATE_COMPLEX(_cmp, _src, _dst, long_double);
-		break;
-	}
-
-	default:
-		SOCK_LOG_ERROR("Atomic datatype not supported\n");
-		break;
-	}
-	return 0;
-}
-
-
-static int sock_pe_recv_atomic_hdrs(struct sock_pe *pe,
-				    struct sock_pe_entry *pe_entry,
-				    size_t *datatype_sz, uint64_t *entry_len)
-{
-	uint64_t len;
-	int i;
-
-	if (!pe_entry->pe.rx.atomic_cmp) {
-		pe_entry->pe.rx.atomic_cmp = util_buf_alloc(pe->atomic_rx_pool);
-		pe_entry->pe.rx.atomic_src = util_buf_alloc(pe->atomic_rx_pool);
-		if (!pe_entry->pe.rx.atomic_cmp || !pe_entry->pe.rx.atomic_src)
-			return -FI_ENOMEM;
-	}
-
-	len = sizeof(struct sock_msg_hdr);
-	if (sock_pe_recv_field(pe_entry, &pe_entry->pe.rx.rx_op,
-			       sizeof(struct sock_op), len))
-		return -FI_EAGAIN;
-	len += sizeof(struct sock_op);
-
-	if (pe_entry->msg_hdr.flags & FI_REMOTE_CQ_DATA) {
-		if (sock_pe_recv_field(pe_entry, &pe_entry->data,
-				       SOCK_CQ_DATA_SIZE, len))
-			return -FI_EAGAIN;
-		len += SOCK_CQ_DATA_SIZE;
+	if (pe_entry->msg_hdr.flags & FI_REMOTE_CQ_DATA) {
+		if (sock_pe_recv_field(pe_entry, &pe_entry->data,
+				       SOCK_CQ_DATA_SIZE, len))
+			return -FI_EAGAIN;
+		len += SOCK_CQ_DATA_SIZE;
 	}
 
 	/* dst iocs */
@@ -1251,8 +1340,7 @@ static int sock_pe_process_rx_atomic(struct sock_pe *pe,
 				struct sock_rx_ctx *rx_ctx,
 				struct sock_pe_entry *pe_entry)
 {
-	int i, ret = 0;
-	size_t j;
+	int i, fetch, ret = 0;
 	size_t datatype_sz;
 	struct sock_mr *mr;
 	uint64_t offset, entry_len;
@@ -1288,18 +1376,22 @@ static int sock_pe_process_rx_atomic(struct sock_pe *pe,
 		pe->pe_atomic = pe_entry;
 	}
 
+	/* Results are only returned for fetching and compare operations */
+	fetch = pe_entry->pe.rx.rx_op.atomic.res_iov_len ||
+		ofi_atomic_isswap_op(pe_entry->pe.rx.rx_op.atomic.op);
 	offset = 0;
+	/* engines serving other contexts may update the same memory */
+	fastlock_acquire(&rx_ctx->domain->lock);
 	for (i = 0; i < pe_entry->pe.rx.rx_op.dest_iov_len; i++) {
-		for (j = 0; j < pe_entry->pe.rx.rx_iov[i].ioc.count; j++) {
-			sock_pe_update_atomic(pe_entry->pe.rx.atomic_cmp + offset,
-				(char *) (uintptr_t) pe_entry->pe.rx.rx_iov[i].
-					ioc.addr + j * datatype_sz,
-				pe_entry->pe.rx.atomic_src + offset,
-				pe_entry->pe.rx.rx_op.atomic.datatype,
-				pe_entry->pe.rx.rx_op.atomic.op);
-			offset += datatype_sz;
-		}
+		sock_pe_update_atomic(fetch ? pe_entry->pe.rx.atomic_cmp + offset : NULL,
+			(char *) (uintptr_t) pe_entry->pe.rx.rx_iov[i].ioc.addr,
+			pe_entry->pe.rx.atomic_src + offset,
+			pe_entry->pe.rx.rx_iov[i].ioc.count,
+			pe_entry->pe.rx.rx_op.atomic.datatype,
+			pe_entry->pe.rx.rx_op.atomic.op);
+		offset += pe_entry->pe.rx.rx_iov[i].ioc.count * datatype_sz;
 	}
+	fastlock_release(&rx_ctx->domain->lock);
 
 	pe_entry->buf = pe_entry->pe.rx.rx_iov[0].iov.addr;
 	pe_entry->data_len = offset;
@@ -1362,6 +1454,7 @@ sock_pe_process_rx_tatomic(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx,
 		rx_entry->flags |= FI_REMOTE_CQ_DATA;
 	rx_entry->flags |= FI_TAGGED | FI_ATOMIC;
 	rx_entry->is_tagged = 1;
+	sock_rx_enqueue_buffered(rx_ctx, rx_entry);
 
 	pe_entry->pe.rx.rx_entry = rx_entry;
 
@@ -1375,6 +1468,91 @@ sock_pe_process_rx_tatomic(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx,
 	return ret;
 }
 
+/* matched rendezvous sends wait on rx_rndv_list for their pull */
+static void sock_pe_queue_rndv(struct sock_rx_ctx *rx_ctx,
+			       struct sock_rx_entry *rx_entry)
+{
+	sock_rx_dequeue_entry(rx_entry);
+	rx_entry->is_busy = 1;
+	dlist_insert_tail(&rx_entry->entry, &rx_ctx->rx_rndv_list);
+}
+
+/* the payload of a discarded rendezvous send is pulled and dropped */
+static void sock_pe_discard_rndv(struct sock_rx_ctx *rx_ctx,
+				 struct sock_rx_entry *rx_entry)
+{
+	rx_entry->rx_op.dest_iov_len = 0;
+	rx_entry->flags |= FI_DISCARD;
+	sock_pe_queue_rndv(rx_ctx, rx_entry);
+}
+
+static void sock_pe_claim_rndv(struct sock_rx_ctx *rx_ctx,
+			       struct sock_rx_entry *rx_entry, uint64_t flags,
+			       const struct iovec *msg_iov, size_t iov_count)
+{
+	size_t i, len, rem = rx_entry->total_len;
+
+	for (i = 0; i < iov_count && rem > 0; i++) {
+		len = MIN(msg_iov[i].iov_len, rem);
+		rx_entry->iov[i].iov.addr = (uintptr_t) msg_iov[i].iov_base;
+		rx_entry->iov[i].iov.len = len;
+		rem -= len;
+	}
+	rx_entry->rx_op.dest_iov_len = i;
+
+	rx_entry->flags |= (flags | FI_MSG | FI_RECV);
+	if (rx_entry->is_tagged)
+		rx_entry->flags |= FI_TAGGED;
+	sock_pe_queue_rndv(rx_ctx, rx_entry);
+}
+
+/*
+ * Point a matched rendezvous send at the unused part of the posted
+ * receive.  The posted entry is consumed here as if the data had been
+ * copied; the receive is reported when the pulled payload arrives.
+ */
+static void sock_pe_match_rndv(struct sock_rx_ctx *rx_ctx,
+			       struct sock_rx_entry *rx_buffered,
+			       struct sock_rx_entry *rx_posted)
+{
+	size_t i, n, len, rem, used;
+
+	used = rx_posted->used;
+	rem = rx_buffered->total_len;
+	for (i = 0, n = 0; i < rx_posted->rx_op.dest_iov_len && rem > 0; i++) {
+		if (used >= rx_posted->iov[i].iov.len) {
+			used -= rx_posted->iov[i].iov.len;
+			continue;
+		}
+
+		len = MIN(rx_posted->iov[i].iov.len - used, rem);
+		rx_buffered->iov[n].iov.addr = rx_posted->iov[i].iov.addr + used;
+		rx_buffered->iov[n++].iov.len = len;
+		rx_posted->used += len;
+		rem -= len;
+		used = 0;
+	}
+	rx_buffered->rx_op.dest_iov_len = n;
+
+	rx_buffered->context = rx_posted->context;
+	rx_buffered->flags |= (rx_posted->flags | FI_MSG | FI_RECV);
+	if (rx_buffered->is_tagged)
+		rx_buffered->flags |= FI_TAGGED;
+	rx_buffered->flags &= ~FI_MULTI_RECV;
+
+	if (rx_posted->flags & FI_MULTI_RECV) {
+		rx_posted->is_busy = 0;
+		if (sock_rx_avail_len(rx_posted) >= rx_ctx->min_multi_recv)
+			goto out;
+		rx_buffered->flags |= FI_MULTI_RECV;
+	}
+	sock_rx_dequeue_entry(rx_posted);
+	sock_rx_release_entry(rx_posted);
+	rx_ctx->num_left++;
+out:
+	sock_pe_queue_rndv(rx_ctx, rx_buffered);
+}
+
 ssize_t sock_rx_peek_recv(struct sock_rx_ctx *rx_ctx, fi_addr_t addr,
 			  uint64_t tag, uint64_t ignore, void *context,
 			  uint64_t flags, uint8_t is_tagged)
@@ -1401,11 +1579,15 @@ ssize_t sock_rx_peek_recv(struct sock_rx_ctx *rx_ctx, fi_addr_t addr,
 		pe_entry.data = rx_buffered->data;
 		rx_buffered->context = (uintptr_t)context;
 		if (flags & FI_CLAIM)
-			rx_buffered->is_claimed = 1;
+			sock_rx_claim_entry(rx_ctx, rx_buffered);
 
 		if (flags & FI_DISCARD) {
-			dlist_remove(&rx_buffered->entry);
-			sock_rx_release_entry(rx_buffered);
+			if (rx_buffered->is_rndv) {
+				sock_pe_discard_rndv(rx_ctx, rx_buffered);
+			} else {
+				sock_rx_dequeue_entry(rx_buffered);
+				sock_rx_release_entry(rx_buffered);
+			}
 		}
 		sock_pe_report_recv_completion(&pe_entry);
 	} else {
@@ -1428,11 +1610,10 @@ ssize_t sock_rx_claim_recv(struct sock_rx_ctx *rx_ctx, void *context,
 	struct sock_rx_entry *rx_buffered = NULL;
 
 	fastlock_acquire(&rx_ctx->lock);
-	for (entry = rx_ctx->rx_buffered_list.next;
-	     entry != &rx_ctx->rx_buffered_list; entry = entry->next) {
-		rx_buffered = container_of(entry, struct sock_rx_entry, entry);
-		if (rx_buffered->is_claimed &&
-		    (uintptr_t)rx_buffered->context == (uintptr_t)context &&
+	for (entry = rx_ctx->rx_claimed_list.next;
+	     entry != &rx_ctx->rx_claimed_list; entry = entry->next) {
+		rx_buffered = container_of(entry, struct sock_rx_entry, match_entry);
+		if ((uintptr_t)rx_buffered->context == (uintptr_t)context &&
 		    is_tagged == rx_buffered->is_tagged &&
 		    (tag & ~ignore) == (rx_buffered->tag & ~ignore))
 			break;
@@ -1440,7 +1621,9 @@ ssize_t sock_rx_claim_recv(struct sock_rx_ctx *rx_ctx, void *context,
 			rx_buffered = NULL;
 	}
 
-	if (rx_buffered) {
+	if (rx_buffered && rx_buffered->is_rndv && !(flags & FI_DISCARD)) {
+		sock_pe_claim_rndv(rx_ctx, rx_buffered, flags, msg_iov, iov_count);
+	} else if (rx_buffered) {
 		memset(&pe_entry, 0, sizeof(pe_entry));
 		pe_entry.comp = &rx_ctx->comp;
 		pe_entry.data_len = rx_buffered->total_len;
@@ -1472,8 +1655,12 @@ ssize_t sock_rx_claim_recv(struct sock_rx_ctx *rx_ctx, void *context,
 			sock_pe_report_recv_completion(&pe_entry);
 		}
 
-		dlist_remove(&rx_buffered->entry);
-		sock_rx_release_entry(rx_buffered);
+		if (rx_buffered->is_rndv) {
+			sock_pe_discard_rndv(rx_ctx, rx_buffered);
+		} else {
+			sock_rx_dequeue_entry(rx_buffered);
+			sock_rx_release_entry(rx_buffered);
+		}
 	} else {
 		ret = -FI_ENOMSG;
 	}
@@ -1487,13 +1674,16 @@ static int sock_pe_progress_buffered_rx(struct sock_rx_ctx *rx_ctx)
 	struct dlist_entry *entry;
 	struct sock_pe_entry pe_entry;
 	struct sock_rx_entry *rx_buffered, *rx_posted;
-	size_t i, j, rem = 0, offset, len, used_len, dst_offset, datatype_sz;
+	size_t i, rem = 0, offset, len, used_len, dst_offset, datatype_sz;
 	char *src, *dst;
 
-	if (dlist_empty(&rx_ctx->rx_entry_list) ||
+	if (!rx_ctx->buffered_pending || dlist_empty(&rx_ctx->rx_entry_list) ||
 	    dlist_empty(&rx_ctx->rx_buffered_list))
 		return 0;
 
+	/* rescan only after a receive was posted or a message was buffered */
+	rx_ctx->buffered_pending = 0;
+
 	for (entry = rx_ctx->rx_buffered_list.next;
 	     entry != &rx_ctx->rx_buffered_list;) {
 
@@ -1504,11 +1694,17 @@ static int sock_pe_progress_buffered_rx(struct sock_rx_ctx *rx_ctx)
 			continue;
 
 		rx_posted = sock_rx_get_entry(rx_ctx, rx_buffered->addr,
-						rx_buffered->tag,
-						rx_buffered->is_tagged);
+					      rx_buffered->src_bucket,
+					      rx_buffered->tag,
+					      rx_buffered->is_tagged);
 		if (!rx_posted)
 			continue;
 
+		if (rx_buffered->is_rndv) {
+			sock_pe_match_rndv(rx_ctx, rx_buffered, rx_posted);
+			continue;
+		}
+
 		SOCK_LOG_DBG("Consuming buffered entry: %p, ctx: %p\n",
 			      rx_buffered, rx_ctx);
 		SOCK_LOG_DBG("Consuming posted entry: %p, ctx: %p\n",
@@ -1538,15 +1734,10 @@ static int sock_pe_progress_buffered_rx(struct sock_rx_ctx *rx_ctx)
 			      rx_posted->iov[i].iov.addr + dst_offset;
 
 			if (datatype_sz) {
-				int cnt = len / datatype_sz;
-
-				for (j = 0; j < cnt; j++) {
-					sock_pe_update_atomic(NULL,
-						dst + j * datatype_sz,
-						src + j * datatype_sz,
-						rx_buffered->rx_op.atomic.datatype,
-						rx_buffered->rx_op.atomic.op);
-				}
+				sock_pe_update_atomic(NULL, dst, src,
+					len / datatype_sz,
+					rx_buffered->rx_op.atomic.datatype,
+					rx_buffered->rx_op.atomic.op);
 			} else {
 				memcpy(dst, src, len);
 			}
@@ -1574,10 +1765,10 @@ static int sock_pe_progress_buffered_rx(struct sock_rx_ctx *rx_ctx)
 		if (rx_posted->flags & FI_MULTI_RECV) {
 			if (sock_rx_avail_len(rx_posted) < rx_ctx->min_multi_recv) {
 				pe_entry.flags |= FI_MULTI_RECV;
-				dlist_remove(&rx_posted->entry);
+				sock_rx_dequeue_entry(rx_posted);
 			}
 		} else {
-			dlist_remove(&rx_posted->entry);
+			sock_rx_dequeue_entry(rx_posted);
 		}
 
 		if (rem) {
@@ -1587,7 +1778,7 @@ static int sock_pe_progress_buffered_rx(struct sock_rx_ctx *rx_ctx)
 			sock_pe_report_recv_completion(&pe_entry);
 		}
 
-		dlist_remove(&rx_buffered->entry);
+		sock_rx_dequeue_entry(rx_buffered);
 		sock_rx_release_entry(rx_buffered);
 
 		if ((!(rx_posted->flags & FI_MULTI_RECV) ||
@@ -1599,13 +1790,68 @@ static int sock_pe_progress_buffered_rx(struct sock_rx_ctx *rx_ctx)
 	return 0;
 }
 
+/*
+ * A rendezvous send only carries its payload length.  Queue it as an
+ * unexpected message without storage; once a receive matches it, the
+ * payload is pulled from the sender straight into the receive buffer.
+ */
+static int sock_pe_process_rx_rndv(struct sock_pe *pe,
+				   struct sock_rx_ctx *rx_ctx,
+				   struct sock_pe_entry *pe_entry, uint64_t len)
+{
+	struct sock_rx_entry *rx_entry;
+
+	if (sock_pe_recv_field(pe_entry, &pe_entry->data_len,
+			       SOCK_RNDV_LEN_SIZE, len))
+		return 0;
+
+	fastlock_acquire(&rx_ctx->lock);
+	rx_entry = sock_rx_new_buffered_entry(rx_ctx, 0);
+	if (!rx_entry) {
+		fastlock_release(&rx_ctx->lock);
+		return -FI_ENOMEM;
+	}
+
+	SOCK_LOG_DBG("%p: rendezvous send (len = %llu)\n", pe_entry,
+		      (long long unsigned int) pe_entry->data_len);
+
+	rx_entry->total_len = pe_entry->data_len;
+	rx_entry->addr = pe_entry->addr;
+	rx_entry->tag = pe_entry->tag;
+	rx_entry->data = pe_entry->data;
+	rx_entry->ignore = 0;
+	rx_entry->comp = pe_entry->comp;
+	rx_entry->conn = pe_entry->conn;
+	rx_entry->rndv_id = pe_entry->msg_hdr.pe_entry_id;
+	rx_entry->rndv_rx_id = pe_entry->msg_hdr.rx_id;
+	rx_entry->rndv_ack = !(pe_entry->msg_hdr.flags & FI_INJECT_COMPLETE);
+	rx_entry->is_rndv = 1;
+
+	if (pe_entry->msg_hdr.flags & FI_REMOTE_CQ_DATA)
+		rx_entry->flags |= FI_REMOTE_CQ_DATA;
+
+	if (pe_entry->msg_hdr.op_type == SOCK_OP_TSEND)
+		rx_entry->is_tagged = 1;
+
+	rx_entry->is_busy = 0;
+	rx_entry->is_complete = 1;
+	sock_rx_enqueue_buffered(rx_ctx, rx_entry);
+	sock_pe_progress_buffered_rx(rx_ctx);
+	fastlock_release(&rx_ctx->lock);
+
+	pe_entry->is_complete = 1;
+	return 0;
+}
+
 static int sock_pe_process_rx_send(struct sock_pe *pe,
 				struct sock_rx_ctx *rx_ctx,
 				struct sock_pe_entry *pe_entry)
 {
 	ssize_t i, ret = 0;
 	struct sock_rx_entry *rx_entry;
-	uint64_t len, rem, offset, data_len, done_data, used;
+	struct iovec iov[SOCK_EP_MAX_IOV_LIMIT];
+	size_t iov_cnt = 0;
+	uint64_t len, rem, offset, data_len, done_data, used, buf;
 
 	offset = 0;
 	len = sizeof(struct sock_msg_hdr);
@@ -1624,12 +1870,19 @@ static int sock_pe_process_rx_send(struct sock_pe *pe,
 		len += SOCK_CQ_DATA_SIZE;
 	}
 
+	if (pe_entry->msg_hdr.flags & SOCK_RNDV)
+		return sock_pe_process_rx_rndv(pe, rx_ctx, pe_entry, len);
+
 	data_len = pe_entry->msg_hdr.msg_len - len;
 	if (pe_entry->done_len == len && !pe_entry->pe.rx.rx_entry) {
 		fastlock_acquire(&rx_ctx->lock);
 		sock_pe_progress_buffered_rx(rx_ctx);
 
-		rx_entry = sock_rx_get_entry(rx_ctx, pe_entry->addr, pe_entry->tag,
+		/* the source hash is empty without directed receives */
+		rx_entry = sock_rx_get_entry(rx_ctx, pe_entry->addr,
+					     rx_ctx->num_directed ?
+					     sock_rx_src_bucket(rx_ctx, pe_entry->addr) : 0,
+					     pe_entry->tag,
 					     pe_entry->msg_hdr.op_type == SOCK_OP_TSEND ? 1 : 0);
 		SOCK_LOG_DBG("Consuming posted entry: %p\n", rx_entry);
 
@@ -1654,6 +1907,7 @@ static int sock_pe_process_rx_send(struct sock_pe *pe,
 
 			if (pe_entry->msg_hdr.op_type == SOCK_OP_TSEND)
 				rx_entry->is_tagged = 1;
+			sock_rx_enqueue_buffered(rx_ctx, rx_entry);
 		}
 		fastlock_release(&rx_ctx->lock);
 		pe_entry->context = rx_entry->context;
@@ -1666,7 +1920,9 @@ static int sock_pe_process_rx_send(struct sock_pe *pe,
 	rem = pe_entry->data_len - done_data;
 	used = rx_entry->used;
 
-	for (i = 0; rem > 0 && i < rx_entry->rx_op.dest_iov_len; i++) {
+	/* gather the unused part of the posted buffer, up to the payload */
+	for (i = 0, data_len = 0;
+	     data_len < rem && i < rx_entry->rx_op.dest_iov_len; i++) {
 
 		/* skip used contents in rx_entry */
 		if (used >= rx_entry->iov[i].iov.len) {
@@ -1675,17 +1931,24 @@ static int sock_pe_process_rx_send(struct sock_pe *pe,
 		}
 
 		offset = used;
-		data_len = MIN(rx_entry->iov[i].iov.len - used, rem);
-		ret = sock_comm_recv(pe_entry,
-				     (char *) (uintptr_t) rx_entry->iov[i].iov.addr + offset,
-				     data_len);
+		iov[iov_cnt].iov_base =
+			(char *) (uintptr_t) rx_entry->iov[i].iov.addr + offset;
+		iov[iov_cnt].iov_len = MIN(rx_entry->iov[i].iov.len - used,
+					   rem - data_len);
+		data_len += iov[iov_cnt].iov_len;
+		iov_cnt++;
+		used = 0;
+	}
+
+	if (iov_cnt) {
+		buf = (uintptr_t) iov[0].iov_base;
+		ret = sock_comm_recvv(pe_entry, iov, iov_cnt);
 		if (ret <= 0)
 			return ret;
 
 		if (!pe_entry->buf)
-			pe_entry->buf = rx_entry->iov[i].iov.addr + offset;
+			pe_entry->buf = buf;
 		rem -= ret;
-		used = 0;
 		pe_entry->done_len += ret;
 		rx_entry->used += ret;
 		if (ret != data_len)
@@ -1708,13 +1971,14 @@ static int sock_pe_process_rx_send(struct sock_pe *pe,
 	if (rx_entry->flags & FI_MULTI_RECV) {
 		if (sock_rx_avail_len(rx_entry) < rx_ctx->min_multi_recv) {
 			pe_entry->flags |= FI_MULTI_RECV;
-			dlist_remove(&rx_entry->entry);
+			sock_rx_dequeue_entry(rx_entry);
 		}
 	} else {
 		if (!rx_entry->is_buffered)
-			dlist_remove(&rx_entry->entry);
+			sock_rx_dequeue_entry(rx_entry);
 	}
 	rx_entry->is_busy = 0;
+	rx_ctx->buffered_pending = 1;
 	fastlock_release(&rx_ctx->lock);
 
 	/* report error, if any */
@@ -1808,7 +2072,8 @@ static int sock_pe_process_recv(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx,
 	struct sock_msg_hdr *msg_hdr;
 
 	msg_hdr = &pe_entry->msg_hdr;
-	if (msg_hdr->version != SOCK_WIRE_PROTO_VERSION) {
+	if (msg_hdr->version != SOCK_WIRE_PROTO_VERSION &&
+	    msg_hdr->version != SOCK_WIRE_PROTO_RNDV_VERSION) {
 		SOCK_LOG_ERROR("Invalid wire protocol\n");
 		ret = -FI_EINVAL;
 		goto out;
@@ -1851,6 +2116,12 @@ static int sock_pe_process_recv(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx,
 	case SOCK_OP_CONN_MSG:
 		ret = sock_pe_process_rx_conn_msg(pe, rx_ctx, pe_entry);
 		break;
+	case SOCK_OP_RNDV_PULL:
+		ret = sock_pe_handle_rndv_pull(pe, rx_ctx, pe_entry);
+		break;
+	case SOCK_OP_RNDV_DATA:
+		ret = sock_pe_handle_rndv_data(pe, rx_ctx, pe_entry);
+		break;
 	default:
 		ret = -FI_ENOSYS;
 		SOCK_LOG_ERROR("Operation not supported\n");
@@ -1913,6 +2184,13 @@ static int sock_pe_read_hdr(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx,
 	    msg_hdr->rx_id != rx_ctx->rx_id)
 		return -1;
 
+	/* responses belong to the engine of the entry waiting for them */
+	if (pe_entry->ep_attr->pe_cnt > 1 &&
+	    !sock_pe_is_data_msg(msg_hdr->op_type) &&
+	    msg_hdr->op_type != SOCK_OP_CONN_MSG &&
+	    PE_ENTRY_PE(msg_hdr->pe_entry_id) != pe->index)
+		return -1;
+
 	if (sock_pe_recv_field(pe_entry, (void *) msg_hdr,
 			       sizeof(struct sock_msg_hdr), 0)) {
 		SOCK_LOG_ERROR("Failed to recv header\n");
@@ -2060,16 +2338,9 @@ static int sock_pe_progress_tx_write(struct sock_pe *pe,
 		len += pe_entry->pe.tx.tx_op.src_iov_len;
 		pe_entry->data_len = pe_entry->pe.tx.tx_op.src_iov_len;
 	} else {
-		pe_entry->data_len = 0;
-		for (i = 0; i < pe_entry->pe.tx.tx_op.src_iov_len; i++) {
-			if (sock_pe_send_field(
-				    pe_entry,
-				    (void *) (uintptr_t) pe_entry->pe.tx.tx_iov[i].src.iov.addr,
-				    pe_entry->pe.tx.tx_iov[i].src.iov.len, len))
-				return 0;
-			len += pe_entry->pe.tx.tx_iov[i].src.iov.len;
-			pe_entry->data_len += pe_entry->pe.tx.tx_iov[i].src.iov.len;
-		}
+		if (sock_pe_send_src_iov(pe_entry, len))
+			return 0;
+		len += pe_entry->data_len;
 	}
 
 	sock_comm_flush(pe_entry);
@@ -2131,7 +2402,7 @@ static int sock_pe_progress_tx_send(struct sock_pe *pe,
 				    struct sock_pe_entry *pe_entry,
 				    struct sock_conn *conn)
 {
-	size_t len, i;
+	size_t len;
 	if (pe_entry->pe.tx.send_done)
 		return 0;
 
@@ -2156,37 +2427,33 @@ static int sock_pe_progress_tx_send(struct sock_pe *pe,
 			return 0;
 		len += pe_entry->pe.tx.tx_op.src_iov_len;
 		pe_entry->data_len = pe_entry->pe.tx.tx_op.src_iov_len;
+	} else if (pe_entry->flags & SOCK_RNDV) {
+		if (sock_pe_send_field(pe_entry, &pe_entry->data_len,
+				       SOCK_RNDV_LEN_SIZE, len))
+			return 0;
+		len += SOCK_RNDV_LEN_SIZE;
 	} else {
-		pe_entry->data_len = 0;
-		for (i = 0; i < pe_entry->pe.tx.tx_op.src_iov_len; i++) {
-			if (sock_pe_send_field(pe_entry,
-				    (void *) (uintptr_t) pe_entry->pe.tx.tx_iov[i].src.iov.addr,
-				    pe_entry->pe.tx.tx_iov[i].src.iov.len, len))
-				return 0;
-			len += pe_entry->pe.tx.tx_iov[i].src.iov.len;
-			pe_entry->data_len += pe_entry->pe.tx.tx_iov[i].src.iov.len;
-		}
+		if (sock_pe_send_src_iov(pe_entry, len))
+			return 0;
+		len += pe_entry->data_len;
 	}
 
-	sock_comm_flush(pe_entry);
-	if (!sock_comm_tx_done(pe_entry))
-		return 0;
-
 	pe_entry->tag = 0;
 	if (pe_entry->pe.tx.tx_op.op == SOCK_OP_TSEND)
 		pe_entry->flags |= FI_TAGGED;
 	pe_entry->flags |= (FI_MSG | FI_SEND);
-
 	pe_entry->msg_hdr.flags = pe_entry->flags;
+
+	if (sock_pe_tx_batch_add(pe_entry))
+		return 0;
+
+	sock_comm_flush(pe_entry);
+	if (!sock_comm_tx_done(pe_entry))
+		return 0;
+
 	if (pe_entry->done_len == pe_entry->total_len) {
-		pe_entry->pe.tx.send_done = 1;
 		pe_entry->conn->tx_pe_entry = NULL;
-		SOCK_LOG_DBG("Send complete\n");
-
-		if (pe_entry->flags & FI_INJECT_COMPLETE) {
-			sock_pe_report_send_completion(pe_entry);
-			pe_entry->is_complete = 1;
-		}
+		sock_pe_tx_send_done(pe_entry);
 	}
 
 	return 0;
@@ -2227,10 +2494,52 @@ static int sock_pe_progress_tx_entry(struct sock_pe *pe,
 {
 	int ret = 0;
 	struct sock_conn *conn = pe_entry->conn;
+	struct sock_ep_attr *ep_attr = pe_entry->ep_attr;
+
+	if (sock_pe_lock_conn(ep_attr, conn))
+		return 0;
 
 	if (pe_entry->is_complete)
 		goto out;
 
+	if (pe_entry->pe.tx.zc_deferred) {
+		if (!conn->connected) {
+			/*
+			 * The socket is gone, so no further notifications will
+			 * arrive.  A send the peer acked, or whose pages the
+			 * kernel released before the close, was delivered;
+			 * anything else was still queued when the connection
+			 * dropped.
+			 */
+			if (pe_entry->pe.tx.zc_acked ||
+			    sock_comm_zc_done(pe_entry)) {
+				sock_pe_report_deferred_completion(pe_entry);
+			} else {
+				sock_pe_report_tx_error(pe_entry, 0, FI_EIO);
+				pe_entry->is_complete = 1;
+			}
+		} else if (sock_comm_zc_done(pe_entry)) {
+			sock_pe_report_deferred_completion(pe_entry);
+		}
+		goto out;
+	}
+
+	if (conn->connect_state != SOCK_CONN_DONE) {
+		ret = sock_conn_progress_connect(pe_entry->ep_attr, conn);
+		if (ret == -FI_EAGAIN) {
+			ret = 0;
+			goto out;
+		}
+
+		if (ret) {
+			if (pe_entry->msg_hdr.op_type != SOCK_OP_CONN_MSG)
+				sock_pe_report_tx_error(pe_entry, 0, -ret);
+			pe_entry->is_complete = 1;
+			ret = 0;
+			goto out;
+		}
+	}
+
 	if (sock_comm_is_disconnected(pe_entry)) {
 		SOCK_LOG_DBG("conn disconnected: removing fd from pollset\n");
 		if (pe_entry->ep_attr->cmap.used > 0 &&
@@ -2238,13 +2547,17 @@ static int sock_pe_progress_tx_entry(struct sock_pe *pe,
 			fastlock_acquire(&pe_entry->ep_attr->cmap.lock);
 			sock_ep_remove_conn(pe_entry->ep_attr, pe_entry->conn);
 			fastlock_release(&pe_entry->ep_attr->cmap.lock);
+			sock_rx_fail_rndv(pe_entry->ep_attr, pe_entry->conn);
 		}
 
-		sock_pe_report_tx_error(pe_entry, 0, FI_EIO);
+		if (pe_entry->msg_hdr.op_type != SOCK_OP_CONN_MSG)
+			sock_pe_report_tx_error(pe_entry, 0, FI_EIO);
+		pe_entry->is_complete = 1;
 		goto out;
 	}
 
-	if (!pe_entry->conn || pe_entry->pe.tx.send_done)
+	if (!pe_entry->conn || pe_entry->pe.tx.send_done ||
+	    pe_entry->pe.tx.batched)
 		goto out;
 
 	if (conn->tx_pe_entry != NULL && conn->tx_pe_entry != pe_entry) {
@@ -2254,6 +2567,14 @@ static int sock_pe_progress_tx_entry(struct sock_pe *pe,
 	}
 
 	if (conn->tx_pe_entry == NULL) {
+		if (sock_pe_batch_busy(pe, conn) ||
+		    !sock_pe_tx_in_order(ep_attr, tx_ctx, pe_entry))
+			goto out;
+		if (!sock_pe_tx_batchable(pe_entry)) {
+			sock_pe_flush_tx_batch(conn);
+			if (conn->tx_batch_cnt)
+				goto out;
+		}
 		SOCK_LOG_DBG("Connection %p grabbed by %p\n", conn, pe_entry);
 		conn->tx_pe_entry = pe_entry;
 	}
@@ -2293,12 +2614,12 @@ static int sock_pe_progress_tx_entry(struct sock_pe *pe,
 		SOCK_LOG_ERROR("Operation not supported\n");
 		break;
 	}
-
 out:
 	if (pe_entry->is_complete) {
 		sock_pe_release_entry(pe, pe_entry);
 		SOCK_LOG_DBG("[%p] TX done\n", pe_entry);
 	}
+	sock_pe_unlock_conn(ep_attr, conn);
 	return ret;
 }
 
@@ -2306,7 +2627,12 @@ static int sock_pe_progress_rx_pe_entry(struct sock_pe *pe,
 					struct sock_pe_entry *pe_entry,
 					struct sock_rx_ctx *rx_ctx)
 {
-	int ret;
+	int ret = 0;
+	struct sock_conn *conn = pe_entry->conn;
+	struct sock_ep_attr *ep_attr = pe_entry->ep_attr;
+
+	if (sock_pe_lock_conn(ep_attr, conn))
+		return 0;
 
 	if (sock_comm_is_disconnected(pe_entry)) {
 		SOCK_LOG_DBG("conn disconnected: removing fd from pollset\n");
@@ -2315,13 +2641,14 @@ static int sock_pe_progress_rx_pe_entry(struct sock_pe *pe,
 			fastlock_acquire(&pe_entry->ep_attr->cmap.lock);
 			sock_ep_remove_conn(pe_entry->ep_attr, pe_entry->conn);
 			fastlock_release(&pe_entry->ep_attr->cmap.lock);
+			sock_rx_fail_rndv(pe_entry->ep_attr, pe_entry->conn);
 		}
 
 		if (pe_entry->pe.rx.header_read)
 			sock_pe_report_rx_error(pe_entry, 0, FI_EIO);
 
 		sock_pe_release_entry(pe, pe_entry);
-		return 0;
+		goto unlock;
 	}
 
 	if (pe_entry->pe.rx.pending_send) {
@@ -2335,14 +2662,14 @@ static int sock_pe_progress_rx_pe_entry(struct sock_pe *pe,
 	if (!pe_entry->pe.rx.header_read) {
 		if (sock_pe_read_hdr(pe, rx_ctx, pe_entry) == -1) {
 			sock_pe_release_entry(pe, pe_entry);
-			return 0;
+			goto unlock;
 		}
 	}
 
 	if (pe_entry->pe.rx.header_read) {
 		ret = sock_pe_process_recv(pe, rx_ctx, pe_entry);
 		if (ret < 0)
-			return ret;
+			goto unlock;
 	}
 
 out:
@@ -2353,15 +2680,21 @@ out:
 		sock_pe_release_entry(pe, pe_entry);
 		SOCK_LOG_DBG("[%p] RX done\n", pe_entry);
 	}
-	return 0;
+	ret = 0;
+unlock:
+	sock_pe_unlock_conn(ep_attr, conn);
+	return ret;
 }
 
-static void sock_pe_new_rx_entry(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx,
-				struct sock_ep_attr *ep_attr, struct sock_conn *conn)
+static struct sock_pe_entry *
+sock_pe_new_rx_entry(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx,
+		     struct sock_ep_attr *ep_attr, struct sock_conn *conn)
 {
 	struct sock_pe_entry *pe_entry;
 
 	pe_entry = sock_pe_acquire_entry(pe);
+	if (!pe_entry)
+		return NULL;
 	memset(&pe_entry->pe.rx, 0, sizeof(pe_entry->pe.rx));
 
 	pe_entry->conn = conn;
@@ -2387,14 +2720,143 @@ static void sock_pe_new_rx_entry(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx,
 		      pe_entry, pe_entry->conn);
 
 	dlist_insert_tail(&pe_entry->ctx_entry, &rx_ctx->pe_entry_list);
+	return pe_entry;
 }
 
-static int sock_pe_new_tx_entry(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
+static void sock_pe_report_rndv_error(struct sock_rx_entry *rx_entry,
+				      int err)
+{
+	struct sock_pe_entry pe_entry;
+
+	if (rx_entry->flags & FI_DISCARD)
+		return;
+
+	memset(&pe_entry, 0, sizeof(pe_entry));
+	pe_entry.type = SOCK_PE_RX;
+	pe_entry.comp = rx_entry->comp;
+	pe_entry.buf = rx_entry->iov[0].iov.addr;
+	pe_entry.data = rx_entry->data;
+	pe_entry.tag = rx_entry->tag;
+	pe_entry.context = rx_entry->context;
+	pe_entry.flags = rx_entry->flags;
+	pe_entry.addr = rx_entry->addr;
+	sock_pe_report_rx_error(&pe_entry, 0, err);
+}
+
+/*
+ * Ask the senders of matched rendezvous sends for their payload.  The pull
+ * carries the rx_id of the original send, so that the data comes back to
+ * this context, and a cookie naming the rx_entry's slot.
+ */
+static void sock_pe_progress_rndv(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx)
+{
+	struct sock_rx_entry *rx_entry;
+	struct sock_pe_entry *pe_entry;
+	struct sock_conn *conn;
+	uint64_t cookie;
+
+	while (!dlist_empty(&rx_ctx->rx_rndv_list)) {
+		rx_entry = container_of(rx_ctx->rx_rndv_list.next,
+					struct sock_rx_entry, entry);
+		if (!rx_entry->conn) {
+			dlist_remove(&rx_entry->entry);
+			sock_pe_report_rndv_error(rx_entry, FI_EIO);
+			sock_rx_release_entry(rx_entry);
+			continue;
+		}
+
+		conn = rx_entry->conn;
+		if (sock_pe_lock_conn(conn->ep_attr, conn))
+			return;
+
+		cookie = sock_rx_rndv_insert(rx_ctx, rx_entry);
+		if (!cookie)
+			goto unlock;
+
+		pe_entry = sock_pe_new_rx_entry(pe, rx_ctx, conn->ep_attr, conn);
+		if (!pe_entry) {
+			sock_rx_rndv_remove(rx_ctx, cookie);
+			goto unlock;
+		}
+
+		dlist_remove(&rx_entry->entry);
+		dlist_init(&rx_entry->entry);
+
+		pe_entry->msg_hdr.pe_entry_id = rx_entry->rndv_id;
+		pe_entry->msg_hdr.rx_id = rx_entry->rndv_rx_id;
+		pe_entry->data = cookie;
+		sock_pe_send_response(pe, rx_ctx, pe_entry,
+				      sizeof(pe_entry->data),
+				      SOCK_OP_RNDV_PULL, 0);
+		if (pe_entry->is_complete && !pe_entry->pe.rx.pending_send)
+			sock_pe_release_entry(pe, pe_entry);
+		sock_pe_unlock_conn(conn->ep_attr, conn);
+	}
+	return;
+unlock:
+	sock_pe_unlock_conn(conn->ep_attr, conn);
+}
+
+static void sock_rx_ctx_fail_rndv(struct sock_rx_ctx *rx_ctx,
+				  struct sock_conn *conn)
+{
+	struct sock_rx_entry *rx_entry;
+	struct dlist_entry *entry;
+	uint32_t i;
+
+	fastlock_acquire(&rx_ctx->lock);
+
+	/* unmatched and claimed sends fail once a receive takes them */
+	dlist_foreach(&rx_ctx->rx_buffered_list, entry) {
+		rx_entry = container_of(entry, struct sock_rx_entry, entry);
+		if (rx_entry->is_rndv && rx_entry->conn == conn)
+			rx_entry->conn = NULL;
+	}
+	dlist_foreach(&rx_ctx->rx_rndv_list, entry) {
+		rx_entry = container_of(entry, struct sock_rx_entry, entry);
+		if (rx_entry->conn == conn)
+			rx_entry->conn = NULL;
+	}
+
+	for (i = 0; i < rx_ctx->rndv_slots_size; i++) {
+		rx_entry = rx_ctx->rndv_slots[i].rx_entry;
+		if (!rx_entry || rx_entry->conn != conn)
+			continue;
+
+		sock_rx_rndv_remove(rx_ctx, ((uint64_t)
+				    rx_ctx->rndv_slots[i].gen << 32) | i);
+		sock_pe_report_rndv_error(rx_entry, FI_EIO);
+		sock_rx_release_entry(rx_entry);
+	}
+
+	fastlock_release(&rx_ctx->lock);
+}
+
+/*
+ * The connection to a peer is gone: receives matched to its rendezvous
+ * sends will never get their payload and fail with FI_EIO.
+ */
+void sock_rx_fail_rndv(struct sock_ep_attr *ep_attr, struct sock_conn *conn)
+{
+	struct sock_rx_ctx *rx_ctx;
+	size_t i;
+
+	if (!ep_attr->rx_array)
+		return;
+
+	for (i = 0; i < ep_attr->ep_attr.rx_ctx_cnt; i++) {
+		rx_ctx = ep_attr->rx_array[i];
+		if (rx_ctx && rx_ctx->use_shared)
+			rx_ctx = rx_ctx->srx_ctx;
+		if (rx_ctx)
+			sock_rx_ctx_fail_rndv(rx_ctx, conn);
+	}
+}
+
+static struct sock_pe_entry *sock_pe_alloc_tx_entry(struct sock_pe *pe,
+						   struct sock_tx_ctx *tx_ctx)
 {
-	int i, datatype_sz;
-	struct sock_msg_hdr *msg_hdr;
 	struct sock_pe_entry *pe_entry;
-	struct sock_ep_attr *ep_attr;
 
 	pe_entry = sock_pe_acquire_entry(pe);
 	memset(&pe_entry->pe.tx, 0, sizeof(pe_entry->pe.tx));
@@ -2409,14 +2871,75 @@ static int sock_pe_new_tx_entry(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
 
 	dlist_insert_tail(&pe_entry->ctx_entry, &tx_ctx->pe_entry_list);
 
-	/* fill in PE tx entry */
-	msg_hdr = &pe_entry->msg_hdr;
-	msg_hdr->msg_len = sizeof(*msg_hdr);
-
-	msg_hdr->pe_entry_id = PE_INDEX(pe, pe_entry);
+	pe_entry->msg_hdr.msg_len = sizeof(pe_entry->msg_hdr);
+	pe_entry->msg_hdr.pe_entry_id = PE_ENTRY_ID(pe, pe_entry);
 	SOCK_LOG_DBG("New TX on PE entry %p (%d)\n",
-		      pe_entry, msg_hdr->pe_entry_id);
+		      pe_entry, pe_entry->msg_hdr.pe_entry_id);
+	return pe_entry;
+}
+
+/* size the payload of a send whose data_len has been summed up */
+static void sock_pe_init_tx_send(struct sock_pe *pe,
+				 struct sock_pe_entry *pe_entry)
+{
+	struct sock_msg_hdr *msg_hdr = &pe_entry->msg_hdr;
+
+	if (pe_entry->flags & FI_INJECT) {
+		msg_hdr->msg_len += pe_entry->pe.tx.tx_op.src_iov_len;
+	} else {
+		/*
+		 * Waiting rendezvous sends hold their PE entry until the
+		 * receiver matches them; keep half of the table for
+		 * eager traffic so that it can always make progress.
+		 */
+		if (sock_rndv_threshold > 0 &&
+		    pe_entry->data_len >= (size_t) sock_rndv_threshold &&
+		    pe->num_free_entries > SOCK_PE_MAX_ENTRIES / 2) {
+			pe_entry->flags |= SOCK_RNDV;
+			msg_hdr->msg_len += SOCK_RNDV_LEN_SIZE;
+		} else {
+			msg_hdr->msg_len += pe_entry->data_len;
+		}
+	}
+	msg_hdr->dest_iov_len = pe_entry->pe.tx.tx_op.dest_iov_len;
+	if (pe_entry->flags & SOCK_NO_COMPLETION)
+		pe_entry->flags |= FI_INJECT_COMPLETE;
+}
 
+static void sock_pe_finish_tx_hdr(struct sock_tx_ctx *tx_ctx,
+				  struct sock_pe_entry *pe_entry)
+{
+	struct sock_msg_hdr *msg_hdr = &pe_entry->msg_hdr;
+
+	msg_hdr->version = (pe_entry->flags & SOCK_RNDV) ?
+		SOCK_WIRE_PROTO_RNDV_VERSION : SOCK_WIRE_PROTO_VERSION;
+
+	if (tx_ctx->av)
+		msg_hdr->rx_id = (uint16_t) SOCK_GET_RX_ID(pe_entry->addr,
+							   tx_ctx->av->rx_ctx_bits);
+	else
+		msg_hdr->rx_id = 0;
+
+	if (pe_entry->flags & FI_INJECT_COMPLETE)
+		pe_entry->flags &= ~FI_TRANSMIT_COMPLETE;
+
+	msg_hdr->flags = htonll(pe_entry->flags);
+	pe_entry->total_len = msg_hdr->msg_len;
+	msg_hdr->msg_len = htonll(msg_hdr->msg_len);
+	msg_hdr->pe_entry_id = htons(msg_hdr->pe_entry_id);
+}
+
+static int sock_pe_new_tx_entry(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
+{
+	int i, datatype_sz;
+	struct sock_msg_hdr *msg_hdr;
+	struct sock_pe_entry *pe_entry;
+	struct sock_ep_attr *ep_attr;
+
+	pe_entry = sock_pe_alloc_tx_entry(pe, tx_ctx);
+	msg_hdr = &pe_entry->msg_hdr;
+
+	/* fill in PE tx entry */
 	sock_tx_ctx_read_op_send(tx_ctx, &pe_entry->pe.tx.tx_op,
 			&pe_entry->flags, &pe_entry->context, &pe_entry->addr,
 			&pe_entry->buf, &ep_attr, &pe_entry->conn);
@@ -2426,10 +2949,12 @@ static int sock_pe_new_tx_entry(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
 		msg_hdr->msg_len += sizeof(pe_entry->tag);
 	}
 
-	if (ep_attr && tx_ctx->fclass == FI_CLASS_STX_CTX)
+	if (ep_attr && tx_ctx->fclass == FI_CLASS_STX_CTX) {
+		pe_entry->ep_attr = ep_attr;
 		pe_entry->comp = &ep_attr->tx_ctx->comp;
-	else
+	} else {
 		pe_entry->comp = &tx_ctx->comp;
+	}
 
 	if (pe_entry->flags & FI_REMOTE_CQ_DATA) {
 		ofi_rbread(&tx_ctx->rb, &pe_entry->data, sizeof(pe_entry->data));
@@ -2443,17 +2968,15 @@ static int sock_pe_new_tx_entry(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
 		if (pe_entry->flags & FI_INJECT) {
 			ofi_rbread(&tx_ctx->rb, &pe_entry->pe.tx.inject[0],
 				 pe_entry->pe.tx.tx_op.src_iov_len);
-			msg_hdr->msg_len += pe_entry->pe.tx.tx_op.src_iov_len;
 		} else {
+			pe_entry->data_len = 0;
 			for (i = 0; i < pe_entry->pe.tx.tx_op.src_iov_len; i++) {
 				ofi_rbread(&tx_ctx->rb, &pe_entry->pe.tx.tx_iov[i].src,
 					 sizeof(pe_entry->pe.tx.tx_iov[i].src));
-				msg_hdr->msg_len += pe_entry->pe.tx.tx_iov[i].src.iov.len;
+				pe_entry->data_len += pe_entry->pe.tx.tx_iov[i].src.iov.len;
 			}
 		}
-		msg_hdr->dest_iov_len = pe_entry->pe.tx.tx_op.dest_iov_len;
-		if (pe_entry->flags & SOCK_NO_COMPLETION)
-			pe_entry->flags |= FI_INJECT_COMPLETE;
+		sock_pe_init_tx_send(pe, pe_entry);
 		break;
 	case SOCK_OP_WRITE:
 		if (pe_entry->flags & FI_INJECT) {
@@ -2541,24 +3064,141 @@ static int sock_pe_new_tx_entry(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
 	SOCK_LOG_DBG("Inserting TX-entry to PE entry %p, conn: %p\n",
 		      pe_entry, pe_entry->conn);
 
-	/* prepare message header */
-	msg_hdr->version = SOCK_WIRE_PROTO_VERSION;
+	sock_pe_finish_tx_hdr(tx_ctx, pe_entry);
+	return sock_pe_progress_tx_entry(pe, tx_ctx, pe_entry);
+}
 
-	if (tx_ctx->av)
-		msg_hdr->rx_id = (uint16_t) SOCK_GET_RX_ID(pe_entry->addr,
-							   tx_ctx->av->rx_ctx_bits);
-	else
-		msg_hdr->rx_id = 0;
+/*
+ * Nothing may overtake queued operations: the TX ring has to be drained
+ * and every entry taken from it already on the wire.
+ */
+static int sock_pe_tx_idle(struct sock_tx_ctx *tx_ctx, struct sock_conn *conn)
+{
+	struct dlist_entry *entry;
+	struct sock_pe_entry *pe_entry;
 
-	if (pe_entry->flags & FI_INJECT_COMPLETE)
-		pe_entry->flags &= ~FI_TRANSMIT_COMPLETE;
+	if (!ofi_rbempty(&tx_ctx->rb) || conn->tx_pe_entry ||
+	    conn->tx_batch_cnt)
+		return 0;
 
-	msg_hdr->flags = htonll(pe_entry->flags);
-	pe_entry->total_len = msg_hdr->msg_len;
-	msg_hdr->msg_len = htonll(msg_hdr->msg_len);
-	msg_hdr->pe_entry_id = htons(msg_hdr->pe_entry_id);
+	for (entry = tx_ctx->pe_entry_list.next;
+	     entry != &tx_ctx->pe_entry_list; entry = entry->next) {
+		pe_entry = container_of(entry, struct sock_pe_entry, ctx_entry);
+		if (!pe_entry->pe.tx.send_done)
+			return 0;
+	}
+	return 1;
+}
 
-	return sock_pe_progress_tx_entry(pe, tx_ctx, pe_entry);
+/*
+ * Sends posted while the connection is idle skip the TX ring: the PE
+ * entry is built from the caller's arguments and pushed to the socket
+ * from the calling thread, completing inline when the send allows it.
+ * Whatever cannot be written right away is left to the progress engine.
+ * Called with the TX ring's write lock held; returns -FI_EAGAIN, before
+ * anything was allocated or written, when the send has to be queued
+ * instead.
+ */
+ssize_t sock_pe_send_direct(struct sock_tx_ctx *tx_ctx,
+			    struct sock_ep_attr *ep_attr, struct sock_conn *conn,
+			    struct sock_op *tx_op, uint64_t flags,
+			    const struct iovec *iov, size_t iov_count,
+			    uint64_t context, uint64_t addr, uint64_t data,
+			    uint64_t tag)
+{
+	struct sock_pe *pe = tx_ctx->pe;
+	struct sock_pe_entry *pe_entry;
+	size_t i, len;
+	int ret, batch;
+
+	if (flags & (FI_MORE | FI_FENCE | FI_TRIGGER | SOCK_TRIGGERED_OP))
+		return -FI_EAGAIN;
+
+	if (conn->connect_state != SOCK_CONN_DONE || !conn->connected)
+		return -FI_EAGAIN;
+
+	/* a connection shared with other engines is only written by them */
+	if (ep_attr->pe_cnt > 1)
+		return -FI_EAGAIN;
+
+	if (fastlock_tryacquire(&pe->lock))
+		return -FI_EAGAIN;
+
+	if (dlist_empty(&pe->free_list) || !sock_pe_tx_idle(tx_ctx, conn)) {
+		ret = -FI_EAGAIN;
+		goto out;
+	}
+
+	pe_entry = sock_pe_alloc_tx_entry(pe, tx_ctx);
+	pe_entry->pe.tx.tx_op = *tx_op;
+	pe_entry->flags = flags;
+	pe_entry->context = context;
+	pe_entry->addr = addr;
+	pe_entry->buf = (uintptr_t) iov[0].iov_base;
+	pe_entry->conn = conn;
+	ofi_atomic_inc32(&conn->ref);
+
+	if (tx_ctx->fclass == FI_CLASS_STX_CTX) {
+		pe_entry->ep_attr = ep_attr;
+		pe_entry->comp = &ep_attr->tx_ctx->comp;
+	} else {
+		pe_entry->comp = &tx_ctx->comp;
+	}
+
+	if (tx_op->op == SOCK_OP_TSEND) {
+		pe_entry->tag = tag;
+		pe_entry->msg_hdr.msg_len += sizeof(pe_entry->tag);
+	}
+
+	if (flags & FI_REMOTE_CQ_DATA) {
+		pe_entry->data = data;
+		pe_entry->msg_hdr.msg_len += sizeof(pe_entry->data);
+	}
+
+	pe_entry->msg_hdr.op_type = tx_op->op;
+	if (flags & FI_INJECT) {
+		for (i = 0, len = 0; i < iov_count; i++) {
+			memcpy(&pe_entry->pe.tx.inject[len], iov[i].iov_base,
+			       iov[i].iov_len);
+			len += iov[i].iov_len;
+		}
+	} else {
+		pe_entry->data_len = 0;
+		for (i = 0; i < iov_count; i++) {
+			pe_entry->pe.tx.tx_iov[i].src.iov.addr =
+				(uintptr_t) iov[i].iov_base;
+			pe_entry->pe.tx.tx_iov[i].src.iov.len = iov[i].iov_len;
+			pe_entry->data_len += iov[i].iov_len;
+		}
+	}
+	sock_pe_init_tx_send(pe, pe_entry);
+	sock_pe_finish_tx_hdr(tx_ctx, pe_entry);
+
+	/*
+	 * The entry now owns the send: whatever happens below, the progress
+	 * engine finishes or fails it, so the caller must not queue it again.
+	 */
+	ret = 0;
+	batch = sock_pe_tx_batchable(pe_entry);
+	if (sock_pe_progress_tx_entry(pe, tx_ctx, pe_entry) < 0) {
+		SOCK_LOG_ERROR("Error in progressing %p\n", pe_entry);
+		sock_pe_signal(pe);
+		goto out;
+	}
+
+	/* small sends are staged into a batch of their own */
+	if (batch) {
+		sock_pe_flush_tx_batch(conn);
+		if (pe_entry->is_complete)
+			sock_pe_release_entry(pe, pe_entry);
+	}
+
+	/* leave a partial write to the progress engine */
+	if (conn->tx_pe_entry == pe_entry || conn->tx_batch_cnt)
+		sock_pe_signal(pe);
+out:
+	fastlock_release(&pe->lock);
+	return ret;
 }
 
 void sock_pe_signal(struct sock_pe *pe)
@@ -2633,16 +3273,58 @@ out:
 
 void sock_pe_remove_tx_ctx(struct sock_tx_ctx *tx_ctx)
 {
-	pthread_mutex_lock(&tx_ctx->domain->pe->list_lock);
+	pthread_mutex_lock(&tx_ctx->pe->list_lock);
 	dlist_remove(&tx_ctx->pe_entry);
-	pthread_mutex_unlock(&tx_ctx->domain->pe->list_lock);
+	pthread_mutex_unlock(&tx_ctx->pe->list_lock);
 }
 
 void sock_pe_remove_rx_ctx(struct sock_rx_ctx *rx_ctx)
 {
-	pthread_mutex_lock(&rx_ctx->domain->pe->list_lock);
+	pthread_mutex_lock(&rx_ctx->pe->list_lock);
 	dlist_remove(&rx_ctx->pe_entry);
-	pthread_mutex_unlock(&rx_ctx->domain->pe->list_lock);
+	pthread_mutex_unlock(&rx_ctx->pe->list_lock);
+}
+
+/*
+ * Connections holding read-ahead are not reported by epoll; start receives
+ * on them directly.  Returns the number of receives started with a whole
+ * header available.
+ */
+static int sock_pe_progress_rx_stash(struct sock_pe *pe,
+				     struct sock_ep_attr *ep_attr,
+				     struct sock_rx_ctx *rx_ctx)
+{
+	struct sock_conn_map *map = &ep_attr->cmap;
+	struct sock_conn *conn;
+	uint8_t op_type, rx_id;
+	int i, cnt = 0;
+
+	fastlock_acquire(&map->lock);
+	for (i = 0; i < map->used; i++) {
+		conn = map->table[i];
+		if (!conn->rx_stash_len || conn->rx_pe_entry ||
+		    sock_pe_lock_conn(ep_attr, conn))
+			continue;
+
+		/* leave messages for other rx contexts where sock_pe_read_hdr
+		 * would reject them, rather than take a pe_entry for nothing */
+		if (conn->rx_stash_len >= sizeof(struct sock_msg_hdr)) {
+			op_type = conn->rx_stash[conn->rx_stash_off +
+				offsetof(struct sock_msg_hdr, op_type)];
+			rx_id = conn->rx_stash[conn->rx_stash_off +
+				offsetof(struct sock_msg_hdr, rx_id)];
+			if (sock_pe_is_data_msg(op_type) &&
+			    (rx_ctx->is_ctrl_ctx || rx_id != rx_ctx->rx_id)) {
+				sock_pe_unlock_conn(ep_attr, conn);
+				continue;
+			}
+			cnt++;
+		}
+		sock_pe_new_rx_entry(pe, rx_ctx, ep_attr, conn);
+		sock_pe_unlock_conn(ep_attr, conn);
+	}
+	fastlock_release(&map->lock);
+	return cnt;
 }
 
 static int sock_pe_progress_rx_ep(struct sock_pe *pe, struct sock_ep_attr *ep_attr,
@@ -2657,14 +3339,19 @@ static int sock_pe_progress_rx_ep(struct sock_pe *pe, struct sock_ep_attr *ep_at
         if (!map->used)
                 return 0;
 
+	if (ofi_atomic_get32(&pe->rx_stashed))
+		sock_pe_progress_rx_stash(pe, ep_attr, rx_ctx);
+
+	/* the events buffer is shared by every engine hosting the endpoint */
+	fastlock_acquire(&map->lock);
         num_fds = sock_epoll_wait(&map->epoll_set, 0);
-        if (num_fds < 0 || num_fds == 0) {
+        if (num_fds <= 0) {
+		fastlock_release(&map->lock);
                 if (num_fds < 0)
                         SOCK_LOG_ERROR("poll failed: %s\n", strerror(errno));
                 return num_fds;
         }
 
-	fastlock_acquire(&map->lock);
 	for (i = 0; i < num_fds; i++) {
 		fd = sock_epoll_get_fd_at_index(&map->epoll_set, i);
 		if (fd == -1) /* failed to lookup fd due to connection failures */
@@ -2674,7 +3361,15 @@ static int sock_pe_progress_rx_ep(struct sock_pe *pe, struct sock_ep_attr *ep_at
 		if (!conn)
 			SOCK_LOG_ERROR("ofi_idm_lookup failed\n");
 
-		if (!conn || conn->rx_pe_entry)
+		/* zerocopy notifications keep EPOLLERR raised until read */
+		if (conn && conn->connected &&
+		    sock_epoll_err_at_index(&map->epoll_set, i) &&
+		    !sock_pe_lock_conn(ep_attr, conn)) {
+			sock_comm_zc_poll(conn);
+			sock_pe_unlock_conn(ep_attr, conn);
+		}
+
+		if (!conn || conn->rx_pe_entry || conn->rx_stash_len)
 			continue;
 
 		sock_pe_new_rx_entry(pe, rx_ctx, ep_attr, conn);
@@ -2686,7 +3381,7 @@ static int sock_pe_progress_rx_ep(struct sock_pe *pe, struct sock_ep_attr *ep_at
 
 int sock_pe_progress_rx_ctx(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx)
 {
-	int ret = 0;
+	int ret = 0, i, cnt;
 	struct sock_ep_attr *ep_attr;
 	struct dlist_entry *entry;
 	struct sock_pe_entry *pe_entry;
@@ -2695,6 +3390,7 @@ int sock_pe_progress_rx_ctx(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx)
 
 	fastlock_acquire(&rx_ctx->lock);
 	sock_pe_progress_buffered_rx(rx_ctx);
+	sock_pe_progress_rndv(pe, rx_ctx);
 	fastlock_release(&rx_ctx->lock);
 
 	/* check for incoming data */
@@ -2714,13 +3410,34 @@ int sock_pe_progress_rx_ctx(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx)
 			goto out;
 	}
 
-	for (entry = rx_ctx->pe_entry_list.next;
-	     entry != &rx_ctx->pe_entry_list;) {
-		pe_entry = container_of(entry, struct sock_pe_entry, ctx_entry);
-		entry = entry->next;
-		ret = sock_pe_progress_rx_pe_entry(pe, pe_entry, rx_ctx);
-		if (ret < 0)
-			goto out;
+	for (i = 0; i < SOCK_PE_RX_BATCH_MAX; i++) {
+		for (entry = rx_ctx->pe_entry_list.next;
+		     entry != &rx_ctx->pe_entry_list;) {
+			pe_entry = container_of(entry, struct sock_pe_entry,
+						ctx_entry);
+			entry = entry->next;
+			ret = sock_pe_progress_rx_pe_entry(pe, pe_entry, rx_ctx);
+			if (ret < 0)
+				goto out;
+		}
+
+		/* handle the rest of a burst picked up by the same read */
+		if (!ofi_atomic_get32(&pe->rx_stashed))
+			break;
+
+		cnt = 0;
+		if (rx_ctx->ctx.fid.fclass == FI_CLASS_SRX_CTX) {
+			for (entry = rx_ctx->ep_list.next;
+			     entry != &rx_ctx->ep_list; entry = entry->next) {
+				ep_attr = container_of(entry, struct sock_ep_attr,
+						       rx_ctx_entry);
+				cnt += sock_pe_progress_rx_stash(pe, ep_attr, rx_ctx);
+			}
+		} else {
+			cnt = sock_pe_progress_rx_stash(pe, rx_ctx->ep_attr, rx_ctx);
+		}
+		if (!cnt)
+			break;
 	}
 out:
 	if (ret < 0)
@@ -2735,6 +3452,7 @@ void sock_pe_progress_rx_ctrl_ctx(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx
 	struct sock_ep_attr *ep_attr;
 	struct dlist_entry *entry;
 	struct sock_pe_entry *pe_entry;
+	int i, cnt;
 
 	/* check for incoming data */
 	if (tx_ctx->fclass == FI_CLASS_STX_CTX) {
@@ -2747,17 +3465,65 @@ void sock_pe_progress_rx_ctrl_ctx(struct sock_pe *pe, struct sock_rx_ctx *rx_ctx
 		sock_pe_progress_rx_ep(pe, tx_ctx->ep_attr, tx_ctx->rx_ctrl_ctx);
 	}
 
-	for (entry = rx_ctx->pe_entry_list.next;
-	     entry != &rx_ctx->pe_entry_list;) {
+	for (i = 0; i < SOCK_PE_RX_BATCH_MAX; i++) {
+		for (entry = rx_ctx->pe_entry_list.next;
+		     entry != &rx_ctx->pe_entry_list;) {
+			pe_entry = container_of(entry, struct sock_pe_entry,
+						ctx_entry);
+			entry = entry->next;
+			sock_pe_progress_rx_pe_entry(pe, pe_entry, rx_ctx);
+		}
+
+		if (!ofi_atomic_get32(&pe->rx_stashed))
+			break;
+
+		cnt = 0;
+		if (tx_ctx->fclass == FI_CLASS_STX_CTX) {
+			for (entry = tx_ctx->ep_list.next;
+			     entry != &tx_ctx->ep_list; entry = entry->next) {
+				ep_attr = container_of(entry, struct sock_ep_attr,
+						       tx_ctx_entry);
+				cnt += sock_pe_progress_rx_stash(pe, ep_attr, rx_ctx);
+			}
+		} else {
+			cnt = sock_pe_progress_rx_stash(pe, tx_ctx->ep_attr, rx_ctx);
+		}
+		if (!cnt)
+			break;
+	}
+}
+
+/*
+ * Flush the send batches built during this pass.  A batch whose last send
+ * carries FI_MORE is held back until the application follows up, unless
+ * it is full.
+ */
+static void sock_pe_flush_tx_ctx(struct sock_tx_ctx *tx_ctx)
+{
+	struct dlist_entry *entry;
+	struct sock_pe_entry *pe_entry;
+	struct sock_conn *conn;
+
+	for (entry = tx_ctx->pe_entry_list.next;
+	     entry != &tx_ctx->pe_entry_list; entry = entry->next) {
 		pe_entry = container_of(entry, struct sock_pe_entry, ctx_entry);
-		entry = entry->next;
-		sock_pe_progress_rx_pe_entry(pe, pe_entry, rx_ctx);
+		if (!pe_entry->pe.tx.batched)
+			continue;
+
+		conn = pe_entry->conn;
+		if (sock_pe_lock_conn(pe_entry->ep_attr, conn))
+			continue;
+		if (conn->tx_batch_cnt && !sock_pe_batch_busy(tx_ctx->pe, conn) &&
+		    (!(conn->tx_batch[conn->tx_batch_cnt - 1]->flags & FI_MORE) ||
+		     conn->tx_batch_cnt >= SOCK_PE_TX_BATCH_MAX || !conn->connected))
+			sock_pe_flush_tx_batch(conn);
+		sock_pe_unlock_conn(pe_entry->ep_attr, conn);
 	}
 }
 
 int sock_pe_progress_tx_ctx(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
 {
-	int ret = 0;
+	int ret = 0, i;
 	struct dlist_entry *entry;
 	struct sock_pe_entry *pe_entry;
 
@@ -2776,14 +3542,20 @@ int sock_pe_progress_tx_ctx(struct sock_pe *pe, struct sock_tx_ctx *tx_ctx)
 		}
 	}
 
+	/* take enough queued operations to fill a send batch */
 	fastlock_acquire(&tx_ctx->rlock);
-	if (!ofi_rbempty(&tx_ctx->rb) && !dlist_empty(&pe->free_list)) {
+	for (i = 0; i < SOCK_PE_TX_BATCH_MAX && !ofi_rbempty(&tx_ctx->rb) &&
+	     !dlist_empty(&pe->free_list); i++) {
 		ret = sock_pe_new_tx_entry(pe, tx_ctx);
+		if (ret < 0)
+			break;
 	}
 	fastlock_release(&tx_ctx->rlock);
 	if (ret < 0)
 		goto out;
 
+	sock_pe_flush_tx_ctx(tx_ctx);
+
 	sock_pe_progress_rx_ctrl_ctx(pe, tx_ctx->rx_ctrl_ctx, tx_ctx);
 out:
 	if (ret < 0)
@@ -2804,6 +3576,9 @@ static int sock_pe_wait_ok(struct sock_pe *pe)
 	if (dlist_empty(&pe->tx_list) && dlist_empty(&pe->rx_list))
 		return 1;
 
+	if (ofi_atomic_get32(&pe->rx_stashed))
+		return 0;
+
 	if (!dlist_empty(&pe->tx_list)) {
 		for (entry = pe->tx_list.next;
 		     entry != &pe->tx_list; entry = entry->next) {
@@ -2822,6 +3597,7 @@ static int sock_pe_wait_ok(struct sock_pe *pe)
 			rx_ctx = container_of(entry, struct sock_rx_ctx,
 						pe_entry);
 			if (!dlist_empty(&rx_ctx->rx_buffered_list) ||
+			    !dlist_empty(&rx_ctx->rx_rndv_list) ||
 			    !dlist_empty(&rx_ctx->pe_entry_list)) {
 				return 0;
 			}
@@ -2852,14 +3628,19 @@ static void sock_pe_wait(struct sock_pe *pe)
 }
 
 #if !defined __APPLE__ && !defined _WIN32
-static void sock_thread_set_affinity(char *s)
+static void sock_thread_set_affinity(const char *str, int index, int count)
 {
 	char *saveptra = NULL, *saveptrb = NULL, *saveptrc = NULL;
-	char *a, *b, *c;
+	char *s, *a, *b, *c;
 	int j, first, last, stride;
-	cpu_set_t mycpuset;
+	cpu_set_t mycpuset, pecpuset;
 	pthread_t mythread;
 
+	/* strtok_r modifies the string, which is shared by all engines */
+	s = strdup(str);
+	if (!s)
+		return;
+
 	mythread = pthread_self();
 	CPU_ZERO(&mycpuset);
 
@@ -2889,6 +3670,19 @@ static void sock_thread_set_affinity(char *s)
 			CPU_SET(j, &mycpuset);
 		a =  strtok_r(NULL, ",", &saveptra);
 	}
+	free(s);
+
+	/* with several engines, engine i takes the i-th listed processor */
+	if (count > 1 && CPU_COUNT(&mycpuset)) {
+		index %= CPU_COUNT(&mycpuset);
+		for (j = 0; j < CPU_SETSIZE; j++) {
+			if (CPU_ISSET(j, &mycpuset) && !index--)
+				break;
+		}
+		CPU_ZERO(&pecpuset);
+		CPU_SET(j, &pecpuset);
+		mycpuset = pecpuset;
+	}
 
 	j = pthread_setaffinity_np(mythread, sizeof(cpu_set_t), &mycpuset);
 	if (j != 0)
@@ -2896,13 +3690,14 @@ static void sock_thread_set_affinity(char *s)
 }
 #endif
 
-static void sock_pe_set_affinity(void)
+static void sock_pe_set_affinity(struct sock_pe *pe)
 {
 	if (sock_pe_affinity_str == NULL)
 		return;
 
 #if !defined __APPLE__ && !defined _WIN32
-	sock_thread_set_affinity(sock_pe_affinity_str);
+	sock_thread_set_affinity(sock_pe_affinity_str, pe->index,
+				 pe->domain->pe_count);
 #else
 	SOCK_LOG_ERROR("*** FI_SOCKETS_PE_AFFINITY is not supported on OS X\n");
 #endif
@@ -2917,7 +3712,7 @@ static void *sock_pe_progress_thread(void *data)
 	struct sock_pe *pe = (struct sock_pe *)data;
 
 	SOCK_LOG_DBG("Progress thread started\n");
-	sock_pe_set_affinity();
+	sock_pe_set_affinity(pe);
 	while (*((volatile int *)&pe->do_progress)) {
 		pthread_mutex_lock(&pe->list_lock);
 		if (pe->domain->progress_mode == FI_PROGRESS_AUTO &&
@@ -2983,7 +3778,7 @@ static void sock_pe_init_table(struct sock_pe *pe)
 	SOCK_LOG_DBG("PE table init: OK\n");
 }
 
-struct sock_pe *sock_pe_init(struct sock_domain *domain)
+struct sock_pe *sock_pe_init(struct sock_domain *domain, int index)
 {
 	struct sock_pe *pe;
 
@@ -2998,6 +3793,8 @@ struct sock_pe *sock_pe_init(struct sock_domain *domain)
 	fastlock_init(&pe->signal_lock);
 	pthread_mutex_init(&pe->list_lock, NULL);
 	pe->domain = domain;
+	pe->index = index;
+	ofi_atomic_initialize32(&pe->rx_stashed, 0);
 
 	pe->pe_rx_pool = util_buf_pool_create(sizeof(struct sock_pe_entry), 16, 0, 1024);
 	if (!pe->pe_rx_pool) {
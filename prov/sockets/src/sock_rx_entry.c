@@ -43,16 +43,72 @@
 
 #include "sock.h"
 #include "sock_util.h"
+#include "fasthash.h"
 
 #define SOCK_LOG_DBG(...) _SOCK_LOG_DBG(FI_LOG_EP_DATA, __VA_ARGS__)
 #define SOCK_LOG_ERROR(...) _SOCK_LOG_ERROR(FI_LOG_EP_DATA, __VA_ARGS__)
 
+/*
+ * Posted receives are queued on rx_entry_list in posting order, and on one
+ * matching queue selected by what the receive may match:
+ *   - directed receives on the hash of their source address,
+ *   - tagged receives from any source with no ignore bits on the hash of
+ *     their tag,
+ *   - remaining tagged receives on the wildcard list,
+ *   - untagged receives from any source on the message list.
+ * Unexpected (buffered) messages are queued on rx_buffered_list in arrival
+ * order, on the hash of their tag or the untagged list, and on the hash of
+ * their source address.  Messages of unknown source take the unspec hash
+ * of their tag, or the unspec list when untagged, in place of the source
+ * hash.  Every queue is kept in order, so the first match in each
+ * candidate queue is the oldest one it holds; the sequence number picks
+ * the oldest among queues.  The source hash bucket is resolved once, when
+ * an entry is queued, and kept in src_bucket.
+ */
+void sock_rx_init_queues(struct sock_rx_ctx *rx_ctx)
+{
+	dlist_init(&rx_ctx->rx_directed_list);
+	dlist_init(&rx_ctx->rx_wild_list);
+	dlist_init(&rx_ctx->rx_msg_list);
+	dlist_init(&rx_ctx->rx_buffered_unspec_list);
+	dlist_init(&rx_ctx->rx_buffered_msg_list);
+	dlist_init(&rx_ctx->rx_claimed_list);
+}
+
+/* hash buckets are allocated with the first entry, control contexts never
+ * need them */
+static int sock_rx_alloc_hash(struct sock_rx_ctx *rx_ctx)
+{
+	struct dlist_entry *queues;
+	int i;
+
+	if (rx_ctx->rx_tag_hash)
+		return 0;
+
+	queues = calloc(5 * SOCK_EP_RX_HASH_SZ, sizeof(*queues));
+	if (!queues)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < 5 * SOCK_EP_RX_HASH_SZ; i++)
+		dlist_init(&queues[i]);
+
+	rx_ctx->rx_tag_hash = queues;
+	rx_ctx->rx_src_hash = queues + SOCK_EP_RX_HASH_SZ;
+	rx_ctx->rx_buffered_tag_hash = queues + 2 * SOCK_EP_RX_HASH_SZ;
+	rx_ctx->rx_buffered_src_hash = queues + 3 * SOCK_EP_RX_HASH_SZ;
+	rx_ctx->rx_buffered_unspec_hash = queues + 4 * SOCK_EP_RX_HASH_SZ;
+	return 0;
+}
+
 struct sock_rx_entry *sock_rx_new_entry(struct sock_rx_ctx *rx_ctx)
 {
 	struct sock_rx_entry *rx_entry;
 	struct slist_entry *entry;
 	size_t i;
 
+	if (sock_rx_alloc_hash(rx_ctx))
+		return NULL;
+
 	if (rx_ctx->rx_entry_pool == NULL) {
 		rx_ctx->rx_entry_pool = calloc(rx_ctx->attr.size,
 						sizeof(*rx_entry));
@@ -77,11 +133,14 @@ struct sock_rx_entry *sock_rx_new_entry(struct sock_rx_ctx *rx_ctx)
 		rx_entry = calloc(1, sizeof(*rx_entry));
 		if (!rx_entry)
 			return NULL;
+		rx_entry->rx_ctx = rx_ctx;
 	}
 
 	rx_entry->is_tagged = 0;
 	SOCK_LOG_DBG("New rx_entry: %p, ctx: %p\n", rx_entry, rx_ctx);
 	dlist_init(&rx_entry->entry);
+	dlist_init(&rx_entry->match_entry);
+	dlist_init(&rx_entry->src_entry);
 	rx_ctx->num_left--;
 	return rx_entry;
 }
@@ -109,6 +168,9 @@ struct sock_rx_entry *sock_rx_new_buffered_entry(struct sock_rx_ctx *rx_ctx,
 	if (rx_ctx->buffered_len + len >= rx_ctx->attr.total_buffered_recv)
 		SOCK_LOG_ERROR("Exceeded buffered recv limit\n");
 
+	if (sock_rx_alloc_hash(rx_ctx))
+		return NULL;
+
 	rx_entry = calloc(1, sizeof(*rx_entry) + len);
 	if (!rx_entry)
 		return NULL;
@@ -122,62 +184,343 @@ struct sock_rx_entry *sock_rx_new_buffered_entry(struct sock_rx_ctx *rx_ctx,
 	rx_entry->iov[0].iov.len = len;
 	rx_entry->iov[0].iov.addr = (uintptr_t) (rx_entry + 1);
 	rx_entry->total_len = len;
+	rx_entry->rx_ctx = rx_ctx;
+	dlist_init(&rx_entry->entry);
+	dlist_init(&rx_entry->match_entry);
+	dlist_init(&rx_entry->src_entry);
 
 	rx_ctx->buffered_len += len;
+	return rx_entry;
+}
+
+static inline int sock_rx_tag_bucket(uint64_t tag)
+{
+	return fasthash64(&tag, sizeof(tag), 0) & (SOCK_EP_RX_HASH_SZ - 1);
+}
+
+/*
+ * Addresses resolving to the same sockaddr must share a bucket.  The AV
+ * table may be resized by an insert on another thread, so read it under
+ * table_lock.
+ */
+int sock_rx_src_bucket(struct sock_rx_ctx *rx_ctx, uint64_t addr)
+{
+	struct sock_av *av = rx_ctx->av;
+	struct sockaddr_in *sin;
+	uint64_t key = addr, index;
+
+	if (addr != FI_ADDR_UNSPEC && av) {
+		index = addr & av->mask;
+		fastlock_acquire(&av->table_lock);
+		if (index < av->table_hdr->size) {
+			sin = (struct sockaddr_in *)&av->table[index].addr;
+			key = ((uint64_t)sin->sin_addr.s_addr << 16) |
+			      sin->sin_port;
+		}
+		fastlock_release(&av->table_lock);
+	}
+	return fasthash64(&key, sizeof(key), 0) & (SOCK_EP_RX_HASH_SZ - 1);
+}
+
+static inline int sock_rx_match_addr(struct sock_rx_ctx *rx_ctx,
+				     uint64_t addr1, uint64_t addr2)
+{
+	return (addr1 == FI_ADDR_UNSPEC || addr2 == FI_ADDR_UNSPEC ||
+		addr1 == addr2 ||
+		(rx_ctx->av && !sock_av_compare_addr(rx_ctx->av, addr2, addr1)));
+}
+
+void sock_rx_enqueue_posted(struct sock_rx_ctx *rx_ctx,
+			    struct sock_rx_entry *rx_entry)
+{
+	struct dlist_entry *queue;
+
+	if (rx_entry->addr != FI_ADDR_UNSPEC) {
+		rx_entry->src_bucket = sock_rx_src_bucket(rx_ctx, rx_entry->addr);
+		queue = &rx_ctx->rx_src_hash[rx_entry->src_bucket];
+		/* a message of unknown source checks them all on one list */
+		dlist_insert_tail(&rx_entry->src_entry,
+				  &rx_ctx->rx_directed_list);
+		rx_ctx->num_directed++;
+	} else if (!rx_entry->is_tagged)
+		queue = &rx_ctx->rx_msg_list;
+	else if (!rx_entry->ignore)
+		queue = &rx_ctx->rx_tag_hash[sock_rx_tag_bucket(rx_entry->tag)];
+	else
+		queue = &rx_ctx->rx_wild_list;
+
+	rx_entry->seq = rx_ctx->match_seq++;
+	dlist_insert_tail(&rx_entry->entry, &rx_ctx->rx_entry_list);
+	dlist_insert_tail(&rx_entry->match_entry, queue);
+	rx_ctx->buffered_pending = 1;
+}
+
+void sock_rx_enqueue_buffered(struct sock_rx_ctx *rx_ctx,
+			      struct sock_rx_entry *rx_entry)
+{
+	struct dlist_entry *queue;
+
+	if (rx_entry->is_tagged)
+		queue = &rx_ctx->rx_buffered_tag_hash[sock_rx_tag_bucket(rx_entry->tag)];
+	else
+		queue = &rx_ctx->rx_buffered_msg_list;
+
+	rx_entry->seq = rx_ctx->match_seq++;
 	dlist_insert_tail(&rx_entry->entry, &rx_ctx->rx_buffered_list);
+	dlist_insert_tail(&rx_entry->match_entry, queue);
+	if (rx_entry->addr == FI_ADDR_UNSPEC && rx_entry->is_tagged) {
+		queue = &rx_ctx->rx_buffered_unspec_hash[sock_rx_tag_bucket(rx_entry->tag)];
+		rx_ctx->num_buffered_unspec++;
+	} else if (rx_entry->addr == FI_ADDR_UNSPEC) {
+		queue = &rx_ctx->rx_buffered_unspec_list;
+	} else {
+		rx_entry->src_bucket = sock_rx_src_bucket(rx_ctx, rx_entry->addr);
+		queue = &rx_ctx->rx_buffered_src_hash[rx_entry->src_bucket];
+	}
+	dlist_insert_tail(&rx_entry->src_entry, queue);
+	rx_ctx->buffered_pending = 1;
+}
 
-	return rx_entry;
+/* claimed messages are only reachable through their context */
+void sock_rx_claim_entry(struct sock_rx_ctx *rx_ctx,
+			 struct sock_rx_entry *rx_entry)
+{
+	if (rx_entry->addr == FI_ADDR_UNSPEC && rx_entry->is_tagged)
+		rx_ctx->num_buffered_unspec--;
+	rx_entry->is_claimed = 1;
+	dlist_remove(&rx_entry->match_entry);
+	dlist_remove(&rx_entry->src_entry);
+	dlist_init(&rx_entry->src_entry);
+	dlist_insert_tail(&rx_entry->match_entry, &rx_ctx->rx_claimed_list);
 }
 
-struct sock_rx_entry *sock_rx_get_entry(struct sock_rx_ctx *rx_ctx,
-					uint64_t addr, uint64_t tag,
-					uint8_t is_tagged)
+void sock_rx_dequeue_entry(struct sock_rx_entry *rx_entry)
+{
+	if (!rx_entry->is_buffered && rx_entry->addr != FI_ADDR_UNSPEC)
+		rx_entry->rx_ctx->num_directed--;
+	else if (rx_entry->is_buffered && !rx_entry->is_claimed &&
+		 rx_entry->addr == FI_ADDR_UNSPEC && rx_entry->is_tagged)
+		rx_entry->rx_ctx->num_buffered_unspec--;
+
+	dlist_remove(&rx_entry->entry);
+	dlist_remove(&rx_entry->match_entry);
+	dlist_remove(&rx_entry->src_entry);
+}
+
+static struct sock_rx_entry *
+sock_rx_match_posted(struct sock_rx_ctx *rx_ctx, struct dlist_entry *queue,
+		     struct sock_rx_entry *best, uint64_t addr, uint64_t tag,
+		     uint8_t is_tagged)
 {
 	struct dlist_entry *entry;
 	struct sock_rx_entry *rx_entry;
 
-	for (entry = rx_ctx->rx_entry_list.next;
-	     entry != &rx_ctx->rx_entry_list; entry = entry->next) {
+	for (entry = queue->next; entry != queue; entry = entry->next) {
+		rx_entry = container_of(entry, struct sock_rx_entry, match_entry);
+		if (best && best->seq < rx_entry->seq)
+			break;
 
-		rx_entry = container_of(entry, struct sock_rx_entry, entry);
 		if (rx_entry->is_busy || (is_tagged != rx_entry->is_tagged))
 			continue;
 
 		if (((rx_entry->tag & ~rx_entry->ignore) == (tag & ~rx_entry->ignore)) &&
-		    (rx_entry->addr == FI_ADDR_UNSPEC || addr == FI_ADDR_UNSPEC ||
-		     rx_entry->addr == addr ||
-		     (rx_ctx->av &&
-		      !sock_av_compare_addr(rx_ctx->av, addr, rx_entry->addr)))) {
-			rx_entry->is_busy = 1;
+		    sock_rx_match_addr(rx_ctx, rx_entry->addr, addr))
+			return rx_entry;
+	}
+	return best;
+}
+
+/* the first match on rx_directed_list, which holds every directed receive */
+static struct sock_rx_entry *
+sock_rx_match_directed(struct sock_rx_ctx *rx_ctx, uint64_t addr, uint64_t tag,
+		       uint8_t is_tagged)
+{
+	struct dlist_entry *entry;
+	struct sock_rx_entry *rx_entry;
+
+	for (entry = rx_ctx->rx_directed_list.next;
+	     entry != &rx_ctx->rx_directed_list; entry = entry->next) {
+		rx_entry = container_of(entry, struct sock_rx_entry, src_entry);
+		if (rx_entry->is_busy || (is_tagged != rx_entry->is_tagged))
+			continue;
+
+		if (((rx_entry->tag & ~rx_entry->ignore) == (tag & ~rx_entry->ignore)) &&
+		    sock_rx_match_addr(rx_ctx, rx_entry->addr, addr))
 			return rx_entry;
-		}
 	}
 	return NULL;
 }
 
+/* src_bucket is the source hash bucket of addr, see sock_rx_src_bucket() */
+struct sock_rx_entry *sock_rx_get_entry(struct sock_rx_ctx *rx_ctx,
+					uint64_t addr, int src_bucket,
+					uint64_t tag, uint8_t is_tagged)
+{
+	struct sock_rx_entry *rx_entry = NULL;
+
+	if (dlist_empty(&rx_ctx->rx_entry_list))
+		return NULL;
+
+	if (addr == FI_ADDR_UNSPEC) {
+		if (rx_ctx->num_directed)
+			rx_entry = sock_rx_match_directed(rx_ctx, addr, tag,
+							  is_tagged);
+	} else {
+		rx_entry = sock_rx_match_posted(rx_ctx,
+				&rx_ctx->rx_src_hash[src_bucket],
+				rx_entry, addr, tag, is_tagged);
+	}
+
+	if (is_tagged) {
+		rx_entry = sock_rx_match_posted(rx_ctx,
+				&rx_ctx->rx_tag_hash[sock_rx_tag_bucket(tag)],
+				rx_entry, addr, tag, is_tagged);
+		rx_entry = sock_rx_match_posted(rx_ctx, &rx_ctx->rx_wild_list,
+						rx_entry, addr, tag, is_tagged);
+	} else {
+		rx_entry = sock_rx_match_posted(rx_ctx, &rx_ctx->rx_msg_list,
+						rx_entry, addr, tag, is_tagged);
+	}
+
+	if (rx_entry)
+		rx_entry->is_busy = 1;
+	return rx_entry;
+}
+
+static inline int sock_rx_match_buffered(struct sock_rx_ctx *rx_ctx,
+					 struct sock_rx_entry *rx_entry,
+					 uint64_t addr, uint64_t tag,
+					 uint64_t ignore, uint8_t is_tagged)
+{
+	return !rx_entry->is_busy && is_tagged == rx_entry->is_tagged &&
+		!rx_entry->is_claimed &&
+		((rx_entry->tag & ~ignore) == (tag & ~ignore)) &&
+		sock_rx_match_addr(rx_ctx, rx_entry->addr, addr);
+}
+
+static struct sock_rx_entry *
+sock_rx_match_src(struct sock_rx_ctx *rx_ctx, struct dlist_entry *queue,
+		  struct sock_rx_entry *best, uint64_t addr, uint64_t tag,
+		  uint64_t ignore, uint8_t is_tagged)
+{
+	struct dlist_entry *entry;
+	struct sock_rx_entry *rx_entry;
+
+	for (entry = queue->next; entry != queue; entry = entry->next) {
+		rx_entry = container_of(entry, struct sock_rx_entry, src_entry);
+		if (best && best->seq < rx_entry->seq)
+			break;
+
+		if (sock_rx_match_buffered(rx_ctx, rx_entry, addr, tag,
+					   ignore, is_tagged))
+			return rx_entry;
+	}
+	return best;
+}
+
 struct sock_rx_entry *sock_rx_get_buffered_entry(struct sock_rx_ctx *rx_ctx,
 						uint64_t addr, uint64_t tag,
 						uint64_t ignore,
 						uint8_t is_tagged)
 {
-	struct dlist_entry *entry;
-	struct sock_rx_entry *rx_entry;
+	struct dlist_entry *entry, *queue;
+	struct sock_rx_entry *rx_entry = NULL;
 
+	if (dlist_empty(&rx_ctx->rx_buffered_list))
+		return NULL;
+
+	if (addr != FI_ADDR_UNSPEC) {
+		rx_entry = sock_rx_match_src(rx_ctx,
+				&rx_ctx->rx_buffered_src_hash[sock_rx_src_bucket(rx_ctx,
+								addr)],
+				rx_entry, addr, tag, ignore, is_tagged);
+		if (!is_tagged)
+			queue = &rx_ctx->rx_buffered_unspec_list;
+		else if (!ignore)
+			queue = &rx_ctx->rx_buffered_unspec_hash[sock_rx_tag_bucket(tag)];
+		else if (!rx_ctx->num_buffered_unspec)
+			return rx_entry;
+		else
+			goto scan;
+		return sock_rx_match_src(rx_ctx, queue, rx_entry, addr, tag,
+					 ignore, is_tagged);
+	}
+
+	if (!is_tagged)
+		queue = &rx_ctx->rx_buffered_msg_list;
+	else if (!ignore)
+		queue = &rx_ctx->rx_buffered_tag_hash[sock_rx_tag_bucket(tag)];
+	else
+		goto scan;
+
+	for (entry = queue->next; entry != queue; entry = entry->next) {
+		rx_entry = container_of(entry, struct sock_rx_entry, match_entry);
+		if (sock_rx_match_buffered(rx_ctx, rx_entry, addr, tag,
+					   ignore, is_tagged))
+			return rx_entry;
+	}
+	return NULL;
+
+scan:
+	/* ignore bits defeat the tag hashes */
 	for (entry = rx_ctx->rx_buffered_list.next;
 	     entry != &rx_ctx->rx_buffered_list; entry = entry->next) {
-
 		rx_entry = container_of(entry, struct sock_rx_entry, entry);
-		if (rx_entry->is_busy || (is_tagged != rx_entry->is_tagged) ||
-		    rx_entry->is_claimed)
-			continue;
-
-		if (((rx_entry->tag & ~ignore) == (tag & ~ignore)) &&
-		    (rx_entry->addr == FI_ADDR_UNSPEC || addr == FI_ADDR_UNSPEC ||
-		     rx_entry->addr == addr ||
-		     (rx_ctx->av &&
-		      !sock_av_compare_addr(rx_ctx->av, addr, rx_entry->addr)))) {
+		if (sock_rx_match_buffered(rx_ctx, rx_entry, addr, tag,
+					   ignore, is_tagged))
 			return rx_entry;
-		}
 	}
 	return NULL;
 }
+
+#define SOCK_RNDV_SLOTS_MIN (64)
+
+/* Returns the pull cookie for a rendezvous receive, 0 if out of memory */
+uint64_t sock_rx_rndv_insert(struct sock_rx_ctx *rx_ctx,
+			     struct sock_rx_entry *rx_entry)
+{
+	struct sock_rndv_slot *slots;
+	uint32_t i, idx, size;
+
+	if (rx_ctx->rndv_free == rx_ctx->rndv_slots_size) {
+		size = MAX(rx_ctx->rndv_slots_size * 2, SOCK_RNDV_SLOTS_MIN);
+		slots = realloc(rx_ctx->rndv_slots, size * sizeof(*slots));
+		if (!slots)
+			return 0;
+
+		for (i = rx_ctx->rndv_slots_size; i < size; i++) {
+			slots[i].rx_entry = NULL;
+			slots[i].gen = 1;
+			slots[i].next_free = i + 1;
+		}
+		rx_ctx->rndv_slots = slots;
+		rx_ctx->rndv_slots_size = size;
+	}
+
+	idx = rx_ctx->rndv_free;
+	rx_ctx->rndv_free = rx_ctx->rndv_slots[idx].next_free;
+	rx_ctx->rndv_slots[idx].rx_entry = rx_entry;
+	return ((uint64_t) rx_ctx->rndv_slots[idx].gen << 32) | idx;
+}
+
+/* Cookies come back from the peer: reject stale or made up ones */
+struct sock_rx_entry *sock_rx_rndv_lookup(struct sock_rx_ctx *rx_ctx,
+					  uint64_t cookie)
+{
+	uint32_t idx = (uint32_t) cookie;
+
+	if (idx >= rx_ctx->rndv_slots_size ||
+	    rx_ctx->rndv_slots[idx].gen != (uint32_t) (cookie >> 32))
+		return NULL;
+	return rx_ctx->rndv_slots[idx].rx_entry;
+}
+
+void sock_rx_rndv_remove(struct sock_rx_ctx *rx_ctx, uint64_t cookie)
+{
+	uint32_t idx = (uint32_t) cookie;
+
+	rx_ctx->rndv_slots[idx].rx_entry = NULL;
+	rx_ctx->rndv_slots[idx].gen++;
+	rx_ctx->rndv_slots[idx].next_free = rx_ctx->rndv_free;
+	rx_ctx->rndv_free = idx;
+}
@@ -82,9 +82,10 @@ ssize_t sock_queue_rma_op(struct fid_ep *ep, const struct fi_msg_rma *msg,
 	trigger->ep = ep;
 	trigger->flags = flags;
 
-	fastlock_acquire(&cntr->trigger_lock);
-	dlist_insert_tail(&trigger->entry, &cntr->trigger_list);
-	fastlock_release(&cntr->trigger_lock);
+	if (sock_cntr_add_trigger(cntr, trigger)) {
+		free(trigger);
+		return -FI_ENOMEM;
+	}
 	sock_cntr_check_trigger_list(cntr);
 	return 0;
 }
@@ -124,9 +125,10 @@ ssize_t sock_queue_msg_op(struct fid_ep *ep, const struct fi_msg *msg,
 	trigger->ep = ep;
 	trigger->flags = flags;
 
-	fastlock_acquire(&cntr->trigger_lock);
-	dlist_insert_tail(&trigger->entry, &cntr->trigger_list);
-	fastlock_release(&cntr->trigger_lock);
+	if (sock_cntr_add_trigger(cntr, trigger)) {
+		free(trigger);
+		return -FI_ENOMEM;
+	}
 	sock_cntr_check_trigger_list(cntr);
 	return 0;
 }
@@ -166,9 +168,10 @@ ssize_t sock_queue_tmsg_op(struct fid_ep *ep, const struct fi_msg_tagged *msg,
 	trigger->ep = ep;
 	trigger->flags = flags;
 
-	fastlock_acquire(&cntr->trigger_lock);
-	dlist_insert_tail(&trigger->entry, &cntr->trigger_list);
-	fastlock_release(&cntr->trigger_lock);
+	if (sock_cntr_add_trigger(cntr, trigger)) {
+		free(trigger);
+		return -FI_ENOMEM;
+	}
 	sock_cntr_check_trigger_list(cntr);
 	return 0;
 }
@@ -224,9 +227,10 @@ ssize_t sock_queue_atomic_op(struct fid_ep *ep, const struct fi_msg_atomic *msg,
 	trigger->ep = ep;
 	trigger->flags = flags;
 
-	fastlock_acquire(&cntr->trigger_lock);
-	dlist_insert_tail(&trigger->entry, &cntr->trigger_list);
-	fastlock_release(&cntr->trigger_lock);
+	if (sock_cntr_add_trigger(cntr, trigger)) {
+		free(trigger);
+		return -FI_ENOMEM;
+	}
 	sock_cntr_check_trigger_list(cntr);
 	return 0;
 }
@@ -254,9 +258,10 @@ ssize_t sock_queue_cntr_op(struct fi_deferred_work *work, uint64_t flags)
 	trigger->threshold = work->threshold;
 	trigger->flags = flags;
 
-	fastlock_acquire(&cntr->trigger_lock);
-	dlist_insert_tail(&trigger->entry, &cntr->trigger_list);
-	fastlock_release(&cntr->trigger_lock);
+	if (sock_cntr_add_trigger(cntr, trigger)) {
+		free(trigger);
+		return -FI_ENOMEM;
+	}
 	sock_cntr_check_trigger_list(cntr);
 	return 0;
 }
@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2017 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Loopback test of atomics over the sockets provider: an endpoint
+ * targets a buffer registered in its own domain, so every operation goes
+ * through the wire protocol and the receive-side kernels.  Covers plain
+ * and injected updates, which return no result, fetching updates, and
+ * complex compare-and-swap, which once compared the target against the
+ * source operand instead of the compare operand.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <complex.h>
+
+#include <rdma/fabric.h>
+#include <rdma/fi_domain.h>
+#include <rdma/fi_endpoint.h>
+#include <rdma/fi_cm.h>
+#include <rdma/fi_atomic.h>
+#include <rdma/fi_errno.h>
+
+#define COUNT		64
+
+static struct fi_info *info;
+static struct fid_fabric *fabric;
+static struct fid_domain *domain;
+static struct fid_ep *ep;
+static struct fid_av *av;
+static struct fid_cq *cq;
+static struct fid_mr *mr;
+static fi_addr_t self;
+static uint64_t key;
+static int errors;
+
+static struct {
+	uint64_t	sum[COUNT];
+	int32_t		max[COUNT];
+	double complex	cswap[3];
+} target;
+
+#define CHECK(cond, ...)					\
+	do {							\
+		if (!(cond)) {					\
+			fprintf(stderr, __VA_ARGS__);		\
+			errors++;				\
+		}						\
+	} while (0)
+
+#define CHECK_RET(call)						\
+	do {							\
+		int _ret = (call);				\
+		if (_ret) {					\
+			fprintf(stderr, "%s: %s\n", #call,	\
+				fi_strerror(-_ret));		\
+			exit(EXIT_FAILURE);			\
+		}						\
+	} while (0)
+
+#define POST(call)						\
+	do {							\
+		ssize_t _ret;					\
+		while ((_ret = (call)) == -FI_EAGAIN)		\
+			fi_cq_read(cq, NULL, 0);		\
+		CHECK_RET((int) _ret);				\
+	} while (0)
+
+static uint64_t addr_of(void *buf)
+{
+	return (uint64_t) (uintptr_t) buf;
+}
+
+static void wait_comp(int cnt)
+{
+	struct fi_cq_entry comp;
+	struct fi_cq_err_entry err;
+	ssize_t ret;
+
+	while (cnt) {
+		ret = fi_cq_read(cq, &comp, 1);
+		if (ret == 1) {
+			cnt--;
+		} else if (ret == -FI_EAVAIL) {
+			fi_cq_readerr(cq, &err, 0);
+			fprintf(stderr, "completion error: %s\n",
+				fi_strerror(err.err));
+			exit(EXIT_FAILURE);
+		} else if (ret != -FI_EAGAIN) {
+			CHECK_RET((int) ret);
+		}
+	}
+}
+
+static void setup(void)
+{
+	struct fi_info *hints;
+	struct fi_av_attr av_attr = { .type = FI_AV_MAP };
+	struct fi_cq_attr cq_attr = { .format = FI_CQ_FORMAT_CONTEXT };
+	char name[64];
+	size_t len = sizeof(name);
+
+	hints = fi_allocinfo();
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_ATOMIC;
+	hints->domain_attr->data_progress = FI_PROGRESS_AUTO;
+	hints->domain_attr->mr_mode = FI_MR_BASIC;
+	hints->fabric_attr->prov_name = strdup("sockets");
+	CHECK_RET(fi_getinfo(FI_VERSION(1, 5), "127.0.0.1", NULL, 0, hints,
+			     &info));
+	fi_freeinfo(hints);
+
+	CHECK_RET(fi_fabric(info->fabric_attr, &fabric, NULL));
+	CHECK_RET(fi_domain(fabric, info, &domain, NULL));
+	CHECK_RET(fi_mr_reg(domain, &target, sizeof(target),
+			    FI_REMOTE_READ | FI_REMOTE_WRITE, 0, 0, 0,
+			    &mr, NULL));
+	key = fi_mr_key(mr);
+	CHECK_RET(fi_av_open(domain, &av_attr, &av, NULL));
+	CHECK_RET(fi_cq_open(domain, &cq_attr, &cq, NULL));
+	CHECK_RET(fi_endpoint(domain, info, &ep, NULL));
+	CHECK_RET(fi_ep_bind(ep, &av->fid, 0));
+	CHECK_RET(fi_ep_bind(ep, &cq->fid, FI_TRANSMIT | FI_RECV));
+	CHECK_RET(fi_enable(ep));
+
+	CHECK_RET(fi_getname(&ep->fid, name, &len));
+	if (fi_av_insert(av, name, 1, &self, 0, NULL) != 1) {
+		fprintf(stderr, "fi_av_insert failed\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void teardown(void)
+{
+	fi_close(&ep->fid);
+	fi_close(&cq->fid);
+	fi_close(&av->fid);
+	fi_close(&mr->fid);
+	fi_close(&domain->fid);
+	fi_close(&fabric->fid);
+	fi_freeinfo(info);
+}
+
+/* non-fetching updates carry no result buffer */
+static void test_sum(void)
+{
+	uint64_t src[COUNT], one = 1;
+	int i;
+
+	for (i = 0; i < COUNT; i++) {
+		target.sum[i] = i;
+		src[i] = 1000 * i;
+	}
+
+	POST(fi_atomic(ep, src, COUNT, NULL, self, addr_of(target.sum),
+		       key, FI_UINT64, FI_SUM, NULL));
+	wait_comp(1);
+	for (i = 0; i < COUNT; i++)
+		POST(fi_inject_atomic(ep, &one, 1, self,
+				      addr_of(&target.sum[i]), key,
+				      FI_UINT64, FI_SUM));
+
+	/* an atomic read orders behind the injected updates */
+	POST(fi_fetch_atomic(ep, NULL, COUNT, NULL, src, NULL, self,
+			     addr_of(target.sum), key, FI_UINT64,
+			     FI_ATOMIC_READ, NULL));
+	wait_comp(1);
+	for (i = 0; i < COUNT; i++)
+		CHECK(src[i] == 1001 * i + 1, "sum %d: %llu\n", i,
+		      (unsigned long long) src[i]);
+}
+
+static void test_fetch_max(void)
+{
+	int32_t src[COUNT], res[COUNT];
+	int i;
+
+	for (i = 0; i < COUNT; i++) {
+		target.max[i] = i;
+		src[i] = COUNT - i;
+	}
+
+	POST(fi_fetch_atomic(ep, src, COUNT, NULL, res, NULL, self,
+			     addr_of(target.max), key, FI_INT32, FI_MAX,
+			     NULL));
+	wait_comp(1);
+	for (i = 0; i < COUNT; i++) {
+		CHECK(res[i] == i, "fetch max %d: result %d\n", i, res[i]);
+		CHECK(target.max[i] == (i > COUNT - i ? i : COUNT - i),
+		      "fetch max %d: target %d\n", i, target.max[i]);
+	}
+}
+
+static void test_complex_cswap(void)
+{
+	double complex src[3] = { 5 + 5 * I, 5 + 5 * I, 5 + 5 * I };
+	double complex cmp[3] = { 1 + 2 * I, 1 + 3 * I, 2 + 2 * I };
+	double complex res[3];
+	int i;
+
+	for (i = 0; i < 3; i++)
+		target.cswap[i] = 1 + 2 * I;
+
+	POST(fi_compare_atomic(ep, src, 3, NULL, cmp, NULL, res, NULL, self,
+			       addr_of(target.cswap), key,
+			       FI_DOUBLE_COMPLEX, FI_CSWAP, NULL));
+	wait_comp(1);
+	CHECK(target.cswap[0] == 5 + 5 * I, "complex cswap missed a match\n");
+	CHECK(target.cswap[1] == 1 + 2 * I,
+	      "complex cswap ignored the imaginary part\n");
+	CHECK(target.cswap[2] == 1 + 2 * I,
+	      "complex cswap ignored the real part\n");
+	for (i = 0; i < 3; i++)
+		CHECK(res[i] == 1 + 2 * I, "complex cswap %d: wrong result\n",
+		      i);
+}
+
+int main(void)
+{
+	setup();
+	test_sum();
+	test_fetch_max();
+	test_complex_cswap();
+	teardown();
+
+	printf("%s\n", errors ? "FAIL" : "PASS");
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
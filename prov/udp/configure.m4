@@ -16,6 +16,9 @@ AC_DEFUN([FI_UDP_CONFIGURE],[
 	                       [udp_h_happy=0])
 
 
+	       # batched datagram I/O is optional
+	       AC_CHECK_FUNCS([recvmmsg sendmmsg])
+
 	       # check if shm_open is already present
 	       AC_CHECK_FUNC([shm_open],
 			     [udp_shm_happy=1],
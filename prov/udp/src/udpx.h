@@ -70,6 +70,9 @@
 extern struct fi_provider udpx_prov;
 extern struct util_prov udpx_util_prov;
 extern struct fi_info udpx_info;
+extern int udpx_gso;
+extern int udpx_gro;
+extern int udpx_conn_cache_size;
 
 
 int udpx_fabric(struct fi_fabric_attr *attr, struct fid_fabric **fabric,
@@ -82,6 +85,18 @@ int udpx_eq_open(struct fid_fabric *fabric, struct fi_eq_attr *attr,
 
 #define UDPX_FLAG_MULTI_RECV	1
 #define UDPX_IOV_LIMIT		4
+#define UDPX_MMSG_MAX		32
+#define UDPX_GSO_MAX_SIZE	65507
+#define UDPX_GRO_BUF_SIZE	65536
+#define UDPX_MAX_CTX		16
+#define UDPX_CONN_ADMIT		8
+
+#if !HAVE_RECVMMSG
+struct mmsghdr {
+	struct msghdr		msg_hdr;
+	unsigned int		msg_len;
+};
+#endif
 
 struct udpx_ep_entry {
 	void			*context;
@@ -93,22 +108,83 @@ struct udpx_ep_entry {
 
 OFI_DECLARE_CIRQUE(struct udpx_ep_entry, udpx_rx_cirq);
 
+struct udpx_tx_entry {
+	void			*context;
+	fi_addr_t		addr;
+	size_t			len;
+	struct iovec		iov[UDPX_IOV_LIMIT];
+	uint8_t			iov_count;
+};
+
+/* A socket connect()ed to one peer, kept in the endpoint's LRU. */
+struct udpx_conn {
+	struct dlist_entry	lru_entry;
+	fi_addr_t		fi_addr;
+	struct sockaddr_in6	addr;
+	int			sock;
+};
+
 struct udpx_ep;
 typedef void (*udpx_rx_comp_func)(struct udpx_ep *ep, void *context,
 		uint64_t flags, size_t len, void *buf, void *addr);
 typedef void (*udpx_tx_comp_func)(struct udpx_ep *ep, void *context);
 
+/*
+ * A scalable endpoint backs one address with several SO_REUSEPORT
+ * sockets, one per rx context, and lets the kernel spread flows across
+ * them.  Tx context i sends from socket i % sock_cnt.
+ */
+struct udpx_sep {
+	struct fid_ep		ep_fid;
+	struct util_domain	*domain;
+	struct util_av		*av;
+	struct fi_info		*info;
+	ofi_atomic32_t		ref;
+	int			sock[UDPX_MAX_CTX];
+	int			sock_cnt;
+	int			is_bound;
+};
+
 struct udpx_ep {
 	struct util_ep		util_ep;
 	udpx_rx_comp_func	rx_comp;
 	udpx_tx_comp_func	tx_comp;
 	struct udpx_rx_cirq	*rxq;    /* protected by rx_cq lock */
+	/* sends held back by FI_MORE, protected by tx_cq lock */
+	struct udpx_tx_entry	tx_batch[UDPX_MMSG_MAX];
+	int			tx_batch_cnt;
+	int			gso;
+	/* coalesced datagrams not yet handed out, protected by rx_cq lock */
+	struct {
+		char			*buf;
+		size_t			off;
+		size_t			len;
+		size_t			seg_size;
+		struct sockaddr_in6	addr;
+	} gro;
+	/* connected sockets of recently used peers, protected by conn_lock */
+	fastlock_t		conn_lock;
+	struct index_map	conn_idm;
+	struct dlist_entry	conn_lru;
+	struct dlist_entry	conn_drain;	/* evicted, closed once empty */
+	fi_epoll_t		conn_epoll;
+	uint8_t			*conn_sends;	/* sends per fi_addr before admission */
+	size_t			conn_sends_size;
+	int			conn_cnt;
+	int			conn_drain_cnt;
+	int			conn_max;
 	int			sock;
 	int			is_bound;
+	struct udpx_sep		*sep;	/* owns sock for sep contexts */
 };
 
 int udpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 		  struct fid_ep **ep, void *context);
+int udpx_ctx_open(struct udpx_sep *sep, size_t fclass, int sock,
+		  size_t size, struct fid_ep **ep_fid, void *context);
+void udpx_bind_src_addr(struct fid *fid);
+int udpx_scalable_ep(struct fid_domain *domain, struct fi_info *info,
+		     struct fid_ep **sep, void *context);
 
 
 int udpx_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
@@ -30,12 +30,41 @@
  * SOFTWARE.
  */
 
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <netinet/udp.h>
+#include <fi_iov.h>
 
 #include "udpx.h"
 
 
+/*
+ * With the connection cache enabled the endpoint socket has SO_REUSEPORT
+ * set, which would let it share a fixed port with another endpoint that
+ * did the same.  Check with a plain socket that the port is free first.
+ */
+static int udpx_check_port(void *addr, size_t addrlen)
+{
+	struct sockaddr *sa = addr;
+	int sock, ret = 0;
+
+	if ((sa->sa_family == AF_INET &&
+	     !((struct sockaddr_in *) sa)->sin_port) ||
+	    (sa->sa_family == AF_INET6 &&
+	     !((struct sockaddr_in6 *) sa)->sin6_port))
+		return 0;
+
+	sock = socket(sa->sa_family, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0)
+		return -errno;
+
+	if (bind(sock, addr, addrlen))
+		ret = -errno;
+	ofi_close_socket(sock);
+	return ret;
+}
+
 int udpx_setname(fid_t fid, void *addr, size_t addrlen)
 {
 	struct udpx_ep *ep;
@@ -43,6 +72,15 @@ int udpx_setname(fid_t fid, void *addr, size_t addrlen)
 
 	ep = container_of(fid, struct udpx_ep, util_ep.ep_fid.fid);
 	FI_DBG(&udpx_prov, FI_LOG_EP_CTRL, "%s\n", ofi_hex_str(addr, addrlen));
+	if (ep->conn_max) {
+		ret = udpx_check_port(addr, addrlen);
+		if (ret) {
+			FI_WARN(&udpx_prov, FI_LOG_EP_CTRL,
+				"address in use: %s\n", fi_strerror(-ret));
+			return ret;
+		}
+	}
+
 	ret = bind(ep->sock, addr, addrlen);
 	if (ret) {
 		FI_WARN(&udpx_prov, FI_LOG_EP_CTRL, "bind %d (%s)\n",
@@ -121,6 +159,31 @@ static void udpx_tx_comp_signal(struct udpx_ep *ep, void *context)
 	ep->util_ep.tx_cq->wait->signal(ep->util_ep.tx_cq->wait);
 }
 
+static void udpx_tx_comp_err(struct udpx_ep *ep, void *context, int err)
+{
+	struct util_cq_err_entry *entry;
+	struct fi_cq_tagged_entry *comp;
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		FI_WARN(&udpx_prov, FI_LOG_CQ,
+			"unable to report send error %d\n", err);
+		return;
+	}
+
+	entry->err_entry.op_context = context;
+	entry->err_entry.flags = FI_SEND;
+	entry->err_entry.err = err;
+	entry->err_entry.prov_errno = err;
+	slist_insert_tail(&entry->list_entry, &ep->util_ep.tx_cq->err_list);
+
+	comp = ofi_cirque_tail(ep->util_ep.tx_cq->cirq);
+	comp->flags = UTIL_FLAG_ERROR;
+	ofi_cirque_commit(ep->util_ep.tx_cq->cirq);
+	if (ep->util_ep.tx_cq->wait)
+		ep->util_ep.tx_cq->wait->signal(ep->util_ep.tx_cq->wait);
+}
+
 static void udpx_rx_comp(struct udpx_ep *ep, void *context, uint64_t flags,
 			 size_t len, void *buf, void *addr)
 {
@@ -157,38 +220,781 @@ static void udpx_rx_src_comp_signal(struct udpx_ep *ep, void *context,
 	ep->util_ep.rx_cq->wait->signal(ep->util_ep.rx_cq->wait);
 }
 
-void udpx_ep_progress(struct util_ep *util_ep)
+/*
+ * Peers we send to often get their own socket, bound to the endpoint's
+ * address with SO_REUSEPORT and connect()ed to the peer, so a send skips
+ * the route and neighbour lookup that sendto() repeats on every call.
+ * The kernel delivers that peer's datagrams to the connected socket, so
+ * the receive path polls the cached sockets through conn_epoll as well.
+ * Entries are keyed by fi_addr_t and checked against the AV on use, so a
+ * removed and reused AV slot never sends to the old peer.
+ *
+ * An evicted socket may still hold datagrams from its peer, so it moves
+ * to conn_drain and stays polled until a receive pass finds it empty.
+ * At most conn_max sockets wait there; beyond that the oldest is closed
+ * and whatever it still holds is lost.
+ */
+static void udpx_conn_close(struct udpx_ep *ep, struct udpx_conn *conn)
 {
-	struct udpx_ep *ep;
-	struct udpx_ep_entry *entry;
-	struct msghdr hdr;
-	struct sockaddr_in6 addr;
+	struct util_wait_fd *wait;
+
+	if (ep->util_ep.rx_cq && ep->util_ep.rx_cq->wait) {
+		wait = container_of(ep->util_ep.rx_cq->wait,
+				    struct util_wait_fd, util_wait);
+		fi_epoll_del(wait->epoll_fd, conn->sock);
+	}
+	fi_epoll_del(ep->conn_epoll, conn->sock);
+	dlist_remove(&conn->lru_entry);
+	ofi_close_socket(conn->sock);
+	free(conn);
+}
+
+static void udpx_conn_evict(struct udpx_ep *ep, struct udpx_conn *conn)
+{
+	ofi_idm_clear(&ep->conn_idm, (int) conn->fi_addr);
+	if (conn->fi_addr < ep->conn_sends_size)
+		ep->conn_sends[conn->fi_addr] = 0;
+	dlist_remove(&conn->lru_entry);
+	ep->conn_cnt--;
+
+	if (ep->conn_drain_cnt >= ep->conn_max) {
+		udpx_conn_close(ep, container_of(ep->conn_drain.prev,
+						 struct udpx_conn, lru_entry));
+		ep->conn_drain_cnt--;
+	}
+	dlist_insert_head(&conn->lru_entry, &ep->conn_drain);
+	ep->conn_drain_cnt++;
+}
+
+/* Close the evicted sockets that have nothing left to read. */
+static void udpx_conn_drain(struct udpx_ep *ep)
+{
+	struct dlist_entry *entry;
+	struct udpx_conn *conn;
+
+	for (entry = ep->conn_drain.next; entry != &ep->conn_drain;) {
+		conn = container_of(entry, struct udpx_conn, lru_entry);
+		entry = entry->next;
+		if (recv(conn->sock, NULL, 0, MSG_PEEK | MSG_DONTWAIT) < 0 &&
+		    (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			udpx_conn_close(ep, conn);
+			ep->conn_drain_cnt--;
+		}
+	}
+}
+
+/*
+ * A peer gets a connected socket only after UDPX_CONN_ADMIT sends, so
+ * that sending to more peers than the cache holds in rotation does not
+ * set up a socket on nearly every send.  The count restarts on eviction.
+ */
+static int udpx_conn_admit(struct udpx_ep *ep, fi_addr_t addr)
+{
+	uint8_t *sends;
+	size_t size;
+
+	if (addr >= ep->conn_sends_size) {
+		size = MAX(MAX(ep->conn_sends_size * 2, 64), addr + 1);
+		sends = realloc(ep->conn_sends, size);
+		if (!sends)
+			return 0;
+		memset(sends + ep->conn_sends_size, 0,
+		       size - ep->conn_sends_size);
+		ep->conn_sends = sends;
+		ep->conn_sends_size = size;
+	}
+
+	if (ep->conn_sends[addr] < UDPX_CONN_ADMIT)
+		ep->conn_sends[addr]++;
+	return ep->conn_sends[addr] == UDPX_CONN_ADMIT;
+}
+
+static int udpx_conn_init(struct udpx_ep *ep, struct udpx_conn *conn)
+{
+	struct sockaddr_storage local;
+	struct util_wait_fd *wait;
+	socklen_t len = sizeof(local);
+	int on = 1;
 	int ret;
 
-	ep = container_of(util_ep, struct udpx_ep, util_ep);
-	hdr.msg_name = &addr;
-	hdr.msg_namelen = sizeof(addr);
+	if (getsockname(ep->sock, (struct sockaddr *) &local, &len))
+		return -errno;
+
+	if (setsockopt(conn->sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) ||
+	    bind(conn->sock, (struct sockaddr *) &local, len) ||
+	    connect(conn->sock, (struct sockaddr *) &conn->addr,
+		    ep->util_ep.av->addrlen))
+		return -errno;
+
+	ret = fi_fd_nonblock(conn->sock);
+	if (ret)
+		return ret;
+
+#ifdef UDP_GRO
+	if (ep->gro.buf &&
+	    setsockopt(conn->sock, IPPROTO_UDP, UDP_GRO, &on, sizeof(on)))
+		return -errno;
+#endif
+
+	ret = fi_epoll_add(ep->conn_epoll, conn->sock, conn);
+	if (ret)
+		return ret;
+
+	if (ep->util_ep.rx_cq && ep->util_ep.rx_cq->wait) {
+		wait = container_of(ep->util_ep.rx_cq->wait,
+				    struct util_wait_fd, util_wait);
+		ret = fi_epoll_add(wait->epoll_fd, conn->sock,
+				   &ep->util_ep.ep_fid.fid);
+		if (ret) {
+			fi_epoll_del(ep->conn_epoll, conn->sock);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+static struct udpx_conn *udpx_conn_new(struct udpx_ep *ep, fi_addr_t addr,
+				       void *peer)
+{
+	struct udpx_conn *conn;
+	int ret;
+
+	if (ep->conn_cnt == ep->conn_max)
+		udpx_conn_evict(ep, container_of(ep->conn_lru.prev,
+						 struct udpx_conn, lru_entry));
+
+	conn = calloc(1, sizeof(*conn));
+	if (!conn)
+		return NULL;
+
+	conn->fi_addr = addr;
+	memcpy(&conn->addr, peer, ep->util_ep.av->addrlen);
+	conn->sock = socket(((struct sockaddr *) peer)->sa_family,
+			    SOCK_DGRAM, IPPROTO_UDP);
+	if (conn->sock < 0) {
+		free(conn);
+		return NULL;
+	}
+
+	ret = udpx_conn_init(ep, conn);
+	if (!ret)
+		ret = ofi_idm_set(&ep->conn_idm, (int) addr, conn) < 0 ?
+		      -FI_ENOMEM : 0;
+	if (ret) {
+		FI_INFO(&udpx_prov, FI_LOG_EP_DATA,
+			"disabling connected sockets: %s\n",
+			fi_strerror(-ret));
+		ofi_close_socket(conn->sock);
+		free(conn);
+		ep->conn_max = 0;
+		return NULL;
+	}
+
+	dlist_insert_head(&conn->lru_entry, &ep->conn_lru);
+	ep->conn_cnt++;
+	return conn;
+}
+
+/* Called with conn_lock held. */
+static struct udpx_conn *udpx_conn_get(struct udpx_ep *ep, fi_addr_t addr)
+{
+	struct udpx_conn *conn;
+	void *peer;
+
+	if (!ep->is_bound || addr > OFI_IDX_MAX_INDEX)
+		return NULL;
+
+	peer = ip_av_get_addr(ep->util_ep.av, addr);
+	conn = ofi_idm_lookup(&ep->conn_idm, (int) addr);
+	if (conn) {
+		if (!memcmp(&conn->addr, peer, ep->util_ep.av->addrlen)) {
+			dlist_remove(&conn->lru_entry);
+			dlist_insert_head(&conn->lru_entry, &ep->conn_lru);
+			return conn;
+		}
+		/* the AV entry was removed and its index reused */
+		udpx_conn_evict(ep, conn);
+	}
+
+	if (!udpx_conn_admit(ep, addr))
+		return NULL;
+	return udpx_conn_new(ep, addr, peer);
+}
+
+/*
+ * Send one datagram, through the peer's connected socket when the cache
+ * is enabled.  conn_lock is held across the send so that eviction by
+ * another thread cannot close the socket underneath us.
+ */
+static ssize_t udpx_sendmsg_to(struct udpx_ep *ep, const struct iovec *iov,
+			       size_t count, fi_addr_t addr)
+{
+	struct udpx_conn *conn;
+	struct msghdr hdr;
+	ssize_t ret;
+
+	hdr.msg_iov = (struct iovec *) iov;
+	hdr.msg_iovlen = count;
 	hdr.msg_control = NULL;
 	hdr.msg_controllen = 0;
 	hdr.msg_flags = 0;
 
-	fastlock_acquire(&ep->util_ep.rx_cq->cq_lock);
-	if (ofi_cirque_isempty(ep->rxq))
-		goto out;
+	if (ep->conn_max) {
+		fastlock_acquire(&ep->conn_lock);
+		conn = ep->conn_max ? udpx_conn_get(ep, addr) : NULL;
+		if (conn) {
+			hdr.msg_name = NULL;
+			hdr.msg_namelen = 0;
+			ret = sendmsg(conn->sock, &hdr, 0);
+			/* unlike sendto(), a connected socket reports ICMP errors */
+			if (ret < 0 && errno == ECONNREFUSED)
+				ret = sendmsg(conn->sock, &hdr, 0);
+			fastlock_release(&ep->conn_lock);
+			return ret;
+		}
+		fastlock_release(&ep->conn_lock);
+	}
 
-	entry = ofi_cirque_head(ep->rxq);
-	hdr.msg_iov = entry->iov;
-	hdr.msg_iovlen = entry->iov_count;
+	hdr.msg_name = ip_av_get_addr(ep->util_ep.av, addr);
+	hdr.msg_namelen = ep->util_ep.av->addrlen;
+	return sendmsg(ep->sock, &hdr, 0);
+}
 
-	ret = recvmsg(ep->sock, &hdr, 0);
-	if (ret >= 0) {
-		ep->rx_comp(ep, entry->context, 0, ret, NULL, &addr);
+static int udpx_conn_cache_init(struct udpx_ep *ep)
+{
+	int on = 1;
+	int ret;
+
+	if (udpx_conn_cache_size <= 0)
+		return 0;
+
+	/* the connected sockets share the endpoint's port */
+	if (setsockopt(ep->sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on))) {
+		FI_INFO(&udpx_prov, FI_LOG_EP_CTRL,
+			"SO_REUSEPORT not available: %s\n", strerror(errno));
+		return 0;
+	}
+
+	ret = fi_epoll_create(&ep->conn_epoll);
+	if (ret)
+		return ret;
+
+	fastlock_init(&ep->conn_lock);
+	dlist_init(&ep->conn_lru);
+	dlist_init(&ep->conn_drain);
+	ep->conn_max = udpx_conn_cache_size;
+	return 0;
+}
+
+static void udpx_conn_cache_close(struct udpx_ep *ep)
+{
+	if (!ep->conn_lru.next)
+		return;
+
+	while (!dlist_empty(&ep->conn_lru))
+		udpx_conn_close(ep, container_of(ep->conn_lru.next,
+						 struct udpx_conn, lru_entry));
+	while (!dlist_empty(&ep->conn_drain))
+		udpx_conn_close(ep, container_of(ep->conn_drain.next,
+						 struct udpx_conn, lru_entry));
+	ep->conn_cnt = ep->conn_drain_cnt = 0;
+	free(ep->conn_sends);
+	ofi_idm_reset(&ep->conn_idm);
+	fi_epoll_close(ep->conn_epoll);
+	fastlock_destroy(&ep->conn_lock);
+}
+
+#if HAVE_RECVMMSG
+static int udpx_recvmmsg(int sock, struct mmsghdr *msg, unsigned int cnt)
+{
+	return recvmmsg(sock, msg, cnt, 0, NULL);
+}
+#else
+static int udpx_recvmmsg(int sock, struct mmsghdr *msg, unsigned int cnt)
+{
+	unsigned int i;
+	ssize_t ret;
+
+	for (i = 0; i < cnt; i++) {
+		ret = recvmsg(sock, &msg[i].msg_hdr, 0);
+		if (ret < 0)
+			return i ? (int) i : -1;
+		msg[i].msg_len = ret;
+	}
+	return i;
+}
+#endif
+
+#if HAVE_SENDMMSG
+static int udpx_sendmmsg(int sock, struct mmsghdr *msg, unsigned int cnt)
+{
+	return sendmmsg(sock, msg, cnt, 0);
+}
+#else
+static int udpx_sendmmsg(int sock, struct mmsghdr *msg, unsigned int cnt)
+{
+	unsigned int i;
+	ssize_t ret;
+
+	for (i = 0; i < cnt; i++) {
+		ret = sendmsg(sock, &msg[i].msg_hdr, 0);
+		if (ret < 0)
+			return i ? (int) i : -1;
+		msg[i].msg_len = ret;
+	}
+	return i;
+}
+#endif
+
+union udpx_gso_cmsg {
+	char			buf[CMSG_SPACE(sizeof(uint16_t))];
+	struct cmsghdr		align;
+};
+
+/*
+ * Number of the listed datagrams, starting at the first, that can be
+ * handed to the kernel as one UDP_SEGMENT send: same destination, equal
+ * sizes, with only the last one allowed to be shorter.
+ */
+static int udpx_tx_gso_cnt(struct udpx_ep *ep, const int *idx, int cnt)
+{
+	struct udpx_tx_entry *entry = &ep->tx_batch[idx[0]];
+	struct udpx_tx_entry *next;
+	size_t total = entry->len;
+	int i;
+
+	if (!ep->gso || !entry->len)
+		return 1;
+
+	for (i = 1; i < cnt; i++) {
+		next = &ep->tx_batch[idx[i]];
+		if (next->addr != entry->addr || next->len > entry->len ||
+		    total + next->len > UDPX_GSO_MAX_SIZE)
+			break;
+
+		total += next->len;
+		if (next->len < entry->len)
+			return i + 1;
+	}
+	return i;
+}
+
+static void udpx_tx_set_gso(struct msghdr *hdr, union udpx_gso_cmsg *ctrl,
+			    uint16_t seg_size)
+{
+#ifdef UDP_SEGMENT
+	struct cmsghdr *cmsg;
+
+	hdr->msg_control = ctrl->buf;
+	hdr->msg_controllen = sizeof(ctrl->buf);
+	cmsg = CMSG_FIRSTHDR(hdr);
+	cmsg->cmsg_level = IPPROTO_UDP;
+	cmsg->cmsg_type = UDP_SEGMENT;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(seg_size));
+	memcpy(CMSG_DATA(cmsg), &seg_size, sizeof(seg_size));
+#else
+	assert(0);
+#endif
+}
+
+static void udpx_tx_consume(struct udpx_ep *ep, int cnt)
+{
+	ep->tx_batch_cnt -= cnt;
+	if (ep->tx_batch_cnt) {
+		memmove(ep->tx_batch, &ep->tx_batch[cnt],
+			sizeof(*ep->tx_batch) * ep->tx_batch_cnt);
+	}
+}
+
+/*
+ * Send the queued datagrams listed in idx through sock, which is either
+ * the endpoint's socket or one connected to their common peer.  Runs of
+ * equal-sized datagrams to one peer are merged into a single segmentation
+ * offload send when the endpoint has GSO enabled.  Returns how many of
+ * the listed datagrams were completed or failed, in list order; fewer
+ * than cnt means the socket cannot take more now.
+ */
+static int udpx_tx_send_list(struct udpx_ep *ep, int sock, int connected,
+			     const int *idx, int cnt)
+{
+	struct mmsghdr msg[UDPX_MMSG_MAX];
+	struct iovec iov[UDPX_MMSG_MAX * UDPX_IOV_LIMIT];
+	union udpx_gso_cmsg ctrl[UDPX_MMSG_MAX];
+	int first[UDPX_MMSG_MAX + 1];
+	struct udpx_tx_entry *entry;
+	struct msghdr *hdr;
+	int i, j, n, nmsg, iov_cnt, done, sent, ret, err, retried;
+
+	sent = 0;
+again:
+	for (i = sent, nmsg = iov_cnt = 0; i < cnt; i += n, nmsg++) {
+		entry = &ep->tx_batch[idx[i]];
+		hdr = &msg[nmsg].msg_hdr;
+		if (connected) {
+			hdr->msg_name = NULL;
+			hdr->msg_namelen = 0;
+		} else {
+			hdr->msg_name = ip_av_get_addr(ep->util_ep.av,
+						       entry->addr);
+			hdr->msg_namelen = ep->util_ep.av->addrlen;
+		}
+		hdr->msg_control = NULL;
+		hdr->msg_controllen = 0;
+		hdr->msg_flags = 0;
+		first[nmsg] = i;
+
+		n = udpx_tx_gso_cnt(ep, &idx[i], cnt - i);
+		if (n == 1) {
+			hdr->msg_iov = entry->iov;
+			hdr->msg_iovlen = entry->iov_count;
+			continue;
+		}
+
+		hdr->msg_iov = &iov[iov_cnt];
+		for (j = i; j < i + n; j++) {
+			memcpy(&iov[iov_cnt], ep->tx_batch[idx[j]].iov,
+			       sizeof(*iov) * ep->tx_batch[idx[j]].iov_count);
+			iov_cnt += ep->tx_batch[idx[j]].iov_count;
+		}
+		hdr->msg_iovlen = &iov[iov_cnt] - hdr->msg_iov;
+		udpx_tx_set_gso(hdr, &ctrl[nmsg], entry->len);
+	}
+	first[nmsg] = cnt;
+
+	for (done = 0, retried = 0; done < nmsg; done += ret) {
+		ret = udpx_sendmmsg(sock, &msg[done], nmsg - done);
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+
+			/* unlike sendto(), a connected socket reports ICMP
+			 * errors; the failed call has consumed it */
+			if (connected && errno == ECONNREFUSED && !retried) {
+				retried = 1;
+				ret = 0;
+				continue;
+			}
+
+			if (msg[done].msg_hdr.msg_control &&
+			    (errno == EINVAL || errno == EIO ||
+			     errno == EOPNOTSUPP)) {
+				/* the route cannot segment for us */
+				FI_INFO(&udpx_prov, FI_LOG_EP_DATA,
+					"disabling UDP GSO: %s\n",
+					strerror(errno));
+				ep->gso = 0;
+				sent = first[done];
+				goto again;
+			}
+
+			/* the message at the head was refused; drop it */
+			err = errno;
+			for (i = first[done]; i < first[done + 1]; i++)
+				udpx_tx_comp_err(ep, ep->tx_batch[idx[i]].context,
+						 err);
+			ret = 1;
+			continue;
+		}
+
+		retried = 0;
+		for (i = first[done]; i < first[done + ret]; i++)
+			ep->tx_comp(ep, ep->tx_batch[idx[i]].context);
+	}
+
+	return first[done];
+}
+
+/*
+ * Send the datagrams held back by FI_MORE with as few calls as possible.
+ * With the connected-socket cache enabled the queue is split by peer, and
+ * each peer's datagrams go out through its cached socket, as single sends
+ * do; the rest share one batch on the endpoint's socket.  Whatever the
+ * sockets or the CQ cannot take now stays queued, in order, for the next
+ * send or progress call.  Called with the tx_cq lock held.
+ */
+static void udpx_tx_flush(struct udpx_ep *ep)
+{
+	int idx[UDPX_MMSG_MAX], rest[UDPX_MMSG_MAX];
+	uint8_t grouped[UDPX_MMSG_MAX], done[UDPX_MMSG_MAX];
+	struct udpx_conn *conn;
+	fi_addr_t addr;
+	int i, j, n, cnt, nrest, sent, blocked;
+
+	cnt = MIN(ep->tx_batch_cnt,
+		  (int) ofi_cirque_freecnt(ep->util_ep.tx_cq->cirq));
+	if (!cnt)
+		return;
+
+	if (!ep->conn_max) {
+		for (i = 0; i < cnt; i++)
+			idx[i] = i;
+		sent = udpx_tx_send_list(ep, ep->sock, 0, idx, cnt);
+		udpx_tx_consume(ep, sent);
+		return;
+	}
+
+	memset(grouped, 0, sizeof(grouped));
+	memset(done, 0, sizeof(done));
+	nrest = blocked = 0;
+
+	/* conn_lock keeps eviction from closing a socket we send on */
+	fastlock_acquire(&ep->conn_lock);
+	for (i = 0; i < cnt && !blocked; i++) {
+		if (grouped[i])
+			continue;
+
+		addr = ep->tx_batch[i].addr;
+		for (j = i, n = 0; j < cnt; j++) {
+			if (!grouped[j] && ep->tx_batch[j].addr == addr) {
+				grouped[j] = 1;
+				idx[n++] = j;
+			}
+		}
+
+		conn = ep->conn_max ? udpx_conn_get(ep, addr) : NULL;
+		if (!conn) {
+			memcpy(&rest[nrest], idx, sizeof(*idx) * n);
+			nrest += n;
+			continue;
+		}
+
+		sent = udpx_tx_send_list(ep, conn->sock, 1, idx, n);
+		for (j = 0; j < sent; j++)
+			done[idx[j]] = 1;
+		blocked = sent < n;
+	}
+	fastlock_release(&ep->conn_lock);
+
+	if (nrest && !blocked) {
+		/* grouped by peer, so runs to one peer can use GSO */
+		sent = udpx_tx_send_list(ep, ep->sock, 0, rest, nrest);
+		for (j = 0; j < sent; j++)
+			done[rest[j]] = 1;
+	}
+
+	for (i = j = 0; i < ep->tx_batch_cnt; i++) {
+		if (i < cnt && done[i])
+			continue;
+		if (i != j)
+			ep->tx_batch[j] = ep->tx_batch[i];
+		j++;
+	}
+	ep->tx_batch_cnt = j;
+}
+
+/*
+ * Push out sends still held back by FI_MORE when the endpoint closes.
+ * Those the socket will not take are completed with FI_ECANCELED while
+ * the CQ has room for the errors.
+ */
+static void udpx_tx_drain(struct udpx_ep *ep)
+{
+	int i, cnt;
+
+	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
+	udpx_tx_flush(ep);
+	cnt = MIN(ep->tx_batch_cnt,
+		  (int) ofi_cirque_freecnt(ep->util_ep.tx_cq->cirq));
+	for (i = 0; i < cnt; i++)
+		udpx_tx_comp_err(ep, ep->tx_batch[i].context, FI_ECANCELED);
+	if (ep->tx_batch_cnt > cnt) {
+		FI_WARN(&udpx_prov, FI_LOG_EP_DATA,
+			"dropping %d queued sends without completion\n",
+			ep->tx_batch_cnt - cnt);
+	}
+	ep->tx_batch_cnt = 0;
+	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
+}
+
+/*
+ * Queue a send behind earlier FI_MORE sends, or flush the queue ahead of
+ * one that cannot be queued.  Returns 1 if the send was queued, 0 if the
+ * caller should send it directly.  Called with the tx_cq lock held.
+ */
+static ssize_t udpx_tx_batch(struct udpx_ep *ep, const struct iovec *iov,
+			     size_t count, fi_addr_t dest_addr, void *context,
+			     uint64_t flags)
+{
+	struct udpx_tx_entry *entry;
+	int batch;
+
+	batch = !(flags & FI_INJECT) && count <= UDPX_IOV_LIMIT;
+	if (ep->tx_batch_cnt && (!batch || ep->tx_batch_cnt == UDPX_MMSG_MAX))
+		udpx_tx_flush(ep);
+
+	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq) ||
+	    (ep->tx_batch_cnt && !batch) || ep->tx_batch_cnt == UDPX_MMSG_MAX)
+		return -FI_EAGAIN;
+
+	if (!batch || !(ep->tx_batch_cnt || (flags & FI_MORE)))
+		return 0;
+
+	entry = &ep->tx_batch[ep->tx_batch_cnt++];
+	entry->context = context;
+	entry->addr = dest_addr;
+	memcpy(entry->iov, iov, sizeof(*iov) * count);
+	entry->iov_count = count;
+	entry->len = ofi_total_iov_len(iov, count);
+
+	if (!(flags & FI_MORE) || ep->tx_batch_cnt == UDPX_MMSG_MAX)
+		udpx_tx_flush(ep);
+	return 1;
+}
+
+#ifdef UDP_GRO
+/*
+ * With UDP_GRO the kernel may hand back several datagrams from one peer
+ * as a single buffer, so receive into a bounce buffer and split it over
+ * the posted receives.  Segments that do not fit in the posted receives
+ * wait in the bounce buffer for the next call.  Called with the rx_cq
+ * lock held.
+ */
+static void udpx_ep_rx_gro(struct udpx_ep *ep, int sock)
+{
+	struct udpx_ep_entry *entry;
+	struct msghdr hdr;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	union {
+		char		buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr	align;
+	} ctrl;
+	size_t len;
+	ssize_t ret;
+	int seg_size;
+
+	while (!ofi_cirque_isempty(ep->rxq) &&
+	       !ofi_cirque_isfull(ep->util_ep.rx_cq->cirq)) {
+		if (ep->gro.off == ep->gro.len) {
+			iov.iov_base = ep->gro.buf;
+			iov.iov_len = UDPX_GRO_BUF_SIZE;
+			hdr.msg_name = &ep->gro.addr;
+			hdr.msg_namelen = sizeof(ep->gro.addr);
+			hdr.msg_iov = &iov;
+			hdr.msg_iovlen = 1;
+			hdr.msg_control = ctrl.buf;
+			hdr.msg_controllen = sizeof(ctrl.buf);
+			hdr.msg_flags = 0;
+
+			ret = recvmsg(sock, &hdr, 0);
+			if (ret < 0)
+				break;
+
+			ep->gro.off = 0;
+			ep->gro.len = ret;
+			ep->gro.seg_size = ret;
+			for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg;
+			     cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+				if (cmsg->cmsg_level == IPPROTO_UDP &&
+				    cmsg->cmsg_type == UDP_GRO) {
+					memcpy(&seg_size, CMSG_DATA(cmsg),
+					       sizeof(seg_size));
+					ep->gro.seg_size = seg_size;
+				}
+			}
+		}
+
+		entry = ofi_cirque_head(ep->rxq);
+		len = MIN(ep->gro.seg_size, ep->gro.len - ep->gro.off);
+		ret = ofi_copy_to_iov(entry->iov, entry->iov_count, 0,
+				      ep->gro.buf + ep->gro.off, len);
+		ep->gro.off += len;
+		ep->rx_comp(ep, entry->context, 0, ret, NULL, &ep->gro.addr);
 		ofi_cirque_discard(ep->rxq);
 	}
-out:
+}
+#endif
+
+/*
+ * Fill as many posted receives as are waiting from sock with one call.
+ * Called with the rx_cq lock held.
+ */
+static void udpx_ep_rx_sock(struct udpx_ep *ep, int sock)
+{
+	struct udpx_ep_entry *entry;
+	struct mmsghdr msg[UDPX_MMSG_MAX];
+	struct sockaddr_in6 addr[UDPX_MMSG_MAX];
+	int i, cnt, ret;
+
+#ifdef UDP_GRO
+	if (ep->gro.buf) {
+		udpx_ep_rx_gro(ep, sock);
+		return;
+	}
+#endif
+
+	cnt = MIN(ofi_cirque_usedcnt(ep->rxq),
+		  ofi_cirque_freecnt(ep->util_ep.rx_cq->cirq));
+	cnt = MIN(cnt, UDPX_MMSG_MAX);
+	if (!cnt)
+		return;
+
+	for (i = 0; i < cnt; i++) {
+		entry = &ep->rxq->buf[(ep->rxq->rcnt + i) & ep->rxq->size_mask];
+		msg[i].msg_hdr.msg_name = &addr[i];
+		msg[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+		msg[i].msg_hdr.msg_iov = entry->iov;
+		msg[i].msg_hdr.msg_iovlen = entry->iov_count;
+		msg[i].msg_hdr.msg_control = NULL;
+		msg[i].msg_hdr.msg_controllen = 0;
+		msg[i].msg_hdr.msg_flags = 0;
+	}
+
+	ret = udpx_recvmmsg(sock, msg, cnt);
+	for (i = 0; i < ret; i++) {
+		entry = ofi_cirque_head(ep->rxq);
+		ep->rx_comp(ep, entry->context, 0, msg[i].msg_len, NULL,
+			    &addr[i]);
+		ofi_cirque_discard(ep->rxq);
+	}
+}
+
+/* Drain the connected sockets that have datagrams waiting. */
+static void udpx_ep_rx_conns(struct udpx_ep *ep)
+{
+	struct udpx_conn *conn;
+	int i;
+
+	fastlock_acquire(&ep->conn_lock);
+	for (i = 0; i < ep->conn_cnt + ep->conn_drain_cnt; i++) {
+		if (ofi_cirque_isempty(ep->rxq) ||
+		    ofi_cirque_isfull(ep->util_ep.rx_cq->cirq))
+			break;
+
+		conn = fi_epoll_wait(ep->conn_epoll, 0);
+		if (!conn)
+			break;
+		udpx_ep_rx_sock(ep, conn->sock);
+	}
+	if (ep->conn_drain_cnt)
+		udpx_conn_drain(ep);
+	fastlock_release(&ep->conn_lock);
+}
+
+static void udpx_ep_rx_progress(struct udpx_ep *ep)
+{
+	fastlock_acquire(&ep->util_ep.rx_cq->cq_lock);
+	udpx_ep_rx_sock(ep, ep->sock);
+	if (ep->conn_cnt || ep->conn_drain_cnt)
+		udpx_ep_rx_conns(ep);
 	fastlock_release(&ep->util_ep.rx_cq->cq_lock);
 }
 
+void udpx_ep_progress(struct util_ep *util_ep)
+{
+	struct udpx_ep *ep;
+
+	ep = container_of(util_ep, struct udpx_ep, util_ep);
+	if (ep->tx_batch_cnt) {
+		fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
+		udpx_tx_flush(ep);
+		fastlock_release(&ep->util_ep.tx_cq->cq_lock);
+	}
+
+	if (ep->util_ep.rx_cq)
+		udpx_ep_rx_progress(ep);
+}
+
 ssize_t udpx_recvmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 		uint64_t flags)
 {
@@ -261,18 +1067,21 @@ ssize_t udpx_send(struct fid_ep *ep_fid, const void *buf, size_t len, void *desc
 		fi_addr_t dest_addr, void *context)
 {
 	struct udpx_ep *ep;
+	struct iovec iov;
 	ssize_t ret;
 
 	ep = container_of(ep_fid, struct udpx_ep, util_ep.ep_fid.fid);
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+
 	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
-	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
-		ret = -FI_EAGAIN;
+	ret = udpx_tx_batch(ep, &iov, 1, dest_addr, context, 0);
+	if (ret) {
+		ret = ret > 0 ? 0 : ret;
 		goto out;
 	}
 
-	ret = sendto(ep->sock, buf, len, 0,
-		     ip_av_get_addr(ep->util_ep.av, dest_addr),
-		     ep->util_ep.av->addrlen);
+	ret = udpx_sendmsg_to(ep, &iov, 1, dest_addr);
 	if (ret == len) {
 		ep->tx_comp(ep, context);
 		ret = 0;
@@ -288,25 +1097,18 @@ ssize_t udpx_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 		uint64_t flags)
 {
 	struct udpx_ep *ep;
-	struct msghdr hdr;
 	ssize_t ret;
 
 	ep = container_of(ep_fid, struct udpx_ep, util_ep.ep_fid.fid);
-	hdr.msg_name = ip_av_get_addr(ep->util_ep.av, msg->addr);
-	hdr.msg_namelen = ep->util_ep.av->addrlen;
-	hdr.msg_iov = (struct iovec *) msg->msg_iov;
-	hdr.msg_iovlen = msg->iov_count;
-	hdr.msg_control = NULL;
-	hdr.msg_controllen = 0;
-	hdr.msg_flags = 0;
-
 	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
-	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
-		ret = -FI_EAGAIN;
+	ret = udpx_tx_batch(ep, msg->msg_iov, msg->iov_count, msg->addr,
+			    msg->context, flags);
+	if (ret) {
+		ret = ret > 0 ? 0 : ret;
 		goto out;
 	}
 
-	ret = sendmsg(ep->sock, &hdr, 0);
+	ret = udpx_sendmsg_to(ep, msg->msg_iov, msg->iov_count, msg->addr);
 	if (ret >= 0) {
 		ep->tx_comp(ep, msg->context);
 		ret = 0;
@@ -335,12 +1137,23 @@ ssize_t udpx_inject(struct fid_ep *ep_fid, const void *buf, size_t len,
 		fi_addr_t dest_addr)
 {
 	struct udpx_ep *ep;
+	struct iovec iov;
 	ssize_t ret;
 
 	ep = container_of(ep_fid, struct udpx_ep, util_ep.ep_fid.fid);
-	ret = sendto(ep->sock, buf, len, 0,
-		     ip_av_get_addr(ep->util_ep.av, dest_addr),
-		     ep->util_ep.av->addrlen);
+	if (ep->tx_batch_cnt) {
+		/* keep ordering with sends held back by FI_MORE */
+		fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
+		udpx_tx_flush(ep);
+		ret = ep->tx_batch_cnt ? -FI_EAGAIN : 0;
+		fastlock_release(&ep->util_ep.tx_cq->cq_lock);
+		if (ret)
+			return ret;
+	}
+
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+	ret = udpx_sendmsg_to(ep, &iov, 1, dest_addr);
 	return ret == len ? 0 : -errno;
 }
 
@@ -357,12 +1170,42 @@ static struct fi_ops_msg udpx_msg_ops = {
 	.injectdata = fi_no_msg_injectdata,
 };
 
+static struct fi_ops_msg udpx_tx_ctx_msg_ops = {
+	.size = sizeof(struct fi_ops_msg),
+	.recv = fi_no_msg_recv,
+	.recvv = fi_no_msg_recvv,
+	.recvmsg = fi_no_msg_recvmsg,
+	.send = udpx_send,
+	.sendv = udpx_sendv,
+	.sendmsg = udpx_sendmsg,
+	.inject = udpx_inject,
+	.senddata = fi_no_msg_senddata,
+	.injectdata = fi_no_msg_injectdata,
+};
+
+static struct fi_ops_msg udpx_rx_ctx_msg_ops = {
+	.size = sizeof(struct fi_ops_msg),
+	.recv = udpx_recv,
+	.recvv = udpx_recvv,
+	.recvmsg = udpx_recvmsg,
+	.send = fi_no_msg_send,
+	.sendv = fi_no_msg_sendv,
+	.sendmsg = fi_no_msg_sendmsg,
+	.inject = fi_no_msg_inject,
+	.senddata = fi_no_msg_senddata,
+	.injectdata = fi_no_msg_injectdata,
+};
+
 static int udpx_ep_close(struct fid *fid)
 {
 	struct udpx_ep *ep;
 	struct util_wait_fd *wait;
 
 	ep = container_of(fid, struct udpx_ep, util_ep.ep_fid.fid);
+	/* queued sends may still go out through the connected sockets */
+	if (ep->util_ep.tx_cq && ep->tx_batch_cnt)
+		udpx_tx_drain(ep);
+	udpx_conn_cache_close(ep);
 
 	if (ep->util_ep.rx_cq) {
 		if (ep->util_ep.rx_cq->wait) {
@@ -376,11 +1219,19 @@ static int udpx_ep_close(struct fid *fid)
 		ofi_atomic_dec32(&ep->util_ep.rx_cq->ref);
 	}
 
-	if (ep->util_ep.tx_cq)
+	if (ep->util_ep.tx_cq) {
+		fid_list_remove(&ep->util_ep.tx_cq->ep_list,
+				&ep->util_ep.tx_cq->ep_list_lock,
+				&ep->util_ep.ep_fid.fid);
 		ofi_atomic_dec32(&ep->util_ep.tx_cq->ref);
+	}
 
 	udpx_rx_cirq_free(ep->rxq);
-	ofi_close_socket(ep->sock);
+	free(ep->gro.buf);
+	if (ep->sep)
+		ofi_atomic_dec32(&ep->sep->ref);
+	else
+		ofi_close_socket(ep->sock);
 	ofi_endpoint_close(&ep->util_ep);
 	free(ep);
 	return 0;
@@ -408,6 +1259,13 @@ static int udpx_ep_bind_cq(struct udpx_ep *ep, struct util_cq *cq, uint64_t flag
 		ep->util_ep.tx_cq = cq;
 		ofi_atomic_inc32(&cq->ref);
 		ep->tx_comp = cq->wait ? udpx_tx_comp_signal : udpx_tx_comp;
+
+		/* reading the tx CQ must flush sends held back by FI_MORE */
+		ret = fid_list_insert(&cq->ep_list,
+				      &cq->ep_list_lock,
+				      &ep->util_ep.ep_fid.fid);
+		if (ret)
+			return ret;
 	}
 
 	if (flags & FI_RECV) {
@@ -471,7 +1329,7 @@ static int udpx_ep_bind(struct fid *ep_fid, struct fid *bfid, uint64_t flags)
 	return ret;
 }
 
-static void udpx_bind_src_addr(struct udpx_ep *ep)
+void udpx_bind_src_addr(struct fid *fid)
 {
 	int ret;
 	struct addrinfo ai, *rai = NULL;
@@ -489,7 +1347,7 @@ static void udpx_bind_src_addr(struct udpx_ep *ep)
 		return;
 	}
 
-	ret = udpx_setname(&ep->util_ep.ep_fid.fid, rai->ai_addr, rai->ai_addrlen);
+	ret = fi_setname(fid, rai->ai_addr, rai->ai_addrlen);
 	if (ret) {
 		FI_WARN(&udpx_prov, FI_LOG_EP_CTRL, "failed to set addr\n");
 	}
@@ -499,17 +1357,29 @@ static void udpx_bind_src_addr(struct udpx_ep *ep)
 static int udpx_ep_ctrl(struct fid *fid, int command, void *arg)
 {
 	struct udpx_ep *ep;
+	int ret;
 
 	ep = container_of(fid, struct udpx_ep, util_ep.ep_fid.fid);
 	switch (command) {
 	case FI_ENABLE:
-		if (!ep->util_ep.rx_cq || !ep->util_ep.tx_cq)
+		if ((fid->fclass != FI_CLASS_TX_CTX && !ep->util_ep.rx_cq) ||
+		    (fid->fclass != FI_CLASS_RX_CTX && !ep->util_ep.tx_cq))
 			return -FI_ENOCQ;
+
+		if (!ep->util_ep.av && ep->sep && ep->sep->av) {
+			ret = ofi_ep_bind_av(&ep->util_ep, ep->sep->av);
+			if (ret)
+				return ret;
+		}
 		if (!ep->util_ep.av)
 			return -FI_ENOAV;
 
-		if (!ep->is_bound)
-			udpx_bind_src_addr(ep);
+		if (ep->sep) {
+			if (!ep->sep->is_bound)
+				udpx_bind_src_addr(&ep->sep->ep_fid.fid);
+		} else if (!ep->is_bound) {
+			udpx_bind_src_addr(fid);
+		}
 		break;
 	default:
 		return -FI_ENOSYS;
@@ -525,6 +1395,33 @@ static struct fi_ops udpx_ep_fi_ops = {
 	.ops_open = fi_no_ops_open,
 };
 
+static void udpx_ep_init_offload(struct udpx_ep *ep)
+{
+#ifdef UDP_GRO
+	int on = 1;
+#endif
+
+#ifdef UDP_SEGMENT
+	ep->gso = udpx_gso;
+#endif
+
+#ifdef UDP_GRO
+	if (!udpx_gro || ep->util_ep.ep_fid.fid.fclass == FI_CLASS_TX_CTX)
+		return;
+
+	ep->gro.buf = malloc(UDPX_GRO_BUF_SIZE);
+	if (!ep->gro.buf)
+		return;
+
+	if (setsockopt(ep->sock, IPPROTO_UDP, UDP_GRO, &on, sizeof(on))) {
+		FI_INFO(&udpx_prov, FI_LOG_EP_CTRL,
+			"UDP GRO not available: %s\n", strerror(errno));
+		free(ep->gro.buf);
+		ep->gro.buf = NULL;
+	}
+#endif
+}
+
 static int udpx_ep_init(struct udpx_ep *ep, struct fi_info *info)
 {
 	int family;
@@ -544,19 +1441,25 @@ static int udpx_ep_init(struct udpx_ep *ep, struct fi_info *info)
 		goto err1;
 	}
 
+	ret = udpx_conn_cache_init(ep);
+	if (ret)
+		goto err2;
+
 	if (info->src_addr) {
 		ret = udpx_setname(&ep->util_ep.ep_fid.fid, info->src_addr,
 				   info->src_addrlen);
 		if (ret)
-			goto err1;
+			goto err2;
 	}
 
 	ret = fi_fd_nonblock(ep->sock);
 	if (ret)
 		goto err2;
 
+	udpx_ep_init_offload(ep);
 	return 0;
 err2:
+	udpx_conn_cache_close(ep);
 	ofi_close_socket(ep->sock);
 err1:
 	udpx_rx_cirq_free(ep->rxq);
@@ -595,3 +1498,47 @@ err:
 	free(ep);
 	return ret;
 }
+
+/* Open a tx or rx context of a scalable endpoint on one of its sockets. */
+int udpx_ctx_open(struct udpx_sep *sep, size_t fclass, int sock,
+		  size_t size, struct fid_ep **ep_fid, void *context)
+{
+	struct udpx_ep *ep;
+	int ret;
+
+	ep = calloc(1, sizeof(*ep));
+	if (!ep)
+		return -FI_ENOMEM;
+
+	ret = ofi_endpoint_init(&sep->domain->domain_fid, &udpx_util_prov,
+				sep->info, &ep->util_ep, context,
+				udpx_ep_progress);
+	if (ret)
+		goto err;
+
+	if (fclass == FI_CLASS_RX_CTX) {
+		ep->rxq = udpx_rx_cirq_create(size);
+		if (!ep->rxq) {
+			ofi_endpoint_close(&ep->util_ep);
+			ret = -FI_ENOMEM;
+			goto err;
+		}
+	}
+
+	ep->util_ep.ep_fid.fid.fclass = fclass;
+	ep->sock = sock;
+	ep->sep = sep;
+	udpx_ep_init_offload(ep);
+	ofi_atomic_inc32(&sep->ref);
+
+	*ep_fid = &ep->util_ep.ep_fid;
+	(*ep_fid)->fid.ops = &udpx_ep_fi_ops;
+	(*ep_fid)->ops = &udpx_ep_ops;
+	(*ep_fid)->cm = &udpx_cm_ops;
+	(*ep_fid)->msg = (fclass == FI_CLASS_RX_CTX) ?
+			 &udpx_rx_ctx_msg_ops : &udpx_tx_ctx_msg_ops;
+	return 0;
+err:
+	free(ep);
+	return ret;
+}
@@ -97,6 +97,10 @@ static void udpx_getinfo_ifs(struct fi_info **info)
 #define udpx_getinfo_ifs(info) do{}while(0)
 #endif
 
+int udpx_gso = 1;
+int udpx_gro = 0;
+int udpx_conn_cache_size = 0;
+
 static int udpx_getinfo(uint32_t version, const char *node, const char *service,
 			uint64_t flags, struct fi_info *hints, struct fi_info **info)
 {
@@ -121,7 +125,7 @@ static void udpx_fini(void)
 struct fi_provider udpx_prov = {
 	.name = "UDP",
 	.version = FI_VERSION(UDPX_MAJOR_VERSION, UDPX_MINOR_VERSION),
-	.fi_version = FI_VERSION(1, 3),
+	.fi_version = FI_VERSION(1, 5),
 	.getinfo = udpx_getinfo,
 	.fabric = udpx_fabric,
 	.cleanup = udpx_fini
@@ -129,5 +133,20 @@ struct fi_provider udpx_prov = {
 
 UDP_INI
 {
+	fi_param_define(&udpx_prov, "gso", FI_PARAM_BOOL,
+			"Send runs of equal-sized datagrams queued with FI_MORE "
+			"as one UDP_SEGMENT offload send (default: yes)");
+	fi_param_define(&udpx_prov, "gro", FI_PARAM_BOOL,
+			"Enable UDP_GRO receive coalescing; datagrams are "
+			"received into a bounce buffer and copied out "
+			"(default: no)");
+	fi_param_define(&udpx_prov, "conn_cache_size", FI_PARAM_INT,
+			"Number of peers per endpoint to keep a connected "
+			"socket for, so sends skip the per-call address "
+			"lookup (default: 0, disabled)");
+	fi_param_get_bool(&udpx_prov, "gso", &udpx_gso);
+	fi_param_get_bool(&udpx_prov, "gro", &udpx_gro);
+	fi_param_get_int(&udpx_prov, "conn_cache_size", &udpx_conn_cache_size);
+
 	return &udpx_prov;
 }
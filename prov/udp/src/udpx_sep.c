@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2017 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "udpx.h"
+
+
+static int udpx_sep_setname(fid_t fid, void *addr, size_t addrlen)
+{
+	struct udpx_sep *sep;
+	struct sockaddr_storage bound;
+	socklen_t len;
+	int i, ret;
+
+	sep = container_of(fid, struct udpx_sep, ep_fid.fid);
+	FI_DBG(&udpx_prov, FI_LOG_EP_CTRL, "%s\n", ofi_hex_str(addr, addrlen));
+	ret = bind(sep->sock[0], addr, addrlen);
+	if (ret)
+		goto err;
+
+	/* the rest of the group joins whatever port the first one got */
+	len = sizeof(bound);
+	ret = getsockname(sep->sock[0], (struct sockaddr *) &bound, &len);
+	if (ret)
+		goto err;
+
+	for (i = 1; i < sep->sock_cnt; i++) {
+		ret = bind(sep->sock[i], (struct sockaddr *) &bound, len);
+		if (ret)
+			goto err;
+	}
+	sep->is_bound = 1;
+	return 0;
+err:
+	FI_WARN(&udpx_prov, FI_LOG_EP_CTRL, "bind %d (%s)\n",
+		errno, strerror(errno));
+	return -errno;
+}
+
+static int udpx_sep_getname(fid_t fid, void *addr, size_t *addrlen)
+{
+	struct udpx_sep *sep;
+	socklen_t len;
+	int ret;
+
+	sep = container_of(fid, struct udpx_sep, ep_fid.fid);
+	len = *addrlen;
+	ret = getsockname(sep->sock[0], addr, &len);
+	*addrlen = len;
+	return ret ? -errno : 0;
+}
+
+static struct fi_ops_cm udpx_sep_cm_ops = {
+	.size = sizeof(struct fi_ops_cm),
+	.setname = udpx_sep_setname,
+	.getname = udpx_sep_getname,
+	.getpeer = fi_no_getpeer,
+	.connect = fi_no_connect,
+	.listen = fi_no_listen,
+	.accept = fi_no_accept,
+	.reject = fi_no_reject,
+	.shutdown = fi_no_shutdown,
+	.join = fi_no_join,
+};
+
+static int udpx_sep_tx_ctx(struct fid_ep *sep_fid, int index,
+			   struct fi_tx_attr *attr, struct fid_ep **tx_ep,
+			   void *context)
+{
+	struct udpx_sep *sep;
+
+	sep = container_of(sep_fid, struct udpx_sep, ep_fid);
+	if (index < 0 || (size_t) index >= sep->info->ep_attr->tx_ctx_cnt)
+		return -FI_EINVAL;
+
+	return udpx_ctx_open(sep, FI_CLASS_TX_CTX,
+			     sep->sock[index % sep->sock_cnt], 0, tx_ep,
+			     context);
+}
+
+static int udpx_sep_rx_ctx(struct fid_ep *sep_fid, int index,
+			   struct fi_rx_attr *attr, struct fid_ep **rx_ep,
+			   void *context)
+{
+	struct udpx_sep *sep;
+
+	sep = container_of(sep_fid, struct udpx_sep, ep_fid);
+	if (index < 0 || index >= sep->sock_cnt)
+		return -FI_EINVAL;
+
+	return udpx_ctx_open(sep, FI_CLASS_RX_CTX, sep->sock[index],
+			     attr ? attr->size : sep->info->rx_attr->size,
+			     rx_ep, context);
+}
+
+static struct fi_ops_ep udpx_sep_ops = {
+	.size = sizeof(struct fi_ops_ep),
+	.cancel = fi_no_cancel,
+	.getopt = fi_no_getopt,
+	.setopt = fi_no_setopt,
+	.tx_ctx = udpx_sep_tx_ctx,
+	.rx_ctx = udpx_sep_rx_ctx,
+	.rx_size_left = fi_no_rx_size_left,
+	.tx_size_left = fi_no_tx_size_left,
+};
+
+static int udpx_sep_close(struct fid *fid)
+{
+	struct udpx_sep *sep;
+	int i;
+
+	sep = container_of(fid, struct udpx_sep, ep_fid.fid);
+	if (ofi_atomic_get32(&sep->ref))
+		return -FI_EBUSY;
+
+	if (sep->av)
+		ofi_atomic_dec32(&sep->av->ref);
+
+	for (i = 0; i < sep->sock_cnt; i++)
+		ofi_close_socket(sep->sock[i]);
+	ofi_atomic_dec32(&sep->domain->ref);
+	fi_freeinfo(sep->info);
+	free(sep);
+	return 0;
+}
+
+static int udpx_sep_bind(struct fid *fid, struct fid *bfid, uint64_t flags)
+{
+	struct udpx_sep *sep;
+	int ret;
+
+	ret = ofi_ep_bind_valid(&udpx_prov, bfid, flags);
+	if (ret)
+		return ret;
+
+	sep = container_of(fid, struct udpx_sep, ep_fid.fid);
+	switch (bfid->fclass) {
+	case FI_CLASS_AV:
+		if (sep->av) {
+			FI_WARN(&udpx_prov, FI_LOG_EP_CTRL,
+				"duplicate AV binding\n");
+			return -FI_EINVAL;
+		}
+		sep->av = container_of(bfid, struct util_av, av_fid.fid);
+		ofi_atomic_inc32(&sep->av->ref);
+		break;
+	case FI_CLASS_EQ:
+		break;
+	default:
+		FI_WARN(&udpx_prov, FI_LOG_EP_CTRL,
+			"CQs must be bound to the tx/rx contexts\n");
+		return -FI_EINVAL;
+	}
+	return 0;
+}
+
+static int udpx_sep_ctrl(struct fid *fid, int command, void *arg)
+{
+	struct udpx_sep *sep;
+
+	sep = container_of(fid, struct udpx_sep, ep_fid.fid);
+	switch (command) {
+	case FI_ENABLE:
+		if (!sep->av)
+			return -FI_ENOAV;
+
+		if (!sep->is_bound)
+			udpx_bind_src_addr(fid);
+		break;
+	default:
+		return -FI_ENOSYS;
+	}
+	return 0;
+}
+
+static struct fi_ops udpx_sep_fi_ops = {
+	.size = sizeof(struct fi_ops),
+	.close = udpx_sep_close,
+	.bind = udpx_sep_bind,
+	.control = udpx_sep_ctrl,
+	.ops_open = fi_no_ops_open,
+};
+
+static int udpx_sep_init(struct udpx_sep *sep, struct fi_info *info)
+{
+	int family, i, ret;
+#ifdef SO_REUSEPORT
+	int on = 1;
+#endif
+
+	family = info->src_addr ?
+		 ((struct sockaddr *) info->src_addr)->sa_family : AF_INET;
+	for (i = 0; i < sep->sock_cnt; i++) {
+		sep->sock[i] = socket(family, SOCK_DGRAM, IPPROTO_UDP);
+		if (sep->sock[i] < 0) {
+			ret = -errno;
+			goto err;
+		}
+
+#ifdef SO_REUSEPORT
+		if (setsockopt(sep->sock[i], SOL_SOCKET, SO_REUSEPORT,
+			       &on, sizeof(on))) {
+			ret = -errno;
+			ofi_close_socket(sep->sock[i]);
+			goto err;
+		}
+#endif
+
+		ret = fi_fd_nonblock(sep->sock[i]);
+		if (ret) {
+			ofi_close_socket(sep->sock[i]);
+			goto err;
+		}
+	}
+
+	if (info->src_addr) {
+		ret = udpx_sep_setname(&sep->ep_fid.fid, info->src_addr,
+				       info->src_addrlen);
+		if (ret)
+			goto err;
+	}
+	return 0;
+err:
+	while (i--)
+		ofi_close_socket(sep->sock[i]);
+	return ret;
+}
+
+int udpx_scalable_ep(struct fid_domain *domain, struct fi_info *info,
+		     struct fid_ep **sep_fid, void *context)
+{
+	struct util_domain *util_domain;
+	struct udpx_sep *sep;
+	int ret;
+
+	util_domain = container_of(domain, struct util_domain, domain_fid);
+	if (!info || !info->ep_attr || !info->rx_attr || !info->tx_attr)
+		return -FI_EINVAL;
+
+	ret = ofi_check_info(&udpx_util_prov,
+			     util_domain->fabric->fabric_fid.api_version, info);
+	if (ret)
+		return ret;
+
+#ifndef SO_REUSEPORT
+	if (info->ep_attr->rx_ctx_cnt > 1)
+		return -FI_ENOSYS;
+#endif
+
+	sep = calloc(1, sizeof(*sep));
+	if (!sep)
+		return -FI_ENOMEM;
+
+	sep->info = fi_dupinfo(info);
+	if (!sep->info) {
+		ret = -FI_ENOMEM;
+		goto err;
+	}
+
+	sep->sock_cnt = MAX(info->ep_attr->rx_ctx_cnt, 1);
+	ret = udpx_sep_init(sep, info);
+	if (ret)
+		goto err;
+
+	sep->domain = util_domain;
+	ofi_atomic_initialize32(&sep->ref, 0);
+	ofi_atomic_inc32(&util_domain->ref);
+
+	sep->ep_fid.fid.fclass = FI_CLASS_SEP;
+	sep->ep_fid.fid.context = context;
+	sep->ep_fid.fid.ops = &udpx_sep_fi_ops;
+	sep->ep_fid.ops = &udpx_sep_ops;
+	sep->ep_fid.cm = &udpx_sep_cm_ops;
+	*sep_fid = &sep->ep_fid;
+	return 0;
+err:
+	fi_freeinfo(sep->info);
+	free(sep);
+	return ret;
+}
@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2017 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <fi_osd.h>
+#include <fi_atomic_ops.h>
+
+/*
+ * Handlers are generated per (op, datatype) from the element expressions
+ * below.  The loops are kept branch-free where the operation allows, so
+ * the compiler can vectorize them for array operands.  GCC only enables
+ * the loop vectorizer by default at -O3; Makefile.am builds this file
+ * with -ftree-vectorize where the compiler accepts it.
+ */
+
+typedef long double long_double;
+typedef OFI_COMPLEX(float) float_complex;
+typedef OFI_COMPLEX(double) double_complex;
+typedef OFI_COMPLEX(long_double) long_double_complex;
+
+#define OFI_OP_MIN(name, dst, src)	((src) < (dst) ? (src) : (dst))
+#define OFI_OP_MAX(name, dst, src)	((src) > (dst) ? (src) : (dst))
+#define OFI_OP_SUM(name, dst, src)	((dst) + (src))
+#define OFI_OP_PROD(name, dst, src)	((dst) * (src))
+#define OFI_OP_LOR(name, dst, src)	((dst) || (src))
+#define OFI_OP_LAND(name, dst, src)	((dst) && (src))
+#define OFI_OP_BOR(name, dst, src)	((dst) | (src))
+#define OFI_OP_BAND(name, dst, src)	((dst) & (src))
+#define OFI_OP_LXOR(name, dst, src)	(((dst) && !(src)) || (!(dst) && (src)))
+#define OFI_OP_BXOR(name, dst, src)	((dst) ^ (src))
+#define OFI_OP_WRITE(name, dst, src)	(src)
+
+#define OFI_OP_SUM_COMPLEX(name, dst, src)	OFI_COMPLEX_OP(name, sum)(dst, src)
+#define OFI_OP_PROD_COMPLEX(name, dst, src)	OFI_COMPLEX_OP(name, mul)(dst, src)
+#define OFI_OP_LOR_COMPLEX(name, dst, src)	OFI_COMPLEX_OP(name, lor)(dst, src)
+#define OFI_OP_LAND_COMPLEX(name, dst, src)	OFI_COMPLEX_OP(name, land)(dst, src)
+#define OFI_OP_WRITE_COMPLEX(name, dst, src)	(src)
+
+#define OFI_CMP_CSWAP(name, cmp, dst)		((cmp) == (dst))
+#define OFI_CMP_CSWAP_NE(name, cmp, dst)	((cmp) != (dst))
+#define OFI_CMP_CSWAP_LE(name, cmp, dst)	((cmp) <= (dst))
+#define OFI_CMP_CSWAP_LT(name, cmp, dst)	((cmp) < (dst))
+#define OFI_CMP_CSWAP_GE(name, cmp, dst)	((cmp) >= (dst))
+#define OFI_CMP_CSWAP_GT(name, cmp, dst)	((cmp) > (dst))
+
+#define OFI_CMP_CSWAP_COMPLEX(name, cmp, dst)			\
+	OFI_COMPLEX_OP(name, equ)(cmp, dst)
+#define OFI_CMP_CSWAP_NE_COMPLEX(name, cmp, dst)		\
+	(!OFI_COMPLEX_OP(name, equ)(cmp, dst))
+
+/*
+ * Function generators.  type is the C type, name the base name used by
+ * the complex helpers in fi_osd.h.
+ */
+#define OFI_DEF_WRITE_FUNC(op, expr, type, name)			\
+static void ofi_write_##op##_##type(void *dst, const void *src,	\
+				   size_t cnt)				\
+{									\
+	type *d = dst;							\
+	const type *s = src;						\
+	size_t i;							\
+									\
+	for (i = 0; i < cnt; i++)					\
+		d[i] = expr(name, d[i], s[i]);				\
+}
+
+#define OFI_DEF_READWRITE_FUNC(op, expr, type, name)			\
+static void ofi_readwrite_##op##_##type(void *dst, const void *src,	\
+				       void *res, size_t cnt)		\
+{									\
+	type *d = dst, *r = res;					\
+	const type *s = src;						\
+	size_t i;							\
+									\
+	for (i = 0; i < cnt; i++) {					\
+		r[i] = d[i];						\
+		d[i] = expr(name, d[i], s[i]);				\
+	}								\
+}
+
+#define OFI_DEF_READ_FUNC(op, expr, type, name)				\
+static void ofi_readwrite_##op##_##type(void *dst, const void *src,	\
+				       void *res, size_t cnt)		\
+{									\
+	type *d = dst, *r = res;					\
+	size_t i;							\
+									\
+	for (i = 0; i < cnt; i++)					\
+		r[i] = d[i];						\
+}
+
+/* cmp and res may alias, so cmp[i] is consumed before res[i] is written */
+#define OFI_DEF_SWAP_FUNC(op, expr, type, name)				\
+static void ofi_swap_##op##_##type(void *dst, const void *src,		\
+				  const void *cmp, void *res,		\
+				  size_t cnt)				\
+{									\
+	type *d = dst, *r = res, tmp;					\
+	const type *s = src, *c = cmp;					\
+	size_t i;							\
+									\
+	for (i = 0; i < cnt; i++) {					\
+		tmp = d[i];						\
+		if (expr(name, c[i], tmp))				\
+			d[i] = s[i];					\
+		r[i] = tmp;						\
+	}								\
+}
+
+#define OFI_DEF_MSWAP_FUNC(op, expr, type, name)			\
+static void ofi_swap_##op##_##type(void *dst, const void *src,		\
+				  const void *cmp, void *res,		\
+				  size_t cnt)				\
+{									\
+	type *d = dst, *r = res, tmp;					\
+	const type *s = src, *c = cmp;					\
+	size_t i;							\
+									\
+	for (i = 0; i < cnt; i++) {					\
+		tmp = d[i];						\
+		d[i] = (s[i] & c[i]) | (tmp & ~c[i]);			\
+		r[i] = tmp;						\
+	}								\
+}
+
+/* Instantiate a generator for each class of datatype */
+#define OFI_DEF_INT(gen, op, expr)		\
+	gen(op, expr, int8_t, int8_t)		\
+	gen(op, expr, uint8_t, uint8_t)		\
+	gen(op, expr, int16_t, int16_t)		\
+	gen(op, expr, uint16_t, uint16_t)	\
+	gen(op, expr, int32_t, int32_t)		\
+	gen(op, expr, uint32_t, uint32_t)	\
+	gen(op, expr, int64_t, int64_t)		\
+	gen(op, expr, uint64_t, uint64_t)
+
+#define OFI_DEF_REAL(gen, op, expr)		\
+	OFI_DEF_INT(gen, op, expr)		\
+	gen(op, expr, float, float)		\
+	gen(op, expr, double, double)		\
+	gen(op, expr, long_double, long_double)
+
+#define OFI_DEF_COMPLEX(gen, op, expr)				\
+	gen(op, expr, float_complex, float)			\
+	gen(op, expr, double_complex, double)			\
+	gen(op, expr, long_double_complex, long_double)
+
+#define OFI_DEF_ALL(gen, op, expr)		\
+	OFI_DEF_REAL(gen, op, expr)		\
+	OFI_DEF_COMPLEX(gen, op, expr##_COMPLEX)
+
+/* Table rows, in enum fi_datatype order */
+#define OFI_TBL_INT(prefix, op)						\
+	{ prefix##op##_int8_t, prefix##op##_uint8_t,			\
+	  prefix##op##_int16_t, prefix##op##_uint16_t,			\
+	  prefix##op##_int32_t, prefix##op##_uint32_t,			\
+	  prefix##op##_int64_t, prefix##op##_uint64_t,			\
+	  NULL, NULL, NULL, NULL, NULL, NULL }
+
+#define OFI_TBL_REAL(prefix, op)					\
+	{ prefix##op##_int8_t, prefix##op##_uint8_t,			\
+	  prefix##op##_int16_t, prefix##op##_uint16_t,			\
+	  prefix##op##_int32_t, prefix##op##_uint32_t,			\
+	  prefix##op##_int64_t, prefix##op##_uint64_t,			\
+	  prefix##op##_float, prefix##op##_double,			\
+	  NULL, NULL,							\
+	  prefix##op##_long_double, NULL }
+
+#define OFI_TBL_ALL(prefix, op)						\
+	{ prefix##op##_int8_t, prefix##op##_uint8_t,			\
+	  prefix##op##_int16_t, prefix##op##_uint16_t,			\
+	  prefix##op##_int32_t, prefix##op##_uint32_t,			\
+	  prefix##op##_int64_t, prefix##op##_uint64_t,			\
+	  prefix##op##_float, prefix##op##_double,			\
+	  prefix##op##_float_complex, prefix##op##_double_complex,	\
+	  prefix##op##_long_double, prefix##op##_long_double_complex }
+
+#define OFI_TBL_NONE							\
+	{ NULL, NULL, NULL, NULL, NULL, NULL, NULL,			\
+	  NULL, NULL, NULL, NULL, NULL, NULL, NULL }
+
+/* write */
+OFI_DEF_REAL(OFI_DEF_WRITE_FUNC, MIN, OFI_OP_MIN)
+OFI_DEF_REAL(OFI_DEF_WRITE_FUNC, MAX, OFI_OP_MAX)
+OFI_DEF_ALL(OFI_DEF_WRITE_FUNC, SUM, OFI_OP_SUM)
+OFI_DEF_ALL(OFI_DEF_WRITE_FUNC, PROD, OFI_OP_PROD)
+OFI_DEF_ALL(OFI_DEF_WRITE_FUNC, LOR, OFI_OP_LOR)
+OFI_DEF_ALL(OFI_DEF_WRITE_FUNC, LAND, OFI_OP_LAND)
+OFI_DEF_INT(OFI_DEF_WRITE_FUNC, BOR, OFI_OP_BOR)
+OFI_DEF_INT(OFI_DEF_WRITE_FUNC, BAND, OFI_OP_BAND)
+OFI_DEF_INT(OFI_DEF_WRITE_FUNC, LXOR, OFI_OP_LXOR)
+OFI_DEF_INT(OFI_DEF_WRITE_FUNC, BXOR, OFI_OP_BXOR)
+OFI_DEF_ALL(OFI_DEF_WRITE_FUNC, WRITE, OFI_OP_WRITE)
+
+ofi_atomic_write_func
+ofi_atomic_write_handlers[OFI_WRITE_OP_LAST][FI_DATATYPE_LAST] = {
+	OFI_TBL_REAL(ofi_write_, MIN),
+	OFI_TBL_REAL(ofi_write_, MAX),
+	OFI_TBL_ALL(ofi_write_, SUM),
+	OFI_TBL_ALL(ofi_write_, PROD),
+	OFI_TBL_ALL(ofi_write_, LOR),
+	OFI_TBL_ALL(ofi_write_, LAND),
+	OFI_TBL_INT(ofi_write_, BOR),
+	OFI_TBL_INT(ofi_write_, BAND),
+	OFI_TBL_INT(ofi_write_, LXOR),
+	OFI_TBL_INT(ofi_write_, BXOR),
+	OFI_TBL_NONE,			/* FI_ATOMIC_READ */
+	OFI_TBL_ALL(ofi_write_, WRITE),
+};
+
+/* readwrite */
+OFI_DEF_REAL(OFI_DEF_READWRITE_FUNC, MIN, OFI_OP_MIN)
+OFI_DEF_REAL(OFI_DEF_READWRITE_FUNC, MAX, OFI_OP_MAX)
+OFI_DEF_ALL(OFI_DEF_READWRITE_FUNC, SUM, OFI_OP_SUM)
+OFI_DEF_ALL(OFI_DEF_READWRITE_FUNC, PROD, OFI_OP_PROD)
+OFI_DEF_ALL(OFI_DEF_READWRITE_FUNC, LOR, OFI_OP_LOR)
+OFI_DEF_ALL(OFI_DEF_READWRITE_FUNC, LAND, OFI_OP_LAND)
+OFI_DEF_INT(OFI_DEF_READWRITE_FUNC, BOR, OFI_OP_BOR)
+OFI_DEF_INT(OFI_DEF_READWRITE_FUNC, BAND, OFI_OP_BAND)
+OFI_DEF_INT(OFI_DEF_READWRITE_FUNC, LXOR, OFI_OP_LXOR)
+OFI_DEF_INT(OFI_DEF_READWRITE_FUNC, BXOR, OFI_OP_BXOR)
+OFI_DEF_ALL(OFI_DEF_READ_FUNC, READ, OFI_OP_WRITE)
+OFI_DEF_ALL(OFI_DEF_READWRITE_FUNC, WRITE, OFI_OP_WRITE)
+
+ofi_atomic_readwrite_func
+ofi_atomic_readwrite_handlers[OFI_READWRITE_OP_LAST][FI_DATATYPE_LAST] = {
+	OFI_TBL_REAL(ofi_readwrite_, MIN),
+	OFI_TBL_REAL(ofi_readwrite_, MAX),
+	OFI_TBL_ALL(ofi_readwrite_, SUM),
+	OFI_TBL_ALL(ofi_readwrite_, PROD),
+	OFI_TBL_ALL(ofi_readwrite_, LOR),
+	OFI_TBL_ALL(ofi_readwrite_, LAND),
+	OFI_TBL_INT(ofi_readwrite_, BOR),
+	OFI_TBL_INT(ofi_readwrite_, BAND),
+	OFI_TBL_INT(ofi_readwrite_, LXOR),
+	OFI_TBL_INT(ofi_readwrite_, BXOR),
+	OFI_TBL_ALL(ofi_readwrite_, READ),
+	OFI_TBL_ALL(ofi_readwrite_, WRITE),
+};
+
+/* swap */
+OFI_DEF_ALL(OFI_DEF_SWAP_FUNC, CSWAP, OFI_CMP_CSWAP)
+OFI_DEF_ALL(OFI_DEF_SWAP_FUNC, CSWAP_NE, OFI_CMP_CSWAP_NE)
+OFI_DEF_REAL(OFI_DEF_SWAP_FUNC, CSWAP_LE, OFI_CMP_CSWAP_LE)
+OFI_DEF_REAL(OFI_DEF_SWAP_FUNC, CSWAP_LT, OFI_CMP_CSWAP_LT)
+OFI_DEF_REAL(OFI_DEF_SWAP_FUNC, CSWAP_GE, OFI_CMP_CSWAP_GE)
+OFI_DEF_REAL(OFI_DEF_SWAP_FUNC, CSWAP_GT, OFI_CMP_CSWAP_GT)
+OFI_DEF_INT(OFI_DEF_MSWAP_FUNC, MSWAP, NULL)
+
+ofi_atomic_swap_func
+ofi_atomic_swap_handlers[OFI_SWAP_OP_LAST][FI_DATATYPE_LAST] = {
+	OFI_TBL_ALL(ofi_swap_, CSWAP),
+	OFI_TBL_ALL(ofi_swap_, CSWAP_NE),
+	OFI_TBL_REAL(ofi_swap_, CSWAP_LE),
+	OFI_TBL_REAL(ofi_swap_, CSWAP_LT),
+	OFI_TBL_REAL(ofi_swap_, CSWAP_GE),
+	OFI_TBL_REAL(ofi_swap_, CSWAP_GT),
+	OFI_TBL_INT(ofi_swap_, MSWAP),
+};
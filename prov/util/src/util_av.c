@@ -49,6 +49,7 @@
 #endif
 
 #include <fi_util.h>
+#include "fasthash.h"
 
 
 enum {
@@ -572,32 +573,33 @@ int ofi_av_init(struct util_domain *domain, const struct fi_av_attr *attr,
 
 static int ip_av_slot(struct util_av *av, const struct sockaddr *sa)
 {
-	uint32_t host;
-	uint16_t port;
+	const struct sockaddr_in6 *sin6;
+	uint64_t key;
 
 	if (!sa)
 		return UTIL_NO_ENTRY;
 
+	/* The slot count is a power of two, so hash all of the address:
+	 * peers commonly share a port and differ only in their hosts. */
 	switch (((struct sockaddr *) sa)->sa_family) {
 	case AF_INET:
-		host = (uint16_t) ntohl(((struct sockaddr_in *) sa)->
-					sin_addr.s_addr);
-		port = ntohs(((struct sockaddr_in *) sa)->sin_port);
+		key = ((uint64_t) ((struct sockaddr_in *) sa)->sin_addr.s_addr
+		       << 16) | ((struct sockaddr_in *) sa)->sin_port;
+		key = fasthash64(&key, sizeof(key), 0);
 		break;
 	case AF_INET6:
-		host = (uint16_t) ((struct sockaddr_in6 *) sa)->
-					sin6_addr.s6_addr[15];
-		port = ntohs(((struct sockaddr_in6 *) sa)->sin6_port);
+		sin6 = (const struct sockaddr_in6 *) sa;
+		key = fasthash64(&sin6->sin6_addr, sizeof(sin6->sin6_addr),
+				 sin6->sin6_port);
 		break;
 	default:
 		assert(0);
 		return UTIL_NO_ENTRY;
 	}
 
-	/* TODO: Find a good hash function */
 	FI_DBG(av->prov, FI_LOG_AV, "slot %d\n",
-		((host << 16) | port) % av->hash.slots);
-	return ((host << 16) | port) % av->hash.slots;
+	       (int) (key % av->hash.slots));
+	return (int) (key % av->hash.slots);
 }
 
 int ip_av_get_index(struct util_av *av, const void *addr)
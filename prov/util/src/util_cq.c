@@ -162,7 +162,7 @@ ssize_t ofi_cq_readfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 		i = ofi_cq_read(cq_fid, buf, count);
 		if (i > 0) {
 			for (count = 0; count < (size_t)i; count++)
-				src_addr[i] = FI_ADDR_NOTAVAIL;
+				src_addr[count] = FI_ADDR_NOTAVAIL;
 		}
 		return i;
 	}
@@ -295,6 +295,14 @@ int ofi_cq_cleanup(struct util_cq *cq)
 	if (ofi_atomic_get32(&cq->ref))
 		return -FI_EBUSY;
 
+	/* leave the wait set first, so no waiting thread reads the CQ */
+	if (cq->wait) {
+		fi_poll_del(&cq->wait->pollset->poll_fid,
+			    &cq->cq_fid.fid, 0);
+		if (cq->internal_wait)
+			fi_close(&cq->wait->wait_fid.fid);
+	}
+
 	fastlock_destroy(&cq->cq_lock);
 	fastlock_destroy(&cq->ep_list_lock);
 
@@ -304,13 +312,6 @@ int ofi_cq_cleanup(struct util_cq *cq)
 		free(err);
 	}
 
-	if (cq->wait) {
-		fi_poll_del(&cq->wait->pollset->poll_fid,
-			    &cq->cq_fid.fid, 0);
-		if (cq->internal_wait)
-			fi_close(&cq->wait->wait_fid.fid);
-	}
-
 	ofi_atomic_dec32(&cq->domain->ref);
 	util_comp_cirq_free(cq->cirq);
 	free(cq->src);
@@ -441,34 +442,33 @@ int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
 	if (ret)
 		return ret;
 
-	/* CQ must be fully operational before adding to wait set */
-	if (cq->wait) {
-		ret = fi_poll_add(&cq->wait->pollset->poll_fid,
-				  &cq->cq_fid.fid, 0);
-		if (ret) {
-			ofi_cq_cleanup(cq);
-			return ret;
-		}
-	}
-
 	cq->cirq = util_comp_cirq_create(attr->size == 0 ? UTIL_DEF_CQ_SIZE : attr->size);
 	if (!cq->cirq) {
 		ret = -FI_ENOMEM;
-		goto err1;
+		goto err;
 	}
 
 	if (cq->domain->info_domain_caps & FI_SOURCE) {
 		cq->src = calloc(cq->cirq->size, sizeof *cq->src);
 		if (!cq->src) {
 			ret = -FI_ENOMEM;
-			goto err2;
+			goto err;
 		}
 	}
+
+	/*
+	 * CQ must be fully operational before adding to wait set: a thread
+	 * already waiting on the set may read it at once.
+	 */
+	if (cq->wait) {
+		ret = fi_poll_add(&cq->wait->pollset->poll_fid,
+				  &cq->cq_fid.fid, 0);
+		if (ret)
+			goto err;
+	}
 	return 0;
 
-err2:
-	util_comp_cirq_free(cq->cirq);
-err1:
+err:
 	ofi_cq_cleanup(cq);
 	return ret;
 }
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2017 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <inttypes.h>
+
+#include <fi_util.h>
+#include <rbtree.h>
+
+
+/* Overlapping regions compare equal; cached regions never overlap */
+static int ofi_mr_cache_compare(void *key1, void *key2)
+{
+	struct iovec *iov1 = key1, *iov2 = key2;
+	uintptr_t start1 = (uintptr_t) iov1->iov_base;
+	uintptr_t start2 = (uintptr_t) iov2->iov_base;
+
+	if (start1 + iov1->iov_len <= start2)
+		return -1;
+	if (start1 >= start2 + iov2->iov_len)
+		return 1;
+	return 0;
+}
+
+static int ofi_mr_cache_covers(struct ofi_mr_entry *entry,
+			       const struct iovec *iov)
+{
+	return ((uintptr_t) iov->iov_base >= (uintptr_t) entry->iov.iov_base) &&
+	       ((uintptr_t) iov->iov_base + iov->iov_len <=
+		(uintptr_t) entry->iov.iov_base + entry->iov.iov_len);
+}
+
+static void ofi_mr_cache_free(struct ofi_mr_cache *cache,
+			      struct ofi_mr_entry *entry)
+{
+	cache->delete_region(cache, entry);
+	free(entry);
+}
+
+static void ofi_mr_cache_evict(struct ofi_mr_cache *cache,
+			       struct ofi_mr_entry *entry)
+{
+	RbtIterator iter;
+
+	assert(!entry->use_cnt);
+	iter = rbtFind(cache->rbtree, &entry->iov);
+	assert(iter);
+	rbtErase(cache->rbtree, iter);
+	dlist_remove(&entry->lru_entry);
+	cache->cached_cnt--;
+	cache->cached_size -= entry->iov.iov_len;
+	ofi_mr_cache_free(cache, entry);
+}
+
+static int ofi_mr_cache_full(struct ofi_mr_cache *cache, size_t len)
+{
+	return (cache->cached_cnt >= cache->max_cached_cnt) ||
+	       (cache->cached_size + len > cache->max_cached_size);
+}
+
+static int ofi_mr_cache_register(struct ofi_mr_cache *cache,
+				 const struct iovec *iov, int cacheable,
+				 struct ofi_mr_entry **entry)
+{
+	struct ofi_mr_entry *item;
+	int ret;
+
+	item = calloc(1, sizeof(*item));
+	if (!item)
+		return -FI_ENOMEM;
+
+	item->iov = *iov;
+	item->use_cnt = 1;
+
+	if (cacheable && iov->iov_len) {
+		while (ofi_mr_cache_full(cache, iov->iov_len) &&
+		       !dlist_empty(&cache->lru_list)) {
+			ofi_mr_cache_evict(cache, container_of(cache->lru_list.next,
+					   struct ofi_mr_entry, lru_entry));
+		}
+		item->cached = !ofi_mr_cache_full(cache, iov->iov_len);
+	}
+
+	ret = cache->add_region(cache, item);
+	if (ret) {
+		free(item);
+		return ret;
+	}
+
+	if (item->cached) {
+		if (rbtInsert(cache->rbtree, &item->iov, item) == RBT_STATUS_OK) {
+			cache->cached_cnt++;
+			cache->cached_size += iov->iov_len;
+		} else {
+			item->cached = 0;
+		}
+	}
+
+	*entry = item;
+	return 0;
+}
+
+int ofi_mr_cache_search(struct ofi_mr_cache *cache, const struct iovec *iov,
+			struct ofi_mr_entry **entry)
+{
+	struct ofi_mr_entry *item;
+	RbtIterator iter;
+	void *key;
+	int ret;
+
+	fastlock_acquire(&cache->lock);
+	cache->search_cnt++;
+
+	while ((iter = rbtFind(cache->rbtree, (void *) iov))) {
+		rbtKeyValue(cache->rbtree, iter, &key, (void **) &item);
+		if (ofi_mr_cache_covers(item, iov)) {
+			if (!item->use_cnt++)
+				dlist_remove(&item->lru_entry);
+			cache->hit_cnt++;
+			*entry = item;
+			fastlock_release(&cache->lock);
+			return 0;
+		}
+
+		/* an overlapping region in use stays; register beside it */
+		if (item->use_cnt)
+			break;
+		ofi_mr_cache_evict(cache, item);
+	}
+
+	ret = ofi_mr_cache_register(cache, iov, !iter, entry);
+	fastlock_release(&cache->lock);
+	return ret;
+}
+
+void ofi_mr_cache_delete(struct ofi_mr_cache *cache,
+			 struct ofi_mr_entry *entry)
+{
+	fastlock_acquire(&cache->lock);
+	assert(entry->use_cnt);
+	if (!--entry->use_cnt) {
+		if (entry->cached)
+			dlist_insert_tail(&entry->lru_entry, &cache->lru_list);
+		else
+			ofi_mr_cache_free(cache, entry);
+	}
+	fastlock_release(&cache->lock);
+}
+
+int ofi_mr_cache_init(struct ofi_mr_cache *cache)
+{
+	assert(cache->add_region && cache->delete_region);
+
+	cache->rbtree = rbtNew(ofi_mr_cache_compare);
+	if (!cache->rbtree)
+		return -FI_ENOMEM;
+
+	fastlock_init(&cache->lock);
+	dlist_init(&cache->lru_list);
+	cache->cached_cnt = 0;
+	cache->cached_size = 0;
+	cache->search_cnt = 0;
+	cache->hit_cnt = 0;
+	return 0;
+}
+
+void ofi_mr_cache_cleanup(struct ofi_mr_cache *cache)
+{
+	FI_INFO(cache->prov, FI_LOG_MR, "MR cache searches %" PRIu64
+		", hits %" PRIu64 "\n", cache->search_cnt, cache->hit_cnt);
+
+	while (!dlist_empty(&cache->lru_list)) {
+		ofi_mr_cache_evict(cache, container_of(cache->lru_list.next,
+				   struct ofi_mr_entry, lru_entry));
+	}
+	if (cache->cached_cnt)
+		FI_WARN(cache->prov, FI_LOG_MR,
+			"%zu cached regions still in use\n", cache->cached_cnt);
+
+	rbtDelete(cache->rbtree);
+	fastlock_destroy(&cache->lock);
+}
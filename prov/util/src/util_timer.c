@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2017 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <fi.h>
+#include <fi_timer.h>
+
+
+static inline uint64_t ofi_timer_span(int level)
+{
+	return ((uint64_t) 1) << (OFI_TIMER_SLOT_BITS * level);
+}
+
+static void ofi_timer_place(struct ofi_timer_wheel *wheel,
+			    struct ofi_timer *timer)
+{
+	uint64_t expires, delta;
+	int level;
+
+	expires = timer->expires;
+	delta = expires - wheel->now;
+	for (level = 0; level < OFI_TIMER_LEVELS - 1; level++) {
+		if (delta < ofi_timer_span(level + 1))
+			break;
+	}
+
+	if (delta >= ofi_timer_span(OFI_TIMER_LEVELS))
+		expires = wheel->now + ofi_timer_span(OFI_TIMER_LEVELS) - 1;
+
+	dlist_insert_tail(&timer->entry, &wheel->slots[level]
+			  [(expires >> (OFI_TIMER_SLOT_BITS * level)) &
+			   OFI_TIMER_SLOT_MASK]);
+}
+
+/* Move a slot onto a private list, so that callbacks may set timers */
+static void ofi_timer_take_slot(struct dlist_entry *slot,
+				struct dlist_entry *list)
+{
+	dlist_init(list);
+	if (dlist_empty(slot))
+		return;
+
+	list->next = slot->next;
+	list->prev = slot->prev;
+	list->next->prev = list;
+	list->prev->next = list;
+	dlist_init(slot);
+}
+
+static void ofi_timer_cascade(struct ofi_timer_wheel *wheel, int level)
+{
+	struct dlist_entry list;
+	struct ofi_timer *timer;
+	uint64_t idx;
+
+	idx = (wheel->now >> (OFI_TIMER_SLOT_BITS * level)) & OFI_TIMER_SLOT_MASK;
+	ofi_timer_take_slot(&wheel->slots[level][idx], &list);
+	while (!dlist_empty(&list)) {
+		timer = container_of(list.next, struct ofi_timer, entry);
+		dlist_remove(&timer->entry);
+		ofi_timer_place(wheel, timer);
+	}
+
+	if (!idx && level + 1 < OFI_TIMER_LEVELS)
+		ofi_timer_cascade(wheel, level + 1);
+}
+
+void ofi_timer_wheel_init(struct ofi_timer_wheel *wheel, uint64_t tick_us,
+			  uint64_t now_us)
+{
+	int i, j;
+
+	wheel->tick_us = tick_us;
+	wheel->now = now_us / tick_us;
+	wheel->now_us = now_us;
+	wheel->count = 0;
+	for (i = 0; i < OFI_TIMER_LEVELS; i++) {
+		for (j = 0; j < OFI_TIMER_SLOTS; j++)
+			dlist_init(&wheel->slots[i][j]);
+	}
+}
+
+void ofi_timer_set(struct ofi_timer_wheel *wheel, struct ofi_timer *timer,
+		   uint64_t expires_us)
+{
+	if (ofi_timer_is_set(timer))
+		dlist_remove(&timer->entry);
+	else
+		wheel->count++;
+
+	timer->expires = (expires_us + wheel->tick_us - 1) / wheel->tick_us;
+	if (timer->expires < wheel->now)
+		timer->expires = wheel->now;
+	ofi_timer_place(wheel, timer);
+}
+
+void ofi_timer_cancel(struct ofi_timer_wheel *wheel, struct ofi_timer *timer)
+{
+	if (!ofi_timer_is_set(timer))
+		return;
+
+	dlist_remove(&timer->entry);
+	dlist_init(&timer->entry);
+	wheel->count--;
+}
+
+void ofi_timer_wheel_run(struct ofi_timer_wheel *wheel, uint64_t now_us)
+{
+	struct dlist_entry list;
+	struct ofi_timer *timer;
+	uint64_t target, idx;
+
+	wheel->now_us = now_us;
+	target = now_us / wheel->tick_us;
+	while (wheel->now <= target) {
+		if (!wheel->count) {
+			wheel->now = target + 1;
+			break;
+		}
+
+		idx = wheel->now & OFI_TIMER_SLOT_MASK;
+		if (!idx)
+			ofi_timer_cascade(wheel, 1);
+
+		ofi_timer_take_slot(&wheel->slots[0][idx], &list);
+		wheel->now++;
+		while (!dlist_empty(&list)) {
+			timer = container_of(list.next, struct ofi_timer, entry);
+			dlist_remove(&timer->entry);
+			dlist_init(&timer->entry);
+			wheel->count--;
+			timer->cb(wheel, timer);
+		}
+	}
+}
+
+uint64_t ofi_timer_wheel_next(struct ofi_timer_wheel *wheel)
+{
+	uint64_t tick, end, idx;
+	int level;
+
+	if (!wheel->count)
+		return UINT64_MAX;
+
+	/* the slots of higher levels due in this turn move down at its start */
+	for (level = 1; !(wheel->now & OFI_TIMER_SLOT_MASK) &&
+	     level < OFI_TIMER_LEVELS; level++) {
+		idx = (wheel->now >> (OFI_TIMER_SLOT_BITS * level)) &
+		      OFI_TIMER_SLOT_MASK;
+		if (!dlist_empty(&wheel->slots[level][idx]))
+			return wheel->now * wheel->tick_us;
+		if (idx)
+			break;
+	}
+
+	/* past the end of this turn of level 0, higher levels may cascade */
+	end = (wheel->now | OFI_TIMER_SLOT_MASK) + 1;
+	for (tick = wheel->now; tick < end; tick++) {
+		if (!dlist_empty(&wheel->slots[0][tick & OFI_TIMER_SLOT_MASK]))
+			break;
+	}
+	return tick * wheel->tick_us;
+}
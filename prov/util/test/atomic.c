@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2017 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Unit test of the atomic kernels in prov/util/src/util_atomic.c.  Every
+ * handler in the write, readwrite and swap tables is checked element by
+ * element against a scalar reference over several array lengths, and
+ * every (op, datatype) pair the reference defines must have a handler.
+ * Swap handlers are also run with the compare and result buffers aliased,
+ * as sockets does.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fi.h>
+#include <fi_atomic_ops.h>
+
+#define COUNT_MAX	131
+#define NCOUNTS		(sizeof(counts) / sizeof(counts[0]))
+
+enum { KIND_WRITE, KIND_READWRITE, KIND_SWAP, KIND_LAST };
+
+static const char *kind_str[] = { "write", "readwrite", "swap" };
+static const size_t counts[] = { 1, 2, 7, 16, 33, COUNT_MAX };
+static int errors, checked;
+
+typedef long double long_double;
+typedef OFI_COMPLEX(float) float_complex;
+typedef OFI_COMPLEX(double) double_complex;
+typedef OFI_COMPLEX(long_double) long_double_complex;
+
+#define CHECK(cond, ...)					\
+	do {							\
+		if (!(cond)) {					\
+			fprintf(stderr, __VA_ARGS__);		\
+			errors++;				\
+		}						\
+	} while (0)
+
+static int op_kind_ok(int kind, enum fi_op op)
+{
+	switch (kind) {
+	case KIND_WRITE:
+		return op <= FI_ATOMIC_WRITE && op != FI_ATOMIC_READ;
+	case KIND_READWRITE:
+		return op <= FI_ATOMIC_WRITE;
+	default:
+		return ofi_atomic_isswap_op(op);
+	}
+}
+
+/* Reference cases; each leaves the updated value in *d */
+#define REF_ALL(d, old, s, c)					\
+	case FI_SUM: *d = old + s; break;			\
+	case FI_PROD: *d = old * s; break;			\
+	case FI_LOR: *d = old || s; break;			\
+	case FI_LAND: *d = old && s; break;			\
+	case FI_ATOMIC_READ: break;				\
+	case FI_ATOMIC_WRITE: *d = s; break;			\
+	case FI_CSWAP: if (c == old) *d = s; break;		\
+	case FI_CSWAP_NE: if (c != old) *d = s; break;
+
+#define REF_REAL(d, old, s, c)					\
+	case FI_MIN: *d = s < old ? s : old; break;		\
+	case FI_MAX: *d = s > old ? s : old; break;		\
+	case FI_CSWAP_LE: if (c <= old) *d = s; break;		\
+	case FI_CSWAP_LT: if (c < old) *d = s; break;		\
+	case FI_CSWAP_GE: if (c >= old) *d = s; break;		\
+	case FI_CSWAP_GT: if (c > old) *d = s; break;
+
+#define REF_INT(d, old, s, c)					\
+	case FI_BOR: *d = old | s; break;			\
+	case FI_BAND: *d = old & s; break;			\
+	case FI_LXOR: *d = !old != !s; break;			\
+	case FI_BXOR: *d = old ^ s; break;			\
+	case FI_MSWAP: *d = (s & c) | (old & ~c); break;
+
+/*
+ * Per datatype: a reference returning 0 for ops it does not define, a
+ * small random value (exact in every type, so float results compare
+ * with ==) and a value near x that a compare must tell apart from x.
+ */
+#define DEF_REF(type, cases)					\
+static int ref_##type(enum fi_op op, type *d, type s, type c)	\
+{								\
+	type old = *d;						\
+								\
+	switch (op) {						\
+	cases							\
+	default:						\
+		return 0;					\
+	}							\
+	return 1;						\
+}
+
+#define DEF_REAL_VALUES(type)					\
+static type val_##type(void)					\
+{								\
+	return (type) (rand() % 4);				\
+}								\
+static type near_##type(type x)					\
+{								\
+	return x + 1;						\
+}
+
+/* complex values may differ in the real or only the imaginary part */
+#define DEF_COMPLEX_VALUES(type)				\
+static type val_##type(void)					\
+{								\
+	return (type) (rand() % 4) + (rand() % 4) * I;		\
+}								\
+static type near_##type(type x)					\
+{								\
+	return rand() % 2 ? x + 1 : x + I;			\
+}
+
+#define DEF_TEST(type, datatype)					\
+static void fill_##type(type *dst, type *src, type *cmp, size_t cnt)	\
+{									\
+	size_t i;							\
+									\
+	for (i = 0; i < cnt; i++) {					\
+		dst[i] = val_##type();					\
+		src[i] = val_##type();					\
+		switch (rand() % 3) {					\
+		case 0: cmp[i] = dst[i]; break;				\
+		case 1: cmp[i] = near_##type(dst[i]); break;		\
+		default: cmp[i] = val_##type(); break;			\
+		}							\
+	}								\
+}									\
+									\
+static void run_##type(int kind, enum fi_op op, size_t cnt, int alias)	\
+{									\
+	static type dst[COUNT_MAX], src[COUNT_MAX], cmp[COUNT_MAX];	\
+	static type res[COUNT_MAX], exp_dst[COUNT_MAX];			\
+	static type exp_res[COUNT_MAX];					\
+	type *r = alias ? cmp : res;					\
+	size_t i;							\
+									\
+	fill_##type(dst, src, cmp, cnt);				\
+	for (i = 0; i < cnt; i++) {					\
+		exp_dst[i] = dst[i];					\
+		exp_res[i] = dst[i];					\
+		ref_##type(op, &exp_dst[i], src[i], cmp[i]);		\
+	}								\
+									\
+	switch (kind) {							\
+	case KIND_WRITE:						\
+		ofi_atomic_write_handler(op, datatype)(dst, src, cnt);	\
+		break;							\
+	case KIND_READWRITE:						\
+		ofi_atomic_readwrite_handler(op, datatype)(dst, src,	\
+							   r, cnt);	\
+		break;							\
+	default:							\
+		ofi_atomic_swap_handler(op, datatype)(dst, src, cmp,	\
+						      r, cnt);		\
+		break;							\
+	}								\
+									\
+	for (i = 0; i < cnt; i++) {					\
+		CHECK(dst[i] == exp_dst[i], "%s %s op %d cnt %zu%s: "	\
+		      "wrong target at %zu\n", kind_str[kind], #type,	\
+		      op, cnt, alias ? " aliased" : "", i);		\
+		CHECK(kind == KIND_WRITE || r[i] == exp_res[i],		\
+		      "%s %s op %d cnt %zu%s: wrong result at %zu\n",	\
+		      kind_str[kind], #type, op, cnt,			\
+		      alias ? " aliased" : "", i);			\
+	}								\
+	checked++;							\
+}									\
+									\
+static void test_##type(void)						\
+{									\
+	type d = 0;							\
+	int kind, handler, defined;					\
+	size_t i;							\
+	enum fi_op op;							\
+									\
+	for (kind = 0; kind < KIND_LAST; kind++) {			\
+		for (op = FI_MIN; op <= FI_MSWAP; op++) {		\
+			switch (kind) {					\
+			case KIND_WRITE:				\
+				handler = !!ofi_atomic_write_handler(	\
+						op, datatype);		\
+				break;					\
+			case KIND_READWRITE:				\
+				handler = !!ofi_atomic_readwrite_handler( \
+						op, datatype);		\
+				break;					\
+			default:					\
+				handler = !!ofi_atomic_swap_handler(	\
+						op, datatype);		\
+				break;					\
+			}						\
+			defined = op_kind_ok(kind, op) &&		\
+				  ref_##type(op, &d, 0, 0);		\
+			CHECK(handler == defined, "%s %s op %d: handler " \
+			      "%s\n", kind_str[kind], #type, op,	\
+			      handler ? "not expected" : "missing");	\
+			if (!handler || !defined)			\
+				continue;				\
+									\
+			for (i = 0; i < NCOUNTS; i++) {		\
+				run_##type(kind, op, counts[i], 0);	\
+				if (kind != KIND_WRITE)			\
+					run_##type(kind, op, counts[i], 1); \
+			}						\
+		}							\
+	}								\
+}
+
+#define DEF_INT_TYPE(type, datatype)					\
+	DEF_REF(type, REF_ALL(d, old, s, c) REF_REAL(d, old, s, c)	\
+		      REF_INT(d, old, s, c))				\
+	DEF_REAL_VALUES(type)						\
+	DEF_TEST(type, datatype)
+
+#define DEF_FLOAT_TYPE(type, datatype)					\
+	DEF_REF(type, REF_ALL(d, old, s, c) REF_REAL(d, old, s, c))	\
+	DEF_REAL_VALUES(type)						\
+	DEF_TEST(type, datatype)
+
+#define DEF_COMPLEX_TYPE(type, datatype)				\
+	DEF_REF(type, REF_ALL(d, old, s, c))				\
+	DEF_COMPLEX_VALUES(type)					\
+	DEF_TEST(type, datatype)
+
+DEF_INT_TYPE(int8_t, FI_INT8)
+DEF_INT_TYPE(uint8_t, FI_UINT8)
+DEF_INT_TYPE(int16_t, FI_INT16)
+DEF_INT_TYPE(uint16_t, FI_UINT16)
+DEF_INT_TYPE(int32_t, FI_INT32)
+DEF_INT_TYPE(uint32_t, FI_UINT32)
+DEF_INT_TYPE(int64_t, FI_INT64)
+DEF_INT_TYPE(uint64_t, FI_UINT64)
+DEF_FLOAT_TYPE(float, FI_FLOAT)
+DEF_FLOAT_TYPE(double, FI_DOUBLE)
+DEF_FLOAT_TYPE(long_double, FI_LONG_DOUBLE)
+DEF_COMPLEX_TYPE(float_complex, FI_FLOAT_COMPLEX)
+DEF_COMPLEX_TYPE(double_complex, FI_DOUBLE_COMPLEX)
+DEF_COMPLEX_TYPE(long_double_complex, FI_LONG_DOUBLE_COMPLEX)
+
+/*
+ * Complex CSWAP once compared the target against the source operand.
+ * Swap only when both parts of the compare operand match the target.
+ */
+static void test_complex_cswap(void)
+{
+	double_complex dst[3] = { 1 + 2 * I, 1 + 2 * I, 1 + 2 * I };
+	double_complex src[3] = { 5 + 5 * I, 5 + 5 * I, 5 + 5 * I };
+	double_complex cmp[3] = { 1 + 2 * I, 1 + 3 * I, 2 + 2 * I };
+
+	ofi_atomic_swap_handler(FI_CSWAP, FI_DOUBLE_COMPLEX)(dst, src, cmp,
+							     cmp, 3);
+	CHECK(dst[0] == 5 + 5 * I, "complex CSWAP missed a match\n");
+	CHECK(dst[1] == 1 + 2 * I, "complex CSWAP ignored the imaginary part\n");
+	CHECK(dst[2] == 1 + 2 * I, "complex CSWAP ignored the real part\n");
+	CHECK(cmp[0] == 1 + 2 * I && cmp[1] == 1 + 2 * I &&
+	      cmp[2] == 1 + 2 * I, "complex CSWAP returned a wrong value\n");
+}
+
+int main(int argc, char **argv)
+{
+	srand(argc > 1 ? atoi(argv[1]) : 1);
+
+	test_int8_t();
+	test_uint8_t();
+	test_int16_t();
+	test_uint16_t();
+	test_int32_t();
+	test_uint32_t();
+	test_int64_t();
+	test_uint64_t();
+	test_float();
+	test_double();
+	test_long_double();
+	test_float_complex();
+	test_double_complex();
+	test_long_double_complex();
+	test_complex_cswap();
+
+	printf("%s: %d kernel runs\n", errors ? "FAIL" : "PASS", checked);
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2017 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * Unit test of the timer wheel in prov/util/src/util_timer.c.  Random
+ * timers, spread over every level of the wheel and past its top, are set,
+ * moved and canceled while the wheel is run forward in random steps; each
+ * must fire exactly once, never before its deadline and no later than the
+ * first run at or past the deadline rounded up to a tick.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <fi.h>
+#include <fi_timer.h>
+
+#define TICK_US		10
+#define NTIMERS		2000
+#define NRUNS		20000
+
+struct test_timer {
+	struct ofi_timer	timer;
+	uint64_t		expires_us;	/* 0 when not armed */
+	uint64_t		due_us;
+	uint64_t		fired;
+	int			rearm;
+};
+
+static struct test_timer timers[NTIMERS];
+static uint64_t now_us, run_us;	/* run_us: time of the latest run */
+static int errors;
+
+#define CHECK(cond, ...)					\
+	do {							\
+		if (!(cond)) {					\
+			fprintf(stderr, __VA_ARGS__);		\
+			errors++;				\
+		}						\
+	} while (0)
+
+static uint64_t deadline(uint64_t base)
+{
+	/* level 0 .. past the top of the wheel */
+	switch (rand() % 5) {
+	case 0:
+		return base + rand() % (TICK_US * OFI_TIMER_SLOTS);
+	case 1:
+		return base + rand() % (TICK_US * OFI_TIMER_SLOTS *
+					OFI_TIMER_SLOTS);
+	case 2:
+		return base + (uint64_t) rand() % ((uint64_t) TICK_US <<
+					(OFI_TIMER_SLOT_BITS * 3));
+	case 3:
+		return base + ((uint64_t) rand() << 8) % ((uint64_t) TICK_US <<
+					(OFI_TIMER_SLOT_BITS * 4));
+	default:
+		return base + ((uint64_t) TICK_US << (OFI_TIMER_SLOT_BITS *
+					OFI_TIMER_LEVELS)) + rand();
+	}
+}
+
+/* deadlines are rounded up to a tick, and past ones move to the next tick */
+static void arm(struct ofi_timer_wheel *wheel, struct test_timer *t,
+		uint64_t expires_us)
+{
+	uint64_t tick = (expires_us + TICK_US - 1) / TICK_US;
+
+	t->expires_us = expires_us;
+	t->due_us = MAX(tick, run_us / TICK_US + 1) * TICK_US;
+	ofi_timer_set(wheel, &t->timer, expires_us);
+}
+
+static void expire(struct ofi_timer_wheel *wheel, struct ofi_timer *timer)
+{
+	struct test_timer *t = container_of(timer, struct test_timer, timer);
+
+	CHECK(t->expires_us, "timer %td fired while not armed\n", t - timers);
+	CHECK(now_us >= t->expires_us, "timer %td fired early: %" PRIu64
+	      " < %" PRIu64 "\n", t - timers, now_us, t->expires_us);
+	t->fired++;
+	t->expires_us = 0;
+
+	/* callbacks may set timers, including their own */
+	if (t->rearm) {
+		t->rearm = 0;
+		arm(wheel, t, deadline(now_us));
+	}
+}
+
+static uint64_t earliest(void)
+{
+	uint64_t min = UINT64_MAX;
+	int i;
+
+	for (i = 0; i < NTIMERS; i++) {
+		if (timers[i].expires_us && timers[i].due_us < min)
+			min = timers[i].due_us;
+	}
+	return min;
+}
+
+int main(int argc, char **argv)
+{
+	struct ofi_timer_wheel wheel;
+	uint64_t next, fired, armed;
+	int i, run;
+
+	srand(argc > 1 ? atoi(argv[1]) : 1);
+	now_us = run_us = 123456789;
+	ofi_timer_wheel_init(&wheel, TICK_US, now_us);
+	CHECK(ofi_timer_wheel_next(&wheel) == UINT64_MAX,
+	      "empty wheel reports a deadline\n");
+
+	for (i = 0; i < NTIMERS; i++) {
+		ofi_timer_init(&timers[i].timer, expire);
+		timers[i].rearm = !(i % 7);
+		arm(&wheel, &timers[i], deadline(now_us));
+	}
+
+	for (run = 0; run < NRUNS; run++) {
+		/* move or cancel a few timers between runs */
+		i = rand() % NTIMERS;
+		if (rand() % 4 == 0) {
+			ofi_timer_cancel(&wheel, &timers[i].timer);
+			timers[i].expires_us = 0;
+		} else {
+			arm(&wheel, &timers[i], deadline(now_us));
+		}
+
+		next = ofi_timer_wheel_next(&wheel);
+		CHECK(next <= earliest(), "next %" PRIu64
+		      " is past the earliest deadline %" PRIu64 "\n",
+		      next, earliest());
+
+		/* mostly short steps, with an occasional long idle gap */
+		now_us += rand() % 8 ? rand() % (TICK_US * 4) :
+			  (uint64_t) rand() % ((uint64_t) TICK_US <<
+					      (OFI_TIMER_SLOT_BITS * 3));
+		run_us = now_us;
+		ofi_timer_wheel_run(&wheel, now_us);
+
+		for (i = 0; i < NTIMERS; i++) {
+			CHECK(!timers[i].expires_us ||
+			      timers[i].due_us > now_us,
+			      "timer %d missed its deadline %" PRIu64
+			      " at %" PRIu64 "\n", i, timers[i].expires_us,
+			      now_us);
+		}
+		if (errors > 10)
+			break;
+	}
+
+	/* drain everything still armed */
+	now_us = earliest();
+	while (now_us != UINT64_MAX && errors <= 10) {
+		run_us = now_us;
+		ofi_timer_wheel_run(&wheel, now_us);
+		now_us = earliest();
+	}
+
+	for (i = 0, fired = armed = 0; i < NTIMERS; i++) {
+		fired += timers[i].fired;
+		armed += !!ofi_timer_is_set(&timers[i].timer);
+	}
+	CHECK(!armed && !wheel.count, "%" PRIu64 " timers left armed, "
+	      "count %zu\n", armed, wheel.count);
+	CHECK(ofi_timer_wheel_next(&wheel) == UINT64_MAX,
+	      "drained wheel reports a deadline\n");
+
+	printf("%s: %" PRIu64 " expirations\n", errors ? "FAIL" : "PASS",
+	       fired);
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -454,6 +454,7 @@ libdl_done:
 	 * functionality than the socket provider has.
 	 */
 	ofi_register_provider(RXM_INIT, NULL);
+	ofi_register_provider(RXD_INIT, NULL);
 
 	ofi_init = 1;
 
@@ -213,8 +213,13 @@ int DEFAULT_SYMVER_PRE(fi_param_define)(const struct fi_provider *provider,
 		return -FI_ENOMEM;
 	}
 
-	for (i = 0; v->env_var_name[i]; ++i)
-		v->env_var_name[i] = toupper(v->env_var_name[i]);
+	/* provider names such as ofi-rxm must still give a valid shell name */
+	for (i = 0; v->env_var_name[i]; ++i) {
+		if (v->env_var_name[i] == '-')
+			v->env_var_name[i] = '_';
+		else
+			v->env_var_name[i] = toupper(v->env_var_name[i]);
+	}
 
 	dlist_insert_tail(&v->entry, &param_list);
 
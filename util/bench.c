@@ -0,0 +1,1268 @@
+/*
+ * Copyright (c) 2017 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Single-process benchmarks.  Two endpoints of one domain talk to each
+ * other through the provider under test, so a provider's data path can be
+ * measured without a second node or an out-of-band control channel.
+ */
+
+#include <config.h>
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <rdma/fabric.h>
+#include <rdma/fi_cm.h>
+#include <rdma/fi_domain.h>
+#include <rdma/fi_endpoint.h>
+#include <rdma/fi_errno.h>
+#include <rdma/fi_trigger.h>
+
+#define BENCH_FIVERSION		FI_VERSION(1, 5)
+#define BENCH_CQ_BATCH		16
+#define BENCH_MAX_WINDOW	1024
+#define BENCH_STREAM_BYTES	(64 << 20)	/* per size, unless -I */
+#define BENCH_AV_PORT		9		/* of the synthetic addresses */
+#define BENCH_TRIGGERS		10000
+#define BENCH_IDLE_ROUNDS	20
+
+#define BENCH_PRINTERR(call, retv)					\
+	fprintf(stderr, "%s(): %s:%-4d, ret=%d (%s)\n", call, __FILE__,	\
+		__LINE__, (int) retv, fi_strerror((int) -retv))
+
+#define BENCH_ERR(fmt, ...)						\
+	fprintf(stderr, "[%s] %s:%-4d: " fmt "\n", "error", __FILE__,	\
+		__LINE__, ##__VA_ARGS__)
+
+struct bench_ep {
+	struct fid_ep		*ep;
+	struct fid_av		*av;
+	struct fid_cq		*cq;
+	struct fid_mr		*mr;
+	void			*desc;
+	fi_addr_t		peer;
+
+	/* window send slots, then window receive slots */
+	char			*buf;
+	struct fi_context	*ctx;
+	uint64_t		sends, recvs;
+};
+
+struct bench_opts {
+	const char		*test;
+	size_t			min_size;
+	size_t			max_size;
+	size_t			min_addrs;
+	size_t			max_addrs;
+	int			iterations;	/* 0: the test's default */
+	int			window;
+	int			verify;
+	int			shuffle;
+	int			idle_ms;
+	enum fi_progress	progress;
+};
+
+struct bench {
+	struct fi_info		*hints;
+	struct fi_info		*info;
+	struct fid_fabric	*fabric;
+	struct fid_domain	*domain;
+	struct bench_ep		tx, rx;
+	struct bench_opts	opts;
+	size_t			buf_size;
+	size_t			av_count;	/* 0: the provider's default */
+	int			source;		/* check receive sources */
+};
+
+struct bench_test {
+	const char		*name;
+	const char		*desc;
+	uint64_t		caps;
+	int			(*run)(struct bench *b);
+};
+
+static uint64_t bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_parse_size(const char *str, size_t *size)
+{
+	unsigned long long val;
+	char *end;
+
+	val = strtoull(str, &end, 0);
+	switch (*end) {
+	case 'g': case 'G':
+		val <<= 10;
+		/* fall through */
+	case 'm': case 'M':
+		val <<= 10;
+		/* fall through */
+	case 'k': case 'K':
+		val <<= 10;
+		end++;
+		break;
+	}
+	if (end == str || (*end && *end != ':')) {
+		fprintf(stderr, "Error parsing \"%s\"\n", str);
+		return -FI_EINVAL;
+	}
+	*size = val;
+	return 0;
+}
+
+/* "<size>" or "<min>:<max>"; ranges step in powers of two */
+static int bench_parse_range(const char *str, size_t *min, size_t *max)
+{
+	const char *sep;
+
+	if (bench_parse_size(str, min))
+		return -FI_EINVAL;
+	sep = strchr(str, ':');
+	if (!sep) {
+		*max = *min;
+		return 0;
+	}
+	if (bench_parse_size(sep + 1, max) || *max < *min) {
+		fprintf(stderr, "Invalid range \"%s\"\n", str);
+		return -FI_EINVAL;
+	}
+	return 0;
+}
+
+static size_t bench_next_size(size_t size)
+{
+	return size ? size << 1 : 1;
+}
+
+static char *bench_sbuf(struct bench *b, struct bench_ep *e, int slot)
+{
+	return e->buf + (size_t) slot * b->buf_size;
+}
+
+static char *bench_rbuf(struct bench *b, struct bench_ep *e, int slot)
+{
+	return bench_sbuf(b, e, b->opts.window + slot);
+}
+
+/*
+ * Sequence-tagged payloads, so a receive can be checked whichever send it
+ * matched; messages shorter than the tag are not checked.
+ */
+static void bench_fill(char *buf, size_t size, uint64_t seq)
+{
+	size_t i;
+
+	if (size < sizeof(seq))
+		return;
+	memcpy(buf, &seq, sizeof(seq));
+	for (i = sizeof(seq); i < size; i++)
+		buf[i] = (char) (seq + i);
+}
+
+static int bench_check(const char *buf, size_t size)
+{
+	uint64_t seq;
+	size_t i;
+
+	if (size < sizeof(seq))
+		return 0;
+	memcpy(&seq, buf, sizeof(seq));
+	for (i = sizeof(seq); i < size; i++) {
+		if (buf[i] != (char) (seq + i)) {
+			BENCH_ERR("message %" PRIu64 " of %zu bytes: bad data "
+				  "at %zu", seq, size, i);
+			return -FI_EIO;
+		}
+	}
+	return 0;
+}
+
+static int bench_cq_readerr(struct fid_cq *cq)
+{
+	struct fi_cq_err_entry err;
+	int ret;
+
+	memset(&err, 0, sizeof(err));
+	ret = fi_cq_readerr(cq, &err, 0);
+	if (ret < 0) {
+		BENCH_PRINTERR("fi_cq_readerr", ret);
+		return ret;
+	}
+	BENCH_ERR("cq_readerr: %s", fi_cq_strerror(cq, err.prov_errno,
+						   err.err_data, NULL, 0));
+	return -err.err;
+}
+
+/*
+ * Drain up to BENCH_CQ_BATCH completions of an endpoint.  Returns the
+ * number read and stores the slot of each, negative for receive slots
+ * (-1 - slot).
+ */
+static int bench_poll(struct bench *b, struct bench_ep *e, int *slots)
+{
+	struct fi_cq_entry comp[BENCH_CQ_BATCH];
+	fi_addr_t src[BENCH_CQ_BATCH];
+	ssize_t ret;
+	int i, idx;
+
+	if (b->source)
+		ret = fi_cq_readfrom(e->cq, comp, BENCH_CQ_BATCH, src);
+	else
+		ret = fi_cq_read(e->cq, comp, BENCH_CQ_BATCH);
+	if (ret == -FI_EAGAIN)
+		return 0;
+	if (ret == -FI_EAVAIL)
+		return bench_cq_readerr(e->cq);
+	if (ret < 0) {
+		BENCH_PRINTERR("fi_cq_read", ret);
+		return (int) ret;
+	}
+
+	for (i = 0; i < ret; i++) {
+		idx = (struct fi_context *) comp[i].op_context - e->ctx;
+		if (idx < b->opts.window) {
+			e->sends++;
+			slots[i] = idx;
+			continue;
+		}
+
+		e->recvs++;
+		slots[i] = -1 - (idx - b->opts.window);
+		if (b->source && src[i] != e->peer) {
+			BENCH_ERR("message from fi_addr %" PRIu64 ", expected "
+				  "%" PRIu64, (uint64_t) src[i],
+				  (uint64_t) e->peer);
+			return -FI_EIO;
+		}
+	}
+	return (int) ret;
+}
+
+/* Give both endpoints a chance to progress while a post is refused */
+static void bench_progress(struct bench *b)
+{
+	fi_cq_read(b->tx.cq, NULL, 0);
+	fi_cq_read(b->rx.cq, NULL, 0);
+}
+
+static int bench_post_send(struct bench *b, struct bench_ep *e, int slot,
+			   size_t size, uint64_t seq)
+{
+	ssize_t ret;
+
+	if (b->opts.verify)
+		bench_fill(bench_sbuf(b, e, slot), size, seq);
+
+	do {
+		ret = fi_send(e->ep, bench_sbuf(b, e, slot), size, e->desc,
+			      e->peer, &e->ctx[slot]);
+		if (ret == -FI_EAGAIN)
+			bench_progress(b);
+	} while (ret == -FI_EAGAIN);
+
+	if (ret)
+		BENCH_PRINTERR("fi_send", ret);
+	return (int) ret;
+}
+
+static int bench_post_recv(struct bench *b, struct bench_ep *e, int slot,
+			   size_t size)
+{
+	ssize_t ret;
+
+	do {
+		ret = fi_recv(e->ep, bench_rbuf(b, e, slot), size, e->desc,
+			      FI_ADDR_UNSPEC, &e->ctx[b->opts.window + slot]);
+		if (ret == -FI_EAGAIN)
+			bench_progress(b);
+	} while (ret == -FI_EAGAIN);
+
+	if (ret)
+		BENCH_PRINTERR("fi_recv", ret);
+	return (int) ret;
+}
+
+static int bench_open_ep(struct bench *b, struct bench_ep *e)
+{
+	struct fi_av_attr av_attr = {
+		.type = b->info->domain_attr->av_type != FI_AV_UNSPEC ?
+			b->info->domain_attr->av_type : FI_AV_MAP,
+		.count = b->av_count,
+	};
+	struct fi_cq_attr cq_attr = {
+		.format = FI_CQ_FORMAT_CONTEXT,
+		.wait_obj = FI_WAIT_NONE,
+	};
+	size_t len;
+	int ret;
+
+	len = b->buf_size * 2 * b->opts.window;
+	e->buf = calloc(1, len);
+	e->ctx = calloc(2 * b->opts.window, sizeof(*e->ctx));
+	if (!e->buf || !e->ctx)
+		return -FI_ENOMEM;
+	e->sends = e->recvs = 0;
+
+	if (b->info->domain_attr->mr_mode & FI_MR_LOCAL) {
+		ret = fi_mr_reg(b->domain, e->buf, len, FI_SEND | FI_RECV, 0,
+				0, 0, &e->mr, NULL);
+		if (ret) {
+			BENCH_PRINTERR("fi_mr_reg", ret);
+			return ret;
+		}
+		e->desc = fi_mr_desc(e->mr);
+	}
+
+	ret = fi_av_open(b->domain, &av_attr, &e->av, NULL);
+	if (ret) {
+		BENCH_PRINTERR("fi_av_open", ret);
+		return ret;
+	}
+
+	cq_attr.size = b->info->tx_attr->size + b->info->rx_attr->size;
+	ret = fi_cq_open(b->domain, &cq_attr, &e->cq, NULL);
+	if (ret) {
+		BENCH_PRINTERR("fi_cq_open", ret);
+		return ret;
+	}
+
+	ret = fi_endpoint(b->domain, b->info, &e->ep, NULL);
+	if (ret) {
+		BENCH_PRINTERR("fi_endpoint", ret);
+		return ret;
+	}
+
+	ret = fi_ep_bind(e->ep, &e->av->fid, 0);
+	if (ret) {
+		BENCH_PRINTERR("fi_ep_bind", ret);
+		return ret;
+	}
+
+	ret = fi_ep_bind(e->ep, &e->cq->fid, FI_TRANSMIT | FI_RECV);
+	if (ret) {
+		BENCH_PRINTERR("fi_ep_bind", ret);
+		return ret;
+	}
+
+	ret = fi_enable(e->ep);
+	if (ret)
+		BENCH_PRINTERR("fi_enable", ret);
+	return ret;
+}
+
+static void bench_close_ep(struct bench_ep *e)
+{
+	if (e->ep)
+		fi_close(&e->ep->fid);
+	if (e->cq)
+		fi_close(&e->cq->fid);
+	if (e->av)
+		fi_close(&e->av->fid);
+	if (e->mr)
+		fi_close(&e->mr->fid);
+	free(e->buf);
+	free(e->ctx);
+	memset(e, 0, sizeof(*e));
+}
+
+static int bench_insert_peer(struct bench_ep *e, struct bench_ep *peer)
+{
+	char name[256];
+	size_t len = sizeof(name);
+	int ret;
+
+	ret = fi_getname(&peer->ep->fid, name, &len);
+	if (ret) {
+		BENCH_PRINTERR("fi_getname", ret);
+		return ret;
+	}
+
+	ret = fi_av_insert(e->av, name, 1, &e->peer, 0, NULL);
+	if (ret != 1) {
+		BENCH_PRINTERR("fi_av_insert", ret);
+		return ret < 0 ? ret : -FI_EINVAL;
+	}
+	return 0;
+}
+
+static int bench_open_eps(struct bench *b)
+{
+	int ret;
+
+	ret = bench_open_ep(b, &b->tx);
+	if (ret)
+		return ret;
+	ret = bench_open_ep(b, &b->rx);
+	if (ret)
+		return ret;
+	ret = bench_insert_peer(&b->tx, &b->rx);
+	if (ret)
+		return ret;
+	return bench_insert_peer(&b->rx, &b->tx);
+}
+
+static void bench_close_eps(struct bench *b)
+{
+	bench_close_ep(&b->tx);
+	bench_close_ep(&b->rx);
+}
+
+static int bench_open(struct bench *b, uint64_t caps)
+{
+	int ret;
+
+	b->hints->caps = caps;
+	b->hints->mode = FI_CONTEXT;
+	b->hints->domain_attr->mr_mode = FI_MR_LOCAL | FI_MR_ALLOCATED;
+	b->hints->ep_attr->type = FI_EP_RDM;
+	b->hints->domain_attr->data_progress = b->opts.progress;
+	b->hints->domain_attr->control_progress = b->opts.progress;
+
+	ret = fi_getinfo(BENCH_FIVERSION, "127.0.0.1", NULL, FI_SOURCE,
+			 b->hints, &b->info);
+	if (ret) {
+		BENCH_PRINTERR("fi_getinfo", ret);
+		return ret;
+	}
+
+	printf("# provider %s, test %s, window %d\n",
+	       b->info->fabric_attr->prov_name, b->opts.test, b->opts.window);
+
+	ret = fi_fabric(b->info->fabric_attr, &b->fabric, NULL);
+	if (ret) {
+		BENCH_PRINTERR("fi_fabric", ret);
+		return ret;
+	}
+
+	ret = fi_domain(b->fabric, b->info, &b->domain, NULL);
+	if (ret)
+		BENCH_PRINTERR("fi_domain", ret);
+	return ret;
+}
+
+static void bench_close(struct bench *b)
+{
+	bench_close_eps(b);
+	if (b->domain)
+		fi_close(&b->domain->fid);
+	if (b->fabric)
+		fi_close(&b->fabric->fid);
+	fi_freeinfo(b->info);
+	b->domain = NULL;
+	b->fabric = NULL;
+	b->info = NULL;
+}
+
+/* Default message count for a size: BENCH_STREAM_BYTES, 100 to 10000 */
+static int bench_count(struct bench *b, size_t size)
+{
+	size_t cnt;
+
+	if (b->opts.iterations)
+		return b->opts.iterations;
+	cnt = BENCH_STREAM_BYTES / (size ? size : 1);
+	return (int) (cnt < 100 ? 100 : cnt > 10000 ? 10000 : cnt);
+}
+
+/*
+ * Stream cnt messages from tx to rx with up to window in flight, reposting
+ * each slot as it completes.  Returns the elapsed time in ns through
+ * elapsed.
+ */
+static int bench_stream(struct bench *b, size_t size, int cnt,
+			uint64_t *elapsed)
+{
+	int slots[BENCH_CQ_BATCH];
+	int window, sent = 0, posted = 0, i, n, ret;
+	uint64_t start, sends, recvs;
+
+	window = cnt < b->opts.window ? cnt : b->opts.window;
+	sends = b->tx.sends + cnt;
+	recvs = b->rx.recvs + cnt;
+
+	for (i = 0; i < window; i++, posted++) {
+		ret = bench_post_recv(b, &b->rx, i, size);
+		if (ret)
+			return ret;
+	}
+
+	start = bench_now();
+	for (i = 0; i < window; i++, sent++) {
+		ret = bench_post_send(b, &b->tx, i, size, sent);
+		if (ret)
+			return ret;
+	}
+
+	while (b->tx.sends < sends || b->rx.recvs < recvs) {
+		n = bench_poll(b, &b->rx, slots);
+		if (n < 0)
+			return n;
+		for (i = 0; i < n; i++) {
+			if (b->opts.verify) {
+				ret = bench_check(bench_rbuf(b, &b->rx,
+							     -1 - slots[i]),
+						  size);
+				if (ret)
+					return ret;
+			}
+			if (posted == cnt)
+				continue;
+			ret = bench_post_recv(b, &b->rx, -1 - slots[i], size);
+			if (ret)
+				return ret;
+			posted++;
+		}
+
+		n = bench_poll(b, &b->tx, slots);
+		if (n < 0)
+			return n;
+		for (i = 0; i < n && sent < cnt; i++, sent++) {
+			ret = bench_post_send(b, &b->tx, slots[i], size, sent);
+			if (ret)
+				return ret;
+		}
+	}
+
+	*elapsed = bench_now() - start;
+	return 0;
+}
+
+/* Wait for the given totals of send and receive completions on e */
+static int bench_wait(struct bench *b, struct bench_ep *e, uint64_t sends,
+		      uint64_t recvs)
+{
+	int slots[BENCH_CQ_BATCH];
+	int ret;
+
+	while (e->sends < sends || e->recvs < recvs) {
+		ret = bench_poll(b, e, slots);
+		if (ret < 0)
+			return ret;
+		if (e == &b->tx) {
+			ret = bench_poll(b, &b->rx, slots);
+		} else {
+			ret = bench_poll(b, &b->tx, slots);
+		}
+		if (ret < 0)
+			return ret;
+	}
+	return 0;
+}
+
+/* One message each way, receives reposted to slot 0 */
+static int bench_round_trip(struct bench *b, size_t size, uint64_t seq)
+{
+	int ret;
+
+	ret = bench_post_send(b, &b->tx, 0, size, seq);
+	if (ret)
+		return ret;
+	ret = bench_wait(b, &b->rx, b->rx.sends, b->rx.recvs + 1);
+	if (ret)
+		return ret;
+	if (b->opts.verify) {
+		ret = bench_check(bench_rbuf(b, &b->rx, 0), size);
+		if (ret)
+			return ret;
+	}
+	ret = bench_post_recv(b, &b->rx, 0, size);
+	if (ret)
+		return ret;
+
+	ret = bench_post_send(b, &b->rx, 0, size, seq);
+	if (ret)
+		return ret;
+	ret = bench_wait(b, &b->tx, b->tx.sends, b->tx.recvs + 1);
+	if (ret)
+		return ret;
+	if (b->opts.verify) {
+		ret = bench_check(bench_rbuf(b, &b->tx, 0), size);
+		if (ret)
+			return ret;
+	}
+	return bench_post_recv(b, &b->tx, 0, size);
+}
+
+static const char *bench_size_str(char *str, size_t len, uint64_t size)
+{
+	if (size >= (1 << 30) && !(size % (1 << 30)))
+		snprintf(str, len, "%" PRIu64 "g", size >> 30);
+	else if (size >= (1 << 20) && !(size % (1 << 20)))
+		snprintf(str, len, "%" PRIu64 "m", size >> 20);
+	else if (size >= (1 << 10) && !(size % (1 << 10)))
+		snprintf(str, len, "%" PRIu64 "k", size >> 10);
+	else
+		snprintf(str, len, "%" PRIu64, size);
+	return str;
+}
+
+static int bench_run_msg(struct bench *b)
+{
+	char str[32];
+	uint64_t elapsed;
+	size_t size;
+	int cnt, ret;
+
+	ret = bench_open_eps(b);
+	if (ret)
+		return ret;
+
+	printf("%-10s%-10s%10s%12s%14s\n", "bytes", "#msgs", "time",
+	       "MB/sec", "msgs/sec");
+	for (size = b->opts.min_size; size <= b->opts.max_size;
+	     size = bench_next_size(size)) {
+		cnt = bench_count(b, size);
+		ret = bench_stream(b, size, cnt, &elapsed);
+		if (ret)
+			return ret;
+
+		printf("%-10s%-10d%9.3fs%12.2f%14.0f\n",
+		       bench_size_str(str, sizeof(str), size), cnt,
+		       elapsed / 1e9, (double) size * cnt * 1e3 / elapsed,
+		       cnt * 1e9 / elapsed);
+	}
+	return 0;
+}
+
+static int bench_run_lat(struct bench *b)
+{
+	char str[32];
+	uint64_t start, elapsed;
+	size_t size;
+	int cnt, i, ret;
+
+	ret = bench_open_eps(b);
+	if (ret)
+		return ret;
+
+	printf("%-10s%-10s%10s%14s\n", "bytes", "#iters", "time",
+	       "usec/xfer");
+	for (size = b->opts.min_size; size <= b->opts.max_size;
+	     size = bench_next_size(size)) {
+		cnt = b->opts.iterations ? b->opts.iterations :
+		      bench_count(b, size) / 10;
+		ret = bench_post_recv(b, &b->rx, 0, size);
+		if (ret)
+			return ret;
+		ret = bench_post_recv(b, &b->tx, 0, size);
+		if (ret)
+			return ret;
+
+		start = bench_now();
+		for (i = 0; i < cnt; i++) {
+			ret = bench_round_trip(b, size, i);
+			if (ret)
+				return ret;
+		}
+		elapsed = bench_now() - start;
+
+		/* retire the spare receives before the next size */
+		bench_close_eps(b);
+		ret = bench_open_eps(b);
+		if (ret)
+			return ret;
+
+		printf("%-10s%-10d%9.3fs%14.2f\n",
+		       bench_size_str(str, sizeof(str), size), cnt,
+		       elapsed / 1e9, elapsed / 1e3 / (2 * cnt));
+	}
+	return 0;
+}
+
+/*
+ * Addresses nobody sends from, distinct from the peer's 127.0.0.1:
+ * addrs[i] is 127.<1 + i / 65536>.<i / 256 % 256>.<i % 256>.
+ */
+static void bench_fill_addrs(struct sockaddr_in *addrs, size_t count)
+{
+	size_t i;
+
+	memset(addrs, 0, count * sizeof(*addrs));
+	for (i = 0; i < count; i++) {
+		addrs[i].sin_family = AF_INET;
+		addrs[i].sin_port = htons(BENCH_AV_PORT);
+		addrs[i].sin_addr.s_addr = htonl((127U << 24) |
+						 ((1 + (i >> 16)) << 16) |
+						 (i & 0xffff));
+	}
+}
+
+/*
+ * Fill the receiver's AV with addrs - 1 unused addresses and its peer last,
+ * then stream to it reading each receive's source, so every completion
+ * resolves the sender through a full AV.
+ */
+static int bench_av_size(struct bench *b, size_t addrs)
+{
+	struct sockaddr_in *fill;
+	fi_addr_t *fi_addrs;
+	uint64_t start, insert, elapsed;
+	char str[32];
+	int cnt, ret;
+
+	bench_close_eps(b);
+	b->av_count = addrs;
+	ret = bench_open_ep(b, &b->tx);
+	if (ret)
+		return ret;
+	ret = bench_open_ep(b, &b->rx);
+	if (ret)
+		return ret;
+	ret = bench_insert_peer(&b->tx, &b->rx);
+	if (ret)
+		return ret;
+
+	fill = calloc(addrs, sizeof(*fill));
+	fi_addrs = calloc(addrs, sizeof(*fi_addrs));
+	if (!fill || !fi_addrs) {
+		ret = -FI_ENOMEM;
+		goto out;
+	}
+	bench_fill_addrs(fill, addrs - 1);
+
+	start = bench_now();
+	if (addrs > 1) {
+		ret = fi_av_insert(b->rx.av, fill, addrs - 1, fi_addrs, 0,
+				   NULL);
+		if (ret != (int) (addrs - 1)) {
+			BENCH_PRINTERR("fi_av_insert", ret);
+			ret = ret < 0 ? ret : -FI_EINVAL;
+			goto out;
+		}
+	}
+	ret = bench_insert_peer(&b->rx, &b->tx);
+	if (ret)
+		goto out;
+	insert = bench_now() - start;
+
+	cnt = bench_count(b, b->opts.min_size);
+	ret = bench_stream(b, b->opts.min_size, cnt, &elapsed);
+	if (ret)
+		goto out;
+
+	printf("%-10s%12.3f%14.0f\n", bench_size_str(str, sizeof(str), addrs),
+	       insert / 1e3 / addrs, cnt * 1e9 / elapsed);
+out:
+	free(fill);
+	free(fi_addrs);
+	return ret;
+}
+
+static int bench_run_av(struct bench *b)
+{
+	size_t addrs;
+	char str[32];
+	int ret;
+
+	if (b->info->addr_format != FI_SOCKADDR_IN &&
+	    b->info->addr_format != FI_SOCKADDR) {
+		BENCH_ERR("the av test needs IPv4 socket addresses");
+		return -FI_ENOSYS;
+	}
+
+	printf("# %s messages, readfrom\n", bench_size_str(str, sizeof(str),
+							   b->opts.min_size));
+	printf("%-10s%12s%14s\n", "addrs", "usec/insert", "msgs/sec");
+	b->source = 1;
+	for (addrs = b->opts.min_addrs; addrs <= b->opts.max_addrs;
+	     addrs *= 10) {
+		ret = bench_av_size(b, addrs);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/* Fisher-Yates with a fixed LCG, so runs post in the same order */
+static void bench_shuffle(int *order, int count)
+{
+	uint32_t seed = 1;
+	int i, j, tmp;
+
+	for (i = count - 1; i > 0; i--) {
+		seed = seed * 1103515245 + 12345;
+		j = (seed >> 8) % (i + 1);
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+}
+
+/*
+ * Retire what the fired triggers produced: send completions, whose contexts
+ * are the triggered contexts, and receives, which are reposted while more
+ * messages are due.  Payloads must arrive in threshold order.
+ */
+static int bench_trigger_poll(struct bench *b, size_t size, int count,
+			      int *posted)
+{
+	struct fi_cq_entry comp[BENCH_CQ_BATCH];
+	int slots[BENCH_CQ_BATCH];
+	uint64_t seq;
+	ssize_t ret;
+	int i, n;
+
+	ret = fi_cq_read(b->tx.cq, comp, BENCH_CQ_BATCH);
+	if (ret > 0)
+		b->tx.sends += ret;
+	else if (ret == -FI_EAVAIL)
+		return bench_cq_readerr(b->tx.cq);
+	else if (ret != -FI_EAGAIN)
+		BENCH_PRINTERR("fi_cq_read", ret);
+
+	n = bench_poll(b, &b->rx, slots);
+	if (n < 0)
+		return n;
+	for (i = 0; i < n; i++) {
+		if (b->opts.verify && size >= sizeof(seq)) {
+			memcpy(&seq, bench_rbuf(b, &b->rx, -1 - slots[i]),
+			       sizeof(seq));
+			if (seq != b->rx.recvs - n + i) {
+				BENCH_ERR("threshold %" PRIu64 " fired at "
+					  "%" PRIu64, seq + 1,
+					  b->rx.recvs - n + i + 1);
+				return -FI_EIO;
+			}
+		}
+		if (*posted == count)
+			continue;
+		ret = bench_post_recv(b, &b->rx, -1 - slots[i], size);
+		if (ret)
+			return (int) ret;
+		(*posted)++;
+	}
+	return 0;
+}
+
+/*
+ * Post count triggered sends on one counter with thresholds 1 to count,
+ * in order or shuffled, then raise the counter one step at a time until
+ * every send has fired and arrived.
+ */
+static int bench_run_trigger(struct bench *b)
+{
+	struct fi_cntr_attr cntr_attr = {
+		.events = FI_CNTR_EVENTS_COMP,
+		.wait_obj = FI_WAIT_NONE,
+	};
+	struct fi_triggered_context *trig = NULL;
+	struct fid_cntr *cntr = NULL;
+	struct fid_mr *mr = NULL;
+	struct fi_msg msg;
+	struct iovec iov;
+	size_t size = b->opts.min_size;
+	uint64_t start, post, fire;
+	char *payload = NULL;
+	void *desc = NULL;
+	int *order = NULL;
+	int count, posted, i, k, ret;
+
+	count = b->opts.iterations ? b->opts.iterations : BENCH_TRIGGERS;
+	ret = bench_open_eps(b);
+	if (ret)
+		return ret;
+
+	ret = fi_cntr_open(b->domain, &cntr_attr, &cntr, NULL);
+	if (ret) {
+		BENCH_PRINTERR("fi_cntr_open", ret);
+		return ret;
+	}
+
+	trig = calloc(count, sizeof(*trig));
+	order = calloc(count, sizeof(*order));
+	payload = calloc(count, size ? size : 1);
+	if (!trig || !order || !payload) {
+		ret = -FI_ENOMEM;
+		goto out;
+	}
+
+	if (b->info->domain_attr->mr_mode & FI_MR_LOCAL) {
+		ret = fi_mr_reg(b->domain, payload, count * (size ? size : 1),
+				FI_SEND, 0, 0, 0, &mr, NULL);
+		if (ret) {
+			BENCH_PRINTERR("fi_mr_reg", ret);
+			goto out;
+		}
+		desc = fi_mr_desc(mr);
+	}
+
+	for (i = 0; i < count; i++) {
+		order[i] = i;
+		bench_fill(payload + i * size, size, i);
+	}
+	if (b->opts.shuffle)
+		bench_shuffle(order, count);
+
+	for (posted = 0; posted < count && posted < b->opts.window; posted++) {
+		ret = bench_post_recv(b, &b->rx, posted, size);
+		if (ret)
+			goto out;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.desc = &desc;
+	msg.iov_count = 1;
+	msg.addr = b->tx.peer;
+	iov.iov_len = size;
+
+	start = bench_now();
+	for (i = 0; i < count; i++) {
+		k = order[i];
+		trig[k].event_type = FI_TRIGGER_THRESHOLD;
+		trig[k].trigger.threshold.cntr = cntr;
+		trig[k].trigger.threshold.threshold = k + 1;
+		iov.iov_base = payload + k * size;
+		msg.context = &trig[k];
+		ret = fi_sendmsg(b->tx.ep, &msg, FI_TRIGGER);
+		if (ret) {
+			BENCH_PRINTERR("fi_sendmsg", ret);
+			goto out;
+		}
+	}
+	post = bench_now() - start;
+
+	start = bench_now();
+	for (i = 0; i < count; i++) {
+		ret = fi_cntr_add(cntr, 1);
+		if (ret) {
+			BENCH_PRINTERR("fi_cntr_add", ret);
+			goto out;
+		}
+		ret = bench_trigger_poll(b, size, count, &posted);
+		if (ret)
+			goto out;
+	}
+
+	/* A trigger refused by a full TX queue waits for the next counter
+	 * update, so keep nudging the counter until everything is out. */
+	while (b->tx.sends < (uint64_t) count ||
+	       b->rx.recvs < (uint64_t) count) {
+		fi_cntr_add(cntr, 0);
+		ret = bench_trigger_poll(b, size, count, &posted);
+		if (ret)
+			goto out;
+	}
+	fire = bench_now() - start;
+
+	printf("%-12s%-10s%12s%12s\n", "thresholds", "#trig", "usec/post",
+	       "usec/fire");
+	printf("%-12s%-10d%12.3f%12.3f\n", b->opts.shuffle ? "shuffled" :
+	       "increasing", count, post / 1e3 / count, fire / 1e3 / count);
+out:
+	/* the endpoints may still reference the payload and counter */
+	bench_close_eps(b);
+	if (mr)
+		fi_close(&mr->fid);
+	if (cntr)
+		fi_close(&cntr->fid);
+	free(payload);
+	free(order);
+	free(trig);
+	return ret;
+}
+
+static uint64_t bench_cpu_time(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ULL +
+	       (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ULL;
+}
+
+/* Send one message from tx to rx and wait for both completions */
+static int bench_one_way(struct bench *b, size_t size, uint64_t seq)
+{
+	uint64_t sends = b->tx.sends + 1, recvs = b->rx.recvs + 1;
+	int ret;
+
+	ret = bench_post_send(b, &b->tx, 0, size, seq);
+	if (ret)
+		return ret;
+	ret = bench_wait(b, &b->tx, sends, 0);
+	if (ret)
+		return ret;
+	return bench_wait(b, &b->rx, 0, recvs);
+}
+
+/*
+ * Leave the endpoints alone for -T ms at a time while measuring the CPU
+ * the process burns, then time one message from send to both completions:
+ * what an idle provider costs, and how quickly it wakes up.
+ */
+static int bench_run_idle(struct bench *b)
+{
+	struct timespec gap = {
+		.tv_sec = b->opts.idle_ms / 1000,
+		.tv_nsec = (b->opts.idle_ms % 1000) * 1000000L,
+	};
+	uint64_t start, cpu, idle = 0, cpu_idle = 0;
+	uint64_t lat, lat_min = UINT64_MAX, lat_max = 0, lat_sum = 0;
+	size_t size = b->opts.min_size;
+	char str[32];
+	int rounds, i, ret;
+
+	rounds = b->opts.iterations ? b->opts.iterations : BENCH_IDLE_ROUNDS;
+	ret = bench_open_eps(b);
+	if (ret)
+		return ret;
+
+	/* connect, so the first round does not time connection setup */
+	ret = bench_post_recv(b, &b->rx, 0, size);
+	if (ret)
+		return ret;
+	ret = bench_one_way(b, size, 0);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < rounds; i++) {
+		ret = bench_post_recv(b, &b->rx, 0, size);
+		if (ret)
+			return ret;
+
+		start = bench_now();
+		cpu = bench_cpu_time();
+		nanosleep(&gap, NULL);
+		cpu_idle += bench_cpu_time() - cpu;
+		idle += bench_now() - start;
+
+		start = bench_now();
+		ret = bench_one_way(b, size, i + 1);
+		if (ret)
+			return ret;
+		lat = bench_now() - start;
+
+		if (b->opts.verify) {
+			ret = bench_check(bench_rbuf(b, &b->rx, 0), size);
+			if (ret)
+				return ret;
+		}
+		lat_sum += lat;
+		if (lat < lat_min)
+			lat_min = lat;
+		if (lat > lat_max)
+			lat_max = lat;
+	}
+
+	printf("%-10s%-10s%10s%14s%14s%14s\n", "idle", "#rounds", "cpu",
+	       "usec/wakeup", "min", "max");
+	snprintf(str, sizeof(str), "%dms", b->opts.idle_ms);
+	printf("%-10s%-10d%9.1f%%%14.1f%14.1f%14.1f\n", str, rounds,
+	       cpu_idle * 100.0 / idle, lat_sum / 1e3 / rounds,
+	       lat_min / 1e3, lat_max / 1e3);
+	return 0;
+}
+
+static struct bench_test bench_tests[] = {
+	{ "msg", "stream messages of each size, window in flight",
+	  FI_MSG, bench_run_msg },
+	{ "lat", "ping-pong one message of each size",
+	  FI_MSG, bench_run_lat },
+	{ "av", "stream with FI_SOURCE into AVs of growing size",
+	  FI_MSG | FI_SOURCE, bench_run_av },
+	{ "trigger", "fire triggered sends from one counter",
+	  FI_MSG | FI_TRIGGER, bench_run_trigger },
+	{ "idle", "CPU use while idle, and the time of the next message",
+	  FI_MSG, bench_run_idle },
+};
+
+#define BENCH_NTESTS (sizeof(bench_tests) / sizeof(bench_tests[0]))
+
+static void bench_usage(char *name)
+{
+	size_t i;
+
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "  %s [OPTIONS]\n", name);
+	fprintf(stderr, "\nSingle-process benchmark: two endpoints of one "
+		"domain exchange messages.\n");
+
+	fprintf(stderr, "\nOptions:\n");
+	fprintf(stderr, " %-20s %s\n", "-p <provider>",
+		"specific provider name eg sockets, \"UDP;ofi-rxd\"");
+	fprintf(stderr, " %-20s %s\n", "-d <domain>", "domain name");
+	fprintf(stderr, " %-20s %s\n", "-t <test>", "test to run (msg), see below");
+	fprintf(stderr, " %-20s %s\n", "-S <size>[:<max>]",
+		"message size, or powers of two up to max (8:1m)");
+	fprintf(stderr, " %-20s %s\n", "-I <number>",
+		"messages or iterations per size (scaled by size)");
+	fprintf(stderr, " %-20s %s\n", "-n <addrs>[:<max>]",
+		"AV size, or powers of ten times it up to max (1k:100k)");
+	fprintf(stderr, " %-20s %s\n", "-W <number>",
+		"messages in flight (8)");
+	fprintf(stderr, " %-20s %s\n", "-m <progress>",
+		"auto or manual (manual)");
+	fprintf(stderr, " %-20s %s\n", "-T <ms>",
+		"idle gap of the idle test (50)");
+	fprintf(stderr, " %-20s %s\n", "-r",
+		"post triggers in shuffled threshold order");
+	fprintf(stderr, " %-20s %s\n", "-c", "check received data");
+	fprintf(stderr, " %-20s %s\n", "-h", "display this help output");
+
+	fprintf(stderr, "\nTests:\n");
+	for (i = 0; i < BENCH_NTESTS; i++)
+		fprintf(stderr, " %-20s %s\n", bench_tests[i].name,
+			bench_tests[i].desc);
+}
+
+int main(int argc, char **argv)
+{
+	struct bench b = {
+		.opts = {
+			.test = "msg",
+			.min_size = 8,
+			.max_size = 1 << 20,
+			.min_addrs = 1 << 10,
+			.max_addrs = 100 << 10,
+			.window = 8,
+			.progress = FI_PROGRESS_MANUAL,
+			.idle_ms = 50,
+		},
+	};
+	struct bench_test *test = NULL;
+	size_t i, max_size;
+	int op, ret;
+
+	b.hints = fi_allocinfo();
+	if (!b.hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "hcrp:d:t:S:I:W:m:n:T:")) != -1) {
+		switch (op) {
+		case 'p':
+			b.hints->fabric_attr->prov_name = strdup(optarg);
+			break;
+		case 'd':
+			b.hints->domain_attr->name = strdup(optarg);
+			break;
+		case 't':
+			b.opts.test = optarg;
+			break;
+		case 'S':
+			if (bench_parse_range(optarg, &b.opts.min_size,
+					      &b.opts.max_size))
+				return EXIT_FAILURE;
+			break;
+		case 'n':
+			if (bench_parse_range(optarg, &b.opts.min_addrs,
+					      &b.opts.max_addrs))
+				return EXIT_FAILURE;
+			if (!b.opts.min_addrs) {
+				fprintf(stderr, "AV size must be at least 1\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'I':
+			b.opts.iterations = atoi(optarg);
+			break;
+		case 'W':
+			b.opts.window = atoi(optarg);
+			if (b.opts.window < 1 ||
+			    b.opts.window > BENCH_MAX_WINDOW) {
+				fprintf(stderr, "Window must be 1 to %d\n",
+					BENCH_MAX_WINDOW);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'm':
+			if (!strcasecmp(optarg, "auto")) {
+				b.opts.progress = FI_PROGRESS_AUTO;
+			} else if (!strcasecmp(optarg, "manual")) {
+				b.opts.progress = FI_PROGRESS_MANUAL;
+			} else {
+				fprintf(stderr, "Unknown progress: %s\n",
+					optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'c':
+			b.opts.verify = 1;
+			break;
+		case 'r':
+			b.opts.shuffle = 1;
+			break;
+		case 'T':
+			b.opts.idle_ms = atoi(optarg);
+			if (b.opts.idle_ms < 1) {
+				fprintf(stderr, "Idle gap must be at least "
+					"1 ms\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case '?':
+		case 'h':
+		default:
+			bench_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (i = 0; i < BENCH_NTESTS; i++) {
+		if (!strcasecmp(b.opts.test, bench_tests[i].name))
+			test = &bench_tests[i];
+	}
+	if (!test) {
+		fprintf(stderr, "Unknown test: %s\n", b.opts.test);
+		bench_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	ret = bench_open(&b, test->caps);
+	if (!ret) {
+		max_size = b.info->ep_attr->max_msg_size;
+		if (b.opts.max_size > max_size)
+			b.opts.max_size = max_size;
+		b.buf_size = b.opts.max_size;
+		ret = test->run(&b);
+	}
+
+	bench_close(&b);
+	fi_freeinfo(b.hints);
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}